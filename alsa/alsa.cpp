@@ -4,9 +4,49 @@
 
 #include "lbu/alsa/alsa.h"
 
+#include <algorithm>
+
 namespace lbu {
 namespace alsa {
 
+alsa_error pcm_device::prepare_realtime(snd_pcm_t* pcm, int flags)
+{
+    hardware_params hw_params;
+    snd_pcm_uframes_t buffer_frames = 0;
+    unsigned channels = 0;
+    alsa_error err;
+
+    if( err = snd_pcm_hw_params_current(pcm, hw_params); err < 0 )
+        return err;
+    if( err = snd_pcm_hw_params_get_buffer_size(hw_params, &buffer_frames); err < 0 )
+        return err;
+    if( err = snd_pcm_hw_params_get_channels(hw_params, &channels); err < 0 )
+        return err;
+
+    // only to get at the areas, the access is closed again with an empty commit
+    const snd_pcm_channel_area_t* areas = {};
+    snd_pcm_uframes_t offset = 0;
+    snd_pcm_uframes_t frames = buffer_frames;
+    if( err = snd_pcm_mmap_begin(pcm, &areas, &offset, &frames); err < 0 )
+        return err;
+
+    char* begin = {};
+    char* end = {};
+    for( unsigned c = 0; c < channels; ++c ) {
+        char* first = static_cast<char*>(areas[c].addr) + (areas[c].first >> 3);
+        char* last = first + size_t(areas[c].step >> 3) * buffer_frames;
+        begin = (begin == nullptr) ? first : std::min(begin, first);
+        end = std::max(end, last);
+    }
+    if( err = alsa_error(snd_pcm_mmap_commit(pcm, offset, 0)); err < 0 )
+        return err;
+
+    int error = 0;
+    if( begin != nullptr && ! realtime::prepare_memory(begin, size_t(end - begin), flags, &error) )
+        return -error;
+    return 0;
+}
+
 uint32_t hardware_params::set_best_matching_sample_rate(snd_pcm_t* pcm, snd_pcm_hw_params_t* hw_params,
                                                         uint32_t rate, alsa_error* error)
 {
@@ -7,6 +7,8 @@
 
 #include "lbu/dynamic_memory.h"
 #include "lbu/endian.h"
+#include "lbu/realtime.h"
+#include "lbu/trace.h"
 
 #include <alsa/asoundlib.h>
 #include <cstring>
@@ -190,6 +192,12 @@ namespace alsa {
         static pcm_buffer mmap_begin(snd_pcm_t* pcm, snd_pcm_uframes_t frames, alsa_error* error);
         static snd_pcm_sframes_t mmap_commit(snd_pcm_t* pcm, const pcm_buffer& buffer);
 
+        // Prefault and/or lock (realtime::PrepareFlags) the mmap buffer of pcm, so the first
+        // periods do not page fault. Call after installing the hardware parameters and before
+        // starting the stream. Scratch buffers of the application can be prepared with
+        // realtime::prepare_memory the same way.
+        static alsa_error LIBLBU_EXPORT prepare_realtime(snd_pcm_t* pcm, int flags = realtime::PrepareDefault);
+
     private:
         void cleanup() { if( device_handle ) snd_pcm_close(device_handle); }
 
@@ -860,7 +868,9 @@ namespace alsa {
 
     inline snd_pcm_sframes_t pcm_device::mmap_commit(snd_pcm_t* pcm, const pcm_buffer& buffer)
     {
-        return snd_pcm_mmap_commit(pcm, buffer.offset, buffer.frames);
+        const auto r = snd_pcm_mmap_commit(pcm, buffer.offset, buffer.frames);
+        trace::detail::lib_event(trace::EventAlsaCommit, buffer.frames, uint64_t(r));
+        return r;
     }
 
     inline hardware_params::hardware_params()
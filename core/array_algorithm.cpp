@@ -0,0 +1,206 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "lbu/array_algorithm.h"
+
+#include "lbu/cpu_features.h"
+
+#include "array_algorithm_kernels.h"
+
+namespace lbu {
+namespace array_algorithm {
+
+namespace kernels {
+namespace {
+
+    template< typename T >
+    size_t scalar_find(const T* data, size_t size, T value)
+    {
+        for( size_t i = 0; i < size; ++i ) {
+            if( data[i] == value )
+                return i;
+        }
+        return size;
+    }
+
+    template< typename T >
+    size_t scalar_count(const T* data, size_t size, T value)
+    {
+        size_t n = 0;
+        for( size_t i = 0; i < size; ++i )
+            n += data[i] == value ? 1 : 0;
+        return n;
+    }
+
+    template< typename T >
+    void scalar_min_max(const T* data, size_t size, T* min, T* max)
+    {
+        T lo = limits<T>::max;
+        T hi = limits<T>::lowest;
+        for( size_t i = 0; i < size; ++i ) {
+            lo = data[i] < lo ? data[i] : lo;
+            hi = data[i] > hi ? data[i] : hi;
+        }
+        *min = lo;
+        *max = hi;
+    }
+
+    template< typename T, typename Total >
+    Total scalar_sum(const T* data, size_t size)
+    {
+        Total s = 0;
+        for( size_t i = 0; i < size; ++i )
+            s += Total(data[i]);
+        return s;
+    }
+
+    size_t scalar_mismatch(const uint8_t* a, const uint8_t* b, size_t size)
+    {
+        for( size_t i = 0; i < size; ++i ) {
+            if( a[i] != b[i] )
+                return i;
+        }
+        return size;
+    }
+
+    template< typename T >
+    void scalar_byte_swap(T* dst, const T* src, size_t size)
+    {
+        for( size_t i = 0; i < size; ++i )
+            dst[i] = byte_swap_scalar(src[i]);
+    }
+
+    template< typename T >
+    void scalar_fill(T* data, size_t size, T value)
+    {
+        for( size_t i = 0; i < size; ++i )
+            data[i] = value;
+    }
+
+    template< typename T >
+    void scalar_prefix_sum(T* data, size_t size, T start)
+    {
+        for( size_t i = 0; i < size; ++i ) {
+            start += data[i];
+            data[i] = start;
+        }
+    }
+
+}
+
+    const table portable = {
+        "portable",
+        &scalar_find<uint8_t>, &scalar_find<uint16_t>, &scalar_find<uint32_t>, &scalar_find<uint64_t>,
+        &scalar_count<uint8_t>, &scalar_count<uint16_t>, &scalar_count<uint32_t>, &scalar_count<uint64_t>,
+        &scalar_min_max<uint8_t>, &scalar_min_max<int16_t>, &scalar_min_max<int32_t>,
+        &scalar_min_max<uint32_t>, &scalar_min_max<float>,
+        &scalar_sum<uint8_t, uint64_t>, &scalar_sum<int16_t, int64_t>,
+        &scalar_sum<int32_t, int64_t>, &scalar_sum<uint32_t, uint64_t>,
+        &scalar_mismatch,
+        &scalar_byte_swap<uint16_t>, &scalar_byte_swap<uint32_t>, &scalar_byte_swap<uint64_t>,
+        &scalar_fill<uint16_t>, &scalar_fill<uint32_t>, &scalar_fill<uint64_t>,
+        &scalar_prefix_sum<uint32_t>, &scalar_prefix_sum<uint64_t>
+    };
+
+}
+
+namespace {
+
+    const kernels::table& active()
+    {
+        static const kernels::table& k = *cpu::select<const kernels::table*>({
+#ifdef LIBLBU_X86_KERNELS
+            {cpu::AVX512, &kernels::avx512},
+            {cpu::AVX2, &kernels::avx2},
+            {cpu::SSE2, &kernels::sse2},
+#endif
+            {0, &kernels::portable}
+        });
+        return k;
+    }
+
+}
+
+const char* kernel_set_name()
+{
+    return active().name;
+}
+
+uint64_t sum(array_ref<const uint8_t> data)
+{
+    return active().sum_u8(data.data(), data.size());
+}
+
+int64_t sum(array_ref<const int16_t> data)
+{
+    return active().sum_i16(data.data(), data.size());
+}
+
+int64_t sum(array_ref<const int32_t> data)
+{
+    return active().sum_i32(data.data(), data.size());
+}
+
+uint64_t sum(array_ref<const uint32_t> data)
+{
+    return active().sum_u32(data.data(), data.size());
+}
+
+namespace detail {
+
+size_t find(const uint8_t* data, size_t size, uint8_t value) { return active().find_8(data, size, value); }
+size_t find(const uint16_t* data, size_t size, uint16_t value) { return active().find_16(data, size, value); }
+size_t find(const uint32_t* data, size_t size, uint32_t value) { return active().find_32(data, size, value); }
+size_t find(const uint64_t* data, size_t size, uint64_t value) { return active().find_64(data, size, value); }
+
+size_t count(const uint8_t* data, size_t size, uint8_t value) { return active().count_8(data, size, value); }
+size_t count(const uint16_t* data, size_t size, uint16_t value) { return active().count_16(data, size, value); }
+size_t count(const uint32_t* data, size_t size, uint32_t value) { return active().count_32(data, size, value); }
+size_t count(const uint64_t* data, size_t size, uint64_t value) { return active().count_64(data, size, value); }
+
+void min_max(const uint8_t* data, size_t size, uint8_t* min, uint8_t* max)
+{
+    active().min_max_u8(data, size, min, max);
+}
+
+void min_max(const int16_t* data, size_t size, int16_t* min, int16_t* max)
+{
+    active().min_max_i16(data, size, min, max);
+}
+
+void min_max(const int32_t* data, size_t size, int32_t* min, int32_t* max)
+{
+    active().min_max_i32(data, size, min, max);
+}
+
+void min_max(const uint32_t* data, size_t size, uint32_t* min, uint32_t* max)
+{
+    active().min_max_u32(data, size, min, max);
+}
+
+void min_max(const float* data, size_t size, float* min, float* max)
+{
+    active().min_max_f32(data, size, min, max);
+}
+
+size_t mismatch(const void* a, const void* b, size_t byte_size)
+{
+    return active().mismatch(static_cast<const uint8_t*>(a), static_cast<const uint8_t*>(b), byte_size);
+}
+
+void byte_swap(uint16_t* dst, const uint16_t* src, size_t size) { active().byte_swap_16(dst, src, size); }
+void byte_swap(uint32_t* dst, const uint32_t* src, size_t size) { active().byte_swap_32(dst, src, size); }
+void byte_swap(uint64_t* dst, const uint64_t* src, size_t size) { active().byte_swap_64(dst, src, size); }
+
+void fill(uint16_t* data, size_t size, uint16_t value) { active().fill_16(data, size, value); }
+void fill(uint32_t* data, size_t size, uint32_t value) { active().fill_32(data, size, value); }
+void fill(uint64_t* data, size_t size, uint64_t value) { active().fill_64(data, size, value); }
+
+void prefix_sum(uint32_t* data, size_t size, uint32_t start) { active().prefix_sum_32(data, size, start); }
+void prefix_sum(uint64_t* data, size_t size, uint64_t start) { active().prefix_sum_64(data, size, start); }
+
+}
+
+}
+}
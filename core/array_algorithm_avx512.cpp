@@ -0,0 +1,16 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define LIBLBU_SIMD_VECTOR_BYTES 64
+#include "array_algorithm_kernels.h"
+
+namespace lbu {
+namespace array_algorithm {
+namespace kernels {
+
+    const table avx512 = vector_table("avx512");
+
+}
+}
+}
@@ -0,0 +1,422 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef LIBLBU_ARRAY_ALGORITHM_KERNELS_H
+#define LIBLBU_ARRAY_ALGORITHM_KERNELS_H
+
+#include <limits>
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+#include <utility>
+
+#ifdef LIBLBU_SIMD_VECTOR_BYTES
+#include "simd_vector.h"
+#endif
+
+// Internal: the kernel sets behind lbu/array_algorithm.h.
+//
+// The vector kernels are written once with GCC vector extensions and instantiated
+// by one translation unit per instruction set (array_algorithm_sse2.cpp etc.), which
+// is compiled with the matching -m flags. Everything in here therefore has internal
+// linkage and uses nothing but builtins and always inlined intrinsics; an inline
+// function emitted out of line by the AVX2 unit could otherwise be picked by the
+// linker for callers on any CPU.
+
+namespace lbu {
+namespace array_algorithm {
+namespace kernels {
+
+    struct table {
+        const char* name;
+
+        size_t (*find_8)(const uint8_t*, size_t, uint8_t);
+        size_t (*find_16)(const uint16_t*, size_t, uint16_t);
+        size_t (*find_32)(const uint32_t*, size_t, uint32_t);
+        size_t (*find_64)(const uint64_t*, size_t, uint64_t);
+
+        size_t (*count_8)(const uint8_t*, size_t, uint8_t);
+        size_t (*count_16)(const uint16_t*, size_t, uint16_t);
+        size_t (*count_32)(const uint32_t*, size_t, uint32_t);
+        size_t (*count_64)(const uint64_t*, size_t, uint64_t);
+
+        void (*min_max_u8)(const uint8_t*, size_t, uint8_t*, uint8_t*);
+        void (*min_max_i16)(const int16_t*, size_t, int16_t*, int16_t*);
+        void (*min_max_i32)(const int32_t*, size_t, int32_t*, int32_t*);
+        void (*min_max_u32)(const uint32_t*, size_t, uint32_t*, uint32_t*);
+        void (*min_max_f32)(const float*, size_t, float*, float*);
+
+        uint64_t (*sum_u8)(const uint8_t*, size_t);
+        int64_t (*sum_i16)(const int16_t*, size_t);
+        int64_t (*sum_i32)(const int32_t*, size_t);
+        uint64_t (*sum_u32)(const uint32_t*, size_t);
+
+        size_t (*mismatch)(const uint8_t*, const uint8_t*, size_t);
+
+        void (*byte_swap_16)(uint16_t*, const uint16_t*, size_t);
+        void (*byte_swap_32)(uint32_t*, const uint32_t*, size_t);
+        void (*byte_swap_64)(uint64_t*, const uint64_t*, size_t);
+
+        void (*fill_16)(uint16_t*, size_t, uint16_t);
+        void (*fill_32)(uint32_t*, size_t, uint32_t);
+        void (*fill_64)(uint64_t*, size_t, uint64_t);
+
+        void (*prefix_sum_32)(uint32_t*, size_t, uint32_t);
+        void (*prefix_sum_64)(uint64_t*, size_t, uint64_t);
+    };
+
+    extern const table portable;
+#ifdef LIBLBU_X86_KERNELS
+    extern const table sse2;
+    extern const table avx2;
+    extern const table avx512;
+#endif
+
+namespace {
+
+    template< typename T >
+    struct limits {
+        static constexpr T max = std::numeric_limits<T>::max();
+        static constexpr T lowest = std::numeric_limits<T>::lowest();
+    };
+
+    template< typename T >
+    T byte_swap_scalar(T v)
+    {
+        if constexpr( sizeof(T) == 2 )
+            return __builtin_bswap16(v);
+        else if constexpr( sizeof(T) == 4 )
+            return __builtin_bswap32(v);
+        else
+            return __builtin_bswap64(v);
+    }
+
+}
+
+#ifdef LIBLBU_SIMD_VECTOR_BYTES
+namespace {
+
+    using simd::W;
+    using simd::vec;
+    using simd::lane_type;
+    using simd::lanes;
+    using simd::load;
+    using simd::store;
+    using simd::byte_mask;
+    using simd::first_lane;
+
+    // shuffle mask moving each lane Shift lanes up and filling with lanes of the second operand
+    template< typename M, size_t Shift, size_t... I >
+    constexpr M shift_up_mask(std::index_sequence<I...>)
+    {
+        return M{ (I >= Shift ? lane_type<M>(I - Shift) : lane_type<M>(sizeof...(I)))... };
+    }
+
+    template< typename M, size_t Lane, size_t... I >
+    constexpr M broadcast_mask(std::index_sequence<I...>)
+    {
+        return M{ ((void)I, lane_type<M>(Lane))... };
+    }
+
+    // byte order reversal within each Size byte group
+    template< typename M, size_t Size, size_t... I >
+    constexpr M byte_swap_mask(std::index_sequence<I...>)
+    {
+        return M{ lane_type<M>(I - I % Size + Size - 1 - I % Size)... };
+    }
+
+    // bits [k * 2 * Shift, k * 2 * Shift + Shift) set
+    template< typename T >
+    constexpr T low_halves_mask(unsigned shift)
+    {
+        T m = 0;
+        for( unsigned b = 0; b < sizeof(T) * 8; b += 2 * shift )
+            m |= T((T(1) << shift) - 1) << b;
+        return m;
+    }
+
+
+    template< typename T >
+    size_t find(const T* data, size_t size, T value)
+    {
+        using V = vec<T>;
+        constexpr size_t N = lanes<V>;
+        const V v = V{} + value;
+        size_t i = 0;
+        for( ; i + 4 * N <= size; i += 4 * N ) {
+            const auto m0 = load<V>(data + i) == v;
+            const auto m1 = load<V>(data + i + N) == v;
+            const auto m2 = load<V>(data + i + 2 * N) == v;
+            const auto m3 = load<V>(data + i + 3 * N) == v;
+            if( byte_mask(m0 | m1 | m2 | m3) != 0 ) {
+                if( const auto b = byte_mask(m0) )
+                    return i + first_lane<T>(b);
+                if( const auto b = byte_mask(m1) )
+                    return i + N + first_lane<T>(b);
+                if( const auto b = byte_mask(m2) )
+                    return i + 2 * N + first_lane<T>(b);
+                return i + 3 * N + first_lane<T>(byte_mask(m3));
+            }
+        }
+        for( ; i + N <= size; i += N ) {
+            if( const auto b = byte_mask(load<V>(data + i) == v) )
+                return i + first_lane<T>(b);
+        }
+        if( i < size && size >= N ) {
+            // overlapping the checked elements, which did not match
+            i = size - N;
+            if( const auto b = byte_mask(load<V>(data + i) == v) )
+                return i + first_lane<T>(b);
+            return size;
+        }
+        for( ; i < size; ++i ) {
+            if( data[i] == value )
+                return i;
+        }
+        return size;
+    }
+
+    template< typename T >
+    size_t count(const T* data, size_t size, T value)
+    {
+        using V = vec<T>;
+        constexpr size_t N = lanes<V>;
+        // lane counters subtract the all ones comparison results, and are
+        // summed up before they overflow (each block adds at most 1 per lane)
+        constexpr size_t Flush = size_t(limits<T>::max);
+        const V v = V{} + value;
+        size_t total = 0;
+        size_t i = 0;
+        while( size - i >= N ) {
+            const size_t blocks = (size - i) / N;
+            const size_t end = i + (blocks < Flush ? blocks : Flush) * N;
+            V acc = {};
+            for( ; i < end; i += N )
+                acc -= reinterpret_cast<V>(load<V>(data + i) == v);
+            for( size_t k = 0; k < N; ++k )
+                total += size_t(acc[k]);
+        }
+        for( ; i < size; ++i )
+            total += data[i] == value ? 1 : 0;
+        return total;
+    }
+
+    template< typename T >
+    void min_max(const T* data, size_t size, T* min, T* max)
+    {
+        using V = vec<T>;
+        constexpr size_t N = lanes<V>;
+        T lo = limits<T>::max;
+        T hi = limits<T>::lowest;
+        size_t i = 0;
+        if( size >= N ) {
+            // several accumulators to hide the min/max latency
+            V lo0 = V{} + lo, lo1 = lo0, hi0 = V{} + hi, hi1 = hi0;
+            for( ; i + 2 * N <= size; i += 2 * N ) {
+                const V x0 = load<V>(data + i);
+                const V x1 = load<V>(data + i + N);
+                lo0 = x0 < lo0 ? x0 : lo0;
+                lo1 = x1 < lo1 ? x1 : lo1;
+                hi0 = x0 > hi0 ? x0 : hi0;
+                hi1 = x1 > hi1 ? x1 : hi1;
+            }
+            if( i + N <= size ) {
+                const V x = load<V>(data + i);
+                lo0 = x < lo0 ? x : lo0;
+                hi0 = x > hi0 ? x : hi0;
+                i += N;
+            }
+            if( i < size ) {
+                // the last N elements, overlapping already seen ones
+                const V x = load<V>(data + size - N);
+                lo1 = x < lo1 ? x : lo1;
+                hi1 = x > hi1 ? x : hi1;
+                i = size;
+            }
+            lo0 = lo1 < lo0 ? lo1 : lo0;
+            hi0 = hi1 > hi0 ? hi1 : hi0;
+            for( size_t k = 0; k < N; ++k ) {
+                lo = lo0[k] < lo ? lo0[k] : lo;
+                hi = hi0[k] > hi ? hi0[k] : hi;
+            }
+        }
+        for( ; i < size; ++i ) {
+            lo = data[i] < lo ? data[i] : lo;
+            hi = data[i] > hi ? data[i] : hi;
+        }
+        *min = lo;
+        *max = hi;
+    }
+
+    // T is widened to Lane (twice the size), Flush bounds the additions per lane
+    template< typename T, typename Lane, typename Total, size_t Flush >
+    Total sum(const T* data, size_t size)
+    {
+        using H = vec<T, W / 2>;
+        using A = vec<Lane>;
+        constexpr size_t N = lanes<H>;
+        Total total = 0;
+        size_t i = 0;
+        while( size - i >= 2 * N ) {
+            const size_t blocks = (size - i) / (2 * N);
+            const size_t end = i + (blocks < Flush ? blocks : Flush) * 2 * N;
+            A acc0 = {}, acc1 = {};
+            for( ; i < end; i += 2 * N ) {
+                acc0 += __builtin_convertvector(load<H>(data + i), A);
+                acc1 += __builtin_convertvector(load<H>(data + i + N), A);
+            }
+            for( size_t k = 0; k < N; ++k )
+                total += Total(acc0[k]) + Total(acc1[k]);
+        }
+        for( ; i < size; ++i )
+            total += Total(data[i]);
+        return total;
+    }
+
+    size_t mismatch(const uint8_t* a, const uint8_t* b, size_t size)
+    {
+        using V = vec<uint8_t>;
+        size_t i = 0;
+        for( ; i + 2 * W <= size; i += 2 * W ) {
+            const auto m0 = load<V>(a + i) != load<V>(b + i);
+            const auto m1 = load<V>(a + i + W) != load<V>(b + i + W);
+            if( byte_mask(m0 | m1) != 0 ) {
+                if( const auto m = byte_mask(m0) )
+                    return i + first_lane<uint8_t>(m);
+                return i + W + first_lane<uint8_t>(byte_mask(m1));
+            }
+        }
+        if( i + W <= size ) {
+            if( const auto m = byte_mask(load<V>(a + i) != load<V>(b + i)) )
+                return i + first_lane<uint8_t>(m);
+            i += W;
+        }
+        if( i < size && size >= W ) {
+            i = size - W;
+            if( const auto m = byte_mask(load<V>(a + i) != load<V>(b + i)) )
+                return i + first_lane<uint8_t>(m);
+            return size;
+        }
+        for( ; i < size; ++i ) {
+            if( a[i] != b[i] )
+                return i;
+        }
+        return size;
+    }
+
+    template< typename T >
+    vec<T> byte_swap_vec(vec<T> x)
+    {
+#ifdef __SSSE3__
+        using B = vec<uint8_t>;
+        constexpr B mask = byte_swap_mask<B, sizeof(T)>(std::make_index_sequence<W>());
+        return reinterpret_cast<vec<T>>(__builtin_shuffle(reinterpret_cast<B>(x), mask));
+#else
+        // swap halves, then quarters, ... down to bytes
+        for( unsigned shift = sizeof(T) * 4; shift >= 8; shift /= 2 ) {
+            const T m = low_halves_mask<T>(shift);
+            x = ((x & m) << shift) | ((x >> shift) & m);
+        }
+        return x;
+#endif
+    }
+
+    template< typename T >
+    void byte_swap(T* dst, const T* src, size_t size)
+    {
+        using V = vec<T>;
+        constexpr size_t N = lanes<V>;
+        size_t i = 0;
+        for( ; i + 2 * N <= size; i += 2 * N ) {
+            const V x0 = load<V>(src + i);
+            const V x1 = load<V>(src + i + N);
+            store(dst + i, byte_swap_vec<T>(x0));
+            store(dst + i + N, byte_swap_vec<T>(x1));
+        }
+        for( ; i < size; ++i )
+            dst[i] = byte_swap_scalar(src[i]);
+    }
+
+    template< typename T >
+    void fill(T* data, size_t size, T value)
+    {
+        using V = vec<T>;
+        constexpr size_t N = lanes<V>;
+        const V v = V{} + value;
+        size_t i = 0;
+        for( ; i + 2 * N <= size; i += 2 * N ) {
+            store(data + i, v);
+            store(data + i + N, v);
+        }
+        if( size >= N ) {
+            if( i + N <= size ) {
+                store(data + i, v);
+                i += N;
+            }
+            if( i < size )
+                store(data + size - N, v);
+            return;
+        }
+        for( ; i < size; ++i )
+            data[i] = value;
+    }
+
+    template< size_t Shift, typename V >
+    V scan(V x)
+    {
+        constexpr size_t N = lanes<V>;
+        if constexpr( Shift < N ) {
+            constexpr V mask = shift_up_mask<V, Shift>(std::make_index_sequence<N>());
+            return scan<Shift * 2>(x + __builtin_shuffle(x, V{}, mask));
+        } else {
+            return x;
+        }
+    }
+
+    template< typename T >
+    void prefix_sum(T* data, size_t size, T start)
+    {
+        using V = vec<T>;
+        constexpr size_t N = lanes<V>;
+        constexpr V last = broadcast_mask<V, N - 1>(std::make_index_sequence<N>());
+        V carry = V{} + start;
+        size_t i = 0;
+        for( ; i + N <= size; i += N ) {
+            const V x = scan<1>(load<V>(data + i)) + carry;
+            store(data + i, x);
+            carry = __builtin_shuffle(x, last);
+        }
+        T s = carry[0];
+        for( ; i < size; ++i ) {
+            s += data[i];
+            data[i] = s;
+        }
+    }
+
+    constexpr table vector_table(const char* name)
+    {
+        return {
+            name,
+            &find<uint8_t>, &find<uint16_t>, &find<uint32_t>, &find<uint64_t>,
+            &count<uint8_t>, &count<uint16_t>, &count<uint32_t>, &count<uint64_t>,
+            &min_max<uint8_t>, &min_max<int16_t>, &min_max<int32_t>, &min_max<uint32_t>, &min_max<float>,
+            &sum<uint8_t, uint16_t, uint64_t, 128>,
+            &sum<int16_t, int32_t, int64_t, 32768>,
+            &sum<int32_t, int64_t, int64_t, ~size_t(0)>,
+            &sum<uint32_t, uint64_t, uint64_t, ~size_t(0)>,
+            &mismatch,
+            &byte_swap<uint16_t>, &byte_swap<uint32_t>, &byte_swap<uint64_t>,
+            &fill<uint16_t>, &fill<uint32_t>, &fill<uint64_t>,
+            &prefix_sum<uint32_t>, &prefix_sum<uint64_t>
+        };
+    }
+
+}
+#endif // LIBLBU_SIMD_VECTOR_BYTES
+
+}
+}
+}
+
+#endif
@@ -0,0 +1,203 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "lbu/buffer_queue_stream.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <limits>
+#include <mutex>
+
+namespace lbu {
+namespace stream {
+
+struct buffer_queue_input_stream::segment {
+    byte_buffer owned;
+    shared_buffer shared;
+    const char* data = nullptr;     // set for borrowed and shared segments, resp. when owned is read
+    size_t size = 0;
+};
+
+struct buffer_queue_input_stream::internal {
+    mutable std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<segment> queue;
+    size_t queued = 0;
+    bool ended = false;
+    bool waiting = false;
+
+    // reader side
+    segment current;
+    size_t current_offset = 0;      // start of the next window into current
+};
+
+
+buffer_queue_input_stream::buffer_queue_input_stream()
+    : abstract_input_stream(InternalBuffer::Yes)
+    , d(std::make_unique<internal>())
+{
+}
+
+buffer_queue_input_stream::~buffer_queue_input_stream()
+{
+}
+
+buffer_queue_input_stream::buffer_queue_input_stream(buffer_queue_input_stream&&) = default;
+buffer_queue_input_stream& buffer_queue_input_stream::operator=(buffer_queue_input_stream&&) = default;
+
+bool buffer_queue_input_stream::append(byte_buffer&& buf)
+{
+    segment s;
+    s.size = buf.size();
+    // the data pointer is only taken once the segment does not move anymore (the small
+    // buffer optimization of byte_buffer moves the data along)
+    s.owned = std::move(buf);
+    return enqueue(std::move(s));
+}
+
+bool buffer_queue_input_stream::append(shared_buffer buf)
+{
+    segment s;
+    s.data = static_cast<const char*>(buf.data());
+    s.size = buf.size();
+    s.shared = std::move(buf);
+    return enqueue(std::move(s));
+}
+
+bool buffer_queue_input_stream::append(array_ref<const void> data)
+{
+    segment s;
+    s.data = static_cast<const char*>(data.data());
+    s.size = data.byte_size();
+    return enqueue(std::move(s));
+}
+
+bool buffer_queue_input_stream::enqueue(segment&& s)
+{
+    bool wake;
+    {
+        std::lock_guard<std::mutex> lock(d->mutex);
+        if( d->ended )
+            return false;
+        if( s.size == 0 )
+            return true;
+        d->queued += s.size;
+        d->queue.push_back(std::move(s));
+        wake = d->waiting;
+    }
+    if( wake )
+        d->cond.notify_one();
+    return true;
+}
+
+void buffer_queue_input_stream::set_end_of_stream()
+{
+    bool wake;
+    {
+        std::lock_guard<std::mutex> lock(d->mutex);
+        d->ended = true;
+        wake = d->waiting;
+    }
+    if( wake )
+        d->cond.notify_one();
+}
+
+size_t buffer_queue_input_stream::queued_size() const
+{
+    std::lock_guard<std::mutex> lock(d->mutex);
+    return d->queued;
+}
+
+void buffer_queue_input_stream::reset()
+{
+    {
+        std::lock_guard<std::mutex> lock(d->mutex);
+        d->queue.clear();
+        d->queued = 0;
+        d->ended = false;
+    }
+    d->current = segment();
+    d->current_offset = 0;
+    buffer_base_ptr = nullptr;
+    buffer_offset = 0;
+    buffer_available = 0;
+    status_flags = 0;
+}
+
+bool buffer_queue_input_stream::next_window(Mode mode)
+{
+    assert(buffer_available == 0);
+    auto& cur = d->current;
+    if( d->current_offset >= cur.size ) {
+        cur = segment();
+        d->current_offset = 0;
+        {
+            std::unique_lock<std::mutex> lock(d->mutex);
+            while( d->queue.empty() ) {
+                if( d->ended ) {
+                    status_flags = StatusEndOfStream;
+                    return false;
+                }
+                if( mode == Mode::NonBlocking ) {
+                    stats_add(&stream_statistics::would_block);
+                    return false;
+                }
+                detail::stats_blocking_scope blocking(statistics());
+                d->waiting = true;
+                d->cond.wait(lock);
+                d->waiting = false;
+            }
+            cur = std::move(d->queue.front());
+            d->queue.pop_front();
+            d->queued -= cur.size;
+        }
+        if( cur.data == nullptr )
+            cur.data = static_cast<const char*>(cur.owned.data());
+    }
+
+    // segments can be larger than the uint32_t buffer window
+    const auto window = std::min<size_t>(cur.size - d->current_offset, std::numeric_limits<uint32_t>::max());
+    buffer_base_ptr = const_cast<char*>(cur.data + d->current_offset);
+    buffer_offset = 0;
+    buffer_available = uint32_t(window);
+    d->current_offset += window;
+    stats_add(&stream_statistics::bytes, window);
+    stats_add(&stream_statistics::buffer_refills);
+    return true;
+}
+
+ssize_t buffer_queue_input_stream::read_stream(array_ref<io::io_vector> buf_array, size_t required_read)
+{
+    if( has_error() )
+        return -1;
+
+    assert(buf_array.size() == 1);
+    char* dst = static_cast<char*>(buf_array[0].iov_base);
+    const size_t size = buf_array[0].iov_len;
+    const Mode mode = (required_read > 0) ? Mode::Blocking : Mode::NonBlocking;
+
+    size_t count = 0;
+    while( true ) {
+        const size_t n = std::min<size_t>(size - count, buffer_available);
+        if( n > 0 ) {
+            std::memcpy(dst + count, buffer_base_ptr + buffer_offset, n);
+            advance(n);
+            count += n;
+        }
+        if( count == size || at_end() || ! next_window(mode) )
+            break;
+    }
+    return ssize_t(count);
+}
+
+array_ref<const void> buffer_queue_input_stream::get_read_buffer(Mode mode)
+{
+    if( status_flags || ! next_window(mode) )
+        return {};
+    return current_buffer();
+}
+
+} // namespace stream
+} // namespace lbu
@@ -24,6 +24,8 @@ void byte_buffer_input_stream::reset(array_ref<void> buf)
     if( buf.byte_size() <= std::numeric_limits<uint32_t>::max() ) {
         buffer_available = buf.byte_size();
         status_flags = 0;
+        // the whole window is readable from here on, directly or via read_stream
+        stats_add(&stream_statistics::bytes, buf.byte_size());
     } else {
         buffer_available = 0;
         status_flags = StatusError;
@@ -74,14 +76,15 @@ ssize_t byte_buffer_output_stream::write_stream(array_ref<io::io_vector> buf_arr
 {
     if( status_flags )
         return -1;
-    buffer.append_commit(buffer_offset - buffer.size());
+    commit();
     const auto buf = io::io_vec_to_array_ref(buf_array[0]);
-    if( buffer.max_size() - buffer.size() > buf.byte_size() ) {
+    if( buffer.max_size() - buffer.size() < buf.byte_size() ) {
         status_flags = StatusError;
         return -1;
     }
     buffer.append(buf);
     sync_state();
+    stats_add(&stream_statistics::bytes, buf.byte_size());
     return ssize_t(buf.byte_size());
 }
 
@@ -89,10 +92,13 @@ array_ref<void> byte_buffer_output_stream::get_write_buffer(Mode)
 {
     if( status_flags )
         return {};
+    commit();
     buffer.auto_grow_reserve();
     sync_state();
     if( buffer_available == 0 )
         status_flags = StatusError;
+    else
+        stats_add(&stream_statistics::buffer_refills);
     return current_buffer();
 }
 
@@ -100,10 +106,17 @@ bool byte_buffer_output_stream::write_buffer_flush(Mode)
 {
     if( status_flags )
         return false;
-    buffer.append_commit(buffer_offset - buffer.size());
+    commit();
     return true;
 }
 
+void byte_buffer_output_stream::commit()
+{
+    const size_t n = buffer_offset - buffer.size();
+    buffer.append_commit(n);
+    stats_add(&stream_statistics::bytes, n);
+}
+
 void byte_buffer_output_stream::sync_state()
 {
     buffer_base_ptr = static_cast<char*>(buffer.data());
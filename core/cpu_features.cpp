@@ -0,0 +1,110 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "lbu/cpu_features.h"
+
+#include <cstdlib>
+#include <string_view>
+
+namespace lbu {
+namespace cpu {
+
+namespace {
+
+    const char* const feature_names[FeatureCount] = {
+        "sse2", "ssse3", "sse4.1", "sse4.2", "popcnt", "avx", "avx2", "bmi2", "fma",
+        "avx512f", "avx512bw", "avx512vl", "avx512cd", "avx512dq"
+    };
+
+    uint32_t detect()
+    {
+        uint32_t f = 0;
+#if defined(__x86_64__) || defined(__i386__)
+        // __builtin_cpu_supports also checks that the OS saves the AVX / AVX-512 state
+        __builtin_cpu_init();
+        const auto add = [&f](bool supported, Feature feature) {
+            if( supported )
+                f |= feature;
+        };
+        add(__builtin_cpu_supports("sse2"), SSE2);
+        add(__builtin_cpu_supports("ssse3"), SSSE3);
+        add(__builtin_cpu_supports("sse4.1"), SSE4_1);
+        add(__builtin_cpu_supports("sse4.2"), SSE4_2);
+        add(__builtin_cpu_supports("popcnt"), POPCNT);
+        add(__builtin_cpu_supports("avx"), AVX);
+        add(__builtin_cpu_supports("avx2"), AVX2);
+        add(__builtin_cpu_supports("bmi2"), BMI2);
+        add(__builtin_cpu_supports("fma"), FMA);
+        add(__builtin_cpu_supports("avx512f"), AVX512F);
+        add(__builtin_cpu_supports("avx512bw"), AVX512BW);
+        add(__builtin_cpu_supports("avx512vl"), AVX512VL);
+        add(__builtin_cpu_supports("avx512cd"), AVX512CD);
+        add(__builtin_cpu_supports("avx512dq"), AVX512DQ);
+#endif
+        return f;
+    }
+
+    uint32_t feature_by_name(std::string_view name)
+    {
+        for( unsigned i = 0; i < FeatureCount; ++i ) {
+            if( name == feature_names[i] )
+                return 1u << i;
+        }
+        return 0;
+    }
+
+    uint32_t apply_override(uint32_t detected, const char* spec)
+    {
+        uint32_t keep = 0;
+        uint32_t remove = 0;
+        bool restricted = false;
+        std::string_view s(spec);
+        while( ! s.empty() ) {
+            const size_t end = s.find(',');
+            std::string_view item = s.substr(0, end);
+            s = end == std::string_view::npos ? std::string_view() : s.substr(end + 1);
+            if( item == "none" ) {
+                restricted = true;
+            } else if( ! item.empty() && item[0] == '-' ) {
+                remove |= feature_by_name(item.substr(1));
+            } else if( const uint32_t f = feature_by_name(item) ) {
+                // unknown names are ignored and must not restrict the set
+                restricted = true;
+                keep |= f;
+            }
+        }
+        return (restricted ? detected & keep : detected) & ~remove;
+    }
+
+    uint32_t effective_features()
+    {
+        const uint32_t detected = detected_features();
+        const char* spec = std::getenv("LBU_CPU_FEATURES");
+        return spec ? apply_override(detected, spec) : detected;
+    }
+
+}
+
+const char* feature_name(Feature f)
+{
+    if( f == 0 )
+        return "";
+    const unsigned i = unsigned(__builtin_ctz(f));
+    return i < FeatureCount ? feature_names[i] : "";
+}
+
+uint32_t detected_features()
+{
+    static const uint32_t f = detect();
+    return f;
+}
+
+uint32_t features()
+{
+    static const uint32_t f = effective_features();
+    return f;
+}
+
+}
+}
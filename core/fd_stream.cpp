@@ -5,17 +5,27 @@
 #include "lbu/fd_stream.h"
 
 #include "lbu/dynamic_memory.h"
+#include "lbu/poll.h"
+#include "lbu/trace.h"
 
 #include <algorithm>
+#include <cerrno>
 
 namespace lbu {
 namespace stream {
 
 
-static bool update_blocking(Mode mode, FdBlockingState block, fd f, int* err)
+static bool update_blocking(Mode mode, FdBlockingState block, fd f, int* err, stream_statistics* stats)
 {
-    if( block == FdBlockingState::Automatic )
-        return f.set_nonblock(mode == Mode::NonBlocking, err);
+    if( block == FdBlockingState::Automatic ) {
+        // only sets the flag if it actually changes
+        bool changed = false;
+        const bool ok = f.set_nonblock(mode == Mode::NonBlocking, err, &changed);
+        detail::stats_add(stats, &stream_statistics::syscalls, changed ? 2 : 1);
+        return ok;
+    }
+    if( block == FdBlockingState::NonBlockingPoll )
+        return true;
     if( (mode == Mode::Blocking) != (block == FdBlockingState::AlwaysBlocking) ) {
         *err = io::ReadBadRequest;
         return false;
@@ -23,12 +33,54 @@ static bool update_blocking(Mode mode, FdBlockingState block, fd f, int* err)
     return true;
 }
 
+// For FdBlockingState::NonBlockingPoll: waits until a blocking request can be retried,
+// returns 0 or the poll error. Errors of the fd itself are reported by the retry.
+static int wait_ready(fd f, short events, stream_statistics* stats)
+{
+    detail::stats_blocking_scope blocking(stats);
+    auto p = poll::poll_fd(f, events);
+    while( true ) {
+        const auto r = poll::poll(&p, 1);
+        detail::stats_add(stats, &stream_statistics::syscalls);
+        if( r.status != poll::StatusPollInterrupted )
+            return r.status;
+    }
+}
+
+static bool should_wait(bool would_block, Mode mode, FdBlockingState block)
+{
+    return would_block && mode == Mode::Blocking && block == FdBlockingState::NonBlockingPoll;
+}
+
 static int set_flag_return_error(uint8_t* status_flags, uint8_t flag)
 {
     *status_flags |= flag;
     return -1;
 }
 
+// an empty buffer (making the stream unbuffered) and *error = ENOMEM on failure
+static array_ref<char> try_malloc_buffer(uint32_t size, int* error)
+{
+    char* p = malloc_bytes<char>(size);
+    if( p == nullptr ) {
+        if( size > 0 )
+            *error = ENOMEM;
+        return {};
+    }
+    return array_ref<char>(p, size);
+}
+
+// like above, but with a buffer from page_alloc and the errno value on failure
+static array_ref<char> try_page_buffer(uint32_t size, const page_options& options, int* error)
+{
+    if( size == 0 )
+        return {};
+    void* p = page_alloc(size, options, error);
+    if( p == nullptr )
+        return {};
+    return array_ref<char>(static_cast<char*>(p), size);
+}
+
 
 fd_input_stream::fd_input_stream(array_ref<void> buffer, fd f, FdBlockingState b)
     : abstract_input_stream(buffer ? InternalBuffer::Yes : InternalBuffer::No)
@@ -50,6 +102,8 @@ void fd_input_stream::set_descriptor(fd f, FdBlockingState b)
     buffer_available = 0;
     buffer_offset = 0;
     status_flags = 0;
+    if( f && b == FdBlockingState::NonBlockingPoll && ! f.set_nonblock(true, &err) )
+        status_flags = StatusError;
 }
 
 ssize_t fd_input_stream::read_stream(array_ref<io::io_vector> buf_array, size_t required_read)
@@ -64,7 +118,7 @@ ssize_t fd_input_stream::read_stream(array_ref<io::io_vector> buf_array, size_t
     }
 
     const Mode mode = (required_read > 0) ? Mode::Blocking : Mode::NonBlocking;
-    if( ! update_blocking(mode, fd_blocking, filedes, &err) )
+    if( ! update_blocking(mode, fd_blocking, filedes, &err, statistics()) )
         return set_flag_return_error(&status_flags, StatusError);
 
     io::io_vector internal_array[2];
@@ -102,9 +156,15 @@ ssize_t fd_input_stream::read_stream(array_ref<io::io_vector> buf_array, size_t
 
     size_t count = 0;
     while( true ) {
-        const auto r = io::readv(filedes, buf_array);
+        io::io_result r;
+        {
+            detail::stats_blocking_scope blocking(mode == Mode::Blocking ? statistics() : nullptr);
+            r = io::readv(filedes, buf_array);
+        }
+        stats_add(&stream_statistics::syscalls);
         if( r.size > 0 ) {
             count += size_t(r.size);
+            stats_add(&stream_statistics::bytes, uint64_t(r.size));
 
             if( count < required_read ) {
                 buf_array = io::io_vector_array_advance(buf_array, size_t(r.size));
@@ -114,6 +174,7 @@ ssize_t fd_input_stream::read_stream(array_ref<io::io_vector> buf_array, size_t
             if( manages_buffer() && count > first_read_request ) {
                 buffer_offset = 0;
                 buffer_available = uint32_t(count - first_read_request);
+                stats_add(&stream_statistics::buffer_refills);
                 return ssize_t(first_read_request + buffer_read);
             }
 
@@ -133,7 +194,12 @@ ssize_t fd_input_stream::read_stream(array_ref<io::io_vector> buf_array, size_t
                 return ssize_t(buffer_read);
             }
         } else if( r.status == io::ReadWouldBlock && mode == Mode::NonBlocking ) {
+            stats_add(&stream_statistics::would_block);
             return ssize_t(buffer_read);
+        } else if( should_wait(r.status == io::ReadWouldBlock, mode, fd_blocking) ) {
+            err = wait_ready(filedes, poll::FlagsReadReady, statistics());
+            if( err != io::ReadNoError )
+                return set_flag_return_error(&status_flags, StatusError);
         } else {
             err = r.status;
             return set_flag_return_error(&status_flags, StatusError);
@@ -145,19 +211,35 @@ array_ref<const void> fd_input_stream::get_read_buffer(Mode mode)
 {
     if( status_flags )
         return {};
-    if( ! update_blocking(mode, fd_blocking, filedes, &err) ) {
+    if( ! update_blocking(mode, fd_blocking, filedes, &err, statistics()) ) {
         status_flags = StatusError;
         return {};
     }
 
-    const auto r = io::read(filedes, array_ref<char>(buffer_base_ptr, buffer_capacity));
+    io::io_result r;
+    while( true ) {
+        {
+            detail::stats_blocking_scope blocking(mode == Mode::Blocking ? statistics() : nullptr);
+            r = io::read(filedes, array_ref<char>(buffer_base_ptr, buffer_capacity));
+        }
+        stats_add(&stream_statistics::syscalls);
+        if( ! should_wait(r.status == io::ReadWouldBlock, mode, fd_blocking) )
+            break;
+        if( const int e = wait_ready(filedes, poll::FlagsReadReady, statistics()); e != 0 ) {
+            r.status = e;
+            break;
+        }
+    }
     if( r.size > 0 ) {
         buffer_offset = 0;
         buffer_available = uint32_t(r.size);
+        stats_add(&stream_statistics::bytes, uint64_t(r.size));
+        stats_add(&stream_statistics::buffer_refills);
         return current_buffer();
     } else if( r.size == 0 ) {
         status_flags = StatusEndOfStream;
     } else if( mode == Mode::NonBlocking && r.status == io::ReadWouldBlock ) {
+        stats_add(&stream_statistics::would_block);
     } else {
         err = r.status;
         status_flags = StatusError;
@@ -187,6 +269,10 @@ void fd_output_stream::set_descriptor(fd f, FdBlockingState b)
     if( ! f )
         buffer_available = 0;
     status_flags = 0;
+    if( f && b == FdBlockingState::NonBlockingPoll && ! f.set_nonblock(true, &err) ) {
+        buffer_available = 0;
+        status_flags = StatusError;
+    }
 }
 
 ssize_t fd_output_stream::write_stream(array_ref<io::io_vector> buf_array, Mode mode)
@@ -197,19 +283,24 @@ ssize_t fd_output_stream::write_stream(array_ref<io::io_vector> buf_array, Mode
 array_ref<void> fd_output_stream::get_write_buffer(Mode mode)
 {
     buffer_flush(mode);
+    if( buffer_available > 0 )
+        stats_add(&stream_statistics::buffer_refills);
     return current_buffer();
 }
 
 bool fd_output_stream::write_buffer_flush(Mode mode)
 {
-    return buffer_flush(mode);
+    const auto pending = buffer_offset - buffer_write_offset;
+    const bool flushed = buffer_flush(mode);
+    trace::detail::lib_event(trace::EventFdFlush, pending, flushed);
+    return flushed;
 }
 
 ssize_t fd_output_stream::write_fd(array_ref<io::io_vector> buf_array, Mode mode)
 {
     if( status_flags )
         return -1;
-    if( ! update_blocking(mode, fd_blocking, filedes, &err) )
+    if( ! update_blocking(mode, fd_blocking, filedes, &err, statistics()) )
         return set_flag_return_error(&status_flags, StatusError);
 
     io::io_vector internal_array[2];
@@ -230,14 +321,24 @@ ssize_t fd_output_stream::write_fd(array_ref<io::io_vector> buf_array, Mode mode
         const ssize_t sum = ssize_t(io::io_vector_array_size_sum(buf_array));
         ssize_t count = 0;
 
+        detail::stats_blocking_scope blocking(statistics());
         while( count < sum ) {
             const auto r = io::writev(filedes, buf_array);
+            stats_add(&stream_statistics::syscalls);
+            if( should_wait(r.status == io::WriteWouldBlock, mode, fd_blocking) ) {
+                err = wait_ready(filedes, poll::FlagsWriteReady, statistics());
+                if( err == io::WriteNoError )
+                    continue;
+                buffer_available = 0;
+                return set_flag_return_error(&status_flags, StatusError);
+            }
             if( r.size < 0 ) {
                 buffer_available = 0;
                 err = r.status;
                 return set_flag_return_error(&status_flags, StatusError);
             }
             count += r.size;
+            stats_add(&stream_statistics::bytes, uint64_t(r.size));
             buf_array = io::io_vector_array_advance(buf_array, size_t(r.size));
         }
 
@@ -247,7 +348,9 @@ ssize_t fd_output_stream::write_fd(array_ref<io::io_vector> buf_array, Mode mode
         return sum - internal_write_size;
     } else {
         const auto r = io::writev(filedes, buf_array);
+        stats_add(&stream_statistics::syscalls);
         if( r.size >= 0 ) {
+            stats_add(&stream_statistics::bytes, uint64_t(r.size));
             if( r.size >= internal_write_size ) {
                 if( manages_buffer() )
                     reset_buffer();
@@ -257,6 +360,7 @@ ssize_t fd_output_stream::write_fd(array_ref<io::io_vector> buf_array, Mode mode
                 return 0;
             }
         } else if( r.status == io::WriteWouldBlock ) {
+            stats_add(&stream_statistics::would_block);
             return 0;
         } else {
             buffer_available = 0;
@@ -294,6 +398,17 @@ socket_stream_pair::socket_stream_pair(uint32_t bufsize_read, uint32_t bufsize_w
 {
 }
 
+socket_stream_pair::socket_stream_pair(uint32_t bufsize, int* error)
+    : socket_stream_pair(bufsize, bufsize, error)
+{
+}
+
+socket_stream_pair::socket_stream_pair(uint32_t bufsize_read, uint32_t bufsize_write, int* error)
+    : in(try_malloc_buffer(bufsize_read, (*error = 0, error)))
+    , out(try_malloc_buffer(bufsize_write, error))
+{
+}
+
 socket_stream_pair::~socket_stream_pair()
 {
     if( in.descriptor() )
@@ -317,11 +432,27 @@ managed_fd_output_stream::managed_fd_output_stream(uint32_t bufsize)
 {
 }
 
+managed_fd_output_stream::managed_fd_output_stream(uint32_t bufsize, int* error)
+    : out(try_malloc_buffer(bufsize, (*error = 0, error)))
+{
+}
+
+managed_fd_output_stream::managed_fd_output_stream(uint32_t bufsize, const page_options& options, int* error)
+    : out(try_page_buffer(bufsize, options, (*error = 0, error)))
+    , paging(options)
+{
+    if( out.buffer_base() )
+        paged_size = bufsize;
+}
+
 managed_fd_output_stream::~managed_fd_output_stream()
 {
     if( out.descriptor() )
         out.descriptor().close();
-    ::free(out.buffer_base());
+    if( paged_size > 0 )
+        page_free(out.buffer_base(), paged_size, paging);
+    else
+        ::free(out.buffer_base());
 }
 
 void managed_fd_output_stream::reset(unique_fd f, FdBlockingState b)
@@ -337,11 +468,27 @@ managed_fd_input_stream::managed_fd_input_stream(uint32_t bufsize)
 {
 }
 
+managed_fd_input_stream::managed_fd_input_stream(uint32_t bufsize, int* error)
+    : in(try_malloc_buffer(bufsize, (*error = 0, error)))
+{
+}
+
+managed_fd_input_stream::managed_fd_input_stream(uint32_t bufsize, const page_options& options, int* error)
+    : in(try_page_buffer(bufsize, options, (*error = 0, error)))
+    , paging(options)
+{
+    if( in.buffer_base() )
+        paged_size = bufsize;
+}
+
 managed_fd_input_stream::~managed_fd_input_stream()
 {
     if( in.descriptor() )
         in.descriptor().close();
-    ::free(in.buffer_base());
+    if( paged_size > 0 )
+        page_free(in.buffer_base(), paged_size, paging);
+    else
+        ::free(in.buffer_base());
 }
 
 void managed_fd_input_stream::reset(unique_fd f, FdBlockingState b)
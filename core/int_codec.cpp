@@ -0,0 +1,538 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "lbu/int_codec.h"
+
+#include "lbu/byte_buffer.h"
+#include "lbu/endian.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstring>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace lbu {
+namespace int_codec {
+
+namespace {
+
+    // four 32 bit lanes, stored as 16 little endian bytes
+
+#if defined(__SSE2__)
+    struct vec4 {
+        __m128i v;
+
+        static vec4 load(const void* src) { return {_mm_loadu_si128(static_cast<const __m128i*>(src))}; }
+        static vec4 load_values(const uint32_t* src) { return load(src); }
+        static vec4 splat(uint32_t x) { return {_mm_set1_epi32(int(x))}; }
+        static vec4 zero() { return {_mm_setzero_si128()}; }
+
+        void store(void* dst) const { _mm_storeu_si128(static_cast<__m128i*>(dst), v); }
+        void store_values(uint32_t* dst) const { store(dst); }
+
+        template< unsigned N > vec4 shl() const { return {_mm_slli_epi32(v, N)}; }
+        template< unsigned N > vec4 shr() const { return {_mm_srli_epi32(v, N)}; }
+        vec4 operator&(vec4 o) const { return {_mm_and_si128(v, o.v)}; }
+        vec4 operator|(vec4 o) const { return {_mm_or_si128(v, o.v)}; }
+    };
+#else
+    struct vec4 {
+        uint32_t v[4];
+
+        static vec4 load(const void* src)
+        {
+            vec4 r;
+            for( unsigned i = 0; i < 4; ++i )
+                r.v[i] = from_little_endian<uint32_t>(static_cast<const char*>(src) + 4 * i);
+            return r;
+        }
+        static vec4 load_values(const uint32_t* src) { return {{src[0], src[1], src[2], src[3]}}; }
+        static vec4 splat(uint32_t x) { return {{x, x, x, x}}; }
+        static vec4 zero() { return splat(0); }
+
+        void store(void* dst) const
+        {
+            for( unsigned i = 0; i < 4; ++i )
+                to_little_endian<uint32_t>(v[i], static_cast<char*>(dst) + 4 * i);
+        }
+        void store_values(uint32_t* dst) const { std::memcpy(dst, v, sizeof(v)); }
+
+        template< unsigned N > vec4 shl() const { return {{v[0] << N, v[1] << N, v[2] << N, v[3] << N}}; }
+        template< unsigned N > vec4 shr() const { return {{v[0] >> N, v[1] >> N, v[2] >> N, v[3] >> N}}; }
+        vec4 operator&(vec4 o) const { return {{v[0] & o.v[0], v[1] & o.v[1], v[2] & o.v[2], v[3] & o.v[3]}}; }
+        vec4 operator|(vec4 o) const { return {{v[0] | o.v[0], v[1] | o.v[1], v[2] | o.v[2], v[3] | o.v[3]}}; }
+    };
+#endif
+
+    constexpr uint32_t low_mask32(unsigned bits) { return bits >= 32 ? ~uint32_t(0) : (uint32_t(1) << bits) - 1; }
+    constexpr uint64_t low_mask64(unsigned bits) { return bits >= 64 ? ~uint64_t(0) : (uint64_t(1) << bits) - 1; }
+
+
+    // 128 value blocks, one vec4 per value group J (values 4J .. 4J+3); packed word W of
+    // all lanes is stored at byte offset 16 W
+
+    template< unsigned Bits, unsigned J >
+    inline void unpack_group(const char* src, uint32_t* dst)
+    {
+        constexpr unsigned bit = J * Bits;
+        constexpr unsigned word = bit / 32;
+        constexpr unsigned shift = bit % 32;
+        vec4 v = vec4::load(src + 16 * word).template shr<shift>();
+        if constexpr( shift + Bits > 32 )
+            v = v | vec4::load(src + 16 * (word + 1)).template shl<32 - shift>();
+        if constexpr( Bits < 32 )
+            v = v & vec4::splat(low_mask32(Bits));
+        v.store_values(dst + 4 * J);
+    }
+
+    template< unsigned Bits, unsigned J >
+    inline void pack_group(const uint32_t* src, char* dst, vec4& acc)
+    {
+        constexpr unsigned bit = J * Bits;
+        constexpr unsigned word = bit / 32;
+        constexpr unsigned shift = bit % 32;
+        const vec4 v = vec4::load_values(src + 4 * J);
+        if constexpr( shift == 0 )
+            acc = v;
+        else
+            acc = acc | v.template shl<shift>();
+        if constexpr( shift + Bits >= 32 ) {
+            acc.store(dst + 16 * word);
+            if constexpr( shift + Bits > 32 )
+                acc = v.template shr<32 - shift>();
+        }
+    }
+
+    template< unsigned Bits, unsigned... J >
+    void unpack_block(const char* src, uint32_t* dst, std::integer_sequence<unsigned, J...>)
+    {
+        (unpack_group<Bits, J>(src, dst), ...);
+    }
+
+    template< unsigned Bits, unsigned... J >
+    void pack_block(const uint32_t* src, char* dst, std::integer_sequence<unsigned, J...>)
+    {
+        vec4 acc = vec4::zero();
+        (pack_group<Bits, J>(src, dst, acc), ...);
+    }
+
+    template< unsigned Bits >
+    void unpack_block(const char* src, uint32_t* dst)
+    {
+        if constexpr( Bits == 0 )
+            std::fill_n(dst, BlockSize, 0);
+        else
+            unpack_block<Bits>(src, dst, std::make_integer_sequence<unsigned, BlockSize / 4>());
+    }
+
+    template< unsigned Bits >
+    void pack_block(const uint32_t* src, char* dst)
+    {
+        if constexpr( Bits > 0 )
+            pack_block<Bits>(src, dst, std::make_integer_sequence<unsigned, BlockSize / 4>());
+    }
+
+    using unpack_block_function = void (*)(const char*, uint32_t*);
+    using pack_block_function = void (*)(const uint32_t*, char*);
+
+    template< unsigned... Bits >
+    constexpr std::array<unpack_block_function, sizeof...(Bits)> make_unpack_table(std::integer_sequence<unsigned, Bits...>)
+    {
+        return {&unpack_block<Bits>...};
+    }
+
+    template< unsigned... Bits >
+    constexpr std::array<pack_block_function, sizeof...(Bits)> make_pack_table(std::integer_sequence<unsigned, Bits...>)
+    {
+        return {&pack_block<Bits>...};
+    }
+
+    constexpr auto unpack_table = make_unpack_table(std::make_integer_sequence<unsigned, 33>());
+    constexpr auto pack_table = make_pack_table(std::make_integer_sequence<unsigned, 33>());
+
+
+    // little endian bit stream, used for partial blocks and 64 bit values
+
+    template< typename UIntType >
+    void pack_stream(const UIntType* src, size_t count, unsigned bits, char* dst)
+    {
+        if( bits == 0 )
+            return;
+        uint64_t acc = 0;
+        unsigned fill = 0;
+        for( size_t i = 0; i < count; ++i ) {
+            const uint64_t v = src[i];
+            acc |= v << fill;
+            if( fill + bits >= 64 ) {
+                to_little_endian<uint64_t>(acc, dst);
+                dst += 8;
+                acc = fill == 0 ? 0 : v >> (64 - fill);
+                fill = fill + bits - 64;
+            } else {
+                fill += bits;
+            }
+        }
+        for( unsigned i = 0; i < fill; i += 8 ) {
+            *dst++ = char(uint8_t(acc));
+            acc >>= 8;
+        }
+    }
+
+    template< typename UIntType >
+    void unpack_stream(const char* src, unsigned bits, UIntType* dst, size_t count)
+    {
+        if( bits == 0 ) {
+            std::fill_n(dst, count, 0);
+            return;
+        }
+        const char* const end = src + packed_size(count, bits);
+        const uint64_t mask = low_mask64(bits);
+        uint64_t acc = 0;
+        unsigned avail = 0;
+        for( size_t i = 0; i < count; ++i ) {
+            if( avail >= bits ) {
+                dst[i] = UIntType(acc & mask);
+                acc = bits == 64 ? 0 : acc >> bits;
+                avail -= bits;
+                continue;
+            }
+            uint64_t next;
+            unsigned next_bits;
+            if( end - src >= 8 ) {
+                next = from_little_endian<uint64_t>(src);
+                next_bits = 64;
+                src += 8;
+            } else {
+                next = 0;
+                next_bits = 0;
+                while( src != end ) {
+                    next |= uint64_t(uint8_t(*src++)) << next_bits;
+                    next_bits += 8;
+                }
+            }
+            dst[i] = UIntType((acc | (avail == 0 ? next : next << avail)) & mask);
+            const unsigned used = bits - avail;
+            acc = used == 64 ? 0 : next >> used;
+            avail = next_bits - used;
+        }
+    }
+
+
+    // blocks
+
+    template< typename UIntType >
+    struct transformed_range {
+        unsigned bits;
+        UIntType reference;
+        UIntType reference_delta;
+    };
+
+    template< typename UIntType >
+    transformed_range<UIntType> analyze(array_ref<const UIntType> values, Transform t)
+    {
+        UIntType acc = 0;
+        UIntType reference = 0;
+        UIntType reference_delta = 0;
+        switch( t ) {
+        case Transform::None:
+            for( auto v : values )
+                acc |= v;
+            break;
+        case Transform::FrameOfReference:
+            if( values.size() > 0 ) {
+                reference = *std::min_element(values.begin(), values.end());
+                for( auto v : values )
+                    acc |= UIntType(v - reference);
+            }
+            break;
+        case Transform::Delta:
+            if( values.size() > 0 ) {
+                reference = values[0];
+                UIntType prev = reference;
+                for( auto v : values ) {
+                    acc |= UIntType(v - prev);
+                    prev = v;
+                }
+            }
+            break;
+        case Transform::DeltaOfDelta:
+            if( values.size() > 0 ) {
+                // start as if the first delta was preceded by itself, so the first two values cost nothing
+                reference_delta = values.size() > 1 ? UIntType(values[1] - values[0]) : 0;
+                reference = UIntType(values[0] - reference_delta);
+                delta_of_delta_state<UIntType> state = {reference, reference_delta};
+                UIntType chunk[BlockSize];
+                for( size_t i = 0; i < values.size(); i += BlockSize ) {
+                    const size_t n = std::min(BlockSize, values.size() - i);
+                    std::copy_n(values.data() + i, n, chunk);
+                    delta_of_delta_encode(array_ref<UIntType>(chunk, n), &state);
+                    for( size_t k = 0; k < n; ++k )
+                        acc |= chunk[k];
+                }
+            }
+            break;
+        }
+        return {bit_width(acc), reference, reference_delta};
+    }
+
+    template< typename UIntType >
+    size_t encode_impl(array_ref<const UIntType> values, Transform t, char* dst)
+    {
+        assert(values.size() <= std::numeric_limits<uint32_t>::max());
+        const auto range = analyze(values, t);
+
+        dst[0] = char(t);
+        dst[1] = char(range.bits);
+        dst[2] = char(sizeof(UIntType));
+        dst[3] = 0;
+        to_little_endian<uint32_t>(uint32_t(values.size()), dst + 4);
+        to_little_endian<uint64_t>(range.reference, dst + 8);
+        to_little_endian<uint64_t>(range.reference_delta, dst + 16);
+
+        char* out = dst + HeaderSize;
+        UIntType chunk[BlockSize];
+        UIntType prev = range.reference;
+        delta_of_delta_state<UIntType> dod = {range.reference, range.reference_delta};
+        for( size_t i = 0; i < values.size(); i += BlockSize ) {
+            const size_t n = std::min(BlockSize, values.size() - i);
+            std::copy_n(values.data() + i, n, chunk);
+            array_ref<UIntType> c(chunk, n);
+            switch( t ) {
+            case Transform::None: break;
+            case Transform::FrameOfReference: for_encode(c, range.reference); break;
+            case Transform::Delta: prev = delta_encode(c, prev); break;
+            case Transform::DeltaOfDelta: delta_of_delta_encode(c, &dod); break;
+            }
+            pack(array_ref<const UIntType>(chunk, n), range.bits, out);
+            out += packed_size(n, range.bits);
+        }
+        return size_t(out - dst);
+    }
+
+    // Undoes the transform across consecutive parts of one block
+    template< typename UIntType >
+    class payload_decoder {
+    public:
+        explicit payload_decoder(const block_info& info)
+            : transform(info.transform)
+            , bits(info.bits)
+            , reference(UIntType(info.reference))
+            , prev(reference)
+            , dod{reference, UIntType(info.reference_delta)}
+        {
+        }
+
+        // Decodes values.size() values packed at src, all parts but the last must hold
+        // a multiple of BlockSize values.
+        void decode(const char* src, array_ref<UIntType> values)
+        {
+            for( size_t i = 0; i < values.size(); i += BlockSize ) {
+                const size_t n = std::min(BlockSize, values.size() - i);
+                array_ref<UIntType> c(values.data() + i, n);
+                unpack(src, bits, c);
+                src += packed_size(n, bits);
+                switch( transform ) {
+                case Transform::None: break;
+                case Transform::FrameOfReference: for_decode(c, reference); break;
+                case Transform::Delta: prev = delta_decode(c, prev); break;
+                case Transform::DeltaOfDelta: delta_of_delta_decode(c, &dod); break;
+                }
+            }
+        }
+
+    private:
+        Transform transform;
+        unsigned bits;
+        UIntType reference;
+        UIntType prev;
+        delta_of_delta_state<UIntType> dod;
+    };
+
+    template< typename UIntType >
+    void decode_payload(const block_info& info, const char* src, array_ref<UIntType> values)
+    {
+        payload_decoder<UIntType>(info).decode(src, values);
+    }
+
+    template< typename UIntType >
+    const char* decode_impl(const char* src, const char* end, array_ref<UIntType> values)
+    {
+        block_info info;
+        if( ! peek(src, end, &info) || info.value_size != sizeof(UIntType) || info.count != values.size() )
+            return nullptr;
+        if( size_t(end - src) < info.encoded_size() )
+            return nullptr;
+        decode_payload(info, src + HeaderSize, values);
+        return src + info.encoded_size();
+    }
+
+    template< typename UIntType >
+    bool write_impl(stream::abstract_output_stream* out, array_ref<const UIntType> values, Transform t)
+    {
+        const size_t bound = encoded_size_bound<UIntType>(values.size());
+        if( out->manages_buffer() ) {
+            auto buf = out->get_buffer(stream::Mode::Blocking);
+            if( buf.byte_size() >= bound ) {
+                out->advance_buffer(encode(values, t, static_cast<char*>(buf.data())));
+                return true;
+            }
+            if( buf.data() == nullptr )
+                return false;
+        }
+        byte_buffer tmp;
+        tmp.resize(bound);
+        const size_t size = encode(values, t, static_cast<char*>(tmp.data()));
+        return out->write(tmp.data(), size, stream::Mode::Blocking) == ssize_t(size);
+    }
+
+    template< typename UIntType >
+    bool read_impl(stream::abstract_input_stream* in, std::vector<UIntType>* values, size_t max_count)
+    {
+        char header[HeaderSize];
+        if( in->read(header, HeaderSize, stream::Mode::Blocking) != ssize_t(HeaderSize) )
+            return false;
+        block_info info;
+        if( ! peek(header, header + HeaderSize, &info) || info.value_size != sizeof(UIntType)
+                || info.count > max_count )
+            return false;
+        const size_t size = packed_size(info.count, info.bits);
+        values->clear();
+
+        if( in->manages_buffer() && size > 0 ) {
+            auto buf = in->get_buffer(stream::Mode::Blocking);
+            if( buf.data() == nullptr )
+                return false;
+            if( buf.byte_size() >= size ) {
+                values->resize(info.count);
+                decode_payload(info, static_cast<const char*>(buf.data()), array_ref<UIntType>(values->data(), values->size()));
+                in->advance_buffer(size);
+                return true;
+            }
+        }
+
+        // The count is not trusted, so values only grow along with the data actually read
+        constexpr size_t ChunkCount = 64 * BlockSize;
+        payload_decoder<UIntType> decoder(info);
+        byte_buffer tmp;
+        for( size_t done = 0; done < info.count; ) {
+            const size_t n = std::min<size_t>(ChunkCount, info.count - done);
+            const size_t bytes = packed_size(n, info.bits);
+            tmp.resize(bytes);
+            if( bytes > 0 && in->read(tmp.data(), bytes, stream::Mode::Blocking) != ssize_t(bytes) )
+                return false;
+            values->resize(done + n);
+            decoder.decode(static_cast<const char*>(tmp.data()), array_ref<UIntType>(values->data() + done, n));
+            done += n;
+        }
+        return true;
+    }
+
+}
+
+
+void pack(array_ref<const uint32_t> values, unsigned bits, char* dst)
+{
+    assert(bits <= 32);
+    const uint32_t* src = values.data();
+    size_t left = values.size();
+    const auto kernel = pack_table[bits];
+    const size_t block_bytes = packed_size(BlockSize, bits);
+    for( ; left >= BlockSize; left -= BlockSize ) {
+        kernel(src, dst);
+        src += BlockSize;
+        dst += block_bytes;
+    }
+    pack_stream(src, left, bits, dst);
+}
+
+void pack(array_ref<const uint64_t> values, unsigned bits, char* dst)
+{
+    assert(bits <= 64);
+    pack_stream(values.data(), values.size(), bits, dst);
+}
+
+void unpack(const char* src, unsigned bits, array_ref<uint32_t> values)
+{
+    assert(bits <= 32);
+    uint32_t* dst = values.data();
+    size_t left = values.size();
+    const auto kernel = unpack_table[bits];
+    const size_t block_bytes = packed_size(BlockSize, bits);
+    for( ; left >= BlockSize; left -= BlockSize ) {
+        kernel(src, dst);
+        src += block_bytes;
+        dst += BlockSize;
+    }
+    unpack_stream(src, bits, dst, left);
+}
+
+void unpack(const char* src, unsigned bits, array_ref<uint64_t> values)
+{
+    assert(bits <= 64);
+    unpack_stream(src, bits, values.data(), values.size());
+}
+
+size_t encode(array_ref<const uint32_t> values, Transform t, char* dst)
+{
+    return encode_impl(values, t, dst);
+}
+
+size_t encode(array_ref<const uint64_t> values, Transform t, char* dst)
+{
+    return encode_impl(values, t, dst);
+}
+
+bool peek(const char* src, const char* end, block_info* info)
+{
+    if( end - src < ptrdiff_t(HeaderSize) )
+        return false;
+    const auto t = uint8_t(src[0]);
+    const auto bits = unsigned(uint8_t(src[1]));
+    const auto value_size = unsigned(uint8_t(src[2]));
+    if( t > uint8_t(Transform::DeltaOfDelta) || (value_size != 4 && value_size != 8)
+            || bits > 8 * value_size || src[3] != 0 )
+        return false;
+    *info = {Transform(t), bits, value_size,
+             from_little_endian<uint32_t>(src + 4), from_little_endian<uint64_t>(src + 8),
+             from_little_endian<uint64_t>(src + 16)};
+    return true;
+}
+
+const char* decode(const char* src, const char* end, array_ref<uint32_t> values)
+{
+    return decode_impl(src, end, values);
+}
+
+const char* decode(const char* src, const char* end, array_ref<uint64_t> values)
+{
+    return decode_impl(src, end, values);
+}
+
+bool write(stream::abstract_output_stream* out, array_ref<const uint32_t> values, Transform t)
+{
+    return write_impl(out, values, t);
+}
+
+bool write(stream::abstract_output_stream* out, array_ref<const uint64_t> values, Transform t)
+{
+    return write_impl(out, values, t);
+}
+
+bool read(stream::abstract_input_stream* in, std::vector<uint32_t>* values, size_t max_count)
+{
+    return read_impl(in, values, max_count);
+}
+
+bool read(stream::abstract_input_stream* in, std::vector<uint64_t>* values, size_t max_count)
+{
+    return read_impl(in, values, max_count);
+}
+
+}
+}
@@ -8,6 +8,7 @@
 #include "lbu/array_ref.h"
 #include "lbu/lbu_global.h"
 #include "lbu/io.h"
+#include "lbu/stream_statistics.h"
 
 #include <cstring>
 
@@ -82,8 +83,31 @@ namespace detail {
         };
         uint8_t status_flags = 0;
 
+        stream_statistics* statistics() const
+        {
+#ifdef LIBLBU_STREAM_STATS
+            return stats;
+#else
+            return nullptr;
+#endif
+        }
+
+        void set_statistics(stream_statistics* s)
+        {
+#ifdef LIBLBU_STREAM_STATS
+            stats = s;
+#else
+            (void)s;
+#endif
+        }
+
+        void stats_add(stream_counter c, uint64_t count = 1) { detail::stats_add(statistics(), c, count); }
+
     private:
         bool manages_buffer;
+#ifdef LIBLBU_STREAM_STATS
+        stream_statistics* stats = {};
+#endif
     };
 
 }
@@ -190,6 +214,13 @@ namespace detail {
         bool has_error() const { return (status_flags & StatusError); }
         bool at_end() const { return (status_flags & StatusEndOfStream); }
 
+        /// \brief Attach (or detach with nullptr) instrumentation counters.
+        ///
+        /// Only has an effect if lbu was built with LBU_STREAM_STATS, see stream_statistics.h.
+        /// The object must outlive the stream or be detached before it is destroyed.
+        void attach_statistics(stream_statistics* s) { set_statistics(s); }
+        stream_statistics* attached_statistics() const { return statistics(); }
+
         abstract_input_stream(const abstract_input_stream&) = delete;
         abstract_input_stream& operator=(const abstract_input_stream&) = delete;
 
@@ -320,6 +351,13 @@ namespace detail {
 
         bool has_error() const { return (status_flags & StatusError); }
 
+        /// \brief Attach (or detach with nullptr) instrumentation counters.
+        ///
+        /// Only has an effect if lbu was built with LBU_STREAM_STATS, see stream_statistics.h.
+        /// The object must outlive the stream or be detached before it is destroyed.
+        void attach_statistics(stream_statistics* s) { set_statistics(s); }
+        stream_statistics* attached_statistics() const { return statistics(); }
+
         abstract_output_stream(const abstract_output_stream&) = delete;
         abstract_output_stream& operator=(const abstract_output_stream&) = delete;
 
@@ -0,0 +1,178 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef LIBLBU_ARRAY_ALGORITHM_H
+#define LIBLBU_ARRAY_ALGORITHM_H
+
+#include "lbu/lbu_global.h"
+#include "lbu/array_ref.h"
+
+#include <cassert>
+#include <cstring>
+#include <stdint.h>
+#include <type_traits>
+#include <utility>
+
+// Bulk operations on array_ref views of plain numbers.
+//
+// The kernels exist once in portable C++ and once per x86 instruction set (SSE2,
+// AVX2, AVX-512); the best one the CPU supports is picked at the first call (see
+// lbu/cpu_features.h for restricting it). Results never depend on the kernel set.
+//
+// All functions take views of mutable or const elements alike, e.g.
+// `array_algorithm::find(ref, 0)` with `ref` an `array_ref<int>`.
+
+namespace lbu {
+namespace array_algorithm {
+
+namespace detail {
+
+    template< size_t Size > struct uint_of_size;
+    template<> struct uint_of_size<1> { typedef uint8_t type; };
+    template<> struct uint_of_size<2> { typedef uint16_t type; };
+    template<> struct uint_of_size<4> { typedef uint32_t type; };
+    template<> struct uint_of_size<8> { typedef uint64_t type; };
+
+    template< typename T >
+    using uint_of = typename uint_of_size<sizeof(T)>::type;
+
+    template< typename T >
+    const uint_of<T>* as_uint(const T* p)
+    {
+        static_assert(std::is_integral_v<T>, "only integral element types are supported");
+        return reinterpret_cast<const uint_of<T>*>(p);
+    }
+
+    template< typename T >
+    uint_of<T>* as_uint(T* p)
+    {
+        static_assert(std::is_integral_v<T>, "only integral element types are supported");
+        return reinterpret_cast<uint_of<T>*>(p);
+    }
+
+    size_t LIBLBU_EXPORT find(const uint8_t* data, size_t size, uint8_t value);
+    size_t LIBLBU_EXPORT find(const uint16_t* data, size_t size, uint16_t value);
+    size_t LIBLBU_EXPORT find(const uint32_t* data, size_t size, uint32_t value);
+    size_t LIBLBU_EXPORT find(const uint64_t* data, size_t size, uint64_t value);
+
+    size_t LIBLBU_EXPORT count(const uint8_t* data, size_t size, uint8_t value);
+    size_t LIBLBU_EXPORT count(const uint16_t* data, size_t size, uint16_t value);
+    size_t LIBLBU_EXPORT count(const uint32_t* data, size_t size, uint32_t value);
+    size_t LIBLBU_EXPORT count(const uint64_t* data, size_t size, uint64_t value);
+
+    void LIBLBU_EXPORT min_max(const uint8_t* data, size_t size, uint8_t* min, uint8_t* max);
+    void LIBLBU_EXPORT min_max(const int16_t* data, size_t size, int16_t* min, int16_t* max);
+    void LIBLBU_EXPORT min_max(const int32_t* data, size_t size, int32_t* min, int32_t* max);
+    void LIBLBU_EXPORT min_max(const uint32_t* data, size_t size, uint32_t* min, uint32_t* max);
+    void LIBLBU_EXPORT min_max(const float* data, size_t size, float* min, float* max);
+
+    size_t LIBLBU_EXPORT mismatch(const void* a, const void* b, size_t byte_size);
+
+    void LIBLBU_EXPORT byte_swap(uint16_t* dst, const uint16_t* src, size_t size);
+    void LIBLBU_EXPORT byte_swap(uint32_t* dst, const uint32_t* src, size_t size);
+    void LIBLBU_EXPORT byte_swap(uint64_t* dst, const uint64_t* src, size_t size);
+
+    void LIBLBU_EXPORT fill(uint16_t* data, size_t size, uint16_t value);
+    void LIBLBU_EXPORT fill(uint32_t* data, size_t size, uint32_t value);
+    void LIBLBU_EXPORT fill(uint64_t* data, size_t size, uint64_t value);
+
+    void LIBLBU_EXPORT prefix_sum(uint32_t* data, size_t size, uint32_t start);
+    void LIBLBU_EXPORT prefix_sum(uint64_t* data, size_t size, uint64_t start);
+
+}
+
+    /// \brief Name of the kernel set in use ("portable", "sse2", "avx2" or "avx512").
+    LIBLBU_EXPORT const char* kernel_set_name();
+
+    /// \brief Index of the first element equal to \p value, or `data.size()` if there is none.
+    template< typename T >
+    size_t find(array_ref<T> data, std::remove_const_t<T> value)
+    {
+        return detail::find(detail::as_uint(data.data()), data.size(), detail::uint_of<T>(value));
+    }
+
+    /// \brief Number of elements equal to \p value.
+    template< typename T >
+    size_t count(array_ref<T> data, std::remove_const_t<T> value)
+    {
+        return detail::count(detail::as_uint(data.data()), data.size(), detail::uint_of<T>(value));
+    }
+
+    /// \brief Smallest and largest element, for uint8_t, int16_t, int32_t, uint32_t and float.
+    ///
+    /// An empty array gives {max(), lowest()} of the element type. NaN values are ignored.
+    template< typename T >
+    std::pair<std::remove_const_t<T>, std::remove_const_t<T>> min_max(array_ref<T> data)
+    {
+        std::pair<std::remove_const_t<T>, std::remove_const_t<T>> r;
+        detail::min_max(data.data(), data.size(), &r.first, &r.second);
+        return r;
+    }
+
+    /// \brief Sum of all elements (without overflow for any realistic array size).
+    LIBLBU_EXPORT uint64_t sum(array_ref<const uint8_t> data);
+    LIBLBU_EXPORT int64_t sum(array_ref<const int16_t> data);
+    LIBLBU_EXPORT int64_t sum(array_ref<const int32_t> data);
+    LIBLBU_EXPORT uint64_t sum(array_ref<const uint32_t> data);
+
+    /// \brief Index of the first element that differs, or the size of the shorter array.
+    ///
+    /// Elements are compared bytewise, so this is meant for integers and other types
+    /// with unique object representations.
+    template< typename T, typename U >
+    size_t mismatch(array_ref<T> a, array_ref<U> b)
+    {
+        static_assert(std::is_same_v<std::remove_const_t<T>, std::remove_const_t<U>>);
+        static_assert(std::is_trivially_copyable_v<T>);
+        const size_t n = std::min(a.size(), b.size());
+        return detail::mismatch(a.data(), b.data(), n * sizeof(T)) / sizeof(T);
+    }
+
+    template< typename T, typename U >
+    bool equal(array_ref<T> a, array_ref<U> b)
+    {
+        return a.size() == b.size() && mismatch(a, b) == a.size();
+    }
+
+    /// \brief Reverse the byte order of each element of \p src into \p dst.
+    ///
+    /// \p dst must have at least the size of \p src, both may be the same array.
+    template< typename T >
+    void byte_swap(array_ref<T> dst, array_ref<const std::remove_const_t<T>> src)
+    {
+        assert(dst.size() >= src.size());
+        if constexpr( sizeof(T) > 1 )
+            detail::byte_swap(detail::as_uint(dst.data()), detail::as_uint(src.data()), src.size());
+    }
+
+    template< typename T >
+    void byte_swap(array_ref<T> data)
+    {
+        if constexpr( sizeof(T) > 1 )
+            detail::byte_swap(detail::as_uint(data.data()), detail::as_uint(data.data()), data.size());
+    }
+
+    template< typename T >
+    void fill(array_ref<T> data, std::remove_const_t<T> value)
+    {
+        if constexpr( sizeof(T) == 1 )
+            std::memset(data.data(), uint8_t(value), data.size());
+        else
+            detail::fill(detail::as_uint(data.data()), data.size(), detail::uint_of<T>(value));
+    }
+
+    /// \brief Inclusive prefix sum in place: `data[i] = start + data[0] + ... + data[i]`.
+    ///
+    /// For 32 and 64 bit integers, with wrapping arithmetic.
+    template< typename T >
+    void prefix_sum(array_ref<T> data, std::remove_const_t<T> start = 0)
+    {
+        static_assert(sizeof(T) == 4 || sizeof(T) == 8);
+        detail::prefix_sum(detail::as_uint(data.data()), data.size(), detail::uint_of<T>(start));
+    }
+
+}
+}
+
+#endif
@@ -0,0 +1,72 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef LIBLBU_BUFFER_QUEUE_STREAM_H
+#define LIBLBU_BUFFER_QUEUE_STREAM_H
+
+#include "lbu/abstract_stream.h"
+#include "lbu/byte_buffer.h"
+#include "lbu/shared_buffer.h"
+
+#include <memory>
+
+namespace lbu {
+namespace stream {
+
+    // An in-memory input stream over a queue of buffers, e.g. to replay captured data or
+    // as an in-process transport.
+    //
+    // Unlike byte_buffer_input_stream the data does not have to be one block: segments
+    // are appended (possibly while the stream is read, from another thread) and
+    // get_buffer() hands out each segment without copying. The stream ends once
+    // set_end_of_stream() was called and all segments are read; before that a Blocking
+    // read waits for more segments.
+    //
+    // Appending is thread safe (one or more producers), reading is not (one consumer).
+    class buffer_queue_input_stream : public abstract_input_stream {
+    public:
+        LIBLBU_EXPORT buffer_queue_input_stream();
+        LIBLBU_EXPORT ~buffer_queue_input_stream() override;
+
+        /// \brief Append an owned segment, empty buffers are ignored.
+        ///
+        /// Returns false (dropping the data) after set_end_of_stream().
+        bool LIBLBU_EXPORT append(byte_buffer&& buf);
+
+        /// \brief Append a shared segment, the stream keeps a reference until it is read.
+        bool LIBLBU_EXPORT append(shared_buffer buf);
+
+        /// \brief Append a borrowed segment, it has to stay valid until it is read (or reset()).
+        bool LIBLBU_EXPORT append(array_ref<const void> data);
+
+        /// \brief No more segments follow, the stream ends after the queued ones.
+        void LIBLBU_EXPORT set_end_of_stream();
+
+        /// \brief Bytes appended but not handed out to the reader yet.
+        size_t LIBLBU_EXPORT queued_size() const;
+
+        /// \brief Drop all segments and restart, not thread safe.
+        void LIBLBU_EXPORT reset();
+
+    protected:
+        ssize_t LIBLBU_EXPORT read_stream(array_ref<io::io_vector> buf_array, size_t required_read) override;
+        array_ref<const void> LIBLBU_EXPORT get_read_buffer(Mode mode) override;
+
+        LIBLBU_EXPORT buffer_queue_input_stream(buffer_queue_input_stream&&);
+        LIBLBU_EXPORT buffer_queue_input_stream& operator=(buffer_queue_input_stream&&);
+
+    private:
+        struct segment;
+        struct internal;
+
+        bool enqueue(segment&& s);
+        bool next_window(Mode mode);
+
+        std::unique_ptr<internal> d;
+    };
+
+}
+}
+
+#endif
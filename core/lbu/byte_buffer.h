@@ -30,6 +30,10 @@ namespace lbu {
     // - more compact on 64 bit, but only allows ~2GB max size
     // - can adopt/release malloced buffer
     // - allows uninitialized insert/append
+    //
+    // Running out of memory calls unexpected_memory_exhaustion(), except for the try_*
+    // functions: they return false and leave the buffer unchanged instead, and never
+    // reach the throwing code.
     class byte_buffer {
     public:
         byte_buffer() = default;
@@ -75,6 +79,11 @@ namespace lbu {
 
         byte_buffer& erase(size_t index, size_t count);
 
+        bool try_reserve(size_t capacity);
+        bool try_resize(size_t count);
+        bool try_append(size_t count, unsigned char ch = 0);
+        bool try_append(array_ref<const void> data);
+
         void adopt_raw_malloc(unique_ptr_raw data, size_t size);
         void adopt_raw_malloc(unique_ptr_raw data, size_t size, size_t capacity);
         unique_ptr_raw release_raw_malloc();
@@ -96,7 +105,9 @@ namespace lbu {
 
         void set_size_checked(size_t size);
         void set_capacity_checked(size_t capacity);
+        bool try_set_capacity_checked(size_t capacity);
 
+        bool try_grow(size_t count);
         array_ref<void> append_base(size_t count);
 
         void cleanup();
@@ -320,10 +331,47 @@ namespace lbu {
         const auto new_size = old_size - count;
         char* c = char_data();
         std::memmove(c + index, c + second_index, old_size - second_index);
-        d.ext.size = new_size;
+        set_size_checked(new_size);
         return *this;
     }
 
+    inline bool byte_buffer::try_reserve(size_t capacity)
+    {
+        if( capacity <= this->capacity() )
+            return true;
+        return capacity <= max_size() && try_set_capacity_checked(capacity);
+    }
+
+    inline bool byte_buffer::try_resize(size_t count)
+    {
+        const auto s = size();
+        if( count > s )
+            return try_append(count - s);
+        set_size_checked(count);
+        return true;
+    }
+
+    inline bool byte_buffer::try_append(size_t count, unsigned char ch)
+    {
+        if( ! try_grow(count) )
+            return false;
+        const auto s = size();
+        std::memset(char_data() + s, ch, count);
+        set_size_checked(s + count);
+        return true;
+    }
+
+    inline bool byte_buffer::try_append(array_ref<const void> data)
+    {
+        const auto count = data.byte_size();
+        if( ! try_grow(count) )
+            return false;
+        const auto s = size();
+        std::memcpy(char_data() + s, data.data(), count);
+        set_size_checked(s + count);
+        return true;
+    }
+
     inline void byte_buffer::adopt_raw_malloc(unique_ptr_raw data, size_t size)
     {
         adopt_raw_malloc(std::move(data), size, size);
@@ -419,48 +467,53 @@ namespace lbu {
     }
 
     inline void byte_buffer::set_capacity_checked(size_t capacity)
+    {
+        if( ! try_set_capacity_checked(capacity) )
+            unexpected_memory_exhaustion();
+    }
+
+    inline bool byte_buffer::try_set_capacity_checked(size_t capacity)
     {
         auto r = ref();
 
         if( capacity <= SmallResered ) {
             if( is_small() )
-                return;
+                return true;
             set_small(r.data(), r.size());
             ::free(r.data());
         } else if( is_small() ) {
-            char* c = xmalloc_bytes<char>(capacity);
+            char* c = malloc_bytes<char>(capacity);
+            if( c == nullptr )
+                return false;
             std::memcpy(c, r.data(), r.size());
             // memcpy must happen first
             set_ext(c, r.size(), capacity);
         } else {
-            set_ext(xrealloc_bytes<char>(d.ext.data, capacity), r.size(), capacity);
+            char* c = realloc_bytes<char>(d.ext.data, capacity);
+            if( c == nullptr )
+                return false;
+            set_ext(c, r.size(), capacity);
         }
+        return true;
+    }
+
+    // room for count more bytes, growing the capacity like append does
+    inline bool byte_buffer::try_grow(size_t count)
+    {
+        const auto s = size();
+        if( count > max_size() - s )
+            return false;
+        return capacity() - s >= count || try_set_capacity_checked(grow_capacity(s + count));
     }
 
     inline array_ref<void> byte_buffer::append_base(size_t count)
     {
+        assert(max_size() - size() >= count);
+        if( ! try_grow(count) )
+            unexpected_memory_exhaustion();
         const auto old_size = size();
-        assert(max_size() - old_size >= count);
-        const auto new_size = old_size + count;
-        char* c = char_data();
-
-        if( capacity() < new_size ) {
-            const auto new_capacity = grow_capacity(new_size);
-            char* new_c;
-
-            if( is_small() ) {
-                new_c = xmalloc_bytes<char>(new_capacity);
-                std::memcpy(new_c, c, old_size);
-            } else {
-                new_c = xrealloc_bytes<char>(c, new_capacity);
-            }
-            set_ext(new_c, new_size, new_capacity);
-            c = new_c;
-        } else {
-            set_size_checked(new_size);
-        }
-
-        return array_ref<char>(c + old_size, count);
+        set_size_checked(old_size + count);
+        return array_ref<char>(char_data() + old_size, count);
     }
 
     inline void byte_buffer::cleanup()
@@ -49,6 +49,7 @@ namespace stream {
         byte_buffer_output_stream& operator=(byte_buffer_output_stream&&) = default;
 
     private:
+        void commit();
         void sync_state();
 
         byte_buffer buffer;
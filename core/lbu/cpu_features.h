@@ -0,0 +1,99 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef LIBLBU_CPU_FEATURES_H
+#define LIBLBU_CPU_FEATURES_H
+
+#include "lbu/lbu_global.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Runtime CPU feature detection, for picking the best of several kernels.
+//
+// The features are detected once (including the OS support for the AVX register
+// state). For testing, the environment variable LBU_CPU_FEATURES restricts them:
+// a comma separated list of feature names keeps only those, names prefixed with
+// '-' remove single features, and "none" disables all. E.g.
+//
+//   LBU_CPU_FEATURES=none            portable kernels only
+//   LBU_CPU_FEATURES=sse2,ssse3      at most SSSE3 kernels
+//   LBU_CPU_FEATURES=-avx512f        everything but AVX-512
+//
+// Unknown names are ignored and an empty value changes nothing. Features the CPU
+// does not have are never enabled.
+//
+// Kernels for a specific instruction set live in their own translation units,
+// compiled with the matching -m flags (see lbu_add_isa_sources in CMakeLists.txt),
+// and are chosen with cpu::select from a candidate list:
+//
+//   static const auto impl = cpu::select<decode_function>({
+//       {cpu::AVX2, &decode_avx2},
+//       {cpu::SSSE3, &decode_ssse3},
+//       {0, &decode_portable}
+//   });
+
+namespace lbu {
+namespace cpu {
+
+    enum Feature : uint32_t {
+        SSE2 = 1u << 0,
+        SSSE3 = 1u << 1,
+        SSE4_1 = 1u << 2,
+        SSE4_2 = 1u << 3,
+        POPCNT = 1u << 4,
+        AVX = 1u << 5,
+        AVX2 = 1u << 6,
+        BMI2 = 1u << 7,
+        FMA = 1u << 8,
+        AVX512F = 1u << 9,
+        AVX512BW = 1u << 10,
+        AVX512VL = 1u << 11,
+        AVX512CD = 1u << 12,
+        AVX512DQ = 1u << 13
+    };
+
+    static constexpr unsigned FeatureCount = 14;
+
+    /// \brief The AVX-512 subset of Skylake-SP and later, which "avx512" kernels are built for.
+    static constexpr uint32_t AVX512 = AVX512F | AVX512BW | AVX512CD | AVX512DQ | AVX512VL;
+
+    /// \brief Name of a single feature as used in LBU_CPU_FEATURES, e.g. "avx2".
+    LIBLBU_EXPORT const char* feature_name(Feature f);
+
+    /// \brief All features of the CPU usable under this OS, ignoring LBU_CPU_FEATURES.
+    uint32_t LIBLBU_EXPORT detected_features();
+
+    /// \brief The usable features, restricted by LBU_CPU_FEATURES.
+    uint32_t LIBLBU_EXPORT features();
+
+    inline bool has(uint32_t required)
+    {
+        return (features() & required) == required;
+    }
+
+    template< typename T >
+    struct candidate {
+        uint32_t required;
+        T value;
+    };
+
+    /// \brief The first candidate all required features of which are available.
+    ///
+    /// The last candidate should require nothing; it is also the result if none fits.
+    template< typename T, size_t N >
+    T select(const candidate<T> (&candidates)[N])
+    {
+        static_assert(N > 0);
+        for( const auto& c : candidates ) {
+            if( has(c.required) )
+                return c.value;
+        }
+        return candidates[N - 1].value;
+    }
+
+}
+}
+
+#endif
@@ -36,15 +36,20 @@ namespace lbu {
             return (f != -1) && (f & O_NONBLOCK);
         }
 
-        inline bool set_nonblock(bool nonblock, int* error)
+        // changed, if given, tells whether the flags had to be set (a second fcntl call)
+        inline bool set_nonblock(bool nonblock, int* error, bool* changed = nullptr)
         {
             int oldflags = ::fcntl(value, F_GETFL, 0);
             if( oldflags == -1 ) {
                 *error = errno;
                 return false;
             }
-            if( ::fcntl(value, F_SETFL, nonblock ? (oldflags | O_NONBLOCK)
-                                                 : (oldflags & (~O_NONBLOCK))) == -1 ) {
+            const int newflags = nonblock ? (oldflags | O_NONBLOCK) : (oldflags & (~O_NONBLOCK));
+            if( newflags == oldflags )
+                return true;
+            if( changed )
+                *changed = true;
+            if( ::fcntl(value, F_SETFL, newflags) == -1 ) {
                 *error = errno;
                 return false;
             }
@@ -6,6 +6,7 @@
 #define LIBLBU_FD_STREAM_H
 
 #include "lbu/abstract_stream.h"
+#include "lbu/page_memory.h"
 
 namespace lbu {
 namespace stream {
@@ -14,7 +15,10 @@ namespace stream {
         Automatic,          // the stream will update the blocking state of the fd for each request accordingly
         AlwaysBlocking,     // the stream assumes the fd will always block and will never change its blocking state
                             // - read or write operation requesting non-blocking will generate an EINVAL error
-        AlwaysNonBlocking   // same principle as above
+        AlwaysNonBlocking,  // same principle as above
+        NonBlockingPoll     // the stream makes the fd non-blocking once when it is set and keeps it so,
+                            // blocking requests poll until the fd is ready and retry - this avoids the
+                            // fcntl calls of Automatic when mixing blocking and non-blocking requests
     };
 
 
@@ -83,12 +87,18 @@ namespace stream {
     };
 
 
-    // convenience classes that use malloced buffers
+    // Convenience classes that use malloced buffers.
+    //
+    // The constructors taking an int* error do not call unexpected_memory_exhaustion():
+    // they set *error to 0, or to ENOMEM if a buffer could not be allocated, in which
+    // case that stream works unbuffered.
 
     class socket_stream_pair {
     public:
         explicit LIBLBU_EXPORT socket_stream_pair(uint32_t bufsize = DefaultBufferSize);
         LIBLBU_EXPORT socket_stream_pair(uint32_t bufsize_read, uint32_t bufsize_write);
+        LIBLBU_EXPORT socket_stream_pair(uint32_t bufsize, int* error);
+        LIBLBU_EXPORT socket_stream_pair(uint32_t bufsize_read, uint32_t bufsize_write, int* error);
 
         LIBLBU_EXPORT ~socket_stream_pair();
 
@@ -110,6 +120,11 @@ namespace stream {
     class managed_fd_output_stream {
     public:
         explicit LIBLBU_EXPORT managed_fd_output_stream(uint32_t bufsize = DefaultBufferSize);
+        LIBLBU_EXPORT managed_fd_output_stream(uint32_t bufsize, int* error);
+        /// \brief With the buffer mapped by page_alloc, e.g. on a NUMA node or with huge pages.
+        ///
+        /// On failure *error is set to the errno value and the stream is unbuffered.
+        LIBLBU_EXPORT managed_fd_output_stream(uint32_t bufsize, const page_options& options, int* error);
         explicit managed_fd_output_stream(unique_fd f,
                                           FdBlockingState b = FdBlockingState::Automatic,
                                           uint32_t bufsize = DefaultBufferSize)
@@ -127,11 +142,18 @@ namespace stream {
 
     private:
         fd_output_stream out;
+        page_options paging;
+        uint32_t paged_size = 0;    // 0 if the buffer is malloced
     };
 
     class managed_fd_input_stream {
     public:
         explicit LIBLBU_EXPORT managed_fd_input_stream(uint32_t bufsize = DefaultBufferSize);
+        LIBLBU_EXPORT managed_fd_input_stream(uint32_t bufsize, int* error);
+        /// \brief With the buffer mapped by page_alloc, e.g. on a NUMA node or with huge pages.
+        ///
+        /// On failure *error is set to the errno value and the stream is unbuffered.
+        LIBLBU_EXPORT managed_fd_input_stream(uint32_t bufsize, const page_options& options, int* error);
         explicit managed_fd_input_stream(unique_fd f,
                                          FdBlockingState b = FdBlockingState::Automatic,
                                          uint32_t bufsize = DefaultBufferSize)
@@ -149,6 +171,8 @@ namespace stream {
 
     private:
         fd_input_stream in;
+        page_options paging;
+        uint32_t paged_size = 0;    // 0 if the buffer is malloced
     };
 
 }
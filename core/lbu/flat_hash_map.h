@@ -0,0 +1,540 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef LIBLBU_FLAT_HASH_MAP_H
+#define LIBLBU_FLAT_HASH_MAP_H
+
+#include "lbu/dynamic_memory.h"
+#include "lbu/endian.h"
+#include "lbu/hash.h"
+#include "lbu/memory.h"
+
+#include <cassert>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <new>
+#include <tuple>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Open addressing hash map in the style of Swiss tables.
+//
+// Next to the slot array there is one control byte per slot: either Empty, Deleted
+// or, for a used slot, the low 7 bits of the key's hash. Lookups probe groups of 16
+// (SSE2) resp. 8 (portable SWAR) control bytes at once and only compare keys of slots
+// whose control byte matches. The table grows at a load factor of 7/8.
+//
+// Erasing marks a slot Empty instead of Deleted whenever no probe sequence can have
+// passed over it (i.e. the group window around it was never completely full), so
+// tombstones only accumulate in crowded tables and are cleaned up by the next
+// rehash.
+//
+// Control bytes and slots share one allocation (through lbu::xmalloc with the slot
+// alignment). Like with std::unordered_map, any insertion may invalidate iterators
+// and references, erase only invalidates the erased element.
+
+namespace lbu {
+
+namespace detail {
+
+    enum : int8_t {
+        HashCtrlEmpty = -128,  // 0b10000000
+        HashCtrlDeleted = -2,  // 0b11111110
+    };
+
+    inline int8_t* hash_empty_group();
+
+    // bit mask with one (SSE2) or eight (SWAR) bits per slot, iterates over set slots
+    template< typename MaskType, unsigned Width, unsigned Shift >
+    class hash_bit_mask {
+    public:
+        explicit hash_bit_mask(MaskType m) : mask(m) {}
+
+        explicit operator bool() const { return mask != 0; }
+
+        unsigned lowest() const { return unsigned(__builtin_ctzll(mask)) >> Shift; }
+        unsigned trailing_zeros() const { return mask == 0 ? Width : lowest(); }
+        unsigned leading_zeros() const
+        {
+            constexpr unsigned extra = 64 - Width * (1u << Shift);
+            return mask == 0 ? Width : (unsigned(__builtin_clzll(uint64_t(mask))) - extra) >> Shift;
+        }
+
+        hash_bit_mask& operator++()
+        {
+            mask &= MaskType(mask - 1);
+            return *this;
+        }
+        unsigned operator*() const { return lowest(); }
+
+        hash_bit_mask begin() const { return *this; }
+        hash_bit_mask end() const { return hash_bit_mask(0); }
+        bool operator!=(const hash_bit_mask& o) const { return mask != o.mask; }
+
+    private:
+        MaskType mask;
+    };
+
+#if defined(__SSE2__)
+    struct hash_group {
+        static constexpr unsigned Width = 16;
+        using mask = hash_bit_mask<uint32_t, 16, 0>;
+
+        explicit hash_group(const int8_t* ctrl) : ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl))) {}
+
+        mask match(uint8_t h2) const
+        {
+            return mask(uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(char(h2)), ctrl))));
+        }
+        mask match_empty() const
+        {
+            return mask(uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(HashCtrlEmpty), ctrl))));
+        }
+        mask match_empty_or_deleted() const
+        {
+            // both have the sign bit set, full slots don't
+            return mask(uint32_t(_mm_movemask_epi8(ctrl)));
+        }
+
+        __m128i ctrl;
+    };
+#else
+    struct hash_group {
+        static constexpr unsigned Width = 8;
+        using mask = hash_bit_mask<uint64_t, 8, 3>;
+
+        static constexpr uint64_t Lsbs = 0x0101010101010101ull;
+        static constexpr uint64_t Msbs = 0x8080808080808080ull;
+
+        explicit hash_group(const int8_t* ctrl) : ctrl(from_little_endian<uint64_t>(ctrl)) {}
+
+        // may report false positives (for the byte after a match), which the key
+        // comparison filters out
+        mask match(uint8_t h2) const
+        {
+            const uint64_t x = ctrl ^ (Lsbs * h2);
+            return mask((x - Lsbs) & ~x & Msbs);
+        }
+        mask match_empty() const { return mask((ctrl & ~(ctrl << 6)) & Msbs); }
+        mask match_empty_or_deleted() const { return mask(ctrl & Msbs); }
+
+        uint64_t ctrl;
+    };
+#endif
+
+    inline int8_t* hash_empty_group()
+    {
+        alignas(16) static int8_t group[16] = {
+            HashCtrlEmpty, HashCtrlEmpty, HashCtrlEmpty, HashCtrlEmpty, HashCtrlEmpty, HashCtrlEmpty,
+            HashCtrlEmpty, HashCtrlEmpty, HashCtrlEmpty, HashCtrlEmpty, HashCtrlEmpty, HashCtrlEmpty,
+            HashCtrlEmpty, HashCtrlEmpty, HashCtrlEmpty, HashCtrlEmpty
+        };
+        return group;
+    }
+
+}
+
+
+    template< typename Key, typename Value,
+              typename Hash = hash::hasher<Key>,
+              typename KeyEqual = std::equal_to<Key> >
+    class flat_hash_map {
+        using group = detail::hash_group;
+
+    public:
+        using key_type = Key;
+        using mapped_type = Value;
+        using value_type = std::pair<const Key, Value>;
+        using size_type = size_t;
+        using hasher = Hash;
+        using key_equal = KeyEqual;
+
+        template< bool Const >
+        class basic_iterator {
+            friend class flat_hash_map;
+            template< bool > friend class basic_iterator;
+            using map_pointer = std::conditional_t<Const, const flat_hash_map*, flat_hash_map*>;
+
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = flat_hash_map::value_type;
+            using difference_type = ptrdiff_t;
+            using pointer = std::conditional_t<Const, const value_type*, value_type*>;
+            using reference = std::conditional_t<Const, const value_type&, value_type&>;
+
+            basic_iterator() = default;
+            template< bool C = Const, typename = std::enable_if_t<C> >
+            basic_iterator(const basic_iterator<false>& o) : map(o.map), index(o.index) {}
+
+            reference operator*() const { return map->slots[index]; }
+            pointer operator->() const { return &map->slots[index]; }
+
+            basic_iterator& operator++()
+            {
+                index = map->next_full(index + 1);
+                return *this;
+            }
+            basic_iterator operator++(int)
+            {
+                auto tmp = *this;
+                ++(*this);
+                return tmp;
+            }
+
+            bool operator==(const basic_iterator& o) const { return index == o.index; }
+            bool operator!=(const basic_iterator& o) const { return index != o.index; }
+
+        private:
+            basic_iterator(map_pointer m, size_t i) : map(m), index(i) {}
+
+            map_pointer map = {};
+            size_t index = 0;
+        };
+
+        using iterator = basic_iterator<false>;
+        using const_iterator = basic_iterator<true>;
+
+        flat_hash_map() = default;
+
+        explicit flat_hash_map(size_t expected_size, const Hash& h = Hash(), const KeyEqual& eq = KeyEqual())
+            : hash_fn(h)
+            , eq_fn(eq)
+        {
+            reserve(expected_size);
+        }
+
+        flat_hash_map(const flat_hash_map& other)
+            : hash_fn(other.hash_fn)
+            , eq_fn(other.eq_fn)
+        {
+            reserve(other.size());
+            for( const auto& v : other )
+                insert_unique(hash_of(v.first), v);
+        }
+
+        flat_hash_map(flat_hash_map&& other) noexcept
+            : hash_fn(std::move(other.hash_fn))
+            , eq_fn(std::move(other.eq_fn))
+        {
+            take(other);
+        }
+
+        ~flat_hash_map() { destroy(); }
+
+        flat_hash_map& operator=(const flat_hash_map& other)
+        {
+            if( this != &other ) {
+                flat_hash_map tmp(other);
+                *this = std::move(tmp);
+            }
+            return *this;
+        }
+
+        flat_hash_map& operator=(flat_hash_map&& other) noexcept
+        {
+            if( this != &other ) {
+                destroy();
+                hash_fn = std::move(other.hash_fn);
+                eq_fn = std::move(other.eq_fn);
+                take(other);
+            }
+            return *this;
+        }
+
+        iterator begin() { return {this, next_full(0)}; }
+        iterator end() { return {this, cap}; }
+        const_iterator begin() const { return {this, next_full(0)}; }
+        const_iterator end() const { return {this, cap}; }
+
+        size_t size() const { return count; }
+        bool is_empty() const { return count == 0; }
+        size_t capacity() const { return cap; }
+
+        iterator find(const Key& key) { return {this, find_index(key, hash_of(key))}; }
+        const_iterator find(const Key& key) const { return {this, find_index(key, hash_of(key))}; }
+        bool contains(const Key& key) const { return find_index(key, hash_of(key)) != cap; }
+
+        Value* lookup(const Key& key)
+        {
+            const size_t i = find_index(key, hash_of(key));
+            return i == cap ? nullptr : &slots[i].second;
+        }
+        const Value* lookup(const Key& key) const { return const_cast<flat_hash_map*>(this)->lookup(key); }
+
+        template< typename... Args >
+        std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args)
+        {
+            return emplace_key(key, std::forward<Args>(args)...);
+        }
+
+        template< typename... Args >
+        std::pair<iterator, bool> try_emplace(Key&& key, Args&&... args)
+        {
+            return emplace_key(std::move(key), std::forward<Args>(args)...);
+        }
+
+        std::pair<iterator, bool> insert(const value_type& v) { return try_emplace(v.first, v.second); }
+        std::pair<iterator, bool> insert(value_type&& v)
+        {
+            return try_emplace(std::move(const_cast<Key&>(v.first)), std::move(v.second));
+        }
+
+        template< typename V >
+        std::pair<iterator, bool> insert_or_assign(const Key& key, V&& value)
+        {
+            auto r = try_emplace(key, std::forward<V>(value));
+            if( ! r.second )
+                r.first->second = std::forward<V>(value);
+            return r;
+        }
+
+        Value& operator[](const Key& key) { return try_emplace(key).first->second; }
+        Value& operator[](Key&& key) { return try_emplace(std::move(key)).first->second; }
+
+        size_t erase(const Key& key)
+        {
+            const size_t i = find_index(key, hash_of(key));
+            if( i == cap )
+                return 0;
+            erase_index(i);
+            return 1;
+        }
+
+        /// \brief Erase the element at \p it, returns the iterator to the next element.
+        iterator erase(const_iterator it)
+        {
+            erase_index(it.index);
+            return {this, next_full(it.index + 1)};
+        }
+
+        void clear()
+        {
+            if( cap == 0 )
+                return;
+            destroy_slots();
+            std::memset(ctrl, detail::HashCtrlEmpty, cap + group::Width);
+            count = 0;
+            growth_left = max_load(cap);
+        }
+
+        /// \brief Make room for \p n elements without further rehashing.
+        void reserve(size_t n)
+        {
+            size_t c = cap;
+            while( max_load(c) < n )
+                c = c == 0 ? group::Width : 2 * c;
+            if( c != cap )
+                rehash(c);
+        }
+
+        const Hash& hash_function() const { return hash_fn; }
+        const KeyEqual& key_eq() const { return eq_fn; }
+
+    private:
+        template< typename K, typename... Args >
+        std::pair<iterator, bool> emplace_key(K&& key, Args&&... args)
+        {
+            const uint64_t h = hash_of(key);
+            size_t i = find_index(key, h);
+            if( i != cap )
+                return {{this, i}, false};
+            i = prepare_insert(h);
+            new (&slots[i]) value_type(std::piecewise_construct,
+                                       std::forward_as_tuple(std::forward<K>(key)),
+                                       std::forward_as_tuple(std::forward<Args>(args)...));
+            return {{this, i}, true};
+        }
+
+        static constexpr size_t max_load(size_t capacity) { return capacity - capacity / 8; }
+
+        uint64_t hash_of(const Key& key) const { return uint64_t(hash_fn(key)); }
+        static uint8_t h2(uint64_t h) { return uint8_t(h & 0x7f); }
+        static size_t h1(uint64_t h) { return size_t(h >> 7); }
+
+        // probe sequence over groups, triangular steps visit every group once
+        struct probe {
+            size_t mask;
+            size_t offset;
+            size_t step = 0;
+
+            probe(size_t h, size_t capacity) : mask(capacity - 1), offset(h & (capacity - 1)) {}
+            size_t at(unsigned i) const { return (offset + i) & mask; }
+            void next()
+            {
+                step += group::Width;
+                offset = (offset + step) & mask;
+            }
+        };
+
+        size_t find_index(const Key& key, uint64_t h) const
+        {
+            if( cap == 0 )
+                return cap;
+            probe p(h1(h), cap);
+            while( true ) {
+                const group g(ctrl + p.offset);
+                for( unsigned i : g.match(h2(h)) ) {
+                    const size_t idx = p.at(i);
+                    if( eq_fn(slots[idx].first, key) )
+                        return idx;
+                }
+                if( g.match_empty() )
+                    return cap;
+                p.next();
+            }
+        }
+
+        size_t find_free(uint64_t h) const
+        {
+            probe p(h1(h), cap);
+            while( true ) {
+                const group g(ctrl + p.offset);
+                if( auto m = g.match_empty_or_deleted() )
+                    return p.at(m.lowest());
+                p.next();
+            }
+        }
+
+        void set_ctrl(size_t i, int8_t c)
+        {
+            ctrl[i] = c;
+            // the first group is mirrored behind the end, so group loads never wrap
+            if( i < group::Width )
+                ctrl[cap + i] = c;
+        }
+
+        size_t prepare_insert(uint64_t h)
+        {
+            size_t i = cap == 0 ? cap : find_free(h);
+            if( cap == 0 || (growth_left == 0 && ctrl[i] == detail::HashCtrlEmpty) ) {
+                // mostly tombstones: clean up in place, otherwise grow
+                rehash(cap == 0 ? group::Width : (count < max_load(cap) / 2 ? cap : 2 * cap));
+                i = find_free(h);
+            }
+            if( ctrl[i] == detail::HashCtrlEmpty )
+                --growth_left;
+            set_ctrl(i, int8_t(h2(h)));
+            ++count;
+            return i;
+        }
+
+        // only for rehashing / copying, the key must not be present yet
+        template< typename... Args >
+        void insert_unique(uint64_t h, Args&&... args)
+        {
+            const size_t i = find_free(h);
+            set_ctrl(i, int8_t(h2(h)));
+            new (&slots[i]) value_type(std::forward<Args>(args)...);
+            --growth_left;
+            ++count;
+        }
+
+        void erase_index(size_t i)
+        {
+            slots[i].~value_type();
+            --count;
+            const size_t before = (i - group::Width) & (cap - 1);
+            const auto empty_after = group(ctrl + i).match_empty();
+            const auto empty_before = group(ctrl + before).match_empty();
+            const bool never_full = empty_before && empty_after
+                                    && empty_after.trailing_zeros() + empty_before.leading_zeros() < group::Width;
+            if( never_full ) {
+                set_ctrl(i, detail::HashCtrlEmpty);
+                ++growth_left;
+            } else {
+                set_ctrl(i, detail::HashCtrlDeleted);
+            }
+        }
+
+        size_t next_full(size_t i) const
+        {
+            while( i < cap && ctrl[i] < 0 )
+                ++i;
+            return i;
+        }
+
+        static dynamic_struct layout(size_t capacity, dynamic_struct::member_offset<value_type>* slot_offset)
+        {
+            dynamic_struct s;
+            s.add_member<int8_t>(capacity + group::Width);
+            *slot_offset = s.add_member<value_type>(capacity);
+            return s;
+        }
+
+        void rehash(size_t new_cap)
+        {
+            assert(is_pow2(new_cap) && new_cap >= group::Width && max_load(new_cap) >= count);
+            int8_t* old_ctrl = ctrl;
+            value_type* old_slots = slots;
+            const size_t old_cap = cap;
+
+            dynamic_struct::member_offset<value_type> slot_offset;
+            const auto s = layout(new_cap, &slot_offset);
+            void* mem = xmalloc(s.storage());
+            ctrl = static_cast<int8_t*>(mem);
+            slots = static_cast<value_type*>(s.resolve(mem, slot_offset));
+            cap = new_cap;
+            count = 0;
+            growth_left = max_load(new_cap);
+            std::memset(ctrl, detail::HashCtrlEmpty, cap + group::Width);
+
+            for( size_t i = 0; i < old_cap; ++i ) {
+                if( old_ctrl[i] >= 0 ) {
+                    value_type& v = old_slots[i];
+                    const uint64_t h = hash_of(v.first);
+                    // the key is const only towards the user, moving it out is fine here
+                    insert_unique(h, std::move(const_cast<Key&>(v.first)), std::move(v.second));
+                    v.~value_type();
+                }
+            }
+            if( old_cap > 0 )
+                ::free(old_ctrl);
+        }
+
+        void destroy_slots()
+        {
+            if constexpr( ! std::is_trivially_destructible_v<value_type> ) {
+                for( size_t i = 0; i < cap; ++i ) {
+                    if( ctrl[i] >= 0 )
+                        slots[i].~value_type();
+                }
+            }
+        }
+
+        void destroy()
+        {
+            if( cap == 0 )
+                return;
+            destroy_slots();
+            ::free(ctrl);
+            ctrl = detail::hash_empty_group();
+            slots = {};
+            cap = count = growth_left = 0;
+        }
+
+        void take(flat_hash_map& other)
+        {
+            ctrl = std::exchange(other.ctrl, detail::hash_empty_group());
+            slots = std::exchange(other.slots, nullptr);
+            cap = std::exchange(other.cap, 0);
+            count = std::exchange(other.count, 0);
+            growth_left = std::exchange(other.growth_left, 0);
+        }
+
+        int8_t* ctrl = detail::hash_empty_group();
+        value_type* slots = {};
+        size_t cap = 0;
+        size_t count = 0;
+        size_t growth_left = 0;
+        Hash hash_fn;
+        KeyEqual eq_fn;
+    };
+
+}
+
+#endif
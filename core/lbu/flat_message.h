@@ -0,0 +1,406 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef LIBLBU_FLAT_MESSAGE_H
+#define LIBLBU_FLAT_MESSAGE_H
+
+#include "lbu/array_ref.h"
+#include "lbu/byte_buffer.h"
+#include "lbu/endian.h"
+#include "lbu/memory.h"
+
+#include <type_traits>
+#include <vector>
+
+// Flat messages that are read in place, without a decoding step.
+//
+// A flat_layout describes the fixed part of a message (built on dynamic_struct):
+// scalars, fixed size arrays and references to variable sized arrays. A message
+// consists of the fixed part followed by the data of the variable arrays, each
+// aligned to its element type relative to the message start:
+//
+//   [ u32 message size | fixed fields ... | variable array data ... ]
+//
+// A variable array reference is stored as u32 offset (from the message start) and
+// u32 element count. All values are little endian, so on little endian hosts the
+// accessors compile to plain loads.
+//
+// flat_builder writes a message into raw memory (e.g. a ring_spsc write window) or
+// appends it to a byte_buffer; flat_view reads fields straight from an
+// array_ref<const void>. Accessors do not check bounds (besides asserts), call
+// flat_view::verify once for untrusted input.
+//
+// Both sides must use an identical layout, i.e. the same add_* calls in the same
+// order; the format carries no schema information.
+
+namespace lbu {
+
+namespace detail {
+
+    template< typename T >
+    constexpr bool is_flat_scalar_v = std::is_arithmetic_v<T> || std::is_enum_v<T>;
+
+    template< typename T >
+    T flat_load(const char* src)
+    {
+        static_assert(is_flat_scalar_v<T>);
+        if constexpr( std::is_enum_v<T> ) {
+            return T(flat_load<std::underlying_type_t<T>>(src));
+        } else if constexpr( std::is_same_v<T, bool> ) {
+            return *src != 0;
+        } else if constexpr( sizeof(T) == 1 ) {
+            return byte_reinterpret_cast<T>(src);
+        } else {
+            return from_little_endian<T>(src);
+        }
+    }
+
+    template< typename T >
+    void flat_store(T v, char* dst)
+    {
+        static_assert(is_flat_scalar_v<T>);
+        if constexpr( std::is_enum_v<T> ) {
+            flat_store<std::underlying_type_t<T>>(std::underlying_type_t<T>(v), dst);
+        } else if constexpr( std::is_same_v<T, bool> ) {
+            *dst = char(v ? 1 : 0);
+        } else if constexpr( sizeof(T) == 1 ) {
+            std::memcpy(dst, &v, 1);
+        } else {
+            to_little_endian<T>(v, dst);
+        }
+    }
+
+}
+
+    template< typename T >
+    struct flat_field {
+        size_t offset;
+    };
+
+    template< typename T >
+    struct flat_array_field {
+        size_t offset;
+        size_t count;
+    };
+
+    template< typename T >
+    struct flat_vector_field {
+        size_t offset;
+    };
+
+
+    class flat_layout {
+    public:
+        static constexpr size_t SizeFieldOffset = 0;
+        static constexpr size_t VectorRefSize = 2 * sizeof(uint32_t);
+
+        flat_layout()
+        {
+            s.add_member<uint32_t>();
+        }
+
+        template< typename T >
+        flat_field<T> add_scalar()
+        {
+            static_assert(detail::is_flat_scalar_v<T>);
+            return { s.add_member_raw({sizeof(T), sizeof(T)}).offset };
+        }
+
+        template< typename T >
+        flat_array_field<T> add_array(size_t count)
+        {
+            static_assert(detail::is_flat_scalar_v<T>);
+            assert(count > 0);
+            return { s.add_member_raw({count * sizeof(T), sizeof(T)}).offset, count };
+        }
+
+        template< typename T >
+        flat_vector_field<T> add_vector()
+        {
+            static_assert(detail::is_flat_scalar_v<T>);
+            const size_t off = s.add_member<uint32_t>(2).offset;
+            vectors.push_back({off, sizeof(T)});
+            return { off };
+        }
+
+        /// \brief Size of the fixed part (including the message size field).
+        size_t fixed_size() const
+        {
+            auto tmp = s;
+            tmp.add_align_padding(s.storage().align);
+            return tmp.storage().size;
+        }
+
+        /// \brief Alignment the message start needs for all fields to be naturally aligned.
+        size_t alignment() const { return s.storage().align; }
+
+        struct vector_info {
+            size_t offset;
+            size_t element_size;
+        };
+        array_ref<const vector_info> vector_fields() const { return {vectors.data(), vectors.size()}; }
+
+    private:
+        dynamic_struct s;
+        std::vector<vector_info> vectors;
+    };
+
+
+    class flat_builder {
+    public:
+        /// \brief Build a message in \p target.
+        ///
+        /// If the message does not fit, has_error() becomes true and further writes are ignored.
+        flat_builder(const flat_layout& layout, array_ref<void> target)
+            : fixed_target(target.array_static_cast<char>())
+        {
+            start(layout);
+        }
+
+        /// \brief Build a message appended to \p target.
+        flat_builder(const flat_layout& layout, byte_buffer* target)
+            : buffer(target)
+            , buffer_start(target->size())
+        {
+            start(layout);
+        }
+
+        template< typename T >
+        void set(flat_field<T> f, T value)
+        {
+            if( ! error )
+                detail::flat_store<T>(value, base() + f.offset);
+        }
+
+        template< typename T >
+        void set(flat_array_field<T> f, size_t index, T value)
+        {
+            assert(index < f.count);
+            if( ! error )
+                detail::flat_store<T>(value, base() + f.offset + index * sizeof(T));
+        }
+
+        template< typename T >
+        void set(flat_array_field<T> f, array_ref<const T> values)
+        {
+            assert(values.size() <= f.count);
+            if( error )
+                return;
+            store_array(base() + f.offset, values);
+        }
+
+        /// \brief Append the elements of a variable array and store the reference to them.
+        template< typename T >
+        void set(flat_vector_field<T> f, array_ref<const T> values)
+        {
+            if( error )
+                return;
+            const size_t off = align_up(used, alignof(T) > sizeof(T) ? sizeof(T) : alignof(T));
+            if( ! grow(off + values.byte_size()) || values.size() > std::numeric_limits<uint32_t>::max() ) {
+                error = true;
+                return;
+            }
+            char* b = base();
+            std::memset(b + used, 0, off - used);
+            store_array(b + off, values);
+            used = off + values.byte_size();
+            to_little_endian<uint32_t>(values.size() > 0 ? uint32_t(off) : 0, b + f.offset);
+            to_little_endian<uint32_t>(uint32_t(values.size()), b + f.offset + sizeof(uint32_t));
+        }
+
+        void set_bytes(flat_vector_field<char> f, array_ref<const void> data)
+        {
+            set(f, data.array_static_cast<const char>());
+        }
+
+        bool has_error() const { return error; }
+
+        /// \brief Current message size.
+        size_t size() const { return used; }
+
+        /// \brief Finalize the message size field and return the message.
+        ///
+        /// For byte_buffer targets the returned ref is invalidated by any modification of the buffer.
+        array_ref<void> finish()
+        {
+            if( error )
+                return {};
+            to_little_endian<uint32_t>(uint32_t(used), base() + flat_layout::SizeFieldOffset);
+            return array_ref<char>(base(), used);
+        }
+
+        flat_builder(const flat_builder&) = delete;
+        flat_builder& operator=(const flat_builder&) = delete;
+
+    private:
+        void start(const flat_layout& layout)
+        {
+            const size_t n = layout.fixed_size();
+            if( ! grow(n) ) {
+                error = true;
+                return;
+            }
+            std::memset(base(), 0, n);
+            used = n;
+        }
+
+        char* base()
+        {
+            if( buffer )
+                return static_cast<char*>(buffer->data()) + buffer_start;
+            return fixed_target.data();
+        }
+
+        bool grow(size_t size)
+        {
+            if( size > std::numeric_limits<uint32_t>::max() )
+                return false;
+            if( buffer == nullptr )
+                return size <= fixed_target.size();
+            if( size > byte_buffer::max_size() - buffer_start )
+                return false;
+            if( buffer->size() < buffer_start + size )
+                buffer->resize(buffer_start + size);
+            return true;
+        }
+
+        template< typename T >
+        static void store_array(char* dst, array_ref<const T> values)
+        {
+            if constexpr( sizeof(T) == 1 || (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ && ! std::is_same_v<T, bool>) ) {
+                std::memcpy(dst, values.data(), values.byte_size());
+            } else {
+                for( const auto& v : values ) {
+                    detail::flat_store<T>(v, dst);
+                    dst += sizeof(T);
+                }
+            }
+        }
+
+        array_ref<char> fixed_target;
+        byte_buffer* buffer = {};
+        size_t buffer_start = 0;
+        size_t used = 0;
+        bool error = false;
+    };
+
+
+    template< typename T >
+    class flat_vector_view {
+    public:
+        flat_vector_view() = default;
+        flat_vector_view(const char* data, uint32_t count) : d(data), n(count) {}
+
+        uint32_t size() const { return n; }
+        bool is_empty() const { return n == 0; }
+
+        T operator[](uint32_t idx) const
+        {
+            assert(idx < n);
+            return detail::flat_load<T>(d + size_t(idx) * sizeof(T));
+        }
+
+        /// \brief The elements as raw (little endian) bytes.
+        array_ref<const char> bytes() const { return {d, size_t(n) * sizeof(T)}; }
+
+        /// \brief Direct typed access, only possible on little endian hosts for suitably aligned data.
+        ///
+        /// Returns an empty ref otherwise.
+        array_ref<const T> direct() const
+        {
+            if constexpr( __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ && ! std::is_same_v<T, bool> && ! std::is_enum_v<T> ) {
+                if( is_aligned<T>(d) )
+                    return {reinterpret_cast<const T*>(d), n};
+            }
+            return {};
+        }
+
+    private:
+        const char* d = {};
+        uint32_t n = 0;
+    };
+
+
+    class flat_view {
+    public:
+        flat_view() = default;
+
+        /// \brief View of the message at the start of \p data (which may extend past the message).
+        explicit flat_view(array_ref<const void> data)
+            : d(static_cast<const char*>(data.data()))
+            , n(data.byte_size())
+        {
+        }
+
+        /// \brief Size of the message as stored in its size field.
+        ///
+        /// \p data must contain at least 4 bytes.
+        static uint32_t message_size(array_ref<const void> data)
+        {
+            assert(data.byte_size() >= sizeof(uint32_t));
+            return from_little_endian<uint32_t>(static_cast<const char*>(data.data()) + flat_layout::SizeFieldOffset);
+        }
+
+        uint32_t size() const { return message_size(array_ref<const char>(d, n)); }
+        array_ref<const void> data() const { return array_ref<const char>(d, size()); }
+
+        /// \brief Check that the message is complete and all variable array references are in bounds.
+        bool verify(const flat_layout& layout) const
+        {
+            const size_t fixed = layout.fixed_size();
+            if( n < fixed )
+                return false;
+            const size_t total = size();
+            if( total < fixed || total > n )
+                return false;
+            for( const auto& v : layout.vector_fields() ) {
+                const size_t off = from_little_endian<uint32_t>(d + v.offset);
+                const size_t count = from_little_endian<uint32_t>(d + v.offset + sizeof(uint32_t));
+                if( count == 0 )
+                    continue;
+                if( off < fixed || off > total || count > (total - off) / v.element_size )
+                    return false;
+            }
+            return true;
+        }
+
+        template< typename T >
+        T get(flat_field<T> f) const
+        {
+            assert(f.offset + sizeof(T) <= n);
+            return detail::flat_load<T>(d + f.offset);
+        }
+
+        template< typename T >
+        T get(flat_array_field<T> f, size_t index) const
+        {
+            assert(index < f.count && f.offset + (index + 1) * sizeof(T) <= n);
+            return detail::flat_load<T>(d + f.offset + index * sizeof(T));
+        }
+
+        template< typename T >
+        flat_vector_view<T> get(flat_array_field<T> f) const
+        {
+            assert(f.offset + f.count * sizeof(T) <= n);
+            return { d + f.offset, uint32_t(f.count) };
+        }
+
+        template< typename T >
+        flat_vector_view<T> get(flat_vector_field<T> f) const
+        {
+            assert(f.offset + flat_layout::VectorRefSize <= n);
+            const auto off = from_little_endian<uint32_t>(d + f.offset);
+            const auto count = from_little_endian<uint32_t>(d + f.offset + sizeof(uint32_t));
+            assert(count == 0 || size_t(off) + size_t(count) * sizeof(T) <= n);
+            return { d + off, count };
+        }
+
+    private:
+        const char* d = {};
+        size_t n = 0;
+    };
+
+}
+
+#endif
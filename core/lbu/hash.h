@@ -0,0 +1,140 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef LIBLBU_HASH_H
+#define LIBLBU_HASH_H
+
+#include "lbu/array_ref.h"
+#include "lbu/endian.h"
+
+#include <cstring>
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// Fast non-cryptographic hashing, following the construction of wyhash (final 4):
+// 64x64->128 bit multiply-and-fold mixing, reading the input in 8 byte words and
+// covering short inputs with overlapping reads.
+//
+// The results are stable across runs and hosts for the same seed, but are not
+// compatible with other wyhash implementations and must not be used where hash
+// flooding by untrusted input is a concern (unless seeded with a secret).
+
+namespace lbu {
+namespace hash {
+
+namespace detail {
+
+    __extension__ typedef unsigned __int128 uint128;
+
+    constexpr uint64_t Secret[4] = {0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull,
+                                    0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull};
+
+    inline void mum(uint64_t* a, uint64_t* b)
+    {
+        const uint128 r = uint128(*a) * *b;
+        *a = uint64_t(r);
+        *b = uint64_t(r >> 64);
+    }
+
+    inline uint64_t mix(uint64_t a, uint64_t b)
+    {
+        mum(&a, &b);
+        return a ^ b;
+    }
+
+    inline uint64_t read8(const char* p) { return from_little_endian<uint64_t>(p); }
+    inline uint64_t read4(const char* p) { return from_little_endian<uint32_t>(p); }
+
+    // 1 to 3 bytes
+    inline uint64_t read3(const char* p, size_t k)
+    {
+        return (uint64_t(uint8_t(p[0])) << 16) | (uint64_t(uint8_t(p[k >> 1])) << 8) | uint8_t(p[k - 1]);
+    }
+
+}
+
+    inline uint64_t hash_bytes(const void* data, size_t size, uint64_t seed = 0)
+    {
+        using namespace detail;
+        const char* p = static_cast<const char*>(data);
+        seed ^= mix(seed ^ Secret[0], Secret[1]);
+        uint64_t a, b;
+        if( size <= 16 ) {
+            if( size >= 4 ) {
+                const size_t off = (size >> 3) << 2;
+                a = (read4(p) << 32) | read4(p + off);
+                b = (read4(p + size - 4) << 32) | read4(p + size - 4 - off);
+            } else if( size > 0 ) {
+                a = read3(p, size);
+                b = 0;
+            } else {
+                a = b = 0;
+            }
+        } else {
+            size_t i = size;
+            if( i > 48 ) {
+                uint64_t see1 = seed, see2 = seed;
+                do {
+                    seed = mix(read8(p) ^ Secret[1], read8(p + 8) ^ seed);
+                    see1 = mix(read8(p + 16) ^ Secret[2], read8(p + 24) ^ see1);
+                    see2 = mix(read8(p + 32) ^ Secret[3], read8(p + 40) ^ see2);
+                    p += 48;
+                    i -= 48;
+                } while( i > 48 );
+                seed ^= see1 ^ see2;
+            }
+            while( i > 16 ) {
+                seed = mix(read8(p) ^ Secret[1], read8(p + 8) ^ seed);
+                i -= 16;
+                p += 16;
+            }
+            a = read8(p + i - 16);
+            b = read8(p + i - 8);
+        }
+        a ^= Secret[1];
+        b ^= seed;
+        mum(&a, &b);
+        return mix(a ^ Secret[0] ^ size, b ^ Secret[1]);
+    }
+
+    inline uint64_t hash_u64(uint64_t v, uint64_t seed = 0)
+    {
+        using namespace detail;
+        uint64_t a = v ^ Secret[0];
+        uint64_t b = seed ^ Secret[1];
+        mum(&a, &b);
+        return mix(a ^ Secret[0], b ^ Secret[1]);
+    }
+
+
+    /// \brief Hash function object, used by flat_hash_map.
+    ///
+    /// Specialize for own key types (or pass a custom hasher to the container).
+    template< typename T, typename Enable = void >
+    struct hasher;
+
+    template< typename T >
+    struct hasher<T, std::enable_if_t<std::is_integral_v<T> || std::is_enum_v<T>>> {
+        uint64_t operator()(T v) const { return hash_u64(uint64_t(v)); }
+    };
+
+    template< typename T >
+    struct hasher<T*> {
+        uint64_t operator()(const T* p) const { return hash_u64(uint64_t(reinterpret_cast<uintptr_t>(p))); }
+    };
+
+    template<>
+    struct hasher<std::string_view> {
+        uint64_t operator()(std::string_view s) const { return hash_bytes(s.data(), s.size()); }
+    };
+
+    template<>
+    struct hasher<std::string> : hasher<std::string_view> {};
+
+}
+}
+
+#endif
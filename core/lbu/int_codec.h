@@ -0,0 +1,218 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef LIBLBU_INT_CODEC_H
+#define LIBLBU_INT_CODEC_H
+
+#include "lbu/lbu_global.h"
+#include "lbu/abstract_stream.h"
+#include "lbu/array_ref.h"
+#include "lbu/varint.h"
+
+#include <limits>
+#include <stdint.h>
+#include <type_traits>
+#include <vector>
+
+// Compression of uint32_t / uint64_t arrays, the building blocks for compact
+// columnar buffers.
+//
+// Bit packing stores each value with a fixed number of bits. uint32_t values are
+// packed in blocks of 128 values spread over four 32 bit lanes (value i goes to lane
+// i % 4), so a block unpacks with a few SIMD shift/mask operations per value group;
+// the kernels are instantiated for every bit width. A trailing partial block and
+// uint64_t values use a plain little endian bit stream. In both cases the packed size
+// of n values is exactly `packed_size(n, bits)`.
+//
+// The transforms turn arrays into small values before packing:
+//
+//  * frame of reference: subtract the minimum
+//  * delta: difference to the previous value (for sorted arrays)
+//  * delta of delta: zigzag coded difference of consecutive deltas (for time stamps
+//    with a mostly regular interval)
+//
+// All transforms use wrapping arithmetic and are lossless for any input, they just
+// don't compress well on data they are not meant for.
+//
+// encode/decode combine a transform and bit packing into a self describing block:
+//
+//   [ u8 transform | u8 bits | u8 value size | u8 0 | u32 count | u64 reference |
+//     u64 reference delta | packed values ]
+//
+// The references are the transform's start state: the frame of reference minimum,
+// the value preceding the first one for the delta transforms, and the delta
+// preceding the first one for delta of delta.
+
+namespace lbu {
+namespace int_codec {
+
+    enum class Transform : uint8_t {
+        None = 0,
+        FrameOfReference = 1,
+        Delta = 2,
+        DeltaOfDelta = 3
+    };
+
+    static constexpr size_t BlockSize = 128;
+    static constexpr size_t HeaderSize = 24;
+
+    constexpr size_t packed_size(size_t count, unsigned bits) { return (count * bits + 7) / 8; }
+
+    template< typename UIntType >
+    constexpr unsigned bit_width(UIntType v)
+    {
+        static_assert(std::is_unsigned_v<UIntType>);
+        unsigned n = 0;
+        while( v != 0 ) {
+            v >>= 1;
+            ++n;
+        }
+        return n;
+    }
+
+    /// \brief Number of bits needed to pack all \p values.
+    template< typename UIntType >
+    unsigned required_bits(array_ref<const UIntType> values)
+    {
+        UIntType acc = 0;
+        for( auto v : values )
+            acc |= v;
+        return bit_width(acc);
+    }
+
+    /// \brief Pack \p values with \p bits each to \p dst, which must hold `packed_size(values.size(), bits)`.
+    ///
+    /// All values must be representable with \p bits.
+    void LIBLBU_EXPORT pack(array_ref<const uint32_t> values, unsigned bits, char* dst);
+    void LIBLBU_EXPORT pack(array_ref<const uint64_t> values, unsigned bits, char* dst);
+
+    /// \brief Unpack `values.size()` values with \p bits each from \p src.
+    void LIBLBU_EXPORT unpack(const char* src, unsigned bits, array_ref<uint32_t> values);
+    void LIBLBU_EXPORT unpack(const char* src, unsigned bits, array_ref<uint64_t> values);
+
+
+    // in place transforms, \p prev is the value preceding the array
+
+    template< typename UIntType >
+    void for_encode(array_ref<UIntType> values, UIntType reference)
+    {
+        for( auto& v : values )
+            v = UIntType(v - reference);
+    }
+
+    template< typename UIntType >
+    void for_decode(array_ref<UIntType> values, UIntType reference)
+    {
+        for( auto& v : values )
+            v = UIntType(v + reference);
+    }
+
+    template< typename UIntType >
+    UIntType delta_encode(array_ref<UIntType> values, UIntType prev = 0)
+    {
+        for( auto& v : values ) {
+            const UIntType cur = v;
+            v = UIntType(cur - prev);
+            prev = cur;
+        }
+        return prev;
+    }
+
+    template< typename UIntType >
+    UIntType delta_decode(array_ref<UIntType> values, UIntType prev = 0)
+    {
+        for( auto& v : values ) {
+            prev = UIntType(prev + v);
+            v = prev;
+        }
+        return prev;
+    }
+
+    template< typename UIntType >
+    struct delta_of_delta_state {
+        UIntType prev = 0;
+        UIntType prev_delta = 0;
+    };
+
+    template< typename UIntType >
+    void delta_of_delta_encode(array_ref<UIntType> values, delta_of_delta_state<UIntType>* state)
+    {
+        using S = std::make_signed_t<UIntType>;
+        auto s = *state;
+        for( auto& v : values ) {
+            const UIntType cur = v;
+            const auto delta = UIntType(cur - s.prev);
+            v = varint::zigzag_encode(S(UIntType(delta - s.prev_delta)));
+            s.prev = cur;
+            s.prev_delta = delta;
+        }
+        *state = s;
+    }
+
+    template< typename UIntType >
+    void delta_of_delta_decode(array_ref<UIntType> values, delta_of_delta_state<UIntType>* state)
+    {
+        auto s = *state;
+        for( auto& v : values ) {
+            s.prev_delta = UIntType(s.prev_delta + UIntType(varint::zigzag_decode(v)));
+            s.prev = UIntType(s.prev + s.prev_delta);
+            v = s.prev;
+        }
+        *state = s;
+    }
+
+
+    // blocks
+
+    template< typename UIntType >
+    constexpr size_t encoded_size_bound(size_t count) { return HeaderSize + count * sizeof(UIntType); }
+
+    struct block_info {
+        Transform transform;
+        unsigned bits;
+        unsigned value_size;
+        uint32_t count;
+        uint64_t reference;
+        uint64_t reference_delta;
+
+        size_t encoded_size() const { return HeaderSize + packed_size(count, bits); }
+    };
+
+    /// \brief Encode \p values to \p dst, which must hold `encoded_size_bound<T>(values.size())`.
+    ///
+    /// Returns the encoded size. At most 2^32 - 1 values can be encoded in one block.
+    size_t LIBLBU_EXPORT encode(array_ref<const uint32_t> values, Transform t, char* dst);
+    size_t LIBLBU_EXPORT encode(array_ref<const uint64_t> values, Transform t, char* dst);
+
+    /// \brief Read the header of an encoded block.
+    ///
+    /// Returns false if [src, end) is too short for a header or the header is invalid.
+    bool LIBLBU_EXPORT peek(const char* src, const char* end, block_info* info);
+
+    /// \brief Decode a block into \p values, which must have exactly the block's count of elements.
+    ///
+    /// Returns the end of the block or nullptr if the input is truncated, invalid or
+    /// does not match \p values.
+    LIBLBU_EXPORT const char* decode(const char* src, const char* end, array_ref<uint32_t> values);
+    LIBLBU_EXPORT const char* decode(const char* src, const char* end, array_ref<uint64_t> values);
+
+    /// \brief Write \p values as one block to \p out, returns false on a stream error.
+    bool LIBLBU_EXPORT write(stream::abstract_output_stream* out, array_ref<const uint32_t> values, Transform t);
+    bool LIBLBU_EXPORT write(stream::abstract_output_stream* out, array_ref<const uint64_t> values, Transform t);
+
+    /// \brief Read one block from \p in into \p values (replacing its content).
+    ///
+    /// Returns false on a stream error, end of stream or invalid data, or if the block
+    /// holds more than \p max_count values. \p values only grows along with the packed
+    /// data read, but a block with 0 bits has no packed data at all; \p max_count bounds
+    /// what such a block can allocate.
+    bool LIBLBU_EXPORT read(stream::abstract_input_stream* in, std::vector<uint32_t>* values,
+                            size_t max_count = std::numeric_limits<uint32_t>::max());
+    bool LIBLBU_EXPORT read(stream::abstract_input_stream* in, std::vector<uint64_t>* values,
+                            size_t max_count = std::numeric_limits<uint32_t>::max());
+
+}
+}
+
+#endif
@@ -0,0 +1,149 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef LIBLBU_IO_VECTOR_BUILDER_H
+#define LIBLBU_IO_VECTOR_BUILDER_H
+
+#include "lbu/io.h"
+#include "lbu/small_vector.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+namespace lbu {
+namespace io {
+
+    // Collects the pieces of a scatter/gather write, as a replacement for hand built
+    // io_vector arrays and io_vector_array_advance.
+    //
+    // Pieces of up to copy_limit bytes are copied into an inline scratch area while it
+    // has room, where consecutive ones end up in a single vector; any piece directly
+    // following the previous one in memory is merged as well. All other pieces are
+    // referenced and must stay valid until written. The total size is kept up to date,
+    // and advance() after a partial write only touches the vectors it consumes, so
+    // writing a batch costs O(vectors) overall instead of a rescan per writev.
+    // pending() returns at most MaxBatch (IOV_MAX) vectors, the limit of one writev.
+    //
+    // The vectors may point into the builder itself, so it can neither be copied nor
+    // moved. Once everything is consumed it starts over, ready for the next batch.
+    template< size_t ScratchSize = 1024, unsigned InlineVectors = 32 >
+    class io_vector_builder
+    {
+    public:
+#ifdef IOV_MAX
+        static constexpr size_t MaxBatch = IOV_MAX;
+#else
+        static constexpr size_t MaxBatch = 1024;
+#endif
+
+        explicit io_vector_builder(size_t copy_limit = 64)
+            : copy_limit(std::min(copy_limit, ScratchSize))
+        {
+        }
+
+        io_vector_builder(const io_vector_builder&) = delete;
+        io_vector_builder& operator=(const io_vector_builder&) = delete;
+
+        // the bytes still to write
+        size_t size() const { return total; }
+        bool is_empty() const { return total == 0; }
+        size_t vector_count() const { return vectors.size() - first; }
+
+        void append(array_ref<const void> piece)
+        {
+            const size_t n = piece.byte_size();
+            if( n == 0 )
+                return;
+            const char* p = static_cast<const char*>(piece.data());
+            if( n <= copy_limit && n <= ScratchSize - scratch_used ) {
+                char* copy = scratch + scratch_used;
+                std::memcpy(copy, p, n);
+                scratch_used += n;
+                p = copy;
+            }
+            total += n;
+            if( vector_count() > 0 ) {
+                io_vector& last = vectors.back();
+                if( static_cast<const char*>(last.iov_base) + last.iov_len == p ) {
+                    last.iov_len += n;
+                    return;
+                }
+            }
+            vectors.append(io_vec(const_cast<char*>(p), n));
+        }
+
+        void append(const void* data, size_t size)
+        {
+            append(array_ref<const char>(static_cast<const char*>(data), size));
+        }
+
+        // the next vectors to write, at most MaxBatch
+        array_ref<const io_vector> pending() const
+        {
+            return array_ref<const io_vector>(vectors.data() + first, std::min(vector_count(), MaxBatch));
+        }
+
+        // drops the first size bytes, e.g. after a (partial) write
+        void advance(size_t size)
+        {
+            assert(size <= total);
+            total -= size;
+            if( total == 0 ) {
+                clear();
+                return;
+            }
+            while( vectors[first].iov_len <= size ) {
+                size -= vectors[first].iov_len;
+                ++first;
+            }
+            io_vector& v = vectors[first];
+            v.iov_base = static_cast<char*>(v.iov_base) + size;
+            v.iov_len -= size;
+        }
+
+        void clear()
+        {
+            vectors.clear();
+            first = 0;
+            scratch_used = 0;
+            total = 0;
+        }
+
+        // one writev of the next batch
+        io_result write_some(fd f)
+        {
+            const io_result r = io::writev(f, pending());
+            if( r.size > 0 )
+                advance(size_t(r.size));
+            return r;
+        }
+
+        // Like io::write_all. On an error (e.g. WriteWouldBlock on a non-blocking fd)
+        // the rest stays pending.
+        int write_all(fd f)
+        {
+            while( ! is_empty() ) {
+                const io_result r = write_some(f);
+                if( r.status != WriteNoError )
+                    return r.status;
+                if( r.size == 0 )
+                    return WriteIOError;
+            }
+            return WriteNoError;
+        }
+
+    private:
+        small_vector<io_vector, InlineVectors> vectors;
+        size_t first = 0;
+        size_t total = 0;
+        size_t scratch_used = 0;
+        const size_t copy_limit;
+        char scratch[ScratchSize];
+    };
+
+}
+}
+
+#endif
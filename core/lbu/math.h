@@ -7,6 +7,7 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cstdint>
 #include <limits>
 #include <type_traits>
 
@@ -192,6 +193,78 @@ namespace lbu {
         return val ? ( ! (val & (val - 1))) : false;
     }
 
+
+    // division by a runtime invariant divisor, as a multiplication and shifts
+    // (Granlund, Montgomery: "Division by Invariant Integers using Multiplication")
+
+namespace detail {
+
+    template< size_t Size > struct double_width_uint;
+    template<> struct double_width_uint<4> { typedef uint64_t type; };
+#ifdef __SIZEOF_INT128__
+    template<> struct double_width_uint<8> { __extension__ typedef unsigned __int128 type; };
+#endif
+
+}
+
+    template< typename UIntType >
+    class invariant_divisor
+    {
+        static_assert(std::is_integral_v<UIntType> && ! std::is_signed_v<UIntType>
+                      && (sizeof(UIntType) == 4 || sizeof(UIntType) == 8), "need 32 or 64 bit unsigned int type");
+
+        using wide = typename detail::double_width_uint<sizeof(UIntType)>::type;
+        static constexpr unsigned Bits = 8 * sizeof(UIntType);
+
+    public:
+        constexpr explicit invariant_divisor(UIntType divisor)
+            : d(divisor)
+        {
+            assert(divisor > 0);
+            s = unsigned(ilog2_floor(divisor));
+            // m = floor(2^Bits * (2^(s+1) - d) / d) + 1, which fits as 2^s < d
+            if( ! is_pow2(divisor) )
+                m = UIntType((((wide(1) << (s + 1)) - divisor) << Bits) / divisor) + 1;
+        }
+
+        constexpr UIntType divisor() const { return d; }
+
+        // the multiplier, 0 for powers of two, and the final shift
+        constexpr UIntType multiplier() const { return m; }
+        constexpr unsigned shift() const { return s; }
+
+        constexpr UIntType divide(UIntType num) const
+        {
+            if( m == 0 )
+                return num >> s;
+            const UIntType t = UIntType((wide(m) * num) >> Bits);
+            return (t + ((num - t) >> 1)) >> s;
+        }
+
+        constexpr UIntType modulo(UIntType num) const
+        {
+            return num - divide(num) * d;
+        }
+
+    private:
+        UIntType d;
+        UIntType m = 0;
+        unsigned s = 0;
+    };
+
+    template< typename UIntType >
+    constexpr UIntType idiv_ceil(UIntType num, const invariant_divisor<UIntType>& den)
+    {
+        const UIntType q = den.divide(num);
+        return q + (num - q * den.divisor() > 0 ? 1 : 0);
+    }
+
+    template< typename UIntType >
+    constexpr UIntType idiv_floor(UIntType num, const invariant_divisor<UIntType>& den)
+    {
+        return den.divide(num);
+    }
+
 }
 
 #endif
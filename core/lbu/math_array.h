@@ -0,0 +1,56 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef LIBLBU_MATH_ARRAY_H
+#define LIBLBU_MATH_ARRAY_H
+
+#include "lbu/lbu_global.h"
+#include "lbu/array_ref.h"
+#include "lbu/math.h"
+
+#include <stdint.h>
+
+// Array versions of the integer functions of lbu/math.h, dst[i] = f(src[i]).
+//
+// Like lbu/array_algorithm.h they come as portable C++ and as SSE2, AVX2 and
+// AVX-512 kernels, the best of which is picked at the first call. dst must be at
+// least as large as src, and may be src itself but not overlap it otherwise. The
+// preconditions of the scalar functions hold for every element; violating them
+// gives unspecified values instead of assertions.
+
+namespace lbu {
+
+    void LIBLBU_EXPORT ilog2_floor(array_ref<uint32_t> dst, array_ref<const uint32_t> src);
+    void LIBLBU_EXPORT ilog2_floor(array_ref<uint64_t> dst, array_ref<const uint64_t> src);
+
+    void LIBLBU_EXPORT ilog2_ceil(array_ref<uint32_t> dst, array_ref<const uint32_t> src);
+    void LIBLBU_EXPORT ilog2_ceil(array_ref<uint64_t> dst, array_ref<const uint64_t> src);
+
+    void LIBLBU_EXPORT next_greater_pow2(array_ref<uint32_t> dst, array_ref<const uint32_t> src);
+    void LIBLBU_EXPORT next_greater_pow2(array_ref<uint64_t> dst, array_ref<const uint64_t> src);
+
+    // 32 bit divisions are vectorized, 64 bit ones only save the division instruction
+    void LIBLBU_EXPORT idiv_floor(array_ref<uint32_t> dst, array_ref<const uint32_t> src,
+                                  const invariant_divisor<uint32_t>& den);
+    void LIBLBU_EXPORT idiv_floor(array_ref<uint64_t> dst, array_ref<const uint64_t> src,
+                                  const invariant_divisor<uint64_t>& den);
+
+    void LIBLBU_EXPORT idiv_ceil(array_ref<uint32_t> dst, array_ref<const uint32_t> src,
+                                 const invariant_divisor<uint32_t>& den);
+    void LIBLBU_EXPORT idiv_ceil(array_ref<uint64_t> dst, array_ref<const uint64_t> src,
+                                 const invariant_divisor<uint64_t>& den);
+
+    void LIBLBU_EXPORT abs(array_ref<uint32_t> dst, array_ref<const int32_t> src);
+    void LIBLBU_EXPORT abs(array_ref<uint64_t> dst, array_ref<const int64_t> src);
+
+    // wrapping on overflow
+    void LIBLBU_EXPORT ipow(array_ref<uint32_t> dst, array_ref<const uint32_t> src, unsigned exp);
+    void LIBLBU_EXPORT ipow(array_ref<uint64_t> dst, array_ref<const uint64_t> src, unsigned exp);
+
+    /// \brief Name of the kernel set in use ("portable", "sse2", "avx2" or "avx512").
+    LIBLBU_EXPORT const char* math_array_kernel_set_name();
+
+}
+
+#endif
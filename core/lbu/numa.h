@@ -0,0 +1,58 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef LIBLBU_NUMA_H
+#define LIBLBU_NUMA_H
+
+#include "lbu/lbu_global.h"
+
+#include <stddef.h>
+
+// NUMA topology and placement of memory and threads, read from sysfs and done with
+// the Linux system calls directly (no libnuma dependency).
+//
+// On kernels or machines without NUMA everything reports a single node 0 (except
+// cpu_node, which does not know the node of a cpu without a sysfs node link), and
+// memory binding fails with ENOSYS. Node and cpu numbers are the kernel's.
+//
+// Memory is bound in whole pages, so malloced buffers are usually not suitable;
+// see page_alloc in lbu/page_memory.h for buffers placed on a node.
+
+namespace lbu {
+namespace numa {
+
+    /// \brief Number of possible nodes (the highest node number + 1), at least 1.
+    int LIBLBU_EXPORT node_count();
+
+    /// \brief Node of \p cpu, or -1 if unknown (also without NUMA support in the kernel).
+    int LIBLBU_EXPORT cpu_node(int cpu);
+
+    /// \brief The cpu resp. node the calling thread is running on right now, or -1.
+    int LIBLBU_EXPORT current_cpu();
+    int LIBLBU_EXPORT current_node();
+
+    /// \brief Node of the page holding \p p, or -1 if it is not populated yet (or on errors).
+    int LIBLBU_EXPORT memory_node(const void* p);
+
+    /// \brief Bind the pages of [p, p + size) to \p node, moving already populated ones.
+    ///
+    /// \p p must be page aligned. On failure *error is set to the errno value.
+    bool LIBLBU_EXPORT bind_memory(void* p, size_t size, int node, int* error);
+
+    /// \brief Write to each page of [p, p + size) so they get populated, keeping the contents.
+    ///
+    /// The writes are atomic no-ops, so the memory may be in use by other threads.
+    /// Without binding, the pages end up on the node of the calling thread (first touch).
+    void LIBLBU_EXPORT touch_memory(void* p, size_t size);
+
+    /// \brief Restrict the calling thread to \p cpu resp. the cpus of \p node.
+    ///
+    /// On failure *error is set to the errno value.
+    bool LIBLBU_EXPORT set_thread_cpu(int cpu, int* error);
+    bool LIBLBU_EXPORT set_thread_node(int node, int* error);
+
+}
+}
+
+#endif
@@ -0,0 +1,69 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef LIBLBU_PAGE_MEMORY_H
+#define LIBLBU_PAGE_MEMORY_H
+
+#include "lbu/lbu_global.h"
+#include "lbu/memory.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+
+namespace lbu {
+
+    // Buffers mapped directly in whole pages, for control over the memory that malloc
+    // does not give, like placing it on a NUMA node or backing it with huge pages.
+    //
+    // The size is rounded up to whole pages (huge pages if requested), and the memory
+    // is zero filled. For real-time use the pages can be populated and locked up front,
+    // see also lbu/realtime.h.
+
+    enum class huge_pages : uint8_t {
+        None,
+        // transparent huge pages (madvise), the kernel may still use small pages
+        Transparent,
+        // preallocated hugetlbfs pages, falls back to Transparent if none are available
+        // or the size is below the hugetlbfs page size
+        Explicit,
+    };
+
+    struct page_options {
+        int numa_node = -1;     // bind the pages to this node, -1 for the default policy
+        huge_pages huge = huge_pages::None;
+        bool populate = false;  // prefault all pages (on the bound node)
+        bool lock = false;      // mlock the pages, which populates them; failing fails page_alloc
+    };
+
+    inline size_t page_size()
+    {
+        return size_t(::sysconf(_SC_PAGESIZE));
+    }
+
+    /// \brief Size of transparent huge pages, 0 if they are not available.
+    size_t LIBLBU_EXPORT transparent_huge_page_size();
+
+    /// \brief Default hugetlbfs page size, 0 if there is none.
+    size_t LIBLBU_EXPORT explicit_huge_page_size();
+
+    /// \brief The size page_alloc maps for \p size bytes, 0 on overflow.
+    size_t LIBLBU_EXPORT page_alloc_size(size_t size, const page_options& options);
+
+    /// \brief Map \p size bytes, returns nullptr and sets *error to the errno value on failure.
+    LIBLBU_EXPORT void* page_alloc(size_t size, const page_options& options, int* error);
+
+    /// \brief Like above, fails with EINVAL if \p spec needs more than page alignment.
+    LIBLBU_EXPORT void* page_alloc(buffer_spec spec, const page_options& options, int* error);
+
+    /// \brief Like page_alloc, but calls unexpected_memory_exhaustion() resp.
+    /// unexpected_system_error() on failure.
+    LIBLBU_EXPORT void* xpage_alloc(size_t size, const page_options& options);
+
+    /// \brief Unmap memory from page_alloc, \p size and \p options as given there.
+    void LIBLBU_EXPORT page_free(void* p, size_t size, const page_options& options);
+
+}
+
+#endif
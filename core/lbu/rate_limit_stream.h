@@ -0,0 +1,177 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef LIBLBU_RATE_LIMIT_STREAM_H
+#define LIBLBU_RATE_LIMIT_STREAM_H
+
+#include "lbu/abstract_stream.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace lbu {
+namespace stream {
+
+    // A token bucket: tokens (bytes) accumulate at a fixed rate up to the burst size.
+    //
+    // Not thread safe; one bucket may be shared by several streams of one thread to
+    // throttle them together.
+    class token_bucket {
+    public:
+        using clock = std::chrono::steady_clock;
+
+        /// The bucket starts full. \p bytes_per_second must be > 0, \p burst must be > 0
+        /// and below 2^33 (so the refill computation can't overflow).
+        token_bucket(uint64_t bytes_per_second, uint64_t burst, clock::time_point now = clock::now())
+            : last_refill(now)
+        {
+            set_rate(bytes_per_second, burst);
+            tokens = burst_size;
+        }
+
+        void set_rate(uint64_t bytes_per_second, uint64_t burst)
+        {
+            assert(bytes_per_second > 0);
+            assert(burst > 0 && burst < (uint64_t(1) << 33));
+            rate = bytes_per_second;
+            burst_size = burst;
+            tokens = std::min(tokens, burst_size);
+        }
+
+        uint64_t bytes_per_second() const { return rate; }
+        uint64_t burst() const { return burst_size; }
+
+        /// \brief Refill and return the tokens available at \p now.
+        uint64_t available(clock::time_point now = clock::now())
+        {
+            if( tokens >= burst_size || now <= last_refill ) {
+                if( tokens >= burst_size )
+                    last_refill = now;
+                return tokens;
+            }
+            const auto elapsed = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(now - last_refill).count());
+            // past the time to fill the bucket completely the product below could overflow
+            if( elapsed >= (burst_size - tokens) * NanosecondsPerSecond / rate ) {
+                tokens = burst_size;
+                last_refill = now;
+                return tokens;
+            }
+            const uint64_t added = elapsed * rate / NanosecondsPerSecond;
+            tokens += added;
+            // keep the fraction of a token that was not credited yet
+            last_refill += std::chrono::nanoseconds(added * NanosecondsPerSecond / rate);
+            return tokens;
+        }
+
+        /// \brief Take \p count tokens, taking more than available empties the bucket.
+        ///
+        /// That only happens when streams sharing the bucket use their windows at once.
+        void consume(uint64_t count)
+        {
+            tokens = (count < tokens) ? tokens - count : 0;
+        }
+
+        /// \brief Time until \p count tokens (at most the burst size) are available.
+        ///
+        /// Only valid directly after `available`.
+        std::chrono::nanoseconds time_until(uint64_t count) const
+        {
+            count = std::min(count, burst_size);
+            if( tokens >= count )
+                return std::chrono::nanoseconds(0);
+            return std::chrono::nanoseconds(((count - tokens) * NanosecondsPerSecond + rate - 1) / rate);
+        }
+
+    private:
+        static constexpr uint64_t NanosecondsPerSecond = 1000000000;
+
+        uint64_t rate;
+        uint64_t burst_size;
+        uint64_t tokens = 0;
+        clock::time_point last_refill;
+    };
+
+
+    // Stream adapters that throttle another stream with a token bucket, e.g. to keep
+    // replication or backfill traffic from starving other I/O.
+    //
+    // Pacing happens per buffer window: for a buffered stream the adapter hands out a
+    // prefix of the wrapped stream's buffer limited by the available tokens and takes the
+    // tokens for the part that was actually used when the next window is requested (or on
+    // flush); the memcpy fast path of read/write stays untouched. Unbuffered streams are
+    // throttled per direct_read/direct_write request.
+    //
+    // A window is only handed out once at least MinimumWindow tokens (or the whole burst,
+    // if smaller) are available, so a throttled stream is not paced in tiny steps. Blocking
+    // requests sleep until then. NonBlocking requests return without progress instead and
+    // throttle_delay() tells when to retry, so an event loop can arm a timer.
+    //
+    // The wrapped stream and the bucket must outlive the adapter. Data written into the
+    // adapter's window is only committed to the wrapped stream with the next window or
+    // flush, so flush the adapter before using the wrapped stream directly again.
+    class rate_limited_output_stream : public abstract_output_stream {
+    public:
+        static constexpr uint32_t MinimumWindow = 4096;
+
+        LIBLBU_EXPORT rate_limited_output_stream(abstract_output_stream* target, token_bucket* bucket);
+        LIBLBU_EXPORT ~rate_limited_output_stream() override;
+
+        abstract_output_stream* target() const { return out; }
+
+        /// \brief Time until a request throttled in NonBlocking mode can make progress.
+        ///
+        /// Zero if the last request was not held back by the bucket.
+        std::chrono::nanoseconds throttle_delay() const { return delay; }
+
+    protected:
+        ssize_t LIBLBU_EXPORT write_stream(array_ref<io::io_vector> buf_array, Mode mode) override;
+        array_ref<void> LIBLBU_EXPORT get_write_buffer(Mode mode) override;
+        bool LIBLBU_EXPORT write_buffer_flush(Mode mode) override;
+
+        rate_limited_output_stream(rate_limited_output_stream&&) = default;
+        rate_limited_output_stream& operator=(rate_limited_output_stream&&) = default;
+
+    private:
+        void commit();
+
+        abstract_output_stream* out;
+        token_bucket* tokens;
+        std::chrono::nanoseconds delay{0};
+    };
+
+
+    class rate_limited_input_stream : public abstract_input_stream {
+    public:
+        static constexpr uint32_t MinimumWindow = rate_limited_output_stream::MinimumWindow;
+
+        LIBLBU_EXPORT rate_limited_input_stream(abstract_input_stream* source, token_bucket* bucket);
+        LIBLBU_EXPORT ~rate_limited_input_stream() override;
+
+        abstract_input_stream* source() const { return in; }
+
+        /// \brief Time until a request throttled in NonBlocking mode can make progress.
+        ///
+        /// Zero if the last request was not held back by the bucket.
+        std::chrono::nanoseconds throttle_delay() const { return delay; }
+
+    protected:
+        ssize_t LIBLBU_EXPORT read_stream(array_ref<io::io_vector> buf_array, size_t required_read) override;
+        array_ref<const void> LIBLBU_EXPORT get_read_buffer(Mode mode) override;
+
+        rate_limited_input_stream(rate_limited_input_stream&&) = default;
+        rate_limited_input_stream& operator=(rate_limited_input_stream&&) = default;
+
+    private:
+        void commit();
+        void sync_status();
+
+        abstract_input_stream* in;
+        token_bucket* tokens;
+        std::chrono::nanoseconds delay{0};
+    };
+
+}
+}
+
+#endif
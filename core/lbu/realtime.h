@@ -0,0 +1,102 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef LIBLBU_REALTIME_H
+#define LIBLBU_REALTIME_H
+
+#include "lbu/lbu_global.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <utility>
+
+// Preparing memory and threads for real-time work, so that the first access to a
+// buffer or the stack does not page fault in the middle of a deadline.
+//
+// Locking needs a sufficient RLIMIT_MEMLOCK (or CAP_IPC_LOCK); when it fails the
+// memory is still prefaulted, which helps until the kernel reclaims it.
+//
+// Memory mapped with page_alloc can be prepared right away with page_options::populate
+// and page_options::lock, see lbu/page_memory.h.
+
+namespace lbu {
+namespace realtime {
+
+    enum PrepareFlags {
+        PrepareNone = 0,
+        PreparePrefault = 1 << 0,   // touch every page
+        PrepareLock = 1 << 1,       // mlock, which implies prefaulting
+        PrepareDefault = PreparePrefault | PrepareLock
+    };
+
+    /// \brief Prefault and/or lock the pages of [p, p + size).
+    ///
+    /// The range does not need to be page aligned, the pages containing it are prepared.
+    /// On failure to lock, *error is set to the errno value (the pages are prefaulted).
+    bool LIBLBU_EXPORT prepare_memory(void* p, size_t size, int flags, int* error);
+
+    /// \brief Undo PrepareLock of prepare_memory; unmapping memory unlocks it as well.
+    void LIBLBU_EXPORT release_memory(void* p, size_t size);
+
+    /// \brief Lock all current and future mappings of the process.
+    bool LIBLBU_EXPORT lock_all_memory(int* error);
+
+    /// \brief Touch \p size bytes of the calling thread's stack below the current frame.
+    ///
+    /// Together with lock_all_memory this keeps the stack of an already running thread
+    /// resident; for new threads a thread_stack is the better option.
+    void LIBLBU_EXPORT prefault_stack(size_t size);
+
+
+    // A stack for a real-time thread, mapped with a guard page and prepared up front.
+    class thread_stack {
+    public:
+        thread_stack() = default;
+        /// On failure *error is set to the errno value; a failed PrepareLock leaves
+        /// a usable (prefaulted) stack though, check is_valid().
+        LIBLBU_EXPORT thread_stack(size_t size, int flags, int* error);
+        LIBLBU_EXPORT ~thread_stack();
+
+        thread_stack(thread_stack&& other) noexcept;
+        thread_stack& operator=(thread_stack&& other) noexcept;
+
+        bool is_valid() const { return base != nullptr; }
+        explicit operator bool() const { return is_valid(); }
+
+        void* data() const { return stack; }
+        size_t size() const { return stack_size; }
+
+        /// \brief Use the stack for threads created with \p attr; the stack must outlive them.
+        bool LIBLBU_EXPORT apply(pthread_attr_t* attr, int* error) const;
+
+    private:
+        void* base = nullptr;       // including the guard page
+        void* stack = nullptr;
+        size_t stack_size = 0;
+    };
+
+
+    // implementation
+
+    inline thread_stack::thread_stack(thread_stack&& other) noexcept
+        : base(other.base), stack(other.stack), stack_size(other.stack_size)
+    {
+        other.base = nullptr;
+        other.stack = nullptr;
+        other.stack_size = 0;
+    }
+
+    inline thread_stack& thread_stack::operator=(thread_stack&& other) noexcept
+    {
+        thread_stack tmp(static_cast<thread_stack&&>(other));
+        std::swap(base, tmp.base);
+        std::swap(stack, tmp.stack);
+        std::swap(stack_size, tmp.stack_size);
+        return *this;
+    }
+
+}
+}
+
+#endif
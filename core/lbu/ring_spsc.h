@@ -170,7 +170,7 @@ namespace algorithm {
     };
 
     template< class T, class SizeType >
-    std::pair<array_ref<T>, array_ref<T>> ranges(T* begin, SizeType offset, SizeType available, SizeType n)
+    std::pair<array_ref<T, SizeType>, array_ref<T, SizeType>> ranges(T* begin, SizeType offset, SizeType available, SizeType n)
     {
         const auto first = algorithm::continuous_slots(offset, available, n);
         return { {begin + offset, first}, {begin, available - first} };
@@ -0,0 +1,208 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef LIBLBU_RING_SPSC_QUEUE_H
+#define LIBLBU_RING_SPSC_QUEUE_H
+
+#include "lbu/ring_spsc_stream.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace lbu {
+namespace stream {
+
+    // Message queue on top of a ring_spsc stream pair, for variable sized records.
+    //
+    // Each record is an 8 byte header holding the message size followed by the message,
+    // padded to a multiple of 8 bytes, so messages are 8 byte aligned relative to the
+    // ring. Records are written with ring_spsc::output_stream::reserve and thus never
+    // wrap around, and the consumer hands out messages as refs into the ring: one copy
+    // in (or none with reserve/commit) and no copy out.
+    //
+    // Like any stream write, records become visible to the consumer with flush() or
+    // once segment_limit bytes are pending. A message (including an empty one) has a
+    // valid data pointer, an invalid ref signals that none was available.
+    class ring_spsc_queue {
+    public:
+        static constexpr uint32_t HeaderSize = 8;
+        static constexpr uint32_t RecordAlignment = 8;
+
+        // ring space needed for a message of the given size
+        static constexpr size_t record_size(size_t message_size)
+        {
+            return HeaderSize + ((message_size + RecordAlignment - 1) & ~size_t(RecordAlignment - 1));
+        }
+
+        class producer {
+        public:
+            producer() = default;
+
+            /// \brief Return a buffer to write a message of \p size bytes into, finish with `commit`.
+            ///
+            /// An empty ref is returned on a stream error (e.g. if the record does not fit into
+            /// the ring at all) or in NonBlocking mode if the space is not free yet.
+            array_ref<void> reserve(uint32_t size, Mode mode = Mode::Blocking)
+            {
+                const auto r = std::min<size_t>(record_size(size), std::numeric_limits<uint32_t>::max());
+                auto buf = out.reserve(uint32_t(r), mode);
+                if( buf.size() == 0 )
+                    return {};
+                record = static_cast<char*>(buf.data());
+                reserved = size;
+                return array_ref<char>(record + HeaderSize, size);
+            }
+
+            /// \brief Finish the reserved message, with \p size at most the reserved size.
+            void commit(uint32_t size)
+            {
+                assert(size <= reserved);
+                const uint64_t header = size;
+                std::memcpy(record, &header, sizeof(header));
+                out.commit(uint32_t(record_size(size)));
+                record = nullptr;
+                reserved = 0;
+            }
+            void commit() { commit(reserved); }
+
+            bool push(array_ref<const void> message, Mode mode = Mode::Blocking)
+            {
+                const auto size = uint32_t(std::min<size_t>(message.byte_size(), std::numeric_limits<uint32_t>::max()));
+                auto buf = reserve(size, mode);
+                if( ! buf.data() )
+                    return false;
+                if( size )
+                    std::memcpy(buf.data(), message.data(), size);
+                commit(size);
+                return true;
+            }
+
+            bool flush(Mode mode = Mode::Blocking) { return out.flush_buffer(mode); }
+            bool set_end_of_stream() { return out.set_end_of_stream(); }
+            bool has_error() const { return out.has_error(); }
+
+            ring_spsc::output_stream* stream() { return &out; }
+
+            producer(const producer&) = delete;
+            producer& operator=(const producer&) = delete;
+
+        private:
+            ring_spsc::output_stream out;
+            char* record = {};
+            uint32_t reserved = 0;
+        };
+
+        class consumer {
+        public:
+            consumer() = default;
+
+            /// \brief Return the next message.
+            ///
+            /// Messages stay valid until `release`. Once all messages received so far have been
+            /// handed out, no new ones are returned until `release` is called (even in Blocking
+            /// mode), `must_release` tells this case apart. Otherwise an invalid ref signals an
+            /// error or the end of the stream, or in NonBlocking mode that no message is
+            /// available right now.
+            ///
+            /// A record header that does not fit the received data (i.e. a corrupted ring) puts
+            /// the consumer into the error state.
+            array_ref<const void> pop(Mode mode = Mode::Blocking)
+            {
+                if( corrupt )
+                    return {};
+                if( popped == current.size() ) {
+                    if( popped > 0 )
+                        return {};
+                    current = in.get_buffer(mode).array_static_cast<char>();
+                    if( current.size() == 0 )
+                        return {};
+                }
+
+                const size_t left = current.size() - popped;
+                if( left < HeaderSize ) {
+                    corrupt = true;
+                    return {};
+                }
+                uint64_t size;
+                const char* p = current.data() + popped;
+                std::memcpy(&size, p, sizeof(size));
+                if( size > left - HeaderSize || record_size(size_t(size)) > left ) {
+                    corrupt = true;
+                    return {};
+                }
+                popped += uint32_t(record_size(size_t(size)));
+                return array_ref<const char>(p + HeaderSize, size_t(size));
+            }
+
+            array_ref<const void> try_pop() { return pop(Mode::NonBlocking); }
+
+            /// \brief Pop up to dst.size() messages, returns how many.
+            ///
+            /// In Blocking mode this waits for the first message only.
+            size_t pop_batch(array_ref<array_ref<const void>> dst, Mode mode = Mode::NonBlocking)
+            {
+                size_t count = 0;
+                for( ; count < dst.size(); ++count ) {
+                    dst[count] = pop(count == 0 ? mode : Mode::NonBlocking);
+                    if( ! dst[count].data() )
+                        break;
+                }
+                return count;
+            }
+
+            /// \brief Done with all popped messages.
+            ///
+            /// The ring space goes back to the producer once all messages the consumer has
+            /// received so far are released.
+            void release()
+            {
+                in.advance_buffer(popped);
+                popped = 0;
+                current = in.get_buffer(Mode::NonBlocking).array_static_cast<char>();
+            }
+
+            /// \brief True iff all messages received so far are popped but not released yet.
+            ///
+            /// `pop` returns no further messages until `release` is called then.
+            bool must_release() const { return popped > 0 && popped == current.size(); }
+
+            bool at_end() const { return in.at_end(); }
+            bool has_error() const { return corrupt || in.has_error(); }
+
+            ring_spsc::input_stream* stream() { return &in; }
+
+            consumer(const consumer&) = delete;
+            consumer& operator=(const consumer&) = delete;
+
+        private:
+            ring_spsc::input_stream in;
+            array_ref<const char> current;
+            uint32_t popped = 0;
+            bool corrupt = false;
+        };
+
+        // The consumer needs buffers holding whole records, so it is given no segment limit.
+        static void pair(producer* p, consumer* c,
+                         array_ref<void> buffer, fd event_fd, ring_spsc_shared_data* s,
+                         uint32_t segment_limit = ring_spsc::DefaultRingSegmentLimit)
+        {
+            ring_spsc::pair_streams(p->stream(), c->stream(), buffer, event_fd, s, segment_limit);
+            c->stream()->set_segment_size_limit(std::numeric_limits<uint32_t>::max());
+        }
+
+        static bool pair(producer* p, consumer* c, ring_spsc_basic_controller* controller,
+                         uint32_t segment_limit = ring_spsc::DefaultRingSegmentLimit)
+        {
+            if( ! controller->pair_streams(p->stream(), c->stream(), segment_limit) )
+                return false;
+            c->stream()->set_segment_size_limit(std::numeric_limits<uint32_t>::max());
+            return true;
+        }
+    };
+
+}
+}
+
+#endif
@@ -8,15 +8,21 @@
 #include "lbu/abstract_stream.h"
 #include "lbu/eventfd.h"
 #include "lbu/fd.h"
+#include "lbu/page_memory.h"
 
 #include <atomic>
+#include <limits>
 
 namespace lbu {
 namespace stream {
 
     struct ring_spsc_shared_data {
+        static constexpr uint32_t NoPadding = std::numeric_limits<uint32_t>::max();
+
         std::atomic<uint32_t> producer_index;
         std::atomic<uint32_t> consumer_index;
+        // index where the producer skipped the rest of the ring (see output_stream::reserve)
+        std::atomic<uint32_t> padding_index;
         std::atomic<bool> producer_wake;
         std::atomic<bool> consumer_wake;
         std::atomic<bool> eos;
@@ -24,6 +30,7 @@ namespace stream {
         ring_spsc_shared_data()
             : producer_index(0)
             , consumer_index(0)
+            , padding_index(NoPadding)
             , producer_wake(false)
             , consumer_wake(true)
             , eos(false)
@@ -76,8 +83,7 @@ namespace stream {
 
         private:
             array_ref<const void> next_buffer(Mode mode);
-            bool update_buffer_size(ring_spsc_shared_data* shared, uint32_t consumer_index,
-                                    uint32_t segment_limit, uint32_t ring_size);
+            bool update_buffer_size(ring_spsc_shared_data* shared, uint32_t segment_limit, uint32_t ring_size);
 
             data d;
         };
@@ -98,6 +104,28 @@ namespace stream {
 
             void LIBLBU_EXPORT reset(array_ref<void> buffer, fd event_fd, ring_spsc_shared_data* s);
 
+            /// \brief Return a contiguous buffer of at least \p size bytes for zero copy writing.
+            ///
+            /// Unlike `get_buffer` this is not capped by the segment size limit. When the ring
+            /// has less than \p size bytes left before it wraps around, the rest is published
+            /// as padding that the input stream skips, so a record written here is never split.
+            /// As long as only reserve/commit is used, the input stream thus returns buffers
+            /// holding whole records (given its segment size limit is not smaller than them).
+            ///
+            /// \p size may not exceed the ring size. An empty ref is returned on a stream error,
+            /// or in NonBlocking mode if the space is not free yet.
+            array_ref<void> reserve(uint32_t size, Mode mode = Mode::Blocking)
+            {
+                if( buffer_available >= size && buffer_available > 0 )
+                    return current_buffer();
+                return reserve_buffer(size, mode);
+            }
+
+            /// \brief Finish a record written into the buffer returned by `reserve`.
+            ///
+            /// Like any other write, it is published with the next buffer refill or flush.
+            void commit(uint32_t size) { advance_buffer(size); }
+
             uint32_t segment_size_limit() const { return d.segment_limit; }
             void set_segment_size_limit(uint32_t limit)
             {
@@ -116,6 +144,9 @@ namespace stream {
 
         private:
             array_ref<void> next_buffer(Mode mode);
+            array_ref<void> LIBLBU_EXPORT reserve_buffer(uint32_t size, Mode mode);
+            bool publish(uint32_t count);
+            int reserve_update_buffer(uint32_t size);
             bool update_buffer_size(ring_spsc_shared_data* shared, uint32_t producer_index,
                                     uint32_t segment_limit, uint32_t ring_size);
 
@@ -137,23 +168,38 @@ namespace stream {
         }
     };
 
-    // convenience class that uses internally malloced buffer
+    // Convenience class that uses internally malloced buffer. The constructors taking an
+    // int* error do not throw but set *error to 0, ENOMEM or the system error, in which
+    // case pair_streams() fails.
+    //
+    // With page_options the ring (and the shared indices) are mapped with page_alloc
+    // instead, e.g. to place them on the NUMA node of the consumer, to back large
+    // rings with huge pages to avoid TLB misses, or to populate and lock them for
+    // real-time use.
 
     class ring_spsc_basic_controller {
     public:
         static constexpr uint32_t DefaultRingBufferSize = 4 * ring_spsc::DefaultRingSegmentLimit;
 
         explicit LIBLBU_EXPORT ring_spsc_basic_controller(uint32_t bufsize = DefaultRingBufferSize);
+        LIBLBU_EXPORT ring_spsc_basic_controller(uint32_t bufsize, int* error);
+        LIBLBU_EXPORT ring_spsc_basic_controller(uint32_t bufsize, const page_options& options);
+        LIBLBU_EXPORT ring_spsc_basic_controller(uint32_t bufsize, const page_options& options, int* error);
 
         LIBLBU_EXPORT ~ring_spsc_basic_controller();
 
         bool LIBLBU_EXPORT pair_streams(ring_spsc::output_stream* out, ring_spsc::input_stream* in,
                                         uint32_t segment_limit = ring_spsc::DefaultRingSegmentLimit);
 
+        /// \brief NUMA node of the ring memory, -1 if unknown or not populated yet.
+        int LIBLBU_EXPORT numa_node() const;
+
         ring_spsc_basic_controller(const ring_spsc_basic_controller&) = delete;
         ring_spsc_basic_controller& operator=(const ring_spsc_basic_controller&) = delete;
 
     private:
+        int init(uint32_t bufsize, const page_options* options);
+
         struct internal;
         internal* d;
     };
@@ -0,0 +1,588 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef LIBLBU_SERIALIZE_H
+#define LIBLBU_SERIALIZE_H
+
+#include "lbu/abstract_stream.h"
+#include "lbu/byte_buffer.h"
+#include "lbu/endian.h"
+#include "lbu/varint.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <type_traits>
+
+// Binary serialization of plain structs.
+//
+// The wire layout of a struct is described once by specializing
+// lbu::serialize::fields with a field_list of member descriptors:
+//
+//   struct sample { uint32_t id; int64_t delta; std::array<float, 4> v; lbu::byte_buffer blob; };
+//
+//   template<> struct lbu::serialize::fields<sample>
+//       : lbu::serialize::field_list<lbu::serialize::fixed<&sample::id>,
+//                                    lbu::serialize::varint<&sample::delta>,
+//                                    lbu::serialize::fixed<&sample::v, lbu::serialize::ByteOrder::Big>,
+//                                    lbu::serialize::bytes<&sample::blob>> {};
+//
+// Descriptors:
+// - fixed: integers, enums, bool, float and double in the given byte order, std::array
+//          of those (a single memcpy when the byte order matches the host), and nested
+//          structs that have a fields specialization themselves (using their own layout).
+// - varint: integers and enums as LEB128, signed values zigzag mapped (see lbu/varint.h),
+//           also element wise for std::array.
+// - bytes: byte_buffer as varint length followed by the data.
+//
+// The fields are encoded back to back without padding or tags, so the format has
+// no versioning; this is meant for tight wire formats both sides agree on.
+//
+// encode/decode work on raw memory. write/read work on abstract streams: if the
+// stream manages a buffer and the current window can hold the whole struct it is
+// encoded resp. decoded in place in one go, otherwise it falls back to writing
+// resp. reading field by field.
+
+namespace lbu {
+namespace serialize {
+
+    enum class ByteOrder : uint8_t {
+        Little,
+        Big
+    };
+
+    template< auto Member, ByteOrder Order = ByteOrder::Little >
+    struct fixed {};
+
+    template< auto Member >
+    struct varint {};
+
+    template< auto Member >
+    struct bytes {};
+
+    template< typename... Fields >
+    struct field_list {};
+
+    template< typename T >
+    struct fields;
+
+
+    /// \brief Upper bound of the encoded size of \p v.
+    template< typename T >
+    size_t encoded_size_bound(const T& v);
+
+    /// \brief Encode \p v to \p dst, which must have room for `encoded_size_bound(v)`.
+    ///
+    /// Returns the end of the encoded data.
+    template< typename T >
+    char* encode(const T& v, char* dst);
+
+    /// \brief Append the encoding of \p v to \p dst.
+    template< typename T >
+    void append(const T& v, byte_buffer* dst);
+
+    /// \brief Decode into \p v from [src, end).
+    ///
+    /// Returns the end of the decoded data, or nullptr if the input is truncated or
+    /// invalid. On failure \p v may be partially modified.
+    template< typename T >
+    const char* decode(T* v, const char* src, const char* end);
+
+    /// \brief Blocking write of \p v to the stream; returns false on a stream error.
+    template< typename T >
+    bool write(stream::abstract_output_stream* out, const T& v);
+
+    /// \brief Blocking read of \p v from the stream.
+    ///
+    /// Returns false on a stream error, invalid data or when the stream ends early.
+    /// On failure \p v may be partially modified.
+    template< typename T >
+    bool read(stream::abstract_input_stream* in, T* v);
+
+
+namespace detail {
+
+    template< typename T, typename = void >
+    struct has_fields : std::false_type {};
+
+    template< typename T >
+    struct has_fields<T, std::void_t<decltype(sizeof(fields<T>))>> : std::true_type {};
+
+    template< typename T >
+    struct is_std_array : std::false_type {};
+
+    template< typename E, size_t N >
+    struct is_std_array<std::array<E, N>> : std::true_type {};
+
+    template< typename T >
+    constexpr bool is_scalar_v = std::is_arithmetic_v<T> || std::is_enum_v<T>;
+
+    template< ByteOrder Order >
+    constexpr bool is_host_order_v = (Order == ByteOrder::Little) == (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__);
+
+    template< typename M >
+    struct member_traits;
+
+    template< typename C, typename M >
+    struct member_traits<M C::*> {
+        using class_type = C;
+        using type = M;
+    };
+
+    inline bool write_raw(stream::abstract_output_stream* out, const void* data, size_t size)
+    {
+        return out->write(data, size, stream::Mode::Blocking) == ssize_t(size);
+    }
+
+    inline bool read_raw(stream::abstract_input_stream* in, void* data, size_t size)
+    {
+        return in->read(data, size, stream::Mode::Blocking) == ssize_t(size);
+    }
+
+
+    // value codecs
+
+    template< ByteOrder Order, typename T, typename Enable = void >
+    struct fixed_codec;
+
+    template< ByteOrder Order, typename T >
+    struct fixed_codec<Order, T, std::enable_if_t<is_scalar_v<T>>> {
+        static constexpr size_t Size = sizeof(T);
+
+        static size_t bound(const T&) { return Size; }
+
+        static char* encode(const T& v, char* dst)
+        {
+            if constexpr( std::is_enum_v<T> ) {
+                return fixed_codec<Order, std::underlying_type_t<T>>::encode(std::underlying_type_t<T>(v), dst);
+            } else if constexpr( std::is_same_v<T, bool> ) {
+                *dst = char(v ? 1 : 0);
+            } else if constexpr( Size == 1 ) {
+                std::memcpy(dst, &v, 1);
+            } else if constexpr( Order == ByteOrder::Little ) {
+                to_little_endian<T>(v, dst);
+            } else {
+                to_big_endian<T>(v, dst);
+            }
+            return dst + Size;
+        }
+
+        static const char* decode(T* v, const char* src, const char* end)
+        {
+            if( size_t(end - src) < Size )
+                return nullptr;
+            if constexpr( std::is_enum_v<T> ) {
+                std::underlying_type_t<T> tmp;
+                src = fixed_codec<Order, std::underlying_type_t<T>>::decode(&tmp, src, end);
+                *v = T(tmp);
+                return src;
+            } else if constexpr( std::is_same_v<T, bool> ) {
+                *v = (*src != 0);
+            } else if constexpr( Size == 1 ) {
+                std::memcpy(v, src, 1);
+            } else if constexpr( Order == ByteOrder::Little ) {
+                *v = from_little_endian<T>(src);
+            } else {
+                *v = from_big_endian<T>(src);
+            }
+            return src + Size;
+        }
+
+        static bool write(stream::abstract_output_stream* out, const T& v)
+        {
+            char tmp[Size];
+            encode(v, tmp);
+            return write_raw(out, tmp, Size);
+        }
+
+        static bool read(stream::abstract_input_stream* in, T* v)
+        {
+            char tmp[Size];
+            return read_raw(in, tmp, Size) && decode(v, tmp, tmp + Size) != nullptr;
+        }
+    };
+
+    template< ByteOrder Order, typename E, size_t N >
+    struct fixed_codec<Order, std::array<E, N>> {
+        using element = fixed_codec<Order, E>;
+
+        // scalar elements in host order are copied as a whole
+        static constexpr bool Bulk = is_scalar_v<E> && ! std::is_same_v<E, bool>
+                                     && (sizeof(E) == 1 || is_host_order_v<Order>);
+
+        static size_t bound(const std::array<E, N>& v)
+        {
+            if constexpr( is_scalar_v<E> ) {
+                return N * sizeof(E);
+            } else {
+                size_t n = 0;
+                for( const auto& e : v )
+                    n += element::bound(e);
+                return n;
+            }
+        }
+
+        static char* encode(const std::array<E, N>& v, char* dst)
+        {
+            if constexpr( Bulk ) {
+                std::memcpy(dst, v.data(), N * sizeof(E));
+                return dst + N * sizeof(E);
+            } else {
+                for( const auto& e : v )
+                    dst = element::encode(e, dst);
+                return dst;
+            }
+        }
+
+        static const char* decode(std::array<E, N>* v, const char* src, const char* end)
+        {
+            if constexpr( Bulk ) {
+                if( size_t(end - src) < N * sizeof(E) )
+                    return nullptr;
+                std::memcpy(v->data(), src, N * sizeof(E));
+                return src + N * sizeof(E);
+            } else {
+                for( auto& e : *v ) {
+                    src = element::decode(&e, src, end);
+                    if( src == nullptr )
+                        return nullptr;
+                }
+                return src;
+            }
+        }
+
+        static bool write(stream::abstract_output_stream* out, const std::array<E, N>& v)
+        {
+            if constexpr( Bulk ) {
+                return write_raw(out, v.data(), N * sizeof(E));
+            } else {
+                for( const auto& e : v ) {
+                    if( ! element::write(out, e) )
+                        return false;
+                }
+                return true;
+            }
+        }
+
+        static bool read(stream::abstract_input_stream* in, std::array<E, N>* v)
+        {
+            if constexpr( Bulk ) {
+                return read_raw(in, v->data(), N * sizeof(E));
+            } else {
+                for( auto& e : *v ) {
+                    if( ! element::read(in, &e) )
+                        return false;
+                }
+                return true;
+            }
+        }
+    };
+
+    template< ByteOrder Order, typename T >
+    struct fixed_codec<Order, T, std::enable_if_t<has_fields<T>::value>> {
+        static size_t bound(const T& v) { return serialize::encoded_size_bound(v); }
+        static char* encode(const T& v, char* dst) { return serialize::encode(v, dst); }
+        static const char* decode(T* v, const char* src, const char* end) { return serialize::decode(v, src, end); }
+        static bool write(stream::abstract_output_stream* out, const T& v) { return serialize::write(out, v); }
+        static bool read(stream::abstract_input_stream* in, T* v) { return serialize::read(in, v); }
+    };
+
+
+    template< typename T, typename Enable = void >
+    struct varint_codec;
+
+    template< typename T >
+    struct varint_codec<T, std::enable_if_t<std::is_integral_v<T> || std::is_enum_v<T>>> {
+        using underlying = typename std::conditional_t<std::is_enum_v<T>, std::underlying_type<T>, std::common_type<T>>::type;
+        // bool has no unsigned counterpart, it goes over the wire as 0 or 1
+        using integer = std::conditional_t<std::is_same_v<underlying, bool>, uint8_t, underlying>;
+        using unsigned_integer = std::make_unsigned_t<integer>;
+        static constexpr unsigned MaxBytes = lbu::varint::max_bytes<unsigned_integer>();
+
+        static unsigned_integer to_wire(const T& v)
+        {
+            const auto i = integer(v);
+            if constexpr( std::is_signed_v<integer> )
+                return lbu::varint::zigzag_encode(i);
+            else
+                return i;
+        }
+
+        static T from_wire(unsigned_integer u)
+        {
+            if constexpr( std::is_signed_v<integer> )
+                return T(lbu::varint::zigzag_decode(u));
+            else
+                return T(underlying(u));
+        }
+
+        static size_t bound(const T&) { return MaxBytes; }
+
+        static char* encode(const T& v, char* dst)
+        {
+            return lbu::varint::encode(to_wire(v), dst);
+        }
+
+        static const char* decode(T* v, const char* src, const char* end)
+        {
+            unsigned_integer u;
+            src = lbu::varint::decode(src, end, &u);
+            if( src != nullptr )
+                *v = from_wire(u);
+            return src;
+        }
+
+        static bool write(stream::abstract_output_stream* out, const T& v)
+        {
+            return lbu::varint::write(out, to_wire(v));
+        }
+
+        static bool read(stream::abstract_input_stream* in, T* v)
+        {
+            unsigned_integer u;
+            if( ! lbu::varint::read(in, &u) )
+                return false;
+            *v = from_wire(u);
+            return true;
+        }
+    };
+
+    template< typename E, size_t N >
+    struct varint_codec<std::array<E, N>> {
+        using element = varint_codec<E>;
+
+        static size_t bound(const std::array<E, N>&) { return N * element::MaxBytes; }
+
+        static char* encode(const std::array<E, N>& v, char* dst)
+        {
+            for( const auto& e : v )
+                dst = element::encode(e, dst);
+            return dst;
+        }
+
+        static const char* decode(std::array<E, N>* v, const char* src, const char* end)
+        {
+            for( auto& e : *v ) {
+                src = element::decode(&e, src, end);
+                if( src == nullptr )
+                    return nullptr;
+            }
+            return src;
+        }
+
+        static bool write(stream::abstract_output_stream* out, const std::array<E, N>& v)
+        {
+            for( const auto& e : v ) {
+                if( ! element::write(out, e) )
+                    return false;
+            }
+            return true;
+        }
+
+        static bool read(stream::abstract_input_stream* in, std::array<E, N>* v)
+        {
+            for( auto& e : *v ) {
+                if( ! element::read(in, &e) )
+                    return false;
+            }
+            return true;
+        }
+    };
+
+
+    struct bytes_codec {
+        using length = varint_codec<uint32_t>;
+
+        static size_t bound(const byte_buffer& v) { return length::MaxBytes + v.size(); }
+
+        static char* encode(const byte_buffer& v, char* dst)
+        {
+            dst = length::encode(uint32_t(v.size()), dst);
+            std::memcpy(dst, v.data(), v.size());
+            return dst + v.size();
+        }
+
+        static const char* decode(byte_buffer* v, const char* src, const char* end)
+        {
+            uint32_t n;
+            src = length::decode(&n, src, end);
+            if( src == nullptr || n > byte_buffer::max_size() || size_t(end - src) < n )
+                return nullptr;
+            v->clear();
+            v->append(array_ref<const char>(src, n));
+            return src + n;
+        }
+
+        static bool write(stream::abstract_output_stream* out, const byte_buffer& v)
+        {
+            return length::write(out, uint32_t(v.size())) && write_raw(out, v.data(), v.size());
+        }
+
+        // the length comes from the stream, so the buffer only grows as data arrives
+        static constexpr size_t ReadChunkSize = 64 * 1024;
+
+        static bool read(stream::abstract_input_stream* in, byte_buffer* v)
+        {
+            uint32_t n;
+            if( ! length::read(in, &n) || n > byte_buffer::max_size() )
+                return false;
+            v->clear();
+            while( v->size() < n ) {
+                const size_t offset = v->size();
+                const size_t chunk = std::min(ReadChunkSize, n - offset);
+                v->resize(offset + chunk);
+                if( ! read_raw(in, static_cast<char*>(v->data()) + offset, chunk) )
+                    return false;
+            }
+            return true;
+        }
+    };
+
+
+    // field descriptors
+
+    template< typename Field >
+    struct field_codec;
+
+    template< typename Codec, auto Member >
+    struct member_codec {
+        using class_type = typename member_traits<decltype(Member)>::class_type;
+
+        static size_t bound(const class_type& v) { return Codec::bound(v.*Member); }
+        static char* encode(const class_type& v, char* dst) { return Codec::encode(v.*Member, dst); }
+        static const char* decode(class_type* v, const char* src, const char* end) { return Codec::decode(&(v->*Member), src, end); }
+        static bool write(stream::abstract_output_stream* out, const class_type& v) { return Codec::write(out, v.*Member); }
+        static bool read(stream::abstract_input_stream* in, class_type* v) { return Codec::read(in, &(v->*Member)); }
+    };
+
+    template< auto Member, ByteOrder Order >
+    struct field_codec<fixed<Member, Order>>
+        : member_codec<fixed_codec<Order, typename member_traits<decltype(Member)>::type>, Member> {};
+
+    template< auto Member >
+    struct field_codec<varint<Member>>
+        : member_codec<varint_codec<typename member_traits<decltype(Member)>::type>, Member> {};
+
+    template< auto Member >
+    struct field_codec<bytes<Member>>
+        : member_codec<bytes_codec, Member> {
+        static_assert(std::is_same_v<typename member_traits<decltype(Member)>::type, byte_buffer>,
+                      "bytes fields must be byte_buffer members");
+    };
+
+
+    template< typename List >
+    struct struct_codec;
+
+    template< typename... Fields >
+    struct struct_codec<field_list<Fields...>> {
+        template< typename T >
+        static size_t bound(const T& v)
+        {
+            return (size_t(0) + ... + field_codec<Fields>::bound(v));
+        }
+
+        template< typename T >
+        static char* encode(const T& v, char* dst)
+        {
+            ((dst = field_codec<Fields>::encode(v, dst)), ...);
+            return dst;
+        }
+
+        template< typename T >
+        static const char* decode(T* v, const char* src, const char* end)
+        {
+            // stops at the first failing field
+            ((src = (src == nullptr ? nullptr : field_codec<Fields>::decode(v, src, end))), ...);
+            return src;
+        }
+
+        template< typename T >
+        static bool write(stream::abstract_output_stream* out, const T& v)
+        {
+            return (field_codec<Fields>::write(out, v) && ...);
+        }
+
+        template< typename T >
+        static bool read(stream::abstract_input_stream* in, T* v)
+        {
+            return (field_codec<Fields>::read(in, v) && ...);
+        }
+    };
+
+    template< typename... Fields >
+    struct_codec<field_list<Fields...>> field_list_codec(const field_list<Fields...>*);
+
+    template< typename T >
+    using codec_for = decltype(field_list_codec(static_cast<const fields<T>*>(nullptr)));
+
+}
+
+
+    // implementation
+
+    template< typename T >
+    inline size_t encoded_size_bound(const T& v)
+    {
+        return detail::codec_for<T>::bound(v);
+    }
+
+    template< typename T >
+    inline char* encode(const T& v, char* dst)
+    {
+        return detail::codec_for<T>::encode(v, dst);
+    }
+
+    template< typename T >
+    inline void append(const T& v, byte_buffer* dst)
+    {
+        const auto n = encoded_size_bound(v);
+        if( dst->capacity() - dst->size() < n )
+            dst->reserve(std::max(dst->size() + n, dst->capacity() * 2));
+        char* begin = static_cast<char*>(dst->append_begin().data());
+        dst->append_commit(size_t(encode(v, begin) - begin));
+    }
+
+    template< typename T >
+    inline const char* decode(T* v, const char* src, const char* end)
+    {
+        return detail::codec_for<T>::decode(v, src, end);
+    }
+
+    template< typename T >
+    inline bool write(stream::abstract_output_stream* out, const T& v)
+    {
+        if( out->manages_buffer() ) {
+            auto buf = out->get_buffer(stream::Mode::Blocking);
+            if( buf.byte_size() >= encoded_size_bound(v) ) {
+                char* begin = static_cast<char*>(buf.data());
+                out->advance_buffer(size_t(encode(v, begin) - begin));
+                return true;
+            }
+            if( buf.data() == nullptr )
+                return false;
+        }
+        return detail::codec_for<T>::write(out, v);
+    }
+
+    template< typename T >
+    inline bool read(stream::abstract_input_stream* in, T* v)
+    {
+        if( in->manages_buffer() ) {
+            auto buf = in->get_buffer(stream::Mode::Blocking);
+            if( buf.data() == nullptr )
+                return false;
+            const char* begin = static_cast<const char*>(buf.data());
+            if( const char* end = decode(v, begin, begin + buf.byte_size()) ) {
+                in->advance_buffer(size_t(end - begin));
+                return true;
+            }
+        }
+        return detail::codec_for<T>::read(in, v);
+    }
+
+}
+}
+
+#endif
@@ -0,0 +1,209 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef LIBLBU_SHARED_BUFFER_H
+#define LIBLBU_SHARED_BUFFER_H
+
+#include "lbu/byte_buffer.h"
+
+#include <atomic>
+#include <new>
+
+namespace lbu {
+
+    // An immutable, reference counted byte buffer, to hand one payload to several
+    // consumers (possibly on other threads) without copying it.
+    //
+    // - copies and slices share the allocation, they only bump an atomic counter
+    // - a slice is a view of offset/length into the same allocation
+    // - made from a byte_buffer&& it takes over the malloced data (small buffers are
+    //   copied, they are stored inline in the byte_buffer)
+    // - to_byte_buffer() gives back a mutable byte_buffer, moving the allocation if this
+    //   is its only reference (copy on write), copying otherwise
+    //
+    // The counter is the only shared state; one shared_buffer object must not be used by
+    // several threads at once without synchronization, like any other value type.
+    class shared_buffer {
+    public:
+        shared_buffer() = default;
+        ~shared_buffer() { release(); }
+        explicit shared_buffer(byte_buffer&& buf);
+        explicit shared_buffer(array_ref<const void> data);
+
+        shared_buffer(const shared_buffer& other);
+        shared_buffer& operator=(const shared_buffer& other);
+        shared_buffer(shared_buffer&& other);
+        shared_buffer& operator=(shared_buffer&& other);
+
+        size_t size() const { return length; }
+        bool is_empty() const { return length == 0; }
+
+        const void* data() const { return ptr; }
+        array_ref<const void> ref() const { return array_ref<const char>(ptr, length); }
+
+        /// \brief A view of \p count bytes at \p offset, sharing the allocation.
+        shared_buffer slice(size_t offset, size_t count) const;
+        shared_buffer slice(size_t offset) const;
+
+        /// \brief True iff no other shared_buffer refers to the allocation.
+        bool is_unique() const;
+
+        /// \brief A mutable copy.
+        byte_buffer to_byte_buffer() const &;
+        /// \brief A mutable byte_buffer, taking over the allocation if this is its only reference.
+        byte_buffer to_byte_buffer() &&;
+
+        void clear() { release(); }
+
+    private:
+        struct block {
+            std::atomic<uint32_t> refs;
+            uint32_t capacity;      // of data
+            char* data;             // the adopted malloced buffer, or the storage behind the block
+        };
+
+        static char* inline_storage(block* b) { return reinterpret_cast<char*>(b + 1); }
+
+        void release();
+        void move_from(shared_buffer& other);
+
+        block* b = {};
+        const char* ptr = {};
+        size_t length = 0;
+    };
+
+    // implementation
+
+    inline shared_buffer::shared_buffer(byte_buffer&& buf)
+    {
+        const auto size = buf.size();
+        if( size == 0 )
+            return;
+        const auto capacity = buf.capacity();
+        auto data = buf.release_raw_malloc();
+        if( ! data ) {
+            *this = shared_buffer(buf.ref());
+            buf.clear();
+            return;
+        }
+        b = new (xmalloc_bytes<char>(sizeof(block))) block{{1}, uint32_t(capacity), static_cast<char*>(data.release())};
+        ptr = b->data;
+        length = size;
+    }
+
+    inline shared_buffer::shared_buffer(array_ref<const void> data)
+    {
+        const auto size = data.byte_size();
+        if( size == 0 )
+            return;
+        assert(size <= byte_buffer::max_size());
+        auto mem = xmalloc_bytes<char>(sizeof(block) + size);
+        b = new (mem) block{{1}, uint32_t(size), {}};
+        b->data = inline_storage(b);
+        std::memcpy(b->data, data.data(), size);
+        ptr = b->data;
+        length = size;
+    }
+
+    inline shared_buffer::shared_buffer(const shared_buffer& other)
+        : b(other.b)
+        , ptr(other.ptr)
+        , length(other.length)
+    {
+        if( b )
+            b->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    inline shared_buffer& shared_buffer::operator=(const shared_buffer& other)
+    {
+        return operator =(shared_buffer(other));
+    }
+
+    inline shared_buffer::shared_buffer(shared_buffer&& other)
+    {
+        move_from(other);
+    }
+
+    inline shared_buffer& shared_buffer::operator=(shared_buffer&& other)
+    {
+        if( this != &other ) {
+            release();
+            move_from(other);
+        }
+        return *this;
+    }
+
+    inline shared_buffer shared_buffer::slice(size_t offset, size_t count) const
+    {
+        assert(offset <= length && count <= length - offset);
+        if( count == 0 )
+            return {};
+        shared_buffer s(*this);
+        s.ptr += offset;
+        s.length = count;
+        return s;
+    }
+
+    inline shared_buffer shared_buffer::slice(size_t offset) const
+    {
+        assert(offset <= length);
+        return slice(offset, length - offset);
+    }
+
+    inline bool shared_buffer::is_unique() const
+    {
+        return b && b->refs.load(std::memory_order_acquire) == 1;
+    }
+
+    inline byte_buffer shared_buffer::to_byte_buffer() const &
+    {
+        return byte_buffer(ref());
+    }
+
+    inline byte_buffer shared_buffer::to_byte_buffer() &&
+    {
+        if( ! is_unique() || b->data == inline_storage(b) ) {
+            auto r = byte_buffer(ref());
+            release();
+            return r;
+        }
+        char* data = b->data;
+        if( ptr != data )
+            std::memmove(data, ptr, length);
+        byte_buffer r;
+        r.adopt_raw_malloc(unique_ptr_raw(data), length, b->capacity);
+        b->~block();
+        ::free(b);
+        b = nullptr;
+        ptr = nullptr;
+        length = 0;
+        return r;
+    }
+
+    inline void shared_buffer::release()
+    {
+        if( b && b->refs.fetch_sub(1, std::memory_order_acq_rel) == 1 ) {
+            if( b->data != inline_storage(b) )
+                ::free(b->data);
+            b->~block();
+            ::free(b);
+        }
+        b = nullptr;
+        ptr = nullptr;
+        length = 0;
+    }
+
+    inline void shared_buffer::move_from(shared_buffer& other)
+    {
+        b = other.b;
+        ptr = other.ptr;
+        length = other.length;
+        other.b = nullptr;
+        other.ptr = nullptr;
+        other.length = 0;
+    }
+
+}
+
+#endif
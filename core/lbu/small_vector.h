@@ -0,0 +1,276 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef LIBLBU_SMALL_VECTOR_H
+#define LIBLBU_SMALL_VECTOR_H
+
+#include "lbu/array_ref.h"
+#include "lbu/dynamic_memory.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <limits>
+#include <stdint.h>
+#include <type_traits>
+
+namespace lbu {
+
+    // The byte_buffer approach for arrays of trivial types (e.g. io_vector, pollfd):
+    // - stores up to N elements inline without allocating
+    // - grows with realloc, elements are never constructed or copied one by one
+    // - resize/append_n zero initialize only what they add, append_begin/append_commit
+    //   allow filling uninitialized capacity directly
+    // - can adopt/release malloced buffers
+    // - sizes are 32 bit, max_size() elements at most
+    template< typename T, unsigned N >
+    class small_vector {
+        static_assert(std::is_trivial_v<T>, "small_vector only supports trivial types");
+
+    public:
+        using value_type = T;
+        using size_type = size_t;
+        using iterator = T*;
+        using const_iterator = const T*;
+
+        small_vector() = default;
+        ~small_vector() { cleanup(); }
+        explicit small_vector(array_ref<const T> data) { append(data); }
+
+        small_vector(const small_vector& other) : small_vector(other.ref()) {}
+        small_vector& operator=(const small_vector& other)
+        {
+            if( this != &other ) {
+                clear();
+                append(other.ref());
+            }
+            return *this;
+        }
+        small_vector(small_vector&& other) noexcept { move_from(other); }
+        small_vector& operator=(small_vector&& other) noexcept
+        {
+            if( this != &other ) {
+                cleanup();
+                move_from(other);
+            }
+            return *this;
+        }
+
+        size_t size() const { return n; }
+        bool is_empty() const { return n == 0; }
+        size_t capacity() const { return cap; }
+        static constexpr size_t inline_capacity() { return N; }
+        static constexpr size_t max_size() { return std::numeric_limits<uint32_t>::max() / sizeof(T); }
+
+        T* data() { return ptr(); }
+        const T* data() const { return ptr(); }
+
+        array_ref<T> ref() { return {ptr(), n}; }
+        array_ref<const T> ref() const { return {ptr(), n}; }
+
+        T& operator[](size_t idx) { assert(idx < n); return ptr()[idx]; }
+        const T& operator[](size_t idx) const { assert(idx < n); return ptr()[idx]; }
+        T& front() { return (*this)[0]; }
+        const T& front() const { return (*this)[0]; }
+        T& back() { return (*this)[n - 1]; }
+        const T& back() const { return (*this)[n - 1]; }
+
+        iterator begin() { return ptr(); }
+        iterator end() { return ptr() + n; }
+        const_iterator begin() const { return ptr(); }
+        const_iterator end() const { return ptr() + n; }
+
+        void reserve(size_t capacity)
+        {
+            if( capacity > cap )
+                set_capacity_checked(capacity);
+        }
+        void shrink_to_fit() { set_capacity_checked(n); }
+        void set_capacity(size_t capacity) { set_capacity_checked(std::max(capacity, size_t(n))); }
+
+        void clear() { n = 0; }
+        void resize(size_t count)
+        {
+            if( count > n )
+                append_n(count - n);
+            else
+                n = uint32_t(count);
+        }
+        void chop(size_t count) { n = count > n ? 0 : uint32_t(n - count); }
+
+        // value may be an element of this vector, so it is copied before growing
+        small_vector& append(const T& value)
+        {
+            const T v = value;
+            if( n == cap )
+                set_capacity_checked(grow_capacity(size_t(n) + 1));
+            ptr()[n++] = v;
+            return *this;
+        }
+        small_vector& append_n(size_t count, const T& value = T())
+        {
+            const T v = value;
+            auto a = append_base(count);
+            std::fill(a.begin(), a.end(), v);
+            return *this;
+        }
+        small_vector& append(array_ref<const T> data)
+        {
+            // data may point into this vector
+            if( data.size() > cap - n && data.data() >= ptr() && data.data() < ptr() + n ) {
+                const small_vector tmp(data);
+                return append(tmp.ref());
+            }
+            auto a = append_base(data.size());
+            std::memcpy(a.data(), data.data(), a.byte_size());
+            return *this;
+        }
+
+        /// \brief Uninitialized free capacity behind the elements, reserve first to get enough.
+        array_ref<T> append_begin() { return {ptr() + n, cap - n}; }
+        void append_commit(size_t count)
+        {
+            assert(cap - n >= count);
+            n += uint32_t(count);
+        }
+
+        array_ref<T> insert_uninitialized(size_t index, size_t count)
+        {
+            assert(index <= n);
+            const size_t old_size = n;
+            append_base(count);
+            T* p = ptr() + index;
+            std::memmove(p + count, p, (old_size - index) * sizeof(T));
+            return {p, count};
+        }
+        small_vector& insert(size_t index, const T& value)
+        {
+            const T v = value;
+            insert_uninitialized(index, 1)[0] = v;
+            return *this;
+        }
+
+        small_vector& erase(size_t index, size_t count = 1)
+        {
+            assert(index <= n);
+            count = std::min(size_t(n) - index, count);
+            T* p = ptr() + index;
+            std::memmove(p, p + count, (n - index - count) * sizeof(T));
+            n -= uint32_t(count);
+            return *this;
+        }
+
+        /// \brief Take ownership of a malloced array of \p size elements and \p capacity elements room.
+        void adopt_raw_malloc(unique_ptr_raw data, size_t size) { adopt_raw_malloc(std::move(data), size, size); }
+        void adopt_raw_malloc(unique_ptr_raw data, size_t size, size_t capacity)
+        {
+            assert(capacity >= size && capacity <= max_size());
+            cleanup();
+            if( capacity <= N ) {
+                std::memcpy(small, data.get(), size * sizeof(T));
+                set_inline(size);
+            } else {
+                ext = static_cast<T*>(data.release());
+                n = uint32_t(size);
+                cap = uint32_t(capacity);
+            }
+        }
+
+        /// \brief Give up the malloced storage (capacity() elements, size() of which are used).
+        ///
+        /// Inline stored elements are copied to a new malloced buffer; an empty vector
+        /// returns nullptr. The vector is empty afterwards.
+        unique_ptr_raw release_raw_malloc()
+        {
+            void* p;
+            if( ext != nullptr ) {
+                p = ext;
+            } else {
+                p = xmalloc_bytes<char>(size_t(n) * sizeof(T));
+                if( p )
+                    std::memcpy(p, small, size_t(n) * sizeof(T));
+            }
+            set_inline(0);
+            return unique_ptr_raw(p);
+        }
+
+    private:
+        T* ptr() { return ext != nullptr ? ext : small; }
+        const T* ptr() const { return ext != nullptr ? ext : small; }
+
+        void set_inline(size_t size)
+        {
+            ext = nullptr;
+            n = uint32_t(size);
+            cap = N;
+        }
+
+        array_ref<T> append_base(size_t count)
+        {
+            const size_t old_size = n;
+            assert(max_size() - old_size >= count);
+            const size_t new_size = old_size + count;
+            if( cap < new_size )
+                set_capacity_checked(grow_capacity(new_size));
+            n = uint32_t(new_size);
+            return {ptr() + old_size, count};
+        }
+
+        void set_capacity_checked(size_t capacity)
+        {
+            assert(capacity >= n && capacity <= max_size());
+            if( capacity <= N ) {
+                if( ext == nullptr )
+                    return;
+                T* old = ext;
+                std::memcpy(small, old, size_t(n) * sizeof(T));
+                set_inline(n);
+                ::free(old);
+            } else if( ext == nullptr ) {
+                T* c = reinterpret_cast<T*>(xmalloc_bytes<char>(capacity * sizeof(T)));
+                std::memcpy(c, small, size_t(n) * sizeof(T));
+                ext = c;
+                cap = uint32_t(capacity);
+            } else {
+                ext = reinterpret_cast<T*>(xrealloc_bytes<char>(reinterpret_cast<char*>(ext), capacity * sizeof(T)));
+                cap = uint32_t(capacity);
+            }
+        }
+
+        size_t grow_capacity(size_t size) const
+        {
+            assert(size <= max_size());
+            if( cap >= max_size() / 2 )
+                return max_size();
+            return std::max({size_t(cap) * 2, size, size_t(4)});
+        }
+
+        void cleanup()
+        {
+            if( ext != nullptr )
+                ::free(ext);
+        }
+
+        void move_from(small_vector& other)
+        {
+            if( other.ext != nullptr ) {
+                ext = other.ext;
+                n = other.n;
+                cap = other.cap;
+            } else {
+                std::memcpy(small, other.small, size_t(other.n) * sizeof(T));
+                set_inline(other.n);
+            }
+            other.set_inline(0);
+        }
+
+        T* ext = nullptr; // nullptr while the elements are stored inline
+        uint32_t n = 0;
+        uint32_t cap = N;
+        T small[N > 0 ? N : 1];
+    };
+
+}
+
+#endif
@@ -0,0 +1,182 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef LIBLBU_STREAM_STATISTICS_H
+#define LIBLBU_STREAM_STATISTICS_H
+
+#include "lbu/lbu_global.h"
+#include "lbu/math.h"
+
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+
+// Opt-in instrumentation for the stream implementations of this library.
+//
+// The counters are only updated when lbu was configured with LBU_STREAM_STATS
+// (which defines LIBLBU_STREAM_STATS in lbu_global.h). Otherwise all hooks
+// compile to nothing and attaching a stream_statistics object has no effect.
+//
+// All updates use relaxed atomics, so one statistics object may be shared by
+// several streams (e.g. both ends of a ring) and read concurrently by a
+// monitoring thread; the values are however not a consistent snapshot.
+
+namespace lbu {
+namespace stream {
+
+    // Log-linear histogram in the spirit of HdrHistogram: values are grouped by their
+    // power of two magnitude and each magnitude is split into SubBucketCount linear
+    // sub-buckets, so the relative error of any reported value is below 1/SubBucketCount
+    // over the whole uint64_t range.
+    class latency_histogram {
+    public:
+        static constexpr unsigned SubBucketBits = 3;
+        static constexpr unsigned SubBucketCount = 1u << SubBucketBits;
+        static constexpr unsigned BucketCount = (64 - SubBucketBits + 1) * SubBucketCount;
+
+        void record(uint64_t value)
+        {
+            buckets[bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+        }
+
+        uint64_t bucket_count(unsigned index) const
+        {
+            assert(index < BucketCount);
+            return buckets[index].load(std::memory_order_relaxed);
+        }
+
+        uint64_t count() const
+        {
+            uint64_t sum = 0;
+            for( const auto& b : buckets )
+                sum += b.load(std::memory_order_relaxed);
+            return sum;
+        }
+
+        /// \brief Upper bound of the bucket containing the given percentile (0 - 100).
+        ///
+        /// Returns 0 for an empty histogram.
+        uint64_t value_at_percentile(double percentile) const
+        {
+            const uint64_t total = count();
+            if( total == 0 )
+                return 0;
+            auto target = uint64_t(double(total) * std::clamp(percentile, 0.0, 100.0) / 100.0 + 0.5);
+            target = std::max(target, uint64_t(1));
+            uint64_t sum = 0;
+            for( unsigned i = 0; i < BucketCount; ++i ) {
+                sum += bucket_count(i);
+                if( sum >= target )
+                    return bucket_upper_bound(i);
+            }
+            return bucket_upper_bound(BucketCount - 1);
+        }
+
+        void reset()
+        {
+            for( auto& b : buckets )
+                b.store(0, std::memory_order_relaxed);
+        }
+
+        static unsigned bucket_index(uint64_t value)
+        {
+            if( value < SubBucketCount )
+                return unsigned(value);
+            const auto shift = unsigned(ilog2_floor(value)) - SubBucketBits;
+            return (shift + 1) * SubBucketCount + unsigned(value >> shift) - SubBucketCount;
+        }
+
+        static uint64_t bucket_upper_bound(unsigned index)
+        {
+            assert(index < BucketCount);
+            if( index < SubBucketCount )
+                return index;
+            const unsigned shift = index / SubBucketCount - 1;
+            const uint64_t base = uint64_t(index % SubBucketCount + SubBucketCount) << shift;
+            return base + ((uint64_t(1) << shift) - 1);
+        }
+
+    private:
+        std::atomic<uint64_t> buckets[BucketCount] = {};
+    };
+
+
+    struct stream_statistics {
+#ifdef LIBLBU_STREAM_STATS
+        static constexpr bool enabled = true;
+#else
+        static constexpr bool enabled = false;
+#endif
+
+        std::atomic<uint64_t> bytes{0};             // bytes moved through the backend (syscalls, ring indices, ...)
+        std::atomic<uint64_t> syscalls{0};
+        std::atomic<uint64_t> would_block{0};       // non-blocking requests that could not make progress
+        std::atomic<uint64_t> wakeups_sent{0};      // eventfd signals to the peer of a ring
+        std::atomic<uint64_t> wakeups_received{0};  // returns from waiting on the eventfd of a ring
+        std::atomic<uint64_t> buffer_refills{0};    // new internal buffer windows handed out
+        std::atomic<uint64_t> blocked_ns{0};        // total time spent in blocking waits resp. syscalls
+        latency_histogram blocked_latency;          // per wait, in ns
+
+        void reset()
+        {
+            for( auto c : { &bytes, &syscalls, &would_block, &wakeups_sent,
+                            &wakeups_received, &buffer_refills, &blocked_ns } )
+                c->store(0, std::memory_order_relaxed);
+            blocked_latency.reset();
+        }
+    };
+
+    using stream_counter = std::atomic<uint64_t> stream_statistics::*;
+
+
+namespace detail {
+
+    inline void stats_add(stream_statistics* s, stream_counter c, uint64_t count = 1)
+    {
+#ifdef LIBLBU_STREAM_STATS
+        if( s )
+            (s->*c).fetch_add(count, std::memory_order_relaxed);
+#else
+        (void)s; (void)c; (void)count;
+#endif
+    }
+
+    // Measures the lifetime of the scope as blocked time
+    class stats_blocking_scope {
+    public:
+#ifdef LIBLBU_STREAM_STATS
+        explicit stats_blocking_scope(stream_statistics* s) : stats(s)
+        {
+            if( stats )
+                start = std::chrono::steady_clock::now();
+        }
+
+        ~stats_blocking_scope()
+        {
+            if( ! stats )
+                return;
+            const auto d = std::chrono::steady_clock::now() - start;
+            const auto ns = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+            stats->blocked_ns.fetch_add(ns, std::memory_order_relaxed);
+            stats->blocked_latency.record(ns);
+        }
+
+    private:
+        stream_statistics* stats;
+        std::chrono::steady_clock::time_point start;
+#else
+        explicit stats_blocking_scope(stream_statistics*) {}
+#endif
+
+    public:
+        stats_blocking_scope(const stats_blocking_scope&) = delete;
+        stats_blocking_scope& operator=(const stats_blocking_scope&) = delete;
+    };
+
+}
+
+}
+}
+
+#endif
@@ -0,0 +1,83 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef LIBLBU_TEE_STREAM_H
+#define LIBLBU_TEE_STREAM_H
+
+#include "lbu/abstract_stream.h"
+#include "lbu/fd.h"
+
+#include <vector>
+
+namespace lbu {
+namespace stream {
+
+    // An output stream that writes everything to several sinks, e.g. a journal file, a
+    // socket and a ring at once.
+    //
+    // Data is written once into the internal buffer window and from there sent to each
+    // sink on its own: fd sinks with write straight from the window, buffered streams
+    // (like a ring_spsc::output_stream) with one memcpy into their buffer, and unbuffered
+    // streams with direct_write. Each sink makes as much progress as it can, so a slow sink
+    // only holds up the others once it lags behind by the whole window: then NonBlocking
+    // requests make no progress and Blocking ones wait for it.
+    //
+    // fd sinks are made non-blocking while the tee exists, blocking requests poll until
+    // they are writable; the destructor restores the blocking state they were added with.
+    // Stream sinks are flushed when the tee is flushed.
+    //
+    // A failing sink is a stream error of the tee, failed_sink() tells which one.
+    class tee_output_stream : public abstract_output_stream {
+    public:
+        /// \p buffer is the window all data passes through, it must not be empty.
+        explicit LIBLBU_EXPORT tee_output_stream(array_ref<void> buffer);
+        LIBLBU_EXPORT ~tee_output_stream() override;
+
+        /// \brief Add a sink, it receives the data written from then on.
+        ///
+        /// For fd sinks, returns false and sets *error if the fd can't be made non-blocking.
+        bool LIBLBU_EXPORT add_sink(fd f, int* error);
+        void LIBLBU_EXPORT add_sink(abstract_output_stream* s);
+
+        size_t sink_count() const { return sinks.size(); }
+
+        /// \brief Index of the sink that caused a stream error, or -1.
+        int failed_sink() const { return failed; }
+        /// \brief The errno value of a failed fd sink, 0 otherwise.
+        int status() const { return err; }
+
+        /// \brief Bytes the slowest sink still has to receive.
+        size_t LIBLBU_EXPORT max_lag() const;
+
+    protected:
+        ssize_t LIBLBU_EXPORT write_stream(array_ref<io::io_vector> buf_array, Mode mode) override;
+        array_ref<void> LIBLBU_EXPORT get_write_buffer(Mode mode) override;
+        bool LIBLBU_EXPORT write_buffer_flush(Mode mode) override;
+
+        tee_output_stream(tee_output_stream&&) = default;
+        tee_output_stream& operator=(tee_output_stream&&) = default;
+
+    private:
+        struct sink {
+            fd filedes;
+            abstract_output_stream* stream;
+            uint32_t sent;      // offset into the window
+            bool restore_blocking;
+        };
+
+        bool send(size_t index, Mode mode);
+        bool progress(Mode mode);
+        void compact();
+        bool fail(size_t index, int error);
+
+        std::vector<sink> sinks;
+        uint32_t buffer_capacity;
+        int failed = -1;
+        int err = 0;
+    };
+
+}
+}
+
+#endif
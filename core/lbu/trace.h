@@ -0,0 +1,182 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef LIBLBU_TRACE_H
+#define LIBLBU_TRACE_H
+
+#include "lbu/lbu_global.h"
+#include "lbu/array_ref.h"
+#include "lbu/fd.h"
+
+#include <chrono>
+#include <stdint.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Low overhead binary event tracing.
+//
+// Every thread records fixed size events into its own single producer ring
+// buffer (registered lazily on the first event of the thread), a collector
+// thread owned by the active session drains all rings periodically into a
+// file descriptor. Recording an event is a handful of instructions plus a
+// timestamp counter read; if a thread ring is full the event is dropped and
+// accounted for with an EventDropped record instead of blocking.
+//
+// Without an active session recording is a cheap no-op, so trace points can
+// stay in production code. The trace points inside lbu itself (ring publish,
+// fd flush, alsa commit) are only compiled in when lbu was configured with
+// LBU_TRACE (which defines LIBLBU_TRACE in lbu_global.h).
+//
+// Use write_chrome_json to convert a recorded file into the Chrome trace event
+// JSON format, which can be loaded by chrome://tracing and Perfetto.
+
+namespace lbu {
+namespace trace {
+
+    enum class Phase : uint8_t {
+        Instant,
+        Begin,
+        End,
+        Counter     // arg0 is the counter value
+    };
+
+    enum EventId : uint16_t {
+        EventDropped = 1,           // arg0: number of events lost since the last record of the thread
+        EventCalibration = 2,       // ticks = timestamp counter, arg0 = CLOCK_MONOTONIC in ns
+
+        EventRingPublish = 16,      // arg0: bytes made available to the consumer
+        EventRingRelease = 17,      // arg0: bytes given back to the producer
+        EventFdFlush = 18,          // arg0: buffered bytes to flush, arg1: 1 if the buffer was flushed completely
+        EventAlsaCommit = 19,       // arg0: frames committed, arg1: snd_pcm_mmap_commit result
+
+        EventUserFirst = 1024       // application defined ids start here
+    };
+
+    struct event {
+        uint64_t ticks;
+        uint16_t id;
+        Phase phase;
+        uint8_t reserved;
+        uint32_t thread;
+        uint64_t arg0;
+        uint64_t arg1;
+    };
+    static_assert(sizeof(event) == 32);
+
+    // Timestamp counter used for events; converted to time using the calibration
+    // records of the trace file.
+    inline uint64_t ticks()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return uint64_t(ts.tv_sec) * 1000000000u + uint64_t(ts.tv_nsec);
+#endif
+    }
+
+    void LIBLBU_EXPORT record(uint16_t id, Phase phase, uint64_t arg0, uint64_t arg1);
+
+    inline void instant(uint16_t id, uint64_t arg0 = 0, uint64_t arg1 = 0) { record(id, Phase::Instant, arg0, arg1); }
+    inline void begin(uint16_t id, uint64_t arg0 = 0, uint64_t arg1 = 0) { record(id, Phase::Begin, arg0, arg1); }
+    inline void end(uint16_t id, uint64_t arg0 = 0, uint64_t arg1 = 0) { record(id, Phase::End, arg0, arg1); }
+    inline void counter(uint16_t id, uint64_t value) { record(id, Phase::Counter, value, 0); }
+
+    class scope {
+    public:
+        explicit scope(uint16_t id, uint64_t arg0 = 0, uint64_t arg1 = 0) : event_id(id) { begin(id, arg0, arg1); }
+        ~scope() { end(event_id); }
+
+        scope(const scope&) = delete;
+        scope& operator=(const scope&) = delete;
+
+    private:
+        uint16_t event_id;
+    };
+
+
+    // Only one session can be active at a time; constructing a second one while
+    // another is active results in an inactive session that records nothing.
+    class session {
+    public:
+        static constexpr uint32_t DefaultThreadBufferEvents = 16384;
+        static constexpr std::chrono::milliseconds DefaultFlushInterval{10};
+
+        // The file descriptor is not owned and must stay valid for the lifetime of the session.
+        explicit LIBLBU_EXPORT session(fd output,
+                                       uint32_t thread_buffer_events = DefaultThreadBufferEvents,
+                                       std::chrono::milliseconds flush_interval = DefaultFlushInterval);
+        // Stops the collector after a final drain of all thread rings.
+        LIBLBU_EXPORT ~session();
+
+        bool is_active() const { return d != nullptr; }
+        explicit operator bool() const { return is_active(); }
+
+        // errno of the first failed write to the output, 0 if none.
+        int LIBLBU_EXPORT status() const;
+
+        session(const session&) = delete;
+        session& operator=(const session&) = delete;
+
+    private:
+        struct internal;
+        internal* d = {};
+    };
+
+
+    // file format, all values little endian:
+    // file_header followed by event records, as laid out in the event struct. Every
+    // write of the collector ends with an EventCalibration record.
+    struct file_header {
+        static constexpr char Magic[8] = {'L', 'B', 'U', 'T', 'R', 'A', 'C', 'E'};
+        static constexpr uint32_t Version = 1;
+
+        char magic[8];
+        uint32_t version;
+        uint32_t event_size;
+        uint64_t start_ticks;
+        uint64_t start_ns;      // CLOCK_MONOTONIC
+        uint32_t pid;
+        uint32_t reserved;
+    };
+    static_assert(sizeof(file_header) == 40);
+
+    struct event_name {
+        uint16_t id;
+        const char* name;
+    };
+
+    enum ConvertStatus {
+        ConvertNoError = 0,
+        ConvertInvalidFormat = -1,
+        ConvertMissingCalibration = -2  // events but no calibration record to convert their ticks to time
+        // other values are errno of a failed read or write
+    };
+
+    // Converts a recorded trace into Chrome trace event JSON. Events without an entry
+    // in \p names (or the built in lbu names) are called "event_<id>". Nothing is written
+    // if the conversion fails before the first event.
+    int LIBLBU_EXPORT write_chrome_json(fd trace_file, fd json_output, array_ref<const event_name> names = {});
+
+namespace detail {
+
+    inline void lib_event(uint16_t id, uint64_t arg0 = 0, uint64_t arg1 = 0)
+    {
+#ifdef LIBLBU_TRACE
+        instant(id, arg0, arg1);
+#else
+        (void)id; (void)arg0; (void)arg1;
+#endif
+    }
+
+}
+
+}
+}
+
+#endif
@@ -0,0 +1,192 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef LIBLBU_VARINT_H
+#define LIBLBU_VARINT_H
+
+#include "lbu/lbu_global.h"
+#include "lbu/abstract_stream.h"
+#include "lbu/array_ref.h"
+
+#include <limits>
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+
+// LEB128 style variable length integers: 7 bits per byte, least significant group
+// first, the high bit of a byte marks that more bytes follow. Signed values are
+// zigzag mapped first, so small negative values stay short.
+//
+// For arrays of 32 bit integers there are two bulk formats with SIMD decoding:
+//
+//  * group varint: groups of four values, each group is one tag byte holding four
+//    2 bit lengths (value i in bits 2i and 2i+1, length - 1) followed by the values
+//    as 1 to 4 little endian bytes.
+//  * stream vbyte: the same tags, but all tag bytes are stored in front of the data
+//    bytes, which makes decoding independent of the data dependency chain.
+//
+// Neither bulk format stores the value count, the caller has to transfer it.
+
+namespace lbu {
+namespace varint {
+
+    template< typename UIntType >
+    constexpr unsigned max_bytes()
+    {
+        static_assert(std::is_unsigned_v<UIntType>);
+        return (std::numeric_limits<UIntType>::digits + 6) / 7;
+    }
+
+    template< typename IntType >
+    constexpr std::make_unsigned_t<IntType> zigzag_encode(IntType v)
+    {
+        static_assert(std::is_integral_v<IntType> && std::is_signed_v<IntType>);
+        using U = std::make_unsigned_t<IntType>;
+        return (U(v) << 1) ^ U(v < 0 ? ~U(0) : U(0));
+    }
+
+    template< typename UIntType >
+    constexpr std::make_signed_t<UIntType> zigzag_decode(UIntType v)
+    {
+        static_assert(std::is_unsigned_v<UIntType>);
+        using S = std::make_signed_t<UIntType>;
+        return S((v >> 1) ^ (~(v & 1) + 1));
+    }
+
+    template< typename UIntType >
+    constexpr unsigned encoded_size(UIntType v)
+    {
+        static_assert(std::is_unsigned_v<UIntType>);
+        unsigned n = 1;
+        while( v >= 0x80 ) {
+            v >>= 7;
+            ++n;
+        }
+        return n;
+    }
+
+    /// \brief Encode \p v to \p dst, which must have room for `max_bytes<UIntType>()`.
+    ///
+    /// Returns the end of the encoded value.
+    template< typename UIntType >
+    char* encode(UIntType v, char* dst)
+    {
+        static_assert(std::is_unsigned_v<UIntType>);
+        while( v >= 0x80 ) {
+            *dst++ = char(uint8_t(v) | 0x80);
+            v >>= 7;
+        }
+        *dst++ = char(v);
+        return dst;
+    }
+
+    /// \brief Decode a value from [src, end).
+    ///
+    /// Returns the end of the encoded value, or nullptr if the input is truncated or
+    /// does not fit into UIntType.
+    template< typename UIntType >
+    const char* decode(const char* src, const char* end, UIntType* v)
+    {
+        static_assert(std::is_unsigned_v<UIntType>);
+        constexpr unsigned Digits = std::numeric_limits<UIntType>::digits;
+        UIntType result = 0;
+        unsigned shift = 0;
+        while( src != end ) {
+            const auto b = uint8_t(*src++);
+            const auto bits = UIntType(b & 0x7f);
+            if( shift > 0 && (shift >= Digits || (bits >> (Digits - shift)) != 0) )
+                return nullptr;
+            result |= UIntType(bits << shift);
+            if( (b & 0x80) == 0 ) {
+                *v = result;
+                return src;
+            }
+            shift += 7;
+        }
+        return nullptr;
+    }
+
+    /// \brief Write \p v to \p out, returns false on a stream error.
+    template< typename UIntType >
+    bool write(stream::abstract_output_stream* out, UIntType v)
+    {
+        if( out->manages_buffer() ) {
+            auto buf = out->get_buffer(stream::Mode::Blocking);
+            if( buf.byte_size() >= max_bytes<UIntType>() ) {
+                char* begin = static_cast<char*>(buf.data());
+                out->advance_buffer(size_t(encode(v, begin) - begin));
+                return true;
+            }
+            if( buf.data() == nullptr )
+                return false;
+        }
+        char tmp[max_bytes<UIntType>()];
+        const auto size = size_t(encode(v, tmp) - tmp);
+        return out->write(tmp, size, stream::Mode::Blocking) == ssize_t(size);
+    }
+
+    /// \brief Read a value from \p in.
+    ///
+    /// Returns false on a stream error, end of stream or an invalid encoding.
+    template< typename UIntType >
+    bool read(stream::abstract_input_stream* in, UIntType* v)
+    {
+        if( in->manages_buffer() ) {
+            auto buf = in->get_buffer(stream::Mode::Blocking);
+            if( buf.data() == nullptr )
+                return false;
+            const char* begin = static_cast<const char*>(buf.data());
+            if( const char* end = decode(begin, begin + buf.byte_size(), v) ) {
+                in->advance_buffer(size_t(end - begin));
+                return true;
+            }
+            // value continues in the next buffer (or is invalid)
+        }
+        char tmp[max_bytes<UIntType>()];
+        for( unsigned i = 0; i < max_bytes<UIntType>(); ++i ) {
+            if( in->read(tmp + i, 1, stream::Mode::Blocking) != 1 )
+                return false;
+            if( (uint8_t(tmp[i]) & 0x80) == 0 )
+                return decode(tmp, tmp + i + 1, v) != nullptr;
+        }
+        return false;
+    }
+
+
+namespace group {
+
+    constexpr size_t encoded_size_bound(size_t count) { return count * 4 + (count + 3) / 4; }
+
+    /// \brief Encode \p values to \p dst, which must hold `encoded_size_bound(values.size())`.
+    ///
+    /// Returns the encoded size.
+    size_t LIBLBU_EXPORT encode(array_ref<const uint32_t> values, char* dst);
+
+    /// \brief Decode `values.size()` values from [src, end).
+    ///
+    /// Returns the end of the encoded data, or nullptr if the input is truncated.
+    LIBLBU_EXPORT const char* decode(const char* src, const char* end, array_ref<uint32_t> values);
+
+}
+
+namespace stream_vbyte {
+
+    constexpr size_t encoded_size_bound(size_t count) { return count * 4 + (count + 3) / 4; }
+
+    /// \brief Encode \p values to \p dst, which must hold `encoded_size_bound(values.size())`.
+    ///
+    /// Returns the encoded size.
+    size_t LIBLBU_EXPORT encode(array_ref<const uint32_t> values, char* dst);
+
+    /// \brief Decode `values.size()` values from [src, end).
+    ///
+    /// Returns the end of the encoded data, or nullptr if the input is truncated.
+    LIBLBU_EXPORT const char* decode(const char* src, const char* end, array_ref<uint32_t> values);
+
+}
+
+}
+}
+
+#endif
@@ -5,6 +5,9 @@
 #define LIBLBU_VERSION_MINOR ${LIBLBU_VERSION_MINOR}
 #define LIBLBU_VERSION_PATCH ${LIBLBU_VERSION_PATCH}
 
+#cmakedefine LIBLBU_STREAM_STATS
+#cmakedefine LIBLBU_TRACE
+
 #define LIBLBU_EXPORT __attribute__((visibility("default")))
 
 namespace lbu {
@@ -0,0 +1,143 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "lbu/math_array.h"
+
+#include "lbu/cpu_features.h"
+
+#include "math_array_kernels.h"
+
+namespace lbu {
+
+namespace math_array_kernels {
+
+    const table portable = {
+        "portable",
+        &scalar_transform<uint32_t, &scalar_ilog2_floor<uint32_t>>,
+        &scalar_transform<uint64_t, &scalar_ilog2_floor<uint64_t>>,
+        &scalar_transform<uint32_t, &scalar_ilog2_ceil<uint32_t>>,
+        &scalar_transform<uint64_t, &scalar_ilog2_ceil<uint64_t>>,
+        &scalar_transform<uint32_t, &scalar_next_greater_pow2<uint32_t>>,
+        &scalar_transform<uint64_t, &scalar_next_greater_pow2<uint64_t>>,
+        &scalar_idiv_floor<uint32_t>, &scalar_idiv_floor<uint64_t>,
+        &scalar_idiv_ceil<uint32_t>, &scalar_idiv_ceil<uint64_t>,
+        &scalar_abs_array<uint32_t>, &scalar_abs_array<uint64_t>,
+        &scalar_ipow_array<uint32_t>, &scalar_ipow_array<uint64_t>
+    };
+
+}
+
+namespace {
+
+    const math_array_kernels::table& active()
+    {
+        static const math_array_kernels::table& k = *cpu::select<const math_array_kernels::table*>({
+#ifdef LIBLBU_X86_KERNELS
+            {cpu::AVX512, &math_array_kernels::avx512},
+            {cpu::AVX2, &math_array_kernels::avx2},
+            {cpu::SSE2, &math_array_kernels::sse2},
+#endif
+            {0, &math_array_kernels::portable}
+        });
+        return k;
+    }
+
+    template< typename T >
+    math_array_kernels::divisor<T> parts(const invariant_divisor<T>& den)
+    {
+        return {den.divisor(), den.multiplier(), den.shift()};
+    }
+
+}
+
+const char* math_array_kernel_set_name()
+{
+    return active().name;
+}
+
+void ilog2_floor(array_ref<uint32_t> dst, array_ref<const uint32_t> src)
+{
+    assert(dst.size() >= src.size());
+    active().ilog2_floor_32(dst.data(), src.data(), src.size());
+}
+
+void ilog2_floor(array_ref<uint64_t> dst, array_ref<const uint64_t> src)
+{
+    assert(dst.size() >= src.size());
+    active().ilog2_floor_64(dst.data(), src.data(), src.size());
+}
+
+void ilog2_ceil(array_ref<uint32_t> dst, array_ref<const uint32_t> src)
+{
+    assert(dst.size() >= src.size());
+    active().ilog2_ceil_32(dst.data(), src.data(), src.size());
+}
+
+void ilog2_ceil(array_ref<uint64_t> dst, array_ref<const uint64_t> src)
+{
+    assert(dst.size() >= src.size());
+    active().ilog2_ceil_64(dst.data(), src.data(), src.size());
+}
+
+void next_greater_pow2(array_ref<uint32_t> dst, array_ref<const uint32_t> src)
+{
+    assert(dst.size() >= src.size());
+    active().next_greater_pow2_32(dst.data(), src.data(), src.size());
+}
+
+void next_greater_pow2(array_ref<uint64_t> dst, array_ref<const uint64_t> src)
+{
+    assert(dst.size() >= src.size());
+    active().next_greater_pow2_64(dst.data(), src.data(), src.size());
+}
+
+void idiv_floor(array_ref<uint32_t> dst, array_ref<const uint32_t> src, const invariant_divisor<uint32_t>& den)
+{
+    assert(dst.size() >= src.size());
+    active().idiv_floor_32(dst.data(), src.data(), src.size(), parts(den));
+}
+
+void idiv_floor(array_ref<uint64_t> dst, array_ref<const uint64_t> src, const invariant_divisor<uint64_t>& den)
+{
+    assert(dst.size() >= src.size());
+    active().idiv_floor_64(dst.data(), src.data(), src.size(), parts(den));
+}
+
+void idiv_ceil(array_ref<uint32_t> dst, array_ref<const uint32_t> src, const invariant_divisor<uint32_t>& den)
+{
+    assert(dst.size() >= src.size());
+    active().idiv_ceil_32(dst.data(), src.data(), src.size(), parts(den));
+}
+
+void idiv_ceil(array_ref<uint64_t> dst, array_ref<const uint64_t> src, const invariant_divisor<uint64_t>& den)
+{
+    assert(dst.size() >= src.size());
+    active().idiv_ceil_64(dst.data(), src.data(), src.size(), parts(den));
+}
+
+void abs(array_ref<uint32_t> dst, array_ref<const int32_t> src)
+{
+    assert(dst.size() >= src.size());
+    active().abs_32(dst.data(), src.data(), src.size());
+}
+
+void abs(array_ref<uint64_t> dst, array_ref<const int64_t> src)
+{
+    assert(dst.size() >= src.size());
+    active().abs_64(dst.data(), src.data(), src.size());
+}
+
+void ipow(array_ref<uint32_t> dst, array_ref<const uint32_t> src, unsigned exp)
+{
+    assert(dst.size() >= src.size());
+    active().ipow_32(dst.data(), src.data(), src.size(), exp);
+}
+
+void ipow(array_ref<uint64_t> dst, array_ref<const uint64_t> src, unsigned exp)
+{
+    assert(dst.size() >= src.size());
+    active().ipow_64(dst.data(), src.data(), src.size(), exp);
+}
+
+}
@@ -0,0 +1,14 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define LIBLBU_SIMD_VECTOR_BYTES 32
+#include "math_array_kernels.h"
+
+namespace lbu {
+namespace math_array_kernels {
+
+    const table avx2 = vector_table("avx2");
+
+}
+}
@@ -0,0 +1,324 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef LIBLBU_MATH_ARRAY_KERNELS_H
+#define LIBLBU_MATH_ARRAY_KERNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+
+#ifdef LIBLBU_SIMD_VECTOR_BYTES
+#include "simd_vector.h"
+#endif
+
+// Internal: the kernel sets behind lbu/math_array.h, built like those of
+// array_algorithm_kernels.h (one translation unit per instruction set, everything
+// with internal linkage). For the same reason the kernels do not call into lbu/math.h
+// but get the invariant divisor as its plain parts.
+
+namespace lbu {
+namespace math_array_kernels {
+
+    template< typename T >
+    struct divisor {
+        T d;
+        T m; // 0 for powers of two
+        unsigned s;
+    };
+
+    struct table {
+        const char* name;
+
+        void (*ilog2_floor_32)(uint32_t*, const uint32_t*, size_t);
+        void (*ilog2_floor_64)(uint64_t*, const uint64_t*, size_t);
+        void (*ilog2_ceil_32)(uint32_t*, const uint32_t*, size_t);
+        void (*ilog2_ceil_64)(uint64_t*, const uint64_t*, size_t);
+        void (*next_greater_pow2_32)(uint32_t*, const uint32_t*, size_t);
+        void (*next_greater_pow2_64)(uint64_t*, const uint64_t*, size_t);
+
+        void (*idiv_floor_32)(uint32_t*, const uint32_t*, size_t, divisor<uint32_t>);
+        void (*idiv_floor_64)(uint64_t*, const uint64_t*, size_t, divisor<uint64_t>);
+        void (*idiv_ceil_32)(uint32_t*, const uint32_t*, size_t, divisor<uint32_t>);
+        void (*idiv_ceil_64)(uint64_t*, const uint64_t*, size_t, divisor<uint64_t>);
+
+        void (*abs_32)(uint32_t*, const int32_t*, size_t);
+        void (*abs_64)(uint64_t*, const int64_t*, size_t);
+
+        void (*ipow_32)(uint32_t*, const uint32_t*, size_t, unsigned);
+        void (*ipow_64)(uint64_t*, const uint64_t*, size_t, unsigned);
+    };
+
+    extern const table portable;
+#ifdef LIBLBU_X86_KERNELS
+    extern const table sse2;
+    extern const table avx2;
+    extern const table avx512;
+#endif
+
+namespace {
+
+    __extension__ typedef unsigned __int128 uint128;
+
+    template< typename T >
+    T scalar_ilog2_floor(T v)
+    {
+        if constexpr( sizeof(T) == 4 )
+            return T(31 - __builtin_clz(v));
+        else
+            return T(63 - __builtin_clzll(v));
+    }
+
+    template< typename T >
+    T scalar_ilog2_ceil(T v)
+    {
+        return scalar_ilog2_floor(v) + ((v & (v - 1)) != 0 ? 1 : 0);
+    }
+
+    template< typename T >
+    T scalar_next_greater_pow2(T v)
+    {
+        for( unsigned i = 1; i < 8 * sizeof(T); i <<= 1 )
+            v |= v >> i;
+        return v + 1;
+    }
+
+    template< typename T >
+    T scalar_divide(T v, divisor<T> d)
+    {
+        if( d.m == 0 )
+            return v >> d.s;
+        using wide = std::conditional_t<sizeof(T) == 4, uint64_t, uint128>;
+        const T t = T((wide(d.m) * v) >> (8 * sizeof(T)));
+        return (t + ((v - t) >> 1)) >> d.s;
+    }
+
+    template< typename T >
+    T scalar_abs(std::make_signed_t<T> v)
+    {
+        return v < 0 ? T(0) - T(v) : T(v);
+    }
+
+    template< typename T >
+    T scalar_ipow(T base, unsigned exp)
+    {
+        T result = 1;
+        for( ; exp; exp >>= 1 ) {
+            if( exp & 1 )
+                result *= base;
+            base *= base;
+        }
+        return result;
+    }
+
+    template< typename T, T (*Op)(T) >
+    void scalar_transform(T* dst, const T* src, size_t size)
+    {
+        for( size_t i = 0; i < size; ++i )
+            dst[i] = Op(src[i]);
+    }
+
+    template< typename T >
+    void scalar_abs_array(T* dst, const std::make_signed_t<T>* src, size_t size)
+    {
+        for( size_t i = 0; i < size; ++i )
+            dst[i] = scalar_abs<T>(src[i]);
+    }
+
+    template< typename T >
+    void scalar_ipow_array(T* dst, const T* src, size_t size, unsigned exp)
+    {
+        for( size_t i = 0; i < size; ++i )
+            dst[i] = scalar_ipow(src[i], exp);
+    }
+
+    template< typename T >
+    void scalar_idiv_floor(T* dst, const T* src, size_t size, divisor<T> d)
+    {
+        for( size_t i = 0; i < size; ++i )
+            dst[i] = scalar_divide(src[i], d);
+    }
+
+    template< typename T >
+    void scalar_idiv_ceil(T* dst, const T* src, size_t size, divisor<T> d)
+    {
+        for( size_t i = 0; i < size; ++i ) {
+            const T q = scalar_divide(src[i], d);
+            dst[i] = q + (src[i] != q * d.d ? 1 : 0);
+        }
+    }
+
+}
+
+#ifdef LIBLBU_SIMD_VECTOR_BYTES
+namespace {
+
+    using simd::W;
+    using simd::vec;
+    using simd::load;
+    using simd::store;
+
+    // dst[i] = op(src[i]), whole vectors first; the scalar tail keeps dst == src working
+    template< typename T, typename S, typename VectorOp, typename ScalarOp >
+    void transform(T* dst, const S* src, size_t size, VectorOp vector_op, ScalarOp scalar_op)
+    {
+        static_assert(sizeof(T) == sizeof(S));
+        constexpr size_t N = W / sizeof(T);
+        size_t i = 0;
+        for( ; i + N <= size; i += N )
+            store(dst + i, vector_op(load<vec<S>>(src + i)));
+        for( ; i < size; ++i )
+            dst[i] = scalar_op(src[i]);
+    }
+
+    // Without vector lzcnt, the exponent of the float conversion; clearing the bit
+    // below the leading one keeps the rounding from reaching the next power of two.
+    vec<uint32_t> vector_ilog2_floor(vec<uint32_t> v)
+    {
+#ifdef __AVX512CD__
+        if constexpr( W == 64 )
+            return 31 - reinterpret_cast<vec<uint32_t>>(_mm512_lzcnt_epi32(reinterpret_cast<__m512i>(v)));
+#endif
+        const vec<int32_t> x = reinterpret_cast<vec<int32_t>>(v & ~(v >> 1));
+        const vec<int32_t> f = reinterpret_cast<vec<int32_t>>(__builtin_convertvector(x, vec<float>));
+        const vec<int32_t> e = (f >> 23) - 127;
+        return reinterpret_cast<vec<uint32_t>>(x < 0 ? 31 : e);
+    }
+
+    // the 32 bit result of the high half, if that is not zero, else of the low half
+    vec<uint64_t> vector_ilog2_floor(vec<uint64_t> v)
+    {
+#ifdef __AVX512CD__
+        if constexpr( W == 64 )
+            return 63 - reinterpret_cast<vec<uint64_t>>(_mm512_lzcnt_epi64(reinterpret_cast<__m512i>(v)));
+#endif
+        const vec<uint64_t> r = reinterpret_cast<vec<uint64_t>>(vector_ilog2_floor(reinterpret_cast<vec<uint32_t>>(v)));
+        return (v >> 32) != 0 ? (r >> 32) + 32 : r & 0xffffffff;
+    }
+
+    template< typename T >
+    void ilog2_floor(T* dst, const T* src, size_t size)
+    {
+        transform(dst, src, size,
+                  [](vec<T> v) { return vector_ilog2_floor(v); },
+                  [](T v) { return scalar_ilog2_floor(v); });
+    }
+
+    template< typename T >
+    void ilog2_ceil(T* dst, const T* src, size_t size)
+    {
+        using M = decltype(vec<T>{} != 0);
+        transform(dst, src, size,
+                  [](vec<T> v) {
+                      const M inexact = (v & (v - 1)) != 0;
+                      return vector_ilog2_floor(v) - reinterpret_cast<vec<T>>(inexact);
+                  },
+                  [](T v) { return scalar_ilog2_ceil(v); });
+    }
+
+    template< typename T >
+    void next_greater_pow2(T* dst, const T* src, size_t size)
+    {
+        transform(dst, src, size,
+                  [](vec<T> v) {
+                      for( unsigned i = 1; i < 8 * sizeof(T); i <<= 1 )
+                          v |= v >> i;
+                      return v + 1;
+                  },
+                  [](T v) { return scalar_next_greater_pow2(v); });
+    }
+
+    // The high halves of the 32 x 32 bit products with the multiplier, from 32 x 32 -> 64
+    // bit multiplications of the even and the odd lanes (pmuludq).
+    vec<uint32_t> vector_divide(vec<uint32_t> v, divisor<uint32_t> d)
+    {
+        const vec<uint64_t> x = reinterpret_cast<vec<uint64_t>>(v);
+        const uint64_t m = d.m;
+        const vec<uint64_t> even = ((x & 0xffffffff) * m) >> 32;
+        const vec<uint64_t> odd = ((x >> 32) * m) & ~uint64_t(0xffffffff);
+        const vec<uint32_t> t = reinterpret_cast<vec<uint32_t>>(even | odd);
+        return (t + ((v - t) >> 1)) >> d.s;
+    }
+
+    void idiv_floor_32(uint32_t* dst, const uint32_t* src, size_t size, divisor<uint32_t> d)
+    {
+        if( d.m == 0 ) {
+            transform(dst, src, size,
+                      [d](vec<uint32_t> v) { return v >> d.s; },
+                      [d](uint32_t v) { return v >> d.s; });
+        } else {
+            transform(dst, src, size,
+                      [d](vec<uint32_t> v) { return vector_divide(v, d); },
+                      [d](uint32_t v) { return scalar_divide(v, d); });
+        }
+    }
+
+    void idiv_ceil_32(uint32_t* dst, const uint32_t* src, size_t size, divisor<uint32_t> d)
+    {
+        transform(dst, src, size,
+                  [d](vec<uint32_t> v) {
+                      const vec<uint32_t> q = d.m == 0 ? v >> d.s : vector_divide(v, d);
+                      return q - reinterpret_cast<vec<uint32_t>>(v != q * d.d);
+                  },
+                  [d](uint32_t v) {
+                      const uint32_t q = scalar_divide(v, d);
+                      return q + (v != q * d.d ? 1u : 0u);
+                  });
+    }
+
+    template< typename T >
+    void abs(T* dst, const std::make_signed_t<T>* src, size_t size)
+    {
+        transform(dst, src, size,
+                  [](vec<std::make_signed_t<T>> v) {
+                      const vec<T> u = reinterpret_cast<vec<T>>(v);
+                      return v < 0 ? 0 - u : u;
+                  },
+                  [](std::make_signed_t<T> v) { return scalar_abs<T>(v); });
+    }
+
+    template< typename T >
+    void ipow(T* dst, const T* src, size_t size, unsigned exp)
+    {
+        transform(dst, src, size,
+                  [exp](vec<T> base) {
+                      vec<T> result = vec<T>{} + 1;
+                      for( unsigned e = exp; e; e >>= 1 ) {
+                          if( e & 1 )
+                              result *= base;
+                          base *= base;
+                      }
+                      return result;
+                  },
+                  [exp](T base) { return scalar_ipow(base, exp); });
+    }
+
+    // No 64 x 64 -> 128 bit vector multiplication, so the 64 bit division stays scalar.
+    // SSE2 lacks 64 bit comparisons, and the 64 bit absolute value does no better than
+    // the scalar loop below AVX-512.
+    constexpr table vector_table(const char* name)
+    {
+        constexpr bool compare64 = W > 16;
+        constexpr bool abs64 = W >= 64;
+        return {
+            name,
+            &ilog2_floor<uint32_t>,
+            compare64 ? &ilog2_floor<uint64_t> : &scalar_transform<uint64_t, &scalar_ilog2_floor<uint64_t>>,
+            &ilog2_ceil<uint32_t>,
+            compare64 ? &ilog2_ceil<uint64_t> : &scalar_transform<uint64_t, &scalar_ilog2_ceil<uint64_t>>,
+            &next_greater_pow2<uint32_t>, &next_greater_pow2<uint64_t>,
+            &idiv_floor_32, &scalar_idiv_floor<uint64_t>,
+            &idiv_ceil_32, &scalar_idiv_ceil<uint64_t>,
+            &abs<uint32_t>, abs64 ? &abs<uint64_t> : &scalar_abs_array<uint64_t>,
+            &ipow<uint32_t>, &ipow<uint64_t>
+        };
+    }
+
+}
+#endif // LIBLBU_SIMD_VECTOR_BYTES
+
+}
+}
+
+#endif
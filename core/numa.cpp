@@ -0,0 +1,208 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "lbu/numa.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace lbu {
+namespace numa {
+
+namespace {
+
+    constexpr int MaxNodes = 1024;
+    constexpr size_t MaskWords = MaxNodes / (8 * sizeof(unsigned long));
+
+    // the first line of a sysfs file
+    bool read_sysfs(const char* path, char* buf, size_t size)
+    {
+        const int f = ::open(path, O_RDONLY | O_CLOEXEC);
+        if( f == -1 )
+            return false;
+        const ssize_t r = ::read(f, buf, size - 1);
+        ::close(f);
+        if( r <= 0 )
+            return false;
+        buf[r] = 0;
+        if( char* nl = std::strchr(buf, '\n') )
+            *nl = 0;
+        return true;
+    }
+
+    // calls f for each number of a list like "0-3,8,10-11", returns the highest or -1
+    template< typename F >
+    int for_each_in_list(const char* list, F&& f)
+    {
+        int highest = -1;
+        const char* p = list;
+        while( *p ) {
+            char* end = nullptr;
+            const long first = std::strtol(p, &end, 10);
+            if( end == p )
+                break;
+            long last = first;
+            if( *end == '-' )
+                last = std::strtol(end + 1, &end, 10);
+            for( long i = first; i <= last; ++i )
+                f(int(i));
+            highest = std::max(highest, int(last));
+            p = (*end == ',') ? end + 1 : end;
+        }
+        return highest;
+    }
+
+    bool node_cpus(int node, cpu_set_t* set)
+    {
+        char path[64];
+        char list[4096];
+        std::snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        if( ! read_sysfs(path, list, sizeof(list)) ) {
+            // no NUMA support, everything is node 0
+            if( node != 0 || ! read_sysfs("/sys/devices/system/cpu/online", list, sizeof(list)) )
+                return false;
+        }
+        CPU_ZERO(set);
+        for_each_in_list(list, [set](int cpu) {
+            if( cpu >= 0 && cpu < CPU_SETSIZE )
+                CPU_SET(size_t(cpu), set);
+        });
+        return CPU_COUNT(set) > 0;
+    }
+
+    bool set_affinity(const cpu_set_t* set, int* error)
+    {
+        const int r = pthread_setaffinity_np(pthread_self(), sizeof(*set), set);
+        if( r != 0 ) {
+            *error = r;
+            return false;
+        }
+        return true;
+    }
+
+}
+
+int node_count()
+{
+    static const int count = []() {
+        char list[256];
+        if( ! read_sysfs("/sys/devices/system/node/possible", list, sizeof(list)) )
+            return 1;
+        return std::max(1, for_each_in_list(list, [](int) {}) + 1);
+    }();
+    return count;
+}
+
+int cpu_node(int cpu)
+{
+    if( cpu < 0 )
+        return -1;
+    char path[64];
+    std::snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR* dir = ::opendir(path);
+    if( dir == nullptr )
+        return -1;
+    // without a node link the node is unknown, even if it is the only one
+    int node = -1;
+    while( dirent* e = ::readdir(dir) ) {
+        char* end = nullptr;
+        if( std::strncmp(e->d_name, "node", 4) == 0 ) {
+            const long n = std::strtol(e->d_name + 4, &end, 10);
+            if( end != e->d_name + 4 && *end == 0 ) {
+                node = int(n);
+                break;
+            }
+        }
+    }
+    ::closedir(dir);
+    return node;
+}
+
+int current_cpu()
+{
+    return ::sched_getcpu();
+}
+
+int current_node()
+{
+    unsigned cpu = 0;
+    unsigned node = 0;
+    if( ::syscall(SYS_getcpu, &cpu, &node, nullptr) == -1 )
+        return -1;
+    return int(node);
+}
+
+int memory_node(const void* p)
+{
+    // move_pages without target nodes only queries, and does not populate the page
+    void* page = const_cast<void*>(p);
+    int status = -1;
+    if( ::syscall(SYS_move_pages, 0, 1ul, &page, nullptr, &status, 0) == -1 )
+        return -1;
+    return status >= 0 ? status : -1;
+}
+
+bool bind_memory(void* p, size_t size, int node, int* error)
+{
+    if( node < 0 || node >= MaxNodes ) {
+        *error = EINVAL;
+        return false;
+    }
+    unsigned long mask[MaskWords] = {};
+    const auto n = size_t(node);
+    mask[n / (8 * sizeof(unsigned long))] = 1ul << (n % (8 * sizeof(unsigned long)));
+    if( ::syscall(SYS_mbind, p, size, MPOL_BIND, mask, MaxNodes + 1ul, MPOL_MF_MOVE) == -1 ) {
+        *error = errno;
+        return false;
+    }
+    return true;
+}
+
+void touch_memory(void* p, size_t size)
+{
+    if( size == 0 )
+        return;
+    // a read would only map the shared zero page, so this has to write; an atomic
+    // no-op does not lose the writes of other threads using the memory meanwhile
+    const auto page = size_t(::sysconf(_SC_PAGESIZE));
+    char* c = static_cast<char*>(p);
+    for( size_t i = 0; i < size; i += page )
+        __atomic_fetch_or(c + i, 0, __ATOMIC_RELAXED);
+    __atomic_fetch_or(c + size - 1, 0, __ATOMIC_RELAXED);
+}
+
+bool set_thread_cpu(int cpu, int* error)
+{
+    if( cpu < 0 || cpu >= CPU_SETSIZE ) {
+        *error = EINVAL;
+        return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(size_t(cpu), &set);
+    return set_affinity(&set, error);
+}
+
+bool set_thread_node(int node, int* error)
+{
+    cpu_set_t set;
+    if( node < 0 || ! node_cpus(node, &set) ) {
+        *error = EINVAL;
+        return false;
+    }
+    return set_affinity(&set, error);
+}
+
+}
+}
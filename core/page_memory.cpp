@@ -0,0 +1,201 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "lbu/page_memory.h"
+
+#include "lbu/numa.h"
+#include "lbu/unexpected.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <sys/mman.h>
+
+namespace lbu {
+
+namespace {
+
+    // the rest of the first line of \p path that starts with \p prefix
+    bool read_line(const char* path, const char* prefix, char* buf, int size)
+    {
+        std::FILE* f = std::fopen(path, "re");
+        if( f == nullptr )
+            return false;
+        const size_t prefix_size = std::strlen(prefix);
+        bool found = false;
+        while( ! found && std::fgets(buf, size, f) != nullptr ) {
+            if( std::strncmp(buf, prefix, prefix_size) == 0 ) {
+                std::memmove(buf, buf + prefix_size, std::strlen(buf + prefix_size) + 1);
+                found = true;
+            }
+        }
+        std::fclose(f);
+        return found;
+    }
+
+    // the hugetlbfs page size if explicit pages are used for \p size bytes, else 0
+    //
+    // Smaller allocations don't get them, or a 1 GiB default page size would round
+    // every one of them up to 1 GiB.
+    size_t explicit_granule(size_t size, const page_options& options)
+    {
+        if( options.huge != huge_pages::Explicit )
+            return 0;
+        const auto g = explicit_huge_page_size();
+        return size >= g ? g : 0;
+    }
+
+    size_t granule(size_t size, const page_options& options)
+    {
+        size_t g = explicit_granule(size, options);
+        if( g == 0 && options.huge != huge_pages::None )
+            g = transparent_huge_page_size();
+        return g == 0 ? page_size() : g;
+    }
+
+    // maps \p size bytes aligned to \p align (both page multiples)
+    void* map_aligned(size_t size, size_t align, int* error)
+    {
+        const size_t extra = align - page_size();
+        if( size > std::numeric_limits<size_t>::max() - extra ) {
+            *error = ENOMEM;
+            return nullptr;
+        }
+        void* p = ::mmap(nullptr, size + extra, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if( p == MAP_FAILED ) {
+            *error = errno;
+            return nullptr;
+        }
+        if( extra == 0 )
+            return p;
+        char* begin = static_cast<char*>(p);
+        char* aligned = static_cast<char*>(align_up(p, align));
+        const auto head = size_t(aligned - begin);
+        if( head > 0 )
+            ::munmap(begin, head);
+        if( extra > head )
+            ::munmap(aligned + size, extra - head);
+        return aligned;
+    }
+
+}
+
+size_t transparent_huge_page_size()
+{
+    static const size_t size = []() -> size_t {
+        char buf[256];
+        if( ! read_line("/sys/kernel/mm/transparent_hugepage/enabled", "", buf, sizeof(buf))
+                || std::strstr(buf, "[never]") != nullptr )
+            return 0;
+        if( ! read_line("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", "", buf, sizeof(buf)) )
+            return 0;
+        const auto s = size_t(std::strtoull(buf, nullptr, 10));
+        return (is_pow2(s) && s > page_size()) ? s : 0;
+    }();
+    return size;
+}
+
+size_t explicit_huge_page_size()
+{
+    static const size_t size = []() -> size_t {
+        char buf[256];
+        if( ! read_line("/proc/meminfo", "Hugepagesize:", buf, sizeof(buf)) )
+            return 0;
+        const auto s = size_t(std::strtoull(buf, nullptr, 10)) * 1024;
+        return (is_pow2(s) && s > page_size()) ? s : 0;
+    }();
+    return size;
+}
+
+size_t page_alloc_size(size_t size, const page_options& options)
+{
+    const auto g = granule(size, options);
+    if( size > std::numeric_limits<size_t>::max() - g )
+        return 0;
+    return align_up(size, g);
+}
+
+void* page_alloc(size_t size, const page_options& options, int* error)
+{
+    if( size == 0 ) {
+        *error = EINVAL;
+        return nullptr;
+    }
+    const bool use_explicit = explicit_granule(size, options) > 0;
+    size = page_alloc_size(size, options);
+    if( size == 0 ) {
+        *error = ENOMEM;
+        return nullptr;
+    }
+
+    void* p = nullptr;
+    if( use_explicit ) {
+        p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if( p == MAP_FAILED )
+            p = nullptr;
+    }
+    if( p == nullptr ) {
+        // a failed explicit request falls back to here, keeping its size so page_free agrees
+        const auto thp = (options.huge != huge_pages::None) ? transparent_huge_page_size() : 0;
+        p = map_aligned(size, std::max(thp, page_size()), error);
+        if( p == nullptr )
+            return nullptr;
+        // only a hint, the kernel may still use small pages
+        if( thp > 0 )
+            ::madvise(p, size, MADV_HUGEPAGE);
+    }
+
+    if( options.numa_node >= 0 && ! numa::bind_memory(p, size, options.numa_node, error) ) {
+        ::munmap(p, size);
+        return nullptr;
+    }
+    // after binding, so the pages are faulted in on the right node
+    if( options.lock ) {
+        if( ::mlock(p, size) != 0 ) {
+            *error = errno;
+            ::munmap(p, size);
+            return nullptr;
+        }
+    } else if( options.populate ) {
+        numa::touch_memory(p, size);
+    }
+    return p;
+}
+
+void* page_alloc(buffer_spec spec, const page_options& options, int* error)
+{
+    assert(spec.is_valid());
+    if( spec.align > page_size() ) {
+        *error = EINVAL;
+        return nullptr;
+    }
+    return page_alloc(spec.size, options, error);
+}
+
+void* xpage_alloc(size_t size, const page_options& options)
+{
+    int error = 0;
+    void* p = page_alloc(size, options, &error);
+    if( p == nullptr ) {
+        if( error == ENOMEM )
+            unexpected_memory_exhaustion();
+        unexpected_system_error(error);
+    }
+    return p;
+}
+
+void page_free(void* p, size_t size, const page_options& options)
+{
+    if( p == nullptr )
+        return;
+    const int r = ::munmap(p, page_alloc_size(size, options));
+    (void)r;
+    assert(r == 0);
+}
+
+}
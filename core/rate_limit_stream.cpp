@@ -0,0 +1,291 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "lbu/rate_limit_stream.h"
+
+#include "lbu/small_vector.h"
+
+#include <limits>
+#include <thread>
+
+namespace lbu {
+namespace stream {
+
+namespace {
+
+using io_vector_list = small_vector<io::io_vector, 8>;
+
+// Waits until enough tokens for a window (resp. a request of \p request bytes) are
+// available and returns them. In NonBlocking mode returns 0 instead and sets the delay.
+uint64_t acquire(token_bucket* bucket, uint64_t request, Mode mode,
+                 std::chrono::nanoseconds* delay, stream_statistics* stats)
+{
+    const uint64_t want = std::min({uint64_t(rate_limited_output_stream::MinimumWindow),
+                                    bucket->burst(), request});
+    while( true ) {
+        const auto t = bucket->available();
+        if( t >= want ) {
+            *delay = std::chrono::nanoseconds(0);
+            return t;
+        }
+        const auto d = bucket->time_until(want);
+        if( mode == Mode::NonBlocking ) {
+            *delay = d;
+            detail::stats_add(stats, &stream_statistics::would_block);
+            return 0;
+        }
+        detail::stats_blocking_scope blocking(stats);
+        std::this_thread::sleep_for(d);
+    }
+}
+
+// The first \p limit bytes of \p array, copied since the wrapped stream may modify it
+void limited_copy(array_ref<const io::io_vector> array, size_t limit, io_vector_list* dst)
+{
+    dst->clear();
+    for( auto v : array ) {
+        if( limit == 0 )
+            break;
+        v.iov_len = std::min(v.iov_len, limit);
+        limit -= v.iov_len;
+        dst->append(v);
+    }
+}
+
+array_ref<char> limited_window(array_ref<const void> b, uint64_t t)
+{
+    const auto size = std::min<uint64_t>(b.byte_size(), std::min<uint64_t>(t, std::numeric_limits<uint32_t>::max()));
+    return {static_cast<char*>(const_cast<void*>(b.data())), size_t(size)};
+}
+
+}
+
+
+rate_limited_output_stream::rate_limited_output_stream(abstract_output_stream* target, token_bucket* bucket)
+    : abstract_output_stream(target->manages_buffer() ? InternalBuffer::Yes : InternalBuffer::No)
+    , out(target)
+    , tokens(bucket)
+{
+    assert(bucket != nullptr);
+}
+
+rate_limited_output_stream::~rate_limited_output_stream()
+{
+}
+
+// Hands the used part of the window over to the wrapped stream
+void rate_limited_output_stream::commit()
+{
+    if( buffer_offset > 0 ) {
+        out->advance_buffer(buffer_offset);
+        tokens->consume(buffer_offset);
+        stats_add(&stream_statistics::bytes, buffer_offset);
+    }
+    buffer_base_ptr = nullptr;
+    buffer_offset = 0;
+    buffer_available = 0;
+}
+
+ssize_t rate_limited_output_stream::write_stream(array_ref<io::io_vector> buf_array, Mode mode)
+{
+    if( status_flags )
+        return -1;
+
+    ssize_t count = 0;
+    if( manages_buffer() ) {
+        for( const auto& v : buf_array ) {
+            const char* src = static_cast<const char*>(v.iov_base);
+            size_t size = v.iov_len;
+            while( size > 0 ) {
+                if( buffer_available == 0 && get_write_buffer(mode).byte_size() == 0 )
+                    return has_error() ? -1 : count;
+                const auto n = std::min(size, size_t(buffer_available));
+                std::memcpy(buffer_base_ptr + buffer_offset, src, n);
+                advance(n);
+                src += n;
+                size -= n;
+                count += ssize_t(n);
+            }
+        }
+        return count;
+    }
+
+    size_t left = io::io_vector_array_size_sum(buf_array);
+    io_vector_list part;
+    while( left > 0 ) {
+        const auto t = acquire(tokens, left, mode, &delay, statistics());
+        if( t == 0 )
+            break;
+        const auto limit = size_t(std::min<uint64_t>(left, t));
+        limited_copy(buf_array, limit, &part);
+        const auto r = out->direct_write(part.ref(), mode);
+        if( r < 0 ) {
+            status_flags = StatusError;
+            return -1;
+        }
+        tokens->consume(uint64_t(r));
+        stats_add(&stream_statistics::bytes, uint64_t(r));
+        count += r;
+        left -= size_t(r);
+        if( mode == Mode::NonBlocking || left == 0 )
+            break;
+        buf_array = io::io_vector_array_advance(buf_array, size_t(r));
+    }
+    return count;
+}
+
+array_ref<void> rate_limited_output_stream::get_write_buffer(Mode mode)
+{
+    commit();
+    if( status_flags )
+        return {};
+
+    const auto b = out->get_buffer(mode);
+    if( b.byte_size() == 0 ) {
+        if( out->has_error() )
+            status_flags = StatusError;
+        return {};
+    }
+    const auto t = acquire(tokens, std::numeric_limits<uint64_t>::max(), mode, &delay, statistics());
+    if( t == 0 )
+        return {};
+
+    auto w = limited_window(b, t);
+    buffer_base_ptr = w.data();
+    buffer_available = uint32_t(w.size());
+    stats_add(&stream_statistics::buffer_refills);
+    return current_buffer();
+}
+
+bool rate_limited_output_stream::write_buffer_flush(Mode mode)
+{
+    commit();
+    if( status_flags )
+        return false;
+    if( ! out->flush_buffer(mode) ) {
+        if( out->has_error() )
+            status_flags = StatusError;
+        return false;
+    }
+    return true;
+}
+
+
+rate_limited_input_stream::rate_limited_input_stream(abstract_input_stream* source, token_bucket* bucket)
+    : abstract_input_stream(source->manages_buffer() ? InternalBuffer::Yes : InternalBuffer::No)
+    , in(source)
+    , tokens(bucket)
+{
+    assert(bucket != nullptr);
+}
+
+rate_limited_input_stream::~rate_limited_input_stream()
+{
+}
+
+// Moves the wrapped stream past the consumed part of the window
+void rate_limited_input_stream::commit()
+{
+    if( buffer_offset > 0 ) {
+        in->advance_buffer(buffer_offset);
+        tokens->consume(buffer_offset);
+        stats_add(&stream_statistics::bytes, buffer_offset);
+    }
+    buffer_base_ptr = nullptr;
+    buffer_offset = 0;
+    buffer_available = 0;
+}
+
+void rate_limited_input_stream::sync_status()
+{
+    if( in->has_error() )
+        status_flags = StatusError;
+    else if( in->at_end() )
+        status_flags = StatusEndOfStream;
+}
+
+ssize_t rate_limited_input_stream::read_stream(array_ref<io::io_vector> buf_array, size_t required_read)
+{
+    if( has_error() )
+        return -1;
+
+    ssize_t count = 0;
+    if( manages_buffer() ) {
+        assert(buf_array.size() == 1);
+        char* dst = static_cast<char*>(buf_array[0].iov_base);
+        const size_t size = buf_array[0].iov_len;
+        const Mode mode = (required_read > 0) ? Mode::Blocking : Mode::NonBlocking;
+
+        while( true ) {
+            const size_t n = std::min<size_t>(size - size_t(count), buffer_available);
+            if( n > 0 ) {
+                std::memcpy(dst + count, buffer_base_ptr + buffer_offset, n);
+                advance(n);
+                count += ssize_t(n);
+            }
+            if( size_t(count) == size || get_read_buffer(mode).byte_size() == 0 )
+                break;
+        }
+        return has_error() ? -1 : count;
+    }
+
+    if( at_end() ) {
+        if( required_read == 0 )
+            return 0;
+        // a required read past the end is a bad request, like for fd_input_stream
+        status_flags |= StatusError;
+        return -1;
+    }
+    size_t left = io::io_vector_array_size_sum(buf_array);
+    io_vector_list part;
+    while( left > 0 ) {
+        const auto required = required_read - std::min(required_read, size_t(count));
+        const auto t = acquire(tokens, left, required > 0 ? Mode::Blocking : Mode::NonBlocking,
+                               &delay, statistics());
+        if( t == 0 )
+            break;
+        const auto limit = size_t(std::min<uint64_t>(left, t));
+        limited_copy(buf_array, limit, &part);
+        const auto r = in->direct_read(part.ref(), std::min(required, limit));
+        if( r < 0 ) {
+            sync_status();
+            status_flags |= StatusError;
+            return -1;
+        }
+        tokens->consume(uint64_t(r));
+        stats_add(&stream_statistics::bytes, uint64_t(r));
+        count += r;
+        left -= size_t(r);
+        if( size_t(count) >= required_read || left == 0 )
+            break;
+        buf_array = io::io_vector_array_advance(buf_array, size_t(r));
+    }
+    sync_status();
+    return count;
+}
+
+array_ref<const void> rate_limited_input_stream::get_read_buffer(Mode mode)
+{
+    commit();
+    if( status_flags )
+        return {};
+
+    const auto b = in->get_buffer(mode);
+    if( b.byte_size() == 0 ) {
+        sync_status();
+        return {};
+    }
+    const auto t = acquire(tokens, std::numeric_limits<uint64_t>::max(), mode, &delay, statistics());
+    if( t == 0 )
+        return {};
+
+    auto w = limited_window(b, t);
+    buffer_base_ptr = w.data();
+    buffer_available = uint32_t(w.size());
+    stats_add(&stream_statistics::buffer_refills);
+    return current_buffer();
+}
+
+} // namespace stream
+} // namespace lbu
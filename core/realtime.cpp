@@ -0,0 +1,125 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "lbu/realtime.h"
+
+#include "lbu/numa.h"
+#include "lbu/page_memory.h"
+
+#include <algorithm>
+#include <alloca.h>
+#include <cassert>
+#include <cerrno>
+#include <limits>
+#include <sys/mman.h>
+
+namespace lbu {
+namespace realtime {
+
+namespace {
+
+    struct page_range {
+        void* begin;
+        size_t size;
+    };
+
+    page_range pages_of(void* p, size_t size)
+    {
+        const auto page = page_size();
+        const auto begin = align_down(uintptr_t(p), page);
+        const auto end = align_up(uintptr_t(p) + size, page);
+        return {reinterpret_cast<void*>(begin), size_t(end - begin)};
+    }
+
+}
+
+bool prepare_memory(void* p, size_t size, int flags, int* error)
+{
+    if( size == 0 )
+        return true;
+    if( flags & PrepareLock ) {
+        const auto r = pages_of(p, size);
+        if( ::mlock(r.begin, r.size) == 0 )
+            return true;
+        *error = errno;
+    }
+    if( flags & (PreparePrefault | PrepareLock) )
+        numa::touch_memory(p, size);
+    return (flags & PrepareLock) == 0;
+}
+
+void release_memory(void* p, size_t size)
+{
+    if( size == 0 )
+        return;
+    const auto r = pages_of(p, size);
+    ::munlock(r.begin, r.size);
+}
+
+bool lock_all_memory(int* error)
+{
+    if( ::mlockall(MCL_CURRENT | MCL_FUTURE) != 0 ) {
+        *error = errno;
+        return false;
+    }
+    return true;
+}
+
+void prefault_stack(size_t size)
+{
+    if( size == 0 )
+        return;
+    const auto page = page_size();
+    volatile char* p = static_cast<volatile char*>(alloca(size));
+    for( size_t i = 0; i < size; i += page )
+        p[i] = 0;
+    p[size - 1] = 0;
+}
+
+thread_stack::thread_stack(size_t size, int flags, int* error)
+{
+    *error = 0;
+    const auto page = page_size();
+    size = std::max(size, size_t(PTHREAD_STACK_MIN));
+    if( size > std::numeric_limits<size_t>::max() - 2 * page ) {
+        *error = ENOMEM;
+        return;
+    }
+    size = align_up(size, page);
+
+    const page_options options;
+    void* p = page_alloc(size + page, options, error);
+    if( p == nullptr )
+        return;
+    // the stack grows down, towards the guard page
+    if( ::mprotect(p, page, PROT_NONE) != 0 ) {
+        *error = errno;
+        page_free(p, size + page, options);
+        return;
+    }
+    base = p;
+    stack = static_cast<char*>(p) + page;
+    stack_size = size;
+    prepare_memory(stack, stack_size, flags, error);
+}
+
+thread_stack::~thread_stack()
+{
+    if( base != nullptr )
+        page_free(base, stack_size + page_size(), page_options());
+}
+
+bool thread_stack::apply(pthread_attr_t* attr, int* error) const
+{
+    assert(is_valid());
+    const int r = ::pthread_attr_setstack(attr, stack, stack_size);
+    if( r != 0 ) {
+        *error = r;
+        return false;
+    }
+    return true;
+}
+
+}
+}
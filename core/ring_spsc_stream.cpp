@@ -6,8 +6,12 @@
 
 #include "lbu/dynamic_memory.h"
 #include "lbu/eventfd.h"
+#include "lbu/numa.h"
 #include "lbu/poll.h"
 #include "lbu/ring_spsc.h"
+#include "lbu/trace.h"
+
+#include <cerrno>
 
 namespace lbu {
 namespace stream {
@@ -19,26 +23,36 @@ static uint32_t continuous_slots(uint32_t offset, uint32_t count, uint32_t n)
     return lbu::ring_spsc::algorithm::continuous_slots(offset, count, n);
 }
 
-static bool consumer_read(fd f)
+static bool consumer_read(fd f, stream_statistics* stats)
 {
     eventfd_t tmp;
     const int r = event_fd::read(f, &tmp);
+    detail::stats_add(stats, &stream_statistics::syscalls);
+    if( r == event_fd::ReadNoError )
+        detail::stats_add(stats, &stream_statistics::wakeups_sent);
     return r == event_fd::ReadNoError || r == event_fd::ReadWouldBlock;
 }
 
-static bool producer_write(fd f)
+static bool producer_write(fd f, stream_statistics* stats)
 {
     const int r = event_fd::write(f, event_fd::MaximumValue);
+    detail::stats_add(stats, &stream_statistics::syscalls);
+    if( r == event_fd::WriteNoError )
+        detail::stats_add(stats, &stream_statistics::wakeups_sent);
     return r == event_fd::WriteNoError || r == event_fd::WriteWouldBlock;
 }
 
-static bool wait(fd f, short flags)
+static bool wait(fd f, short flags, stream_statistics* stats)
 {
+    detail::stats_blocking_scope blocking(stats);
     auto p = poll::poll_fd(f, flags);
     while( true ) {
         const int r = ::poll(&p, 1, poll::NoTimeout.count());
-        if( r == 1 )
+        detail::stats_add(stats, &stream_statistics::syscalls);
+        if( r == 1 ) {
+            detail::stats_add(stats, &stream_statistics::wakeups_received);
             return (p.events & p.revents);
+        }
         if( r == -1 && errno == EINTR)
             continue;
         return false;
@@ -65,7 +79,7 @@ void ring_spsc::input_stream::reset(array_ref<void> buffer, fd event_fd, ring_sp
 
     d.last_index = s->consumer_index.load(std::memory_order_relaxed);
     buffer_offset = alg::offset(d.last_index, n);
-    update_buffer_size(s, d.last_index, d.segment_limit, n);
+    update_buffer_size(s, d.segment_limit, n);
 
     status_flags = 0;
 }
@@ -125,46 +139,50 @@ array_ref<const void> ring_spsc::input_stream::next_buffer(Mode mode)
     s->consumer_index.store(consumer_idx, std::memory_order_release);
     d.last_index = consumer_idx;
     buffer_offset = alg::offset(consumer_idx, n);
+    stats_add(&stream_statistics::bytes, count);
+    if( count > 0 )
+        trace::detail::lib_event(trace::EventRingRelease, count);
 
     bool wake_producer = count > 0;
     if( wake_producer && s->producer_wake.compare_exchange_strong(wake_producer, false) ) {
-        if( ! consumer_read(f) )
+        if( ! consumer_read(f, statistics()) )
             goto error;
     }
 
-    if( update_buffer_size(s, consumer_idx, segment_limit, n) )
+    if( update_buffer_size(s, segment_limit, n) )
         return current_buffer();
 
     if( ! wake_producer ) {
-        if( ! consumer_read(f) )
+        if( ! consumer_read(f, statistics()) )
             goto error;
-        if( update_buffer_size(s, consumer_idx, segment_limit, n) )
+        if( update_buffer_size(s, segment_limit, n) )
             return current_buffer();
     }
 
     s->consumer_wake.store(true);
 
-    if( update_buffer_size(s, consumer_idx, segment_limit, n) || mode == Mode::NonBlocking )
+    if( update_buffer_size(s, segment_limit, n) )
         return current_buffer();
-
-    if( ! wait(f, poll::FlagsReadReady) )
-        goto error;
-
-    if( update_buffer_size(s, consumer_idx, segment_limit, n) )
+    if( mode == Mode::NonBlocking ) {
+        stats_add(&stream_statistics::would_block);
         return current_buffer();
+    }
 
-    if( ! consumer_read(f) )
-        goto error;
+    // A producer waiting in reserve may wake us without publishing anything new, so
+    // this needs to loop.
+    while( true ) {
+        if( ! wait(f, poll::FlagsReadReady, statistics()) )
+            goto error;
 
-    if( update_buffer_size(s, consumer_idx, segment_limit, n) )
-        return current_buffer();
+        if( update_buffer_size(s, segment_limit, n) )
+            return current_buffer();
 
-    if( ! wait(f, poll::FlagsReadReady) )
-        goto error;
+        if( ! consumer_read(f, statistics()) )
+            goto error;
 
-    if( ! update_buffer_size(s, consumer_idx, segment_limit, n) )
-        assert(false);
-    return current_buffer();
+        if( update_buffer_size(s, segment_limit, n) )
+            return current_buffer();
+    }
 
 error:
     status_flags = StatusError;
@@ -172,21 +190,54 @@ error:
 }
 
 bool ring_spsc::input_stream::update_buffer_size(ring_spsc_shared_data* shared,
-                                                 uint32_t consumer_index,
                                                  uint32_t segment_limit,
                                                  uint32_t ring_size)
 {
+retry:
     const auto producer_index = shared->producer_index.load(std::memory_order_acquire);
     const auto n = ring_size;
-    auto b = continuous_slots(alg::offset(consumer_index, n),
-                              alg::consumer_free_slots(producer_index, consumer_index, n),
-                              n);
+    auto consumer_index = d.last_index;
+    auto available = alg::consumer_free_slots(producer_index, consumer_index, n);
+
+    // The padding index is stored before the producer index that covers it; it is reset
+    // here before the producer can see the skip and place the next one.
+    const auto padding_index = shared->padding_index.load(std::memory_order_relaxed);
+    if( padding_index == consumer_index && available > 0 ) {
+        const auto skip = n - alg::offset(consumer_index, n);
+        shared->padding_index.store(ring_spsc_shared_data::NoPadding, std::memory_order_relaxed);
+        consumer_index = alg::new_index(consumer_index, skip, n);
+        shared->consumer_index.store(consumer_index, std::memory_order_release);
+        d.last_index = consumer_index;
+        buffer_offset = 0;
+        available -= skip;
+
+        bool wake_producer = true;
+        if( shared->producer_wake.compare_exchange_strong(wake_producer, false) ) {
+            if( ! consumer_read(d.filedes, statistics()) ) {
+                status_flags = StatusError;
+                buffer_available = 0;
+                return true;
+            }
+        }
+    } else if( padding_index != ring_spsc_shared_data::NoPadding ) {
+        available = std::min(available, alg::consumer_free_slots(padding_index, consumer_index, n));
+    }
+
+    auto b = continuous_slots(alg::offset(consumer_index, n), available, n);
     buffer_available = std::min(segment_limit, b);
     if( buffer_available == 0 && shared->eos.load(std::memory_order_acquire) ) {
+        // The producer may have published its last records and set eos after the producer
+        // index was loaded above (e.g. while a padding skip was handled), the index stored
+        // before eos is final though.
+        if( shared->producer_index.load(std::memory_order_acquire) != producer_index )
+            goto retry;
         status_flags = StatusEndOfStream;
         return true;
     }
-    return buffer_available > 0;
+    if( buffer_available == 0 )
+        return false;
+    stats_add(&stream_statistics::buffer_refills);
+    return true;
 }
 
 ring_spsc::output_stream::output_stream()
@@ -210,11 +261,12 @@ bool ring_spsc::output_stream::set_end_of_stream()
     const auto producer_idx = alg::new_index(d.last_index, count, n);
 
     s->producer_index.store(producer_idx, std::memory_order_release);
+    stats_add(&stream_statistics::bytes, count);
 
     buffer_available = 0;
 
     d.shared->eos.store(true, std::memory_order_release);
-    if( ! producer_write(f) ) {
+    if( ! producer_write(f, statistics()) ) {
         status_flags = StatusError;
         return false;
     }
@@ -277,6 +329,106 @@ ssize_t ring_spsc::output_stream::write_stream(array_ref<io::io_vector> buf_arra
     }
 }
 
+array_ref<void> ring_spsc::output_stream::reserve_buffer(uint32_t size, Mode mode)
+{
+    if( status_flags ) {
+        assert(buffer_available == 0);
+        status_flags |= StatusError;
+        return {};
+    }
+
+    auto s = d.shared;
+    const auto n = d.ring_size;
+    const fd f = d.filedes;
+    const auto count = buffer_offset - alg::offset(d.last_index, n);
+    int r;
+
+    if( size > n )
+        goto error;
+    size = std::max<uint32_t>(size, 1);
+
+    stats_add(&stream_statistics::bytes, count);
+    if( count > 0 )
+        trace::detail::lib_event(trace::EventRingPublish, count);
+    if( ! publish(count) )
+        goto error;
+
+    // Same wake up protocol as next_buffer, but the consumer may need to release
+    // several times before there is enough room.
+    while( true ) {
+        if( (r = reserve_update_buffer(size)) != 0 )
+            break;
+
+        if( ! producer_write(f, statistics()) )
+            goto error;
+        if( (r = reserve_update_buffer(size)) != 0 )
+            break;
+
+        s->producer_wake.store(true);
+        if( (r = reserve_update_buffer(size)) != 0 )
+            break;
+
+        if( mode == Mode::NonBlocking ) {
+            stats_add(&stream_statistics::would_block);
+            update_buffer_size(s, d.last_index, d.segment_limit, n);
+            return {};
+        }
+        if( ! wait(f, poll::FlagsWriteReady, statistics()) )
+            goto error;
+    }
+    if( r > 0 )
+        return current_buffer();
+
+error:
+    status_flags = StatusError;
+    buffer_available = 0;
+    return {};
+}
+
+// 1 if at least size bytes are available, 0 if the consumer must release more and
+// -1 on an error
+int ring_spsc::output_stream::reserve_update_buffer(uint32_t size)
+{
+    auto s = d.shared;
+    const auto n = d.ring_size;
+    while( true ) {
+        const auto consumer_index = s->consumer_index.load(std::memory_order_acquire);
+        const auto free = alg::producer_free_slots(d.last_index, consumer_index, n);
+        const auto till_end = n - buffer_offset;
+        if( till_end >= size ) {
+            if( free < size )
+                return 0;
+            buffer_available = std::max(size, std::min(d.segment_limit, continuous_slots(buffer_offset, free, n)));
+            stats_add(&stream_statistics::buffer_refills);
+            return 1;
+        }
+
+        // wrap around as soon as the rest of the ring is free
+        if( free < till_end )
+            return 0;
+        s->padding_index.store(d.last_index, std::memory_order_relaxed);
+        if( ! publish(till_end) )
+            return -1;
+    }
+}
+
+bool ring_spsc::output_stream::publish(uint32_t count)
+{
+    auto s = d.shared;
+    const auto n = d.ring_size;
+    const auto producer_idx = alg::new_index(d.last_index, count, n);
+
+    s->producer_index.store(producer_idx, std::memory_order_release);
+    d.last_index = producer_idx;
+    buffer_offset = alg::offset(producer_idx, n);
+    buffer_available = 0;
+
+    bool wake_consumer = count > 0;
+    if( wake_consumer && s->consumer_wake.compare_exchange_strong(wake_consumer, false) )
+        return producer_write(d.filedes, statistics());
+    return true;
+}
+
 array_ref<void> ring_spsc::output_stream::get_write_buffer(Mode mode)
 {
     return next_buffer(mode);
@@ -306,10 +458,13 @@ array_ref<void> ring_spsc::output_stream::next_buffer(Mode mode)
     s->producer_index.store(producer_idx, std::memory_order_release);
     d.last_index = producer_idx;
     buffer_offset = alg::offset(producer_idx, n);
+    stats_add(&stream_statistics::bytes, count);
+    if( count > 0 )
+        trace::detail::lib_event(trace::EventRingPublish, count);
 
     bool wake_consumer = count > 0;
     if( wake_consumer && s->consumer_wake.compare_exchange_strong(wake_consumer, false) ) {
-        if( ! producer_write(f) )
+        if( ! producer_write(f, statistics()) )
             goto error;
     }
 
@@ -317,7 +472,7 @@ array_ref<void> ring_spsc::output_stream::next_buffer(Mode mode)
         return current_buffer();
 
     if( ! wake_consumer ) {
-        if( ! producer_write(f) )
+        if( ! producer_write(f, statistics()) )
             goto error;
         if( update_buffer_size(s, producer_idx, segment_simit, n) )
             return current_buffer();
@@ -325,22 +480,26 @@ array_ref<void> ring_spsc::output_stream::next_buffer(Mode mode)
 
     s->producer_wake.store(true);
 
-    if( update_buffer_size(s, producer_idx, segment_simit, n) || mode == Mode::NonBlocking )
+    if( update_buffer_size(s, producer_idx, segment_simit, n) )
+        return current_buffer();
+    if( mode == Mode::NonBlocking ) {
+        stats_add(&stream_statistics::would_block);
         return current_buffer();
+    }
 
-    if( ! wait(f, poll::FlagsWriteReady) )
+    if( ! wait(f, poll::FlagsWriteReady, statistics()) )
         goto error;
 
     if( update_buffer_size(s, producer_idx, segment_simit, n) )
         return current_buffer();
 
-    if( ! producer_write(f) )
+    if( ! producer_write(f, statistics()) )
         goto error;
 
     if( update_buffer_size(s, producer_idx, segment_simit, n) )
         return current_buffer();
 
-    if( ! wait(f, poll::FlagsWriteReady) )
+    if( ! wait(f, poll::FlagsWriteReady, statistics()) )
         goto error;
 
     if( ! update_buffer_size(s, producer_idx, segment_simit, n) )
@@ -364,7 +523,10 @@ bool ring_spsc::output_stream::update_buffer_size(ring_spsc_shared_data* shared,
                               alg::producer_free_slots(producer_index, consumer_index, n),
                               n);
     buffer_available = std::min(segment_limit, b);
-    return buffer_available > 0;
+    if( buffer_available == 0 )
+        return false;
+    stats_add(&stream_statistics::buffer_refills);
+    return true;
 }
 
 event_fd::open_result ring_spsc_shared_data::open_event_fd()
@@ -378,38 +540,99 @@ struct ring_spsc_basic_controller::internal {
     uint32_t bufsize;
     fd filedes = {};
     char* buf;
+    size_t paged_size = 0;      // > 0 if from page_alloc
+    page_options paging;
 };
 
+static void init_error(int error)
+{
+    if( error == ENOMEM )
+        unexpected_memory_exhaustion();
+    else if( error != 0 )
+        unexpected_system_error(error);
+}
+
 ring_spsc_basic_controller::ring_spsc_basic_controller(uint32_t bufsize)
 {
+    init_error(init(bufsize, nullptr));
+}
+
+ring_spsc_basic_controller::ring_spsc_basic_controller(uint32_t bufsize, int* error)
+{
+    *error = init(bufsize, nullptr);
+}
+
+ring_spsc_basic_controller::ring_spsc_basic_controller(uint32_t bufsize, const page_options& options)
+{
+    init_error(init(bufsize, &options));
+}
+
+ring_spsc_basic_controller::ring_spsc_basic_controller(uint32_t bufsize, const page_options& options, int* error)
+{
+    *error = init(bufsize, &options);
+}
+
+int ring_spsc_basic_controller::init(uint32_t bufsize, const page_options* options)
+{
+    d = nullptr;
     const auto align = memory_interference_alignment();
     bufsize = std::min<uint32_t>(bufsize, alg::max_size());
     assert(bufsize > 0);
     dynamic_struct s;
     s.add_member<internal>(1, align);
     auto buffer_offset = s.add_member_raw({bufsize, align});
-    void* p = xmalloc(s.storage());
+
+    int error = ENOMEM;
+    void* p;
+    if( options != nullptr )
+        p = page_alloc(s.storage(), *options, &error);
+    else
+        p = malloc(s.storage());
+    if( p == nullptr )
+        return error;
+
+    auto efd = ring_spsc_shared_data::open_event_fd();
+    if( efd.status != event_fd::OpenNoError ) {
+        if( options != nullptr )
+            page_free(p, s.storage().size, *options);
+        else
+            ::free(p);
+        return efd.status;
+    }
 
     d = new (p) internal;
     d->bufsize = bufsize;
     d->buf = static_cast<char*>(s.resolve(p, buffer_offset));
-
-    auto efd = ring_spsc_shared_data::open_event_fd();
-    if( efd.status != event_fd::OpenNoError)
-        unexpected_system_error(efd.status);
     d->filedes = efd.fd.release();
+    if( options != nullptr ) {
+        d->paged_size = s.storage().size;
+        d->paging = *options;
+    }
+    return 0;
 }
 
 ring_spsc_basic_controller::~ring_spsc_basic_controller()
 {
+    if( d == nullptr )
+        return;
     d->filedes.close();
+    const auto paged_size = d->paged_size;
+    const auto paging = d->paging;
     d->~internal();
-    ::free(d);
+    if( paged_size > 0 )
+        page_free(d, paged_size, paging);
+    else
+        ::free(d);
+}
+
+int ring_spsc_basic_controller::numa_node() const
+{
+    return d != nullptr ? numa::memory_node(d->buf) : -1;
 }
 
 bool ring_spsc_basic_controller::pair_streams(ring_spsc::output_stream *out, ring_spsc::input_stream *in, uint32_t segment_limit)
 {
-    if( ! d->filedes )
+    if( d == nullptr || ! d->filedes )
         return false;
 
     auto buf = array_ref<char>(d->buf, d->bufsize);
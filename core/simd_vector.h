@@ -0,0 +1,84 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef LIBLBU_SIMD_VECTOR_H
+#define LIBLBU_SIMD_VECTOR_H
+
+#ifndef LIBLBU_SIMD_VECTOR_BYTES
+#error "define LIBLBU_SIMD_VECTOR_BYTES to the vector width of the translation unit"
+#endif
+
+#include <immintrin.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+
+// Internal: the GCC vector extension basics shared by the per instruction set kernel
+// units (array_algorithm_avx2.cpp etc.). Each such unit defines LIBLBU_SIMD_VECTOR_BYTES
+// to its register width before including this; like the kernels themselves, all of
+// this has internal linkage.
+
+namespace lbu {
+namespace simd {
+namespace {
+
+    constexpr size_t W = LIBLBU_SIMD_VECTOR_BYTES;
+
+    template< typename T, size_t Bytes >
+    struct vec_type {
+        typedef T type __attribute__((vector_size(Bytes)));
+    };
+
+    template< typename T, size_t Bytes = W >
+    using vec = typename vec_type<T, Bytes>::type;
+
+    template< typename V >
+    using lane_type = std::remove_reference_t<decltype(V{}[0])>;
+
+    template< typename V >
+    constexpr size_t lanes = sizeof(V) / sizeof(lane_type<V>);
+
+    template< typename V >
+    V load(const void* src)
+    {
+        V v;
+        __builtin_memcpy(&v, src, sizeof(V));
+        return v;
+    }
+
+    template< typename V >
+    void store(void* dst, V v)
+    {
+        __builtin_memcpy(dst, &v, sizeof(V));
+    }
+
+    // one bit per byte of a comparison result, the lowest for the first byte
+    template< typename M >
+    uint64_t byte_mask(M m)
+    {
+        if constexpr( sizeof(M) == 16 )
+            return uint32_t(_mm_movemask_epi8(reinterpret_cast<__m128i>(m)));
+#ifdef __AVX2__
+        else if constexpr( sizeof(M) == 32 )
+            return uint32_t(_mm256_movemask_epi8(reinterpret_cast<__m256i>(m)));
+#endif
+#ifdef __AVX512BW__
+        else if constexpr( sizeof(M) == 64 )
+            return _mm512_movepi8_mask(reinterpret_cast<__m512i>(m));
+#endif
+        else
+            static_assert(sizeof(M) == 0, "no byte mask for this vector size");
+    }
+
+    template< typename T >
+    size_t first_lane(uint64_t mask)
+    {
+        return size_t(__builtin_ctzll(mask)) / sizeof(T);
+    }
+
+}
+}
+}
+
+#endif
@@ -0,0 +1,225 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "lbu/tee_stream.h"
+
+#include "lbu/poll.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+
+namespace lbu {
+namespace stream {
+
+tee_output_stream::tee_output_stream(array_ref<void> buffer)
+    : abstract_output_stream(InternalBuffer::Yes)
+{
+    assert(buffer.byte_size() > 0);
+    buffer_base_ptr = static_cast<char*>(buffer.data());
+    buffer_capacity = std::min(buffer.byte_size(), size_t(std::numeric_limits<uint32_t>::max()));
+    buffer_offset = 0;
+    buffer_available = buffer_capacity;
+}
+
+tee_output_stream::~tee_output_stream()
+{
+    for( auto& s : sinks ) {
+        int error = 0;
+        if( s.restore_blocking )
+            s.filedes.set_nonblock(false, &error);
+    }
+}
+
+bool tee_output_stream::add_sink(fd f, int* error)
+{
+    int e = 0;
+    const bool was_nonblocking = f.is_nonblock(&e);
+    if( e != 0 ) {
+        *error = e;
+        return false;
+    }
+    if( ! f.set_nonblock(true, error) )
+        return false;
+    sinks.push_back({f, nullptr, buffer_offset, ! was_nonblocking});
+    return true;
+}
+
+void tee_output_stream::add_sink(abstract_output_stream* s)
+{
+    assert(s != nullptr);
+    sinks.push_back({{}, s, buffer_offset, false});
+}
+
+size_t tee_output_stream::max_lag() const
+{
+    uint32_t lag = 0;
+    for( const auto& s : sinks )
+        lag = std::max(lag, buffer_offset - s.sent);
+    return lag;
+}
+
+bool tee_output_stream::fail(size_t index, int error)
+{
+    failed = int(index);
+    err = error;
+    buffer_available = 0;
+    status_flags = StatusError;
+    return false;
+}
+
+// Sends the window to one sink as far as possible, false on errors
+bool tee_output_stream::send(size_t index, Mode mode)
+{
+    auto& s = sinks[index];
+    while( s.sent < buffer_offset ) {
+        char* data = buffer_base_ptr + s.sent;
+        const uint32_t rest = buffer_offset - s.sent;
+
+        if( s.stream == nullptr ) {
+            const auto r = io::write(s.filedes, array_ref<const char>(data, rest));
+            stats_add(&stream_statistics::syscalls);
+            if( r.size > 0 ) {
+                s.sent += uint32_t(r.size);
+                stats_add(&stream_statistics::bytes, uint64_t(r.size));
+                continue;
+            }
+            if( r.size == 0 )
+                return fail(index, io::WriteIOError);
+            if( r.status != io::WriteWouldBlock )
+                return fail(index, r.status);
+            if( mode == Mode::NonBlocking ) {
+                stats_add(&stream_statistics::would_block);
+                return true;
+            }
+            detail::stats_blocking_scope blocking(statistics());
+            auto p = poll::poll_fd(s.filedes, poll::FlagsWriteReady);
+            poll::poll_result pr;
+            do {
+                pr = poll::poll(&p, 1);
+                stats_add(&stream_statistics::syscalls);
+            } while( pr.status == poll::StatusPollInterrupted );
+            if( pr.status != poll::StatusNoError )
+                return fail(index, pr.status);
+        } else if( s.stream->manages_buffer() ) {
+            auto b = s.stream->get_buffer(mode);
+            if( b.byte_size() == 0 ) {
+                if( s.stream->has_error() || mode == Mode::Blocking )
+                    return fail(index, 0);
+                stats_add(&stream_statistics::would_block);
+                return true;
+            }
+            const auto n = uint32_t(std::min(size_t(rest), b.byte_size()));
+            std::memcpy(b.data(), data, n);
+            s.stream->advance_buffer(n);
+            s.sent += n;
+            stats_add(&stream_statistics::bytes, n);
+        } else {
+            auto v = io::io_vec(data, rest);
+            const auto r = s.stream->direct_write(array_ref_one_element(&v), mode);
+            // a blocking write that makes no progress would leave the tee short
+            if( r < 0 || (r == 0 && mode == Mode::Blocking) )
+                return fail(index, 0);
+            if( r == 0 ) {
+                stats_add(&stream_statistics::would_block);
+                return true;
+            }
+            s.sent += uint32_t(r);
+            stats_add(&stream_statistics::bytes, uint64_t(r));
+        }
+    }
+    return true;
+}
+
+// Sends to all sinks and restarts the window once everybody has it
+bool tee_output_stream::progress(Mode mode)
+{
+    for( size_t i = 0; i < sinks.size(); ++i ) {
+        if( ! send(i, mode) )
+            return false;
+    }
+    if( max_lag() == 0 ) {
+        for( auto& s : sinks )
+            s.sent = 0;
+        buffer_offset = 0;
+        buffer_available = buffer_capacity;
+    }
+    return true;
+}
+
+// Moves the part the slowest sink still needs to the window start, so the lag stays
+// bounded by the window size
+void tee_output_stream::compact()
+{
+    uint32_t done = buffer_offset;
+    for( const auto& s : sinks )
+        done = std::min(done, s.sent);
+    if( done == 0 )
+        return;
+    std::memmove(buffer_base_ptr, buffer_base_ptr + done, buffer_offset - done);
+    for( auto& s : sinks )
+        s.sent -= done;
+    buffer_offset -= done;
+    buffer_available = buffer_capacity - buffer_offset;
+}
+
+ssize_t tee_output_stream::write_stream(array_ref<io::io_vector> buf_array, Mode mode)
+{
+    if( status_flags )
+        return -1;
+
+    ssize_t count = 0;
+    for( const auto& v : buf_array ) {
+        const char* src = static_cast<const char*>(v.iov_base);
+        size_t size = v.iov_len;
+        while( size > 0 ) {
+            if( buffer_available == 0 ) {
+                if( ! progress(mode) )
+                    return -1;
+                if( buffer_available == 0 )
+                    compact();
+                if( buffer_available == 0 )
+                    return count;
+            }
+            const auto n = uint32_t(std::min(size, size_t(buffer_available)));
+            std::memcpy(buffer_base_ptr + buffer_offset, src, n);
+            advance(n);
+            src += n;
+            size -= n;
+            count += ssize_t(n);
+        }
+    }
+    return count;
+}
+
+array_ref<void> tee_output_stream::get_write_buffer(Mode mode)
+{
+    if( status_flags || ! progress(mode) )
+        return {};
+    if( buffer_available == 0 )
+        compact();
+    if( buffer_available > 0 )
+        stats_add(&stream_statistics::buffer_refills);
+    return current_buffer();
+}
+
+bool tee_output_stream::write_buffer_flush(Mode mode)
+{
+    if( status_flags || ! progress(mode) )
+        return false;
+    bool flushed = (buffer_offset == 0);
+    for( size_t i = 0; i < sinks.size(); ++i ) {
+        auto* s = sinks[i].stream;
+        if( s != nullptr && ! s->flush_buffer(mode) ) {
+            if( s->has_error() || mode == Mode::Blocking )
+                return fail(i, 0);
+            flushed = false;
+        }
+    }
+    return flushed;
+}
+
+} // namespace stream
+} // namespace lbu
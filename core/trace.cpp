@@ -0,0 +1,523 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "lbu/trace.h"
+
+#include "lbu/byte_buffer.h"
+#include "lbu/dynamic_memory.h"
+#include "lbu/endian.h"
+#include "lbu/io.h"
+#include "lbu/memory.h"
+#include "lbu/ring_spsc.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <sys/syscall.h>
+
+namespace lbu {
+namespace trace {
+
+using event_ring = lbu::ring_spsc::handle<event, uint32_t>;
+
+static constexpr size_t EncodedEventSize = sizeof(event);
+static constexpr size_t OutputFlushSize = 1 << 16;
+
+static uint64_t monotonic_ns()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000u + uint64_t(ts.tv_nsec);
+}
+
+static void encode_event(const event& e, char* dst)
+{
+    to_little_endian<uint64_t>(e.ticks, dst);
+    to_little_endian<uint16_t>(e.id, dst + 8);
+    dst[10] = char(e.phase);
+    dst[11] = 0;
+    to_little_endian<uint32_t>(e.thread, dst + 12);
+    to_little_endian<uint64_t>(e.arg0, dst + 16);
+    to_little_endian<uint64_t>(e.arg1, dst + 24);
+}
+
+static event decode_event(const char* src)
+{
+    event e;
+    e.ticks = from_little_endian<uint64_t>(src);
+    e.id = from_little_endian<uint16_t>(src + 8);
+    e.phase = Phase(src[10]);
+    e.reserved = 0;
+    e.thread = from_little_endian<uint32_t>(src + 12);
+    e.arg0 = from_little_endian<uint64_t>(src + 16);
+    e.arg1 = from_little_endian<uint64_t>(src + 24);
+    return e;
+}
+
+
+// recording
+
+namespace {
+
+struct thread_buffer {
+    event_ring::shared_index producer_index{0};
+    event_ring::shared_index consumer_index{0};
+    event_ring::producer producer;
+    event_ring::consumer consumer;
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<bool> closed{false};    // the session ended, the thread has to register again
+    std::atomic<bool> retired{false};   // the owning thread exited
+    std::atomic<int> refs{2};           // owning thread and session
+    uint32_t thread = 0;
+};
+
+thread_buffer* create_thread_buffer(uint32_t event_count)
+{
+    const auto align = memory_interference_alignment();
+    dynamic_struct s;
+    s.add_member<thread_buffer>(1, align);
+    auto events_offset = s.add_member<event>(event_count, align);
+    void* p = xmalloc(s.storage());
+
+    auto b = new (p) thread_buffer;
+    auto events = static_cast<event*>(s.resolve(p, events_offset));
+    // fault the pages in now instead of while recording
+    std::memset(static_cast<void*>(events), 0, event_count * sizeof(event));
+    event_ring::pair_producer_consumer({events, event_count},
+                                       &b->producer, &b->producer_index,
+                                       &b->consumer, &b->consumer_index);
+    b->thread = uint32_t(::syscall(SYS_gettid));
+    return b;
+}
+
+void unref(thread_buffer* b)
+{
+    if( b->refs.fetch_sub(1, std::memory_order_acq_rel) == 1 ) {
+        b->~thread_buffer();
+        ::free(b);
+    }
+}
+
+struct thread_slot {
+    thread_buffer* buffer = {};
+
+    ~thread_slot()
+    {
+        if( buffer ) {
+            buffer->retired.store(true, std::memory_order_release);
+            unref(buffer);
+        }
+    }
+};
+
+}
+
+struct session_data {
+    fd output;
+    uint32_t thread_buffer_events;
+    std::chrono::milliseconds flush_interval;
+    std::vector<thread_buffer*> buffers; // guarded by registry_mutex
+
+    std::thread collector;
+    std::mutex stop_mutex;
+    std::condition_variable stop_condition;
+    bool stop = false;
+
+    byte_buffer pending; // only used by the collector
+    std::atomic<int> err{0};
+};
+
+struct session::internal : session_data {};
+
+static std::mutex registry_mutex;
+static session_data* active_session = {}; // guarded by registry_mutex
+static std::atomic<bool> session_active{false};
+static thread_local thread_slot current_thread;
+
+static thread_buffer* register_thread()
+{
+    auto& slot = current_thread;
+    if( slot.buffer ) {
+        unref(slot.buffer);
+        slot.buffer = {};
+    }
+
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    if( active_session == nullptr )
+        return {};
+    auto b = create_thread_buffer(active_session->thread_buffer_events);
+    active_session->buffers.push_back(b);
+    slot.buffer = b;
+    return b;
+}
+
+void record(uint16_t id, Phase phase, uint64_t arg0, uint64_t arg1)
+{
+    if( ! session_active.load(std::memory_order_relaxed) )
+        return;
+
+    thread_buffer* b = current_thread.buffer;
+    if( b == nullptr || b->closed.load(std::memory_order_relaxed) ) {
+        b = register_thread();
+        if( b == nullptr )
+            return;
+    }
+
+    auto& p = b->producer;
+    if( p.last_available() == 0 && p.update_available() == 0 ) {
+        b->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    event* e = p.continuous_range().data();
+    e->ticks = ticks();
+    e->id = id;
+    e->phase = phase;
+    e->reserved = 0;
+    e->thread = b->thread;
+    e->arg0 = arg0;
+    e->arg1 = arg1;
+    p.publish(1);
+}
+
+
+// collector
+
+static void append_event(byte_buffer* out, const event& e)
+{
+    if( out->capacity() - out->size() < EncodedEventSize )
+        out->reserve(std::max(out->capacity() * 2, out->size() + EncodedEventSize));
+    encode_event(e, static_cast<char*>(out->append_begin().data()));
+    out->append_commit(EncodedEventSize);
+}
+
+// Writes the pending events followed by a calibration record, so every part of the file
+// converts to time, also when the session never ended properly (e.g. after a crash).
+static void flush_pending(session_data* d, bool force_calibration = false)
+{
+    if( d->pending.size() == 0 && ! force_calibration )
+        return;
+    append_event(&d->pending, {ticks(), EventCalibration, Phase::Instant, 0, 0, monotonic_ns(), 0});
+    if( d->err.load(std::memory_order_relaxed) == 0 ) {
+        const int r = io::write_all(d->output, d->pending.ref());
+        if( r != io::WriteNoError )
+            d->err.store(r, std::memory_order_relaxed);
+    }
+    d->pending.clear();
+}
+
+static void drain(session_data* d, thread_buffer* b)
+{
+    if( const auto lost = b->dropped.exchange(0, std::memory_order_relaxed) )
+        append_event(&d->pending, {ticks(), EventDropped, Phase::Instant, 0, b->thread, lost, 0});
+
+    auto& c = b->consumer;
+    if( c.update_available() == 0 )
+        return;
+    const auto ranges = c.ranges();
+    for( auto r : { ranges.first, ranges.second } ) {
+        for( const auto& e : r )
+            append_event(&d->pending, e);
+    }
+    c.release(ranges.first.size() + ranges.second.size());
+
+    if( d->pending.size() >= OutputFlushSize )
+        flush_pending(d);
+}
+
+static void drain_all(session_data* d, std::vector<thread_buffer*>* local, bool final = false)
+{
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        *local = d->buffers;
+    }
+    for( auto b : *local ) {
+        // events published before the thread exited are visible after this load
+        const bool retired = b->retired.load(std::memory_order_acquire);
+        drain(d, b);
+        if( retired ) {
+            {
+                std::lock_guard<std::mutex> lock(registry_mutex);
+                d->buffers.erase(std::find(d->buffers.begin(), d->buffers.end(), b));
+            }
+            unref(b);
+        }
+    }
+    flush_pending(d, final);
+}
+
+static void collect(session_data* d)
+{
+    std::vector<thread_buffer*> local;
+    while( true ) {
+        bool stopping;
+        {
+            std::unique_lock<std::mutex> lock(d->stop_mutex);
+            d->stop_condition.wait_for(lock, d->flush_interval, [d]() { return d->stop; });
+            stopping = d->stop;
+        }
+        if( stopping ) {
+            drain_all(d, &local, true);
+            return;
+        }
+        drain_all(d, &local);
+    }
+}
+
+session::session(fd output, uint32_t thread_buffer_events, std::chrono::milliseconds flush_interval)
+{
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    if( active_session != nullptr )
+        return;
+
+    d = new internal;
+    d->output = output;
+    d->thread_buffer_events = std::max(thread_buffer_events, uint32_t(2));
+    d->flush_interval = flush_interval;
+
+    char header[sizeof(file_header)] = {};
+    std::memcpy(header, file_header::Magic, sizeof(file_header::Magic));
+    to_little_endian<uint32_t>(file_header::Version, header + 8);
+    to_little_endian<uint32_t>(uint32_t(EncodedEventSize), header + 12);
+    to_little_endian<uint64_t>(ticks(), header + 16);
+    to_little_endian<uint64_t>(monotonic_ns(), header + 24);
+    to_little_endian<uint32_t>(uint32_t(::getpid()), header + 32);
+    const int r = io::write_all(output, array_ref<const char>(header));
+    if( r != io::WriteNoError )
+        d->err.store(r, std::memory_order_relaxed);
+
+    active_session = d;
+    session_active.store(true, std::memory_order_relaxed);
+    d->collector = std::thread(collect, d);
+}
+
+session::~session()
+{
+    if( d == nullptr )
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        active_session = {};
+        session_active.store(false, std::memory_order_relaxed);
+    }
+    {
+        std::lock_guard<std::mutex> lock(d->stop_mutex);
+        d->stop = true;
+    }
+    d->stop_condition.notify_one();
+    d->collector.join();
+
+    for( auto b : d->buffers ) {
+        b->closed.store(true, std::memory_order_relaxed);
+        unref(b);
+    }
+    delete d;
+}
+
+int session::status() const
+{
+    return d ? d->err.load(std::memory_order_relaxed) : 0;
+}
+
+
+// conversion
+
+static const event_name builtin_names[] = {
+    {EventDropped, "dropped"},
+    {EventRingPublish, "ring_publish"},
+    {EventRingRelease, "ring_release"},
+    {EventFdFlush, "fd_flush"},
+    {EventAlsaCommit, "alsa_commit"}
+};
+
+namespace {
+
+class event_reader {
+public:
+    explicit event_reader(fd f) : filedes(f) {}
+
+    // Returns false at the end of the file or on error (see status)
+    bool next(event* e)
+    {
+        if( available < EncodedEventSize ) {
+            std::memmove(buffer, buffer + offset, available);
+            offset = 0;
+            while( available < EncodedEventSize ) {
+                const auto r = io::read(filedes, array_ref<char>(buffer + available, sizeof(buffer) - available));
+                if( r.size < 0 ) {
+                    err = r.status;
+                    return false;
+                }
+                if( r.size == 0 ) {
+                    if( available > 0 )
+                        err = ConvertInvalidFormat;
+                    return false;
+                }
+                available += size_t(r.size);
+            }
+        }
+        *e = decode_event(buffer + offset);
+        offset += EncodedEventSize;
+        available -= EncodedEventSize;
+        return true;
+    }
+
+    int status() const { return err; }
+
+private:
+    fd filedes;
+    size_t offset = 0;
+    size_t available = 0;
+    int err = ConvertNoError;
+    char buffer[EncodedEventSize * 512];
+};
+
+class json_writer {
+public:
+    explicit json_writer(fd f) : filedes(f) {}
+
+    void append(const char* str) { append(str, std::strlen(str)); }
+    void append(const char* str, size_t len)
+    {
+        out.append(array_ref<const char>(str, len));
+        if( out.size() >= OutputFlushSize )
+            flush();
+    }
+
+    void append_string(const char* str)
+    {
+        append("\"");
+        for( const char* p = str; *p; ++p ) {
+            if( *p == '"' || *p == '\\' )
+                append("\\", 1);
+            if( static_cast<unsigned char>(*p) >= 0x20 )
+                append(p, 1);
+        }
+        append("\"");
+    }
+
+    void flush()
+    {
+        if( err == 0 && out.size() > 0 )
+            err = io::write_all(filedes, out.ref());
+        out.clear();
+    }
+
+    int status() const { return err; }
+
+private:
+    fd filedes;
+    byte_buffer out;
+    int err = 0;
+};
+
+}
+
+int write_chrome_json(fd trace_file, fd json_output, array_ref<const event_name> names)
+{
+    char header[sizeof(file_header)];
+    if( int r = io::read_all(trace_file, array_ref<char>(header)); r != io::ReadNoError )
+        return r == io::ReadIOError ? ConvertInvalidFormat : r;
+    if( std::memcmp(header, file_header::Magic, sizeof(file_header::Magic)) != 0
+        || from_little_endian<uint32_t>(header + 8) != file_header::Version
+        || from_little_endian<uint32_t>(header + 12) != EncodedEventSize )
+        return ConvertInvalidFormat;
+    const auto start_ticks = from_little_endian<uint64_t>(header + 16);
+    const auto start_ns = from_little_endian<uint64_t>(header + 24);
+    const auto pid = from_little_endian<uint32_t>(header + 32);
+
+    const off_t events_begin = ::lseek(trace_file.value, 0, SEEK_CUR);
+    if( events_begin < 0 )
+        return errno;
+
+    // first pass: the last calibration record gives the tick rate
+    double ns_per_tick = 0;
+    bool has_events = false;
+    {
+        event_reader reader(trace_file);
+        event e;
+        while( reader.next(&e) ) {
+            if( e.id != EventCalibration )
+                has_events = true;
+            else if( e.ticks > start_ticks && e.arg0 > start_ns )
+                ns_per_tick = double(e.arg0 - start_ns) / double(e.ticks - start_ticks);
+        }
+        if( reader.status() != ConvertNoError )
+            return reader.status();
+    }
+    if( has_events && ns_per_tick == 0 )
+        return ConvertMissingCalibration;
+    if( ::lseek(trace_file.value, events_begin, SEEK_SET) < 0 )
+        return errno;
+
+    auto name_for = [&](uint16_t id) -> const char* {
+        for( const auto& n : names ) {
+            if( n.id == id )
+                return n.name;
+        }
+        for( const auto& n : builtin_names ) {
+            if( n.id == id )
+                return n.name;
+        }
+        return nullptr;
+    };
+
+    json_writer out(json_output);
+    out.append("{\"traceEvents\":[\n");
+    event_reader reader(trace_file);
+    event e;
+    bool first = true;
+    char tmp[192];
+    while( reader.next(&e) ) {
+        if( e.id == EventCalibration )
+            continue;
+
+        const double ts_us = double(int64_t(e.ticks - start_ticks)) * ns_per_tick / 1000.0;
+        const char* ph = "i";
+        switch( e.phase ) {
+        case Phase::Begin: ph = "B"; break;
+        case Phase::End: ph = "E"; break;
+        case Phase::Counter: ph = "C"; break;
+        default: break;
+        }
+
+        if( ! first )
+            out.append(",\n");
+        first = false;
+        out.append("{\"name\":");
+        if( const char* n = name_for(e.id) ) {
+            out.append_string(n);
+        } else {
+            std::snprintf(tmp, sizeof(tmp), "\"event_%u\"", unsigned(e.id));
+            out.append(tmp);
+        }
+        std::snprintf(tmp, sizeof(tmp), ",\"ph\":\"%s\",\"ts\":%.3f,\"pid\":%u,\"tid\":%u,",
+                      ph, ts_us, unsigned(pid), unsigned(e.thread));
+        out.append(tmp);
+        if( e.phase == Phase::Counter ) {
+            std::snprintf(tmp, sizeof(tmp), "\"args\":{\"value\":%llu}}",
+                          static_cast<unsigned long long>(e.arg0));
+        } else {
+            std::snprintf(tmp, sizeof(tmp), "%s\"args\":{\"arg0\":%llu,\"arg1\":%llu}}",
+                          e.phase == Phase::Instant ? "\"s\":\"t\"," : "",
+                          static_cast<unsigned long long>(e.arg0),
+                          static_cast<unsigned long long>(e.arg1));
+        }
+        out.append(tmp);
+    }
+    out.append("\n]}\n");
+    out.flush();
+
+    if( reader.status() != ConvertNoError )
+        return reader.status();
+    return out.status();
+}
+
+}
+}
@@ -0,0 +1,118 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "lbu/varint.h"
+
+#include "lbu/cpu_features.h"
+#include "lbu/endian.h"
+
+#include "varint_kernels.h"
+
+#include <cstring>
+
+namespace lbu {
+namespace varint {
+
+namespace {
+
+    inline unsigned value_length(uint32_t v)
+    {
+        return 1u + unsigned(v > 0xff) + unsigned(v > 0xffff) + unsigned(v > 0xffffff);
+    }
+
+    // Writes all 4 bytes, the caller only advances by the value length. The encoded
+    // size bound leaves room for that.
+    inline char* put_value(uint32_t v, unsigned length, char* dst)
+    {
+        to_little_endian<uint32_t>(v, dst);
+        return dst + length;
+    }
+
+}
+
+namespace kernels {
+
+    const decoders portable = make_decoders<quad_scalar>();
+
+}
+
+namespace {
+
+    const kernels::decoders& active_decoders()
+    {
+        static const kernels::decoders& d = *cpu::select<const kernels::decoders*>({
+#ifdef LIBLBU_X86_KERNELS
+            {cpu::SSSE3, &kernels::ssse3},
+#endif
+            {0, &kernels::portable}
+        });
+        return d;
+    }
+
+}
+
+
+namespace group {
+
+size_t encode(array_ref<const uint32_t> values, char* dst)
+{
+    char* const begin = dst;
+    const uint32_t* v = values.data();
+    size_t left = values.size();
+    while( left > 0 ) {
+        const size_t n = left < 4 ? left : 4;
+        char* tag_ptr = dst++;
+        unsigned tag = 0;
+        for( unsigned i = 0; i < n; ++i ) {
+            const unsigned len = value_length(v[i]);
+            tag |= (len - 1) << (2 * i);
+            dst = put_value(v[i], len, dst);
+        }
+        *tag_ptr = char(tag);
+        v += n;
+        left -= n;
+    }
+    return size_t(dst - begin);
+}
+
+const char* decode(const char* src, const char* end, array_ref<uint32_t> values)
+{
+    return active_decoders().group(src, end, values.data(), values.size());
+}
+
+}
+
+namespace stream_vbyte {
+
+size_t encode(array_ref<const uint32_t> values, char* dst)
+{
+    const size_t tag_count = (values.size() + 3) / 4;
+    char* tags = dst;
+    char* data = dst + tag_count;
+    const uint32_t* v = values.data();
+    size_t left = values.size();
+    while( left > 0 ) {
+        const size_t n = left < 4 ? left : 4;
+        unsigned tag = 0;
+        for( unsigned i = 0; i < n; ++i ) {
+            const unsigned len = value_length(v[i]);
+            tag |= (len - 1) << (2 * i);
+            data = put_value(v[i], len, data);
+        }
+        *tags++ = char(tag);
+        v += n;
+        left -= n;
+    }
+    return size_t(data - dst);
+}
+
+const char* decode(const char* src, const char* end, array_ref<uint32_t> values)
+{
+    return active_decoders().stream_vbyte(src, end, values.data(), values.size());
+}
+
+}
+
+}
+}
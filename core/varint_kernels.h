@@ -0,0 +1,183 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef LIBLBU_VARINT_KERNELS_H
+#define LIBLBU_VARINT_KERNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __SSSE3__
+#include <immintrin.h>
+#endif
+
+// Internal: the group varint / stream vbyte decoders of lbu/varint.h.
+//
+// Instantiated by varint.cpp with the portable quad decoder and by varint_ssse3.cpp
+// (compiled with -mssse3) with the shuffle based one, so the whole decode loop is
+// built for the instruction set. As in array_algorithm_kernels.h, everything here
+// has internal linkage.
+
+namespace lbu {
+namespace varint {
+namespace kernels {
+
+    using decode_function = const char* (*)(const char* src, const char* end, uint32_t* dst, size_t count);
+
+    struct decoders {
+        decode_function group;
+        decode_function stream_vbyte;
+    };
+
+    extern const decoders portable;
+#ifdef LIBLBU_X86_KERNELS
+    extern const decoders ssse3;
+#endif
+
+namespace {
+
+    inline uint32_t get_value(const char* src, unsigned length)
+    {
+        uint32_t v = 0;
+        for( unsigned i = 0; i < length; ++i )
+            v |= uint32_t(uint8_t(src[i])) << (8 * i);
+        return v;
+    }
+
+    struct tag_tables {
+        uint8_t length[256];
+        alignas(16) uint8_t shuffle[256][16];
+
+        constexpr tag_tables() : length(), shuffle()
+        {
+            for( unsigned tag = 0; tag < 256; ++tag ) {
+                unsigned pos = 0;
+                for( unsigned i = 0; i < 4; ++i ) {
+                    const unsigned len = ((tag >> (2 * i)) & 3) + 1;
+                    for( unsigned b = 0; b < 4; ++b )
+                        shuffle[tag][4 * i + b] = uint8_t(b < len ? pos + b : 0x80);
+                    pos += len;
+                }
+                length[tag] = uint8_t(pos);
+            }
+        }
+    };
+
+    constexpr tag_tables tables;
+
+    // Decodes a full group of four with tag \p tag from \p src (which must hold
+    // tables.length[tag] bytes).
+    inline const char* decode_quad_scalar(uint8_t tag, const char* src, uint32_t* dst)
+    {
+        for( unsigned i = 0; i < 4; ++i ) {
+            const unsigned len = ((tag >> (2 * i)) & 3) + 1;
+            dst[i] = get_value(src, len);
+            src += len;
+        }
+        return src;
+    }
+
+    // Decodes the first \p count values of a group, checking the input bounds.
+    inline const char* decode_partial(uint8_t tag, const char* src, const char* end,
+                                      uint32_t* dst, size_t count)
+    {
+        for( unsigned i = 0; i < count; ++i ) {
+            const unsigned len = ((tag >> (2 * i)) & 3) + 1;
+            if( size_t(end - src) < len )
+                return nullptr;
+            dst[i] = get_value(src, len);
+            src += len;
+        }
+        return src;
+    }
+
+    // The decoders process full groups with `Quad`, which may assume that at least
+    // 16 bytes are readable at the data pointer. Groups too close to the input end
+    // are handled by the checked scalar code.
+
+    struct quad_scalar {
+        static const char* decode(uint8_t tag, const char* src, uint32_t* dst)
+        {
+            return decode_quad_scalar(tag, src, dst);
+        }
+    };
+
+#ifdef __SSSE3__
+    struct quad_ssse3 {
+        static const char* decode(uint8_t tag, const char* src, uint32_t* dst)
+        {
+            const __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+            const __m128i shuf = _mm_load_si128(reinterpret_cast<const __m128i*>(tables.shuffle[tag]));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_shuffle_epi8(data, shuf));
+            return src + tables.length[tag];
+        }
+    };
+#endif
+
+    template< typename Quad >
+    const char* group_decode(const char* src, const char* end, uint32_t* dst, size_t count)
+    {
+        size_t left = count;
+        while( left >= 4 ) {
+            if( end - src < 17 )
+                break;
+            const auto tag = uint8_t(*src);
+            src = Quad::decode(tag, src + 1, dst);
+            dst += 4;
+            left -= 4;
+        }
+        while( left > 0 ) {
+            if( src == end )
+                return nullptr;
+            const auto tag = uint8_t(*src++);
+            const size_t n = left < 4 ? left : 4;
+            src = decode_partial(tag, src, end, dst, n);
+            if( src == nullptr )
+                return nullptr;
+            dst += n;
+            left -= n;
+        }
+        return src;
+    }
+
+    template< typename Quad >
+    const char* svb_decode(const char* src, const char* end, uint32_t* dst, size_t count)
+    {
+        const size_t tag_count = (count + 3) / 4;
+        if( size_t(end - src) < tag_count )
+            return nullptr;
+        const char* tags = src;
+        const char* data = src + tag_count;
+        size_t left = count;
+        while( left >= 4 ) {
+            if( end - data < 16 )
+                break;
+            data = Quad::decode(uint8_t(*tags++), data, dst);
+            dst += 4;
+            left -= 4;
+        }
+        while( left > 0 ) {
+            const size_t n = left < 4 ? left : 4;
+            data = decode_partial(uint8_t(*tags++), data, end, dst, n);
+            if( data == nullptr )
+                return nullptr;
+            dst += n;
+            left -= n;
+        }
+        return data;
+    }
+
+    template< typename Quad >
+    constexpr decoders make_decoders()
+    {
+        return {&group_decode<Quad>, &svb_decode<Quad>};
+    }
+
+}
+
+}
+}
+}
+
+#endif
@@ -0,0 +1,15 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "varint_kernels.h"
+
+namespace lbu {
+namespace varint {
+namespace kernels {
+
+    const decoders ssse3 = make_decoders<quad_ssse3>();
+
+}
+}
+}
@@ -0,0 +1,227 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <QtTest>
+
+#include <lbu/array_algorithm.h>
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <vector>
+
+using namespace lbu;
+
+class Test_array_algorithm : public QObject
+{
+    Q_OBJECT
+
+public:
+    Test_array_algorithm() = default;
+
+private Q_SLOTS:
+    void testFindCount();
+    void testMinMaxSum();
+    void testMismatch();
+    void testByteSwapFill();
+    void testPrefixSum();
+};
+
+namespace {
+
+// all sizes up to a few vectors, at every start offset within a vector
+constexpr size_t MaxSize = 300;
+constexpr size_t MaxOffset = 64;
+
+template< typename T >
+std::vector<T> random_values(size_t count, unsigned distinct, uint64_t seed)
+{
+    std::mt19937_64 gen(seed);
+    std::vector<T> v(count);
+    for( auto& e : v )
+        e = T(gen() % distinct);
+    return v;
+}
+
+template< typename T >
+void check_find_count()
+{
+    const auto values = random_values<T>(MaxSize + MaxOffset, 40, sizeof(T));
+    for( size_t offset = 0; offset < MaxOffset; offset += 7 ) {
+        for( size_t size = 0; size <= MaxSize; ++size ) {
+            const array_ref<const T> a(values.data() + offset, size);
+            for( T v : {T(0), T(17), T(39), T(-1)} ) {
+                QCOMPARE(array_algorithm::find(a, v), size_t(std::find(a.begin(), a.end(), v) - a.begin()));
+                QCOMPARE(array_algorithm::count(a, v), size_t(std::count(a.begin(), a.end(), v)));
+            }
+        }
+    }
+}
+
+template< typename T >
+void check_min_max()
+{
+    std::mt19937_64 gen(1);
+    std::vector<T> values(MaxSize + MaxOffset);
+    for( auto& e : values )
+        e = T(gen());
+    for( size_t offset = 0; offset < MaxOffset; offset += 5 ) {
+        for( size_t size = 1; size <= MaxSize; ++size ) {
+            const array_ref<const T> a(values.data() + offset, size);
+            const auto r = array_algorithm::min_max(a);
+            QCOMPARE(r.first, *std::min_element(a.begin(), a.end()));
+            QCOMPARE(r.second, *std::max_element(a.begin(), a.end()));
+        }
+    }
+}
+
+template< typename T, typename Total >
+void check_sum()
+{
+    std::mt19937_64 gen(2);
+    std::vector<T> values(MaxSize + MaxOffset);
+    for( auto& e : values )
+        e = T(gen());
+    for( size_t offset = 0; offset < MaxOffset; offset += 3 ) {
+        for( size_t size = 0; size <= MaxSize; ++size ) {
+            const array_ref<const T> a(values.data() + offset, size);
+            QCOMPARE(array_algorithm::sum(a), std::accumulate(a.begin(), a.end(), Total(0)));
+        }
+    }
+
+    // long enough for the narrow lane accumulators to be flushed
+    std::vector<T> big(1000000, std::numeric_limits<T>::max());
+    QCOMPARE(array_algorithm::sum(array_ref<const T>(big.data(), big.size())),
+             Total(big.size()) * Total(std::numeric_limits<T>::max()));
+    std::fill(big.begin(), big.end(), std::numeric_limits<T>::lowest());
+    QCOMPARE(array_algorithm::sum(array_ref<const T>(big.data(), big.size())),
+             Total(big.size()) * Total(std::numeric_limits<T>::lowest()));
+}
+
+template< typename T >
+T swapped(T v)
+{
+    using U = std::make_unsigned_t<T>;
+    U r = 0;
+    for( size_t i = 0; i < sizeof(T); ++i )
+        r = U(U(r << 8) | U((U(v) >> (8 * i)) & 0xff));
+    return T(r);
+}
+
+template< typename T >
+void check_byte_swap_fill()
+{
+    std::mt19937_64 gen(3);
+    std::vector<T> values(MaxSize + MaxOffset);
+    for( auto& e : values )
+        e = T(gen());
+    for( size_t offset = 0; offset < MaxOffset; offset += 9 ) {
+        for( size_t size = 0; size <= MaxSize; ++size ) {
+            std::vector<T> dst(values.size(), 0);
+            const array_ref<const T> src(values.data() + offset, size);
+            array_algorithm::byte_swap(array_ref<T>(dst.data() + offset, size), src);
+            for( size_t i = 0; i < dst.size(); ++i ) {
+                const bool inside = i >= offset && i < offset + size;
+                QCOMPARE(dst[i], inside ? swapped(values[i]) : T(0));
+            }
+
+            array_algorithm::byte_swap(array_ref<T>(dst.data() + offset, size));
+            QVERIFY(std::equal(src.begin(), src.end(), dst.begin() + long(offset)));
+
+            array_algorithm::fill(array_ref<T>(dst.data() + offset, size), T(0x5a));
+            for( size_t i = 0; i < dst.size(); ++i ) {
+                const bool inside = i >= offset && i < offset + size;
+                QCOMPARE(dst[i], inside ? T(0x5a) : T(0));
+            }
+        }
+    }
+}
+
+}
+
+void Test_array_algorithm::testFindCount()
+{
+    check_find_count<uint8_t>();
+    check_find_count<int16_t>();
+    check_find_count<uint32_t>();
+    check_find_count<int64_t>();
+}
+
+void Test_array_algorithm::testMinMaxSum()
+{
+    check_min_max<uint8_t>();
+    check_min_max<int16_t>();
+    check_min_max<int32_t>();
+    check_min_max<uint32_t>();
+
+    std::vector<float> f = {3.5f, -1.0f, NAN, 7.25f, 0.0f, -8.0f, 2.0f, NAN, 1.0f};
+    for( size_t i = 0; i < 100; ++i )
+        f.push_back(float(i % 13) - 6.0f);
+    const auto r = array_algorithm::min_max(array_ref<const float>(f.data(), f.size()));
+    QCOMPARE(r.first, -8.0f);
+    QCOMPARE(r.second, 7.25f);
+
+    const auto empty = array_algorithm::min_max(array_ref<const int32_t>());
+    QCOMPARE(empty.first, std::numeric_limits<int32_t>::max());
+    QCOMPARE(empty.second, std::numeric_limits<int32_t>::lowest());
+
+    check_sum<uint8_t, uint64_t>();
+    check_sum<int16_t, int64_t>();
+    check_sum<int32_t, int64_t>();
+    check_sum<uint32_t, uint64_t>();
+}
+
+void Test_array_algorithm::testMismatch()
+{
+    const auto a = random_values<uint8_t>(MaxSize + MaxOffset, 256, 4);
+    for( size_t size = 0; size <= MaxSize; ++size ) {
+        for( size_t diff = 0; diff <= size; ++diff ) {
+            auto b = a;
+            if( diff < size )
+                b[diff] ^= 0x10;
+            const array_ref<const uint8_t> ra(a.data(), size);
+            const array_ref<const uint8_t> rb(b.data(), size);
+            QCOMPARE(array_algorithm::mismatch(ra, rb), diff);
+            QCOMPARE(array_algorithm::equal(ra, rb), diff == size);
+        }
+    }
+
+    const std::vector<uint32_t> x = {1, 2, 3, 4, 5, 6, 7, 8, 9};
+    std::vector<uint32_t> y = x;
+    y[6] = 0x100 | y[6];
+    QCOMPARE(array_algorithm::mismatch(array_ref<const uint32_t>(x.data(), x.size()),
+                                       array_ref<const uint32_t>(y.data(), 8)), size_t(6));
+}
+
+void Test_array_algorithm::testByteSwapFill()
+{
+    check_byte_swap_fill<uint16_t>();
+    check_byte_swap_fill<int32_t>();
+    check_byte_swap_fill<uint64_t>();
+}
+
+void Test_array_algorithm::testPrefixSum()
+{
+    const auto values = random_values<uint32_t>(MaxSize, 1u << 31, 5);
+    for( size_t size = 0; size <= MaxSize; ++size ) {
+        std::vector<uint32_t> v32(values.begin(), values.begin() + long(size));
+        std::vector<uint32_t> e32(size);
+        std::partial_sum(v32.begin(), v32.end(), e32.begin());
+        for( auto& e : e32 )
+            e += 1000;
+        array_algorithm::prefix_sum(array_ref<uint32_t>(v32.data(), size), 1000u);
+        QVERIFY(v32 == e32);
+
+        std::vector<int64_t> v64(values.begin(), values.begin() + long(size));
+        std::vector<int64_t> e64(size);
+        std::partial_sum(v64.begin(), v64.end(), e64.begin());
+        array_algorithm::prefix_sum(array_ref<int64_t>(v64.data(), size));
+        QVERIFY(v64 == e64);
+    }
+}
+
+QTEST_APPLESS_MAIN(Test_array_algorithm)
+
+#include "test_array_algorithm.moc"
@@ -0,0 +1,150 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <QtTest>
+
+#include <lbu/buffer_queue_stream.h>
+
+#include <string>
+#include <thread>
+
+using namespace lbu;
+using namespace lbu::stream;
+
+class Test_buffer_queue_stream : public QObject
+{
+    Q_OBJECT
+
+public:
+    Test_buffer_queue_stream() = default;
+
+private Q_SLOTS:
+    void testZeroCopy();
+    void testRead();
+    void testThreaded();
+};
+
+namespace {
+
+std::string to_string(array_ref<const void> m)
+{
+    return std::string(static_cast<const char*>(m.data()), m.byte_size());
+}
+
+byte_buffer buffer(const std::string& s)
+{
+    return byte_buffer(array_ref<const char>(s.data(), s.size()));
+}
+
+}
+
+void Test_buffer_queue_stream::testZeroCopy()
+{
+    buffer_queue_input_stream s;
+    const std::string borrowed(1000, 'b');
+
+    QVERIFY( ! s.get_buffer(Mode::NonBlocking).data());
+    QVERIFY( ! s.at_end());
+
+    QVERIFY(s.append(buffer("small")));
+    QVERIFY(s.append(byte_buffer()));
+    QVERIFY(s.append(array_ref<const char>(borrowed.data(), borrowed.size())));
+    QVERIFY(s.append(buffer(std::string(100, 'o'))));
+    QCOMPARE(s.queued_size(), size_t(1105));
+
+    QCOMPARE(to_string(s.get_buffer(Mode::NonBlocking)), std::string("small"));
+    QCOMPARE(s.queued_size(), size_t(1100));
+    s.advance_buffer(2);
+    QCOMPARE(to_string(s.get_buffer(Mode::NonBlocking)), std::string("all"));
+    s.advance_whole_buffer();
+
+    auto b = s.get_buffer(Mode::Blocking);
+    QCOMPARE(b.data(), static_cast<const void*>(borrowed.data()));
+    QCOMPARE(b.byte_size(), borrowed.size());
+    s.advance_whole_buffer();
+    QCOMPARE(to_string(s.get_buffer(Mode::Blocking)), std::string(100, 'o'));
+    s.advance_whole_buffer();
+
+    QVERIFY( ! s.get_buffer(Mode::NonBlocking).data());
+    QVERIFY( ! s.at_end());
+    s.set_end_of_stream();
+    QVERIFY( ! s.append(buffer("late")));
+    QVERIFY( ! s.get_buffer(Mode::Blocking).data());
+    QVERIFY(s.at_end());
+    QVERIFY( ! s.has_error());
+
+    s.reset();
+    QVERIFY( ! s.at_end());
+    QVERIFY(s.append(buffer("again")));
+    QCOMPARE(to_string(s.get_buffer(Mode::NonBlocking)), std::string("again"));
+}
+
+void Test_buffer_queue_stream::testRead()
+{
+    buffer_queue_input_stream s;
+    QVERIFY(s.append(buffer("abc")));
+    QVERIFY(s.append(buffer("defgh")));
+    QVERIFY(s.append(buffer("ijklmnopqrstuvwxyz")));
+
+    char buf[32] = {};
+    QCOMPARE(s.read(buf, 2, Mode::Blocking), ssize_t(2));
+    QCOMPARE(std::string(buf, 2), std::string("ab"));
+    // across segments
+    QCOMPARE(s.read(buf, 10, Mode::Blocking), ssize_t(10));
+    QCOMPARE(std::string(buf, 10), std::string("cdefghijkl"));
+
+    // non-blocking reads what is there
+    QCOMPARE(s.read(buf, sizeof(buf), Mode::NonBlocking), ssize_t(14));
+    QCOMPARE(std::string(buf, 14), std::string("mnopqrstuvwxyz"));
+    QCOMPARE(s.read(buf, sizeof(buf), Mode::NonBlocking), ssize_t(0));
+    QVERIFY( ! s.at_end());
+
+    QVERIFY(s.append(buffer("end")));
+    s.set_end_of_stream();
+    QCOMPARE(s.read(buf, sizeof(buf), Mode::Blocking), ssize_t(3));
+    QVERIFY(s.at_end());
+    QCOMPARE(s.read(buf, sizeof(buf), Mode::Blocking), ssize_t(0));
+    QVERIFY( ! s.has_error());
+}
+
+void Test_buffer_queue_stream::testThreaded()
+{
+    buffer_queue_input_stream s;
+    constexpr uint32_t Count = 20000;
+
+    std::thread producer([&]() {
+        for( uint32_t i = 0; i < Count; ++i ) {
+            byte_buffer b;
+            b.append(size_t(i % 97 + 1), char(i));
+            s.append(std::move(b));
+        }
+        s.set_end_of_stream();
+    });
+
+    bool data_ok = true;
+    uint32_t index = 0;
+    uint32_t remaining = 1;
+    size_t total = 0;
+    char c;
+    while( s.read(&c, 1, Mode::Blocking) == 1 ) {
+        if( c != char(index) )
+            data_ok = false;
+        ++total;
+        if( --remaining == 0 && ++index < Count )
+            remaining = index % 97 + 1;
+    }
+    producer.join();
+
+    QVERIFY(data_ok);
+    QVERIFY(s.at_end());
+    QCOMPARE(index, Count);
+    size_t expected = 0;
+    for( uint32_t i = 0; i < Count; ++i )
+        expected += i % 97 + 1;
+    QCOMPARE(total, expected);
+}
+
+QTEST_APPLESS_MAIN(Test_buffer_queue_stream)
+
+#include "test_buffer_queue_stream.moc"
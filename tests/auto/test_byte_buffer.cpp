@@ -21,6 +21,10 @@
 #include <QtTest>
 
 #include <lbu/byte_buffer.h>
+#include <lbu/byte_buffer_stream.h>
+
+#include <limits>
+#include <string>
 
 using namespace lbu;
 
@@ -35,6 +39,8 @@ private Q_SLOTS:
     void testConstructor();
     void testReserve();
     void testModify();
+    void testTryVariants();
+    void testOutputStreamBuffer();
 };
 
 void Test_byte_buffer::testConstructor()
@@ -198,6 +204,70 @@ void Test_byte_buffer::testModify()
 
     b.clear();
     QVERIFY(b.is_empty());
+
+    byte_buffer small;
+    small.append(array_ref<const char>("abcde", 5));
+    small.erase(1, 2);
+    QCOMPARE(small.size(), size_t(3));
+    QCOMPARE(std::memcmp(small.data(), "ade", 3), 0);
+}
+
+void Test_byte_buffer::testTryVariants()
+{
+    byte_buffer b;
+
+    QVERIFY(b.try_reserve(10));
+    QCOMPARE(b.capacity(), size_t(15));
+    QVERIFY(b.try_append(3, 'x'));
+    QVERIFY(b.try_append(array_ref<const char>("abc", 3)));
+    QCOMPARE(b.size(), size_t(6));
+    QCOMPARE(std::memcmp(b.data(), "xxxabc", 6), 0);
+
+    // small to external and growing like append
+    QVERIFY(b.try_append(array_ref<const char>("0123456789abcdef", 16)));
+    QCOMPARE(b.size(), size_t(22));
+    QCOMPARE(b.capacity(), size_t(32));
+    QCOMPARE(std::memcmp(b.data(), "xxxabc0123456789abcdef", 22), 0);
+    QVERIFY(b.try_append(20, 'y'));
+    QCOMPARE(b.capacity(), size_t(64));
+
+    QVERIFY(b.try_reserve(1000));
+    QCOMPARE(b.capacity(), size_t(1000));
+    QVERIFY(b.try_resize(4));
+    QCOMPARE(b.size(), size_t(4));
+    QVERIFY(b.try_resize(8));
+    QCOMPARE(std::memcmp(b.data(), "xxxa\0\0\0\0", 8), 0);
+    QCOMPARE(b.capacity(), size_t(1000));
+
+    // beyond max_size() fails without touching the buffer
+    QVERIFY( ! b.try_reserve(byte_buffer::max_size() + 1));
+    QVERIFY( ! b.try_resize(byte_buffer::max_size() + 1));
+    QVERIFY( ! b.try_append(byte_buffer::max_size() - 7));
+    QVERIFY( ! b.try_append(std::numeric_limits<size_t>::max()));
+    QCOMPARE(b.size(), size_t(8));
+    QCOMPARE(b.capacity(), size_t(1000));
+    QCOMPARE(std::memcmp(b.data(), "xxxa\0\0\0\0", 8), 0);
+}
+
+void Test_byte_buffer::testOutputStreamBuffer()
+{
+    // data in the zero copy buffer is kept when the next get_buffer has to grow it
+    stream::byte_buffer_output_stream out;
+    std::string expected;
+    for( int i = 0; i < 10; ++i ) {
+        auto b = out.get_buffer(stream::Mode::Blocking);
+        QVERIFY(b.byte_size() > 0);
+        std::memset(b.data(), 'a' + i, b.byte_size());
+        expected.append(b.byte_size(), char('a' + i));
+        out.advance_buffer(b.byte_size());
+    }
+    QCOMPARE(out.write("end", 3, stream::Mode::Blocking), ssize_t(3));
+    expected += "end";
+    QVERIFY(out.flush_buffer());
+
+    const auto b = out.release_reset();
+    QCOMPARE(b.size(), expected.size());
+    QCOMPARE(std::memcmp(b.data(), expected.data(), expected.size()), 0);
 }
 
 QTEST_APPLESS_MAIN(Test_byte_buffer)
@@ -0,0 +1,184 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <QtTest>
+
+#include <lbu/fd_stream.h>
+#include <lbu/io.h>
+#include <lbu/pipe.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+
+using namespace lbu;
+using namespace lbu::stream;
+
+class Test_fd_stream : public QObject
+{
+    Q_OBJECT
+
+public:
+    Test_fd_stream() = default;
+
+private Q_SLOTS:
+    void testPollRead();
+    void testPollWrite();
+    void testPollModeSwitch();
+    void testAutomatic();
+};
+
+namespace {
+
+bool nonblocking(fd f)
+{
+    return (::fcntl(f.value, F_GETFL, 0) & O_NONBLOCK) != 0;
+}
+
+std::string pattern(size_t size)
+{
+    std::string s(size, '\0');
+    for( size_t i = 0; i < size; ++i )
+        s[i] = char('a' + i % 23);
+    return s;
+}
+
+void sleep_ms(int ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+}
+
+void Test_fd_stream::testPollRead()
+{
+    auto p = pipe::open();
+    QCOMPARE(p.status, int(pipe::StatusNoError));
+    char buffer[1024];
+    fd_input_stream in(array_ref<char>(buffer, sizeof(buffer)), *p.read_fd, FdBlockingState::NonBlockingPoll);
+    // made non-blocking once when the fd is set
+    QVERIFY(nonblocking(*p.read_fd));
+
+    // the blocking read waits for the delayed writes, more than fit into the buffer
+    const auto data = pattern(100000);
+    std::thread writer([&]() {
+        sleep_ms(20);
+        for( size_t offset = 0; offset < data.size(); offset += 10000 ) {
+            QCOMPARE(io::write_all(*p.write_fd, array_ref<const char>(data.data() + offset, 10000)), int(io::WriteNoError));
+            sleep_ms(1);
+        }
+        p.write_fd.reset();
+    });
+    std::string r(data.size(), '\0');
+    QCOMPARE(in.read(&r[0], r.size(), Mode::Blocking), ssize_t(r.size()));
+    QVERIFY(r == data);
+
+    // at the end a blocking read returns 0, without an error
+    QCOMPARE(in.read(&r[0], r.size(), Mode::Blocking), ssize_t(0));
+    writer.join();
+    QVERIFY(in.at_end());
+    QVERIFY( ! in.has_error());
+    QCOMPARE(in.status(), 0);
+}
+
+void Test_fd_stream::testPollWrite()
+{
+    auto p = pipe::open();
+    QCOMPARE(p.status, int(pipe::StatusNoError));
+    char buffer[1000];
+    fd_output_stream out(array_ref<char>(buffer, sizeof(buffer)), *p.write_fd, FdBlockingState::NonBlockingPoll);
+    QVERIFY(nonblocking(*p.write_fd));
+
+    // much more than the pipe holds, so the write has to wait for the slow reader
+    const auto data = pattern(1 << 20);
+    std::string r;
+    std::thread reader([&]() {
+        char chunk[7000];
+        while( true ) {
+            sleep_ms(1);
+            const auto n = io::read(*p.read_fd, array_ref<char>(chunk, sizeof(chunk)));
+            if( n.size <= 0 )
+                break;
+            r.append(chunk, size_t(n.size));
+        }
+    });
+    QCOMPARE(out.write(data.data(), data.size(), Mode::Blocking), ssize_t(data.size()));
+    QVERIFY(out.flush_buffer());
+    QVERIFY( ! out.has_error());
+    p.write_fd.reset();
+    reader.join();
+    QVERIFY(r == data);
+}
+
+void Test_fd_stream::testPollModeSwitch()
+{
+    auto p = pipe::open();
+    QCOMPARE(p.status, int(pipe::StatusNoError));
+    char in_buffer[256];
+    char out_buffer[256];
+    fd_input_stream in(array_ref<char>(in_buffer, sizeof(in_buffer)), *p.read_fd, FdBlockingState::NonBlockingPoll);
+    fd_output_stream out(array_ref<char>(out_buffer, sizeof(out_buffer)), *p.write_fd, FdBlockingState::NonBlockingPoll);
+
+    char buf[64];
+    // nothing there yet, a non-blocking read does not wait
+    QCOMPARE(in.read(buf, sizeof(buf), Mode::NonBlocking), ssize_t(0));
+    QVERIFY( ! in.has_error());
+
+    // a full pipe: non-blocking writes stop short, without an error
+    const auto data = pattern(1 << 20);
+    const auto written = out.write(data.data(), data.size(), Mode::NonBlocking);
+    QVERIFY(written > 0 && size_t(written) < data.size());
+    QVERIFY( ! out.has_error());
+    QCOMPARE(out.write(data.data(), data.size(), Mode::NonBlocking), ssize_t(0));
+
+    // now blocking on the same stream, the rest goes out as the reader drains the pipe
+    std::string r;
+    std::thread reader([&]() {
+        std::string chunk(5000, '\0');
+        while( true ) {
+            const auto n = in.read(&chunk[0], chunk.size(), (r.size() / chunk.size()) % 2 ? Mode::Blocking : Mode::NonBlocking);
+            if( n < 0 )
+                break;
+            r.append(chunk, 0, size_t(n));
+            if( n == 0 && in.at_end() )
+                break;
+            if( n == 0 )
+                sleep_ms(1);
+        }
+    });
+    const size_t rest = data.size() - size_t(written);
+    QCOMPARE(out.write(data.data() + written, rest, Mode::Blocking), ssize_t(rest));
+    QVERIFY(out.flush_buffer());
+    // the flags were never touched by the mode switches
+    QVERIFY(nonblocking(*p.write_fd));
+    p.write_fd.reset();
+    reader.join();
+    QVERIFY(r == data);
+    QVERIFY( ! in.has_error());
+    QVERIFY(nonblocking(*p.read_fd));
+}
+
+void Test_fd_stream::testAutomatic()
+{
+    auto p = pipe::open();
+    QCOMPARE(p.status, int(pipe::StatusNoError));
+    char buffer[256];
+    fd_input_stream in(array_ref<char>(buffer, sizeof(buffer)), *p.read_fd);
+    QVERIFY( ! nonblocking(*p.read_fd));
+
+    // the flag follows the requests
+    char buf[16];
+    QCOMPARE(in.read(buf, sizeof(buf), Mode::NonBlocking), ssize_t(0));
+    QVERIFY(nonblocking(*p.read_fd));
+    QCOMPARE(io::write_all(*p.write_fd, array_ref<const char>("0123456789abcdef", 16)), int(io::WriteNoError));
+    QCOMPARE(in.read(buf, sizeof(buf), Mode::Blocking), ssize_t(16));
+    QVERIFY( ! nonblocking(*p.read_fd));
+    QCOMPARE(std::string(buf, 16), std::string("0123456789abcdef"));
+}
+
+QTEST_APPLESS_MAIN(Test_fd_stream)
+
+#include "test_fd_stream.moc"
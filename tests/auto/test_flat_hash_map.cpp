@@ -0,0 +1,159 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <QtTest>
+
+#include <lbu/flat_hash_map.h>
+
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+
+using namespace lbu;
+
+class Test_flat_hash_map : public QObject
+{
+    Q_OBJECT
+
+public:
+    Test_flat_hash_map() = default;
+
+private Q_SLOTS:
+    void testBasic();
+    void testRandomOps();
+    void testNonTrivial();
+    void testChurn();
+    void testHash();
+};
+
+void Test_flat_hash_map::testBasic()
+{
+    flat_hash_map<uint32_t, int> m;
+    QVERIFY(m.is_empty());
+    QCOMPARE(m.capacity(), size_t(0));
+    QVERIFY(m.find(1) == m.end());
+    QVERIFY(m.begin() == m.end());
+    QCOMPARE(m.erase(1), size_t(0));
+
+    QVERIFY(m.try_emplace(1, 10).second);
+    QVERIFY( ! m.try_emplace(1, 11).second);
+    QCOMPARE(m.find(1)->second, 10);
+    m.insert_or_assign(1, 12);
+    QCOMPARE(*m.lookup(1), 12);
+    m[2] = 20;
+    QCOMPARE(m.size(), size_t(2));
+    QVERIFY(m.contains(2));
+    QVERIFY(m.lookup(3) == nullptr);
+
+    m.reserve(1000);
+    QVERIFY(m.capacity() >= 1000);
+    QCOMPARE(m.size(), size_t(2));
+    QCOMPARE(*m.lookup(2), 20);
+
+    QCOMPARE(m.erase(1), size_t(1));
+    QVERIFY( ! m.contains(1));
+    m.clear();
+    QVERIFY(m.is_empty());
+    QVERIFY(m.begin() == m.end());
+}
+
+void Test_flat_hash_map::testRandomOps()
+{
+    std::mt19937_64 gen(1);
+    for( uint64_t range : {uint64_t(20), uint64_t(1000), uint64_t(100000)} ) {
+        flat_hash_map<uint64_t, uint64_t> m;
+        std::unordered_map<uint64_t, uint64_t> ref;
+        for( int i = 0; i < 200000; ++i ) {
+            const uint64_t k = gen() % range;
+            switch( gen() % 4 ) {
+            case 0:
+            case 1:
+                QCOMPARE(m.try_emplace(k, k * 3).second, ref.try_emplace(k, k * 3).second);
+                break;
+            case 2:
+                QCOMPARE(m.erase(k), ref.erase(k));
+                break;
+            default:
+                QCOMPARE(m.contains(k), ref.count(k) > 0);
+            }
+        }
+        QCOMPARE(m.size(), ref.size());
+
+        size_t n = 0;
+        for( const auto& kv : m ) {
+            QCOMPARE(kv.second, ref.at(kv.first));
+            ++n;
+        }
+        QCOMPARE(n, ref.size());
+
+        auto copy = m;
+        for( auto it = copy.begin(); it != copy.end(); ) {
+            if( it->first % 2 )
+                it = copy.erase(it);
+            else
+                ++it;
+        }
+        for( const auto& kv : ref )
+            QCOMPARE(copy.contains(kv.first), kv.first % 2 == 0);
+    }
+}
+
+void Test_flat_hash_map::testNonTrivial()
+{
+    flat_hash_map<std::string, std::unique_ptr<int>> m;
+    for( int i = 0; i < 5000; ++i )
+        m[std::to_string(i)] = std::make_unique<int>(i);
+    for( int i = 0; i < 5000; i += 2 )
+        QCOMPARE(m.erase(std::to_string(i)), size_t(1));
+    for( int i = 0; i < 5000; ++i ) {
+        auto* p = m.lookup(std::to_string(i));
+        QCOMPARE(p != nullptr, i % 2 == 1);
+        if( p )
+            QCOMPARE(**p, i);
+    }
+
+    auto moved = std::move(m);
+    QVERIFY(m.is_empty());
+    QCOMPARE(moved.size(), size_t(2500));
+    m = std::move(moved);
+    QCOMPARE(m.size(), size_t(2500));
+    QCOMPARE(**m.lookup("4999"), 4999);
+}
+
+void Test_flat_hash_map::testChurn()
+{
+    // erasing must mostly free slots without tombstones, so a steady state
+    // insert/erase pattern does not grow the table
+    flat_hash_map<uint32_t, int> m;
+    m.reserve(100);
+    const size_t cap = m.capacity();
+    for( uint32_t i = 0; i < 100000; ++i ) {
+        m[i] = 1;
+        if( i >= 50 )
+            QCOMPARE(m.erase(i - 50), size_t(1));
+    }
+    QCOMPARE(m.size(), size_t(50));
+    QCOMPARE(m.capacity(), cap);
+}
+
+void Test_flat_hash_map::testHash()
+{
+    QCOMPARE(hash::hash_bytes("abc", 3), hash::hash_bytes("abc", 3));
+    QVERIFY(hash::hash_bytes("abc", 3) != hash::hash_bytes("abc", 3, 1));
+    QVERIFY(hash::hash_u64(1) != hash::hash_u64(2));
+
+    // every length class, single byte changes
+    for( size_t len = 1; len < 200; ++len ) {
+        std::string a(len, 'a');
+        std::string b = a;
+        b[len / 2] = 'b';
+        QVERIFY(hash::hash_bytes(a.data(), len) != hash::hash_bytes(b.data(), len));
+        QVERIFY(hash::hash_bytes(a.data(), len) != hash::hash_bytes(a.data(), len - 1));
+    }
+}
+
+QTEST_APPLESS_MAIN(Test_flat_hash_map)
+
+#include "test_flat_hash_map.moc"
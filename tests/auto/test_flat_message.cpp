@@ -0,0 +1,216 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <QtTest>
+
+#include <lbu/flat_message.h>
+
+#include <string>
+#include <vector>
+
+using namespace lbu;
+
+class Test_flat_message : public QObject
+{
+    Q_OBJECT
+
+public:
+    Test_flat_message() = default;
+
+private Q_SLOTS:
+    void testLayout();
+    void testBuildView();
+    void testFixedTarget();
+    void testVerify();
+};
+
+namespace {
+
+enum class Kind : uint16_t { Trade = 1, Quote = 0x1234 };
+
+struct message_layout {
+    flat_layout layout;
+    flat_field<uint8_t> flags = layout.add_scalar<uint8_t>();
+    flat_field<uint64_t> id = layout.add_scalar<uint64_t>();
+    flat_field<Kind> kind = layout.add_scalar<Kind>();
+    flat_field<bool> active = layout.add_scalar<bool>();
+    flat_field<double> price = layout.add_scalar<double>();
+    flat_array_field<int32_t> levels = layout.add_array<int32_t>(3);
+    flat_vector_field<uint32_t> values = layout.add_vector<uint32_t>();
+    flat_vector_field<char> name = layout.add_vector<char>();
+    flat_vector_field<uint16_t> empty = layout.add_vector<uint16_t>();
+};
+
+void fill(const message_layout& m, flat_builder* b, const std::vector<uint32_t>& values)
+{
+    b->set(m.flags, uint8_t(0xa5));
+    b->set(m.id, uint64_t(0x0102030405060708));
+    b->set(m.kind, Kind::Quote);
+    b->set(m.active, true);
+    b->set(m.price, 101.25);
+    b->set(m.levels, 0, int32_t(-1));
+    const int32_t rest[] = {7, -70000};
+    b->set(m.levels, array_ref<const int32_t>(rest));
+    b->set(m.name, array_ref<const char>("abc", 3));
+    b->set(m.values, array_ref<const uint32_t>(values.data(), values.size()));
+}
+
+// 8 byte aligned storage for messages
+array_ref<char> aligned(std::vector<uint64_t>* storage, size_t size)
+{
+    assert(size <= storage->size() * 8);
+    return {reinterpret_cast<char*>(storage->data()), size};
+}
+
+}
+
+void Test_flat_message::testLayout()
+{
+    message_layout m;
+    QCOMPARE(m.id.offset % 8, size_t(0));
+    QCOMPARE(m.kind.offset % 2, size_t(0));
+    QCOMPARE(m.price.offset % 8, size_t(0));
+    QCOMPARE(m.levels.offset % 4, size_t(0));
+    QCOMPARE(m.levels.count, size_t(3));
+    QCOMPARE(m.values.offset % 4, size_t(0));
+    QCOMPARE(m.layout.alignment(), size_t(8));
+    QCOMPARE(m.layout.fixed_size() % 8, size_t(0));
+    QVERIFY(m.layout.fixed_size() >= m.empty.offset + flat_layout::VectorRefSize);
+    QCOMPARE(m.layout.vector_fields().size(), size_t(3));
+    QCOMPARE(m.layout.vector_fields()[0].element_size, sizeof(uint32_t));
+}
+
+void Test_flat_message::testBuildView()
+{
+    message_layout m;
+    const std::vector<uint32_t> values = {1, 2, 3, 0xffffffff, 5};
+
+    byte_buffer buf(array_ref<const char>("prefix", 6));
+    flat_builder b(m.layout, &buf);
+    fill(m, &b, values);
+    QVERIFY( ! b.has_error());
+    auto msg = b.finish();
+    QCOMPARE(msg.byte_size(), b.size());
+    QCOMPARE(buf.size(), 6 + b.size());
+    QCOMPARE(msg.data(), static_cast<void*>(static_cast<char*>(buf.data()) + 6));
+
+    // copy to an aligned buffer, as a reader would see it at the start of a ring window
+    std::vector<uint64_t> storage((msg.byte_size() + 7) / 8 + 1);
+    std::memcpy(storage.data(), msg.data(), msg.byte_size());
+    // trailing data after the message does not matter
+    const flat_view v(array_ref<const char>(reinterpret_cast<const char*>(storage.data()), storage.size() * 8));
+    QVERIFY(v.verify(m.layout));
+    QCOMPARE(size_t(v.size()), msg.byte_size());
+    QCOMPARE(v.data().byte_size(), msg.byte_size());
+
+    QCOMPARE(v.get(m.flags), uint8_t(0xa5));
+    QCOMPARE(v.get(m.id), uint64_t(0x0102030405060708));
+    QCOMPARE(v.get(m.kind), Kind::Quote);
+    QCOMPARE(v.get(m.active), true);
+    QCOMPARE(v.get(m.price), 101.25);
+    QCOMPARE(v.get(m.levels, 0), int32_t(7));
+    QCOMPARE(v.get(m.levels, 1), int32_t(-70000));
+    QCOMPARE(v.get(m.levels, 2), int32_t(0));
+    QCOMPARE(v.get(m.levels).size(), uint32_t(3));
+
+    const auto vals = v.get(m.values);
+    QCOMPARE(vals.size(), uint32_t(values.size()));
+    for( uint32_t i = 0; i < vals.size(); ++i )
+        QCOMPARE(vals[i], values[i]);
+    QCOMPARE(reinterpret_cast<uintptr_t>(vals.bytes().data()) % alignof(uint32_t), uintptr_t(0));
+    if( __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ ) {
+        const auto direct = vals.direct();
+        QCOMPARE(direct.size(), values.size());
+        QCOMPARE(direct[3], uint32_t(0xffffffff));
+    }
+
+    const auto name = v.get(m.name);
+    QCOMPARE(std::string(name.bytes().data(), name.size()), std::string("abc"));
+    QVERIFY(v.get(m.empty).is_empty());
+
+    // the fields are little endian on the wire
+    const char* raw = reinterpret_cast<const char*>(storage.data());
+    QCOMPARE(raw[m.id.offset], char(0x08));
+    QCOMPARE(raw[m.kind.offset], char(0x34));
+    QCOMPARE(from_little_endian<uint32_t>(raw), uint32_t(msg.byte_size()));
+}
+
+void Test_flat_message::testFixedTarget()
+{
+    message_layout m;
+    const std::vector<uint32_t> values(10, 42);
+
+    std::vector<uint64_t> storage(64);
+    auto target = aligned(&storage, storage.size() * 8);
+    flat_builder b(m.layout, target);
+    fill(m, &b, values);
+    QVERIFY( ! b.has_error());
+    auto msg = b.finish();
+    QCOMPARE(msg.data(), static_cast<void*>(target.data()));
+    const flat_view v(msg);
+    QVERIFY(v.verify(m.layout));
+    QCOMPARE(v.get(m.values)[9], uint32_t(42));
+
+    // a target too small for the variable arrays
+    std::vector<uint64_t> small(m.layout.fixed_size() / 8 + 1);
+    flat_builder s(m.layout, aligned(&small, small.size() * 8));
+    QVERIFY( ! s.has_error());
+    fill(m, &s, values);
+    QVERIFY(s.has_error());
+    QVERIFY( ! s.finish().data());
+
+    // or even for the fixed part
+    flat_builder t(m.layout, aligned(&small, m.layout.fixed_size() - 1));
+    QVERIFY(t.has_error());
+    QVERIFY( ! t.finish().data());
+}
+
+void Test_flat_message::testVerify()
+{
+    message_layout m;
+    const std::vector<uint32_t> values = {1, 2, 3};
+    byte_buffer buf;
+    flat_builder b(m.layout, &buf);
+    fill(m, &b, values);
+    auto msg = b.finish();
+    const std::string good(static_cast<const char*>(msg.data()), msg.byte_size());
+
+    auto view = [](const std::string& s) { return flat_view(array_ref<const char>(s.data(), s.size())); };
+    QVERIFY(view(good).verify(m.layout));
+
+    // truncated messages
+    QVERIFY( ! view(good.substr(0, good.size() - 1)).verify(m.layout));
+    QVERIFY( ! view(good.substr(0, m.layout.fixed_size() - 1)).verify(m.layout));
+
+    // a size field that is too small or too large
+    auto bad = good;
+    to_little_endian<uint32_t>(uint32_t(m.layout.fixed_size() - 1), &bad[0]);
+    QVERIFY( ! view(bad).verify(m.layout));
+    bad = good;
+    to_little_endian<uint32_t>(uint32_t(good.size() + 1), &bad[0]);
+    QVERIFY( ! view(bad).verify(m.layout));
+
+    // vector references out of bounds or into the fixed part
+    bad = good;
+    to_little_endian<uint32_t>(1000, &bad[m.values.offset + 4]);
+    QVERIFY( ! view(bad).verify(m.layout));
+    bad = good;
+    to_little_endian<uint32_t>(0xffffffff, &bad[m.values.offset + 4]);
+    QVERIFY( ! view(bad).verify(m.layout));
+    bad = good;
+    to_little_endian<uint32_t>(uint32_t(good.size()), &bad[m.values.offset]);
+    QVERIFY( ! view(bad).verify(m.layout));
+    bad = good;
+    to_little_endian<uint32_t>(4, &bad[m.values.offset]);
+    QVERIFY( ! view(bad).verify(m.layout));
+
+    // an empty vector may reference anything
+    bad = good;
+    to_little_endian<uint32_t>(0xffffffff, &bad[m.empty.offset]);
+    QVERIFY(view(bad).verify(m.layout));
+}
+
+QTEST_APPLESS_MAIN(Test_flat_message)
+
+#include "test_flat_message.moc"
@@ -0,0 +1,258 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <QtTest>
+
+#include <lbu/byte_buffer_stream.h>
+#include <lbu/endian.h>
+#include <lbu/fd_stream.h>
+#include <lbu/int_codec.h>
+#include <lbu/io.h>
+#include <lbu/pipe.h>
+
+#include <random>
+#include <vector>
+
+using namespace lbu;
+
+class Test_int_codec : public QObject
+{
+    Q_OBJECT
+
+public:
+    Test_int_codec() = default;
+
+private Q_SLOTS:
+    void testPack();
+    void testTransforms();
+    void testStream();
+    void testTruncated();
+    void testCorrupt();
+};
+
+namespace {
+
+constexpr int_codec::Transform AllTransforms[] = {
+    int_codec::Transform::None, int_codec::Transform::FrameOfReference,
+    int_codec::Transform::Delta, int_codec::Transform::DeltaOfDelta
+};
+
+template< typename UIntType >
+std::vector<UIntType> random_values(size_t count, unsigned bits, unsigned seed)
+{
+    std::mt19937_64 rng(seed);
+    std::vector<UIntType> v(count);
+    const uint64_t mask = bits >= 64 ? ~uint64_t(0) : (uint64_t(1) << bits) - 1;
+    for( auto& x : v )
+        x = UIntType(rng() & mask);
+    // make sure the full width is used
+    if( count > 0 && bits > 0 )
+        v[count / 2] = UIntType(mask);
+    return v;
+}
+
+template< typename UIntType >
+bool pack_round_trip(size_t count, unsigned bits)
+{
+    const auto values = random_values<UIntType>(count, bits, bits);
+    if( count > 0 && int_codec::required_bits(array_ref<const UIntType>(values.data(), values.size())) != bits )
+        return false;
+    // one byte more to catch writes past the packed size
+    std::vector<char> packed(int_codec::packed_size(count, bits) + 1, '\x5a');
+    int_codec::pack(array_ref<const UIntType>(values.data(), values.size()), bits, packed.data());
+    if( packed.back() != '\x5a' )
+        return false;
+    std::vector<UIntType> unpacked(count);
+    int_codec::unpack(packed.data(), bits, array_ref<UIntType>(unpacked.data(), unpacked.size()));
+    return unpacked == values;
+}
+
+template< typename UIntType >
+bool block_round_trip(const std::vector<UIntType>& values, int_codec::Transform t)
+{
+    const array_ref<const UIntType> in(values.data(), values.size());
+    std::vector<char> buf(int_codec::encoded_size_bound<UIntType>(values.size()));
+    const size_t size = int_codec::encode(in, t, buf.data());
+
+    int_codec::block_info info;
+    if( ! int_codec::peek(buf.data(), buf.data() + size, &info) || info.encoded_size() != size
+            || info.transform != t || info.count != values.size() )
+        return false;
+
+    std::vector<UIntType> out(values.size());
+    const char* end = int_codec::decode(buf.data(), buf.data() + size, array_ref<UIntType>(out.data(), out.size()));
+    return end == buf.data() + size && out == values;
+}
+
+std::vector<uint64_t> time_stamps(size_t count)
+{
+    std::mt19937 rng(7);
+    std::vector<uint64_t> v(count);
+    uint64_t t = 1700000000000000000;
+    for( auto& x : v ) {
+        t += 1000000 + rng() % 5;
+        x = t;
+    }
+    return v;
+}
+
+byte_buffer encoded(const std::vector<uint32_t>& values, int_codec::Transform t)
+{
+    byte_buffer b;
+    b.resize(int_codec::encoded_size_bound<uint32_t>(values.size()));
+    b.resize(int_codec::encode(array_ref<const uint32_t>(values.data(), values.size()), t,
+                               static_cast<char*>(b.data())));
+    return b;
+}
+
+}
+
+void Test_int_codec::testPack()
+{
+    for( size_t count : {size_t(0), size_t(1), size_t(127), size_t(128), size_t(129), size_t(1000)} ) {
+        for( unsigned bits = 0; bits <= 32; ++bits )
+            QVERIFY(pack_round_trip<uint32_t>(count, bits));
+        for( unsigned bits = 0; bits <= 64; ++bits )
+            QVERIFY(pack_round_trip<uint64_t>(count, bits));
+    }
+    QCOMPARE(int_codec::packed_size(128, 17), size_t(272));
+}
+
+void Test_int_codec::testTransforms()
+{
+    for( auto t : AllTransforms ) {
+        for( unsigned bits : {0u, 1u, 7u, 16u, 31u, 32u} )
+            QVERIFY(block_round_trip(random_values<uint32_t>(300, bits, bits), t));
+        for( unsigned bits : {0u, 1u, 33u, 63u, 64u} )
+            QVERIFY(block_round_trip(random_values<uint64_t>(300, bits, bits), t));
+        QVERIFY(block_round_trip(std::vector<uint32_t>(), t));
+        QVERIFY(block_round_trip(time_stamps(1000), t));
+    }
+
+    // the transforms are what makes the data small
+    const auto ts = time_stamps(1000);
+    std::vector<char> buf(int_codec::encoded_size_bound<uint64_t>(ts.size()));
+    const size_t dod = int_codec::encode(array_ref<const uint64_t>(ts.data(), ts.size()),
+                                         int_codec::Transform::DeltaOfDelta, buf.data());
+    QVERIFY(dod <= int_codec::HeaderSize + int_codec::packed_size(ts.size(), 4));
+
+    std::vector<uint32_t> sorted(500);
+    for( size_t i = 0; i < sorted.size(); ++i )
+        sorted[i] = uint32_t(100000 + 3 * i);
+    int_codec::block_info info;
+    const auto delta = encoded(sorted, int_codec::Transform::Delta);
+    QVERIFY(int_codec::peek(delta.char_data(), delta.char_data() + delta.size(), &info));
+    QCOMPARE(info.bits, 2u);
+    QVERIFY(block_round_trip(sorted, int_codec::Transform::FrameOfReference));
+}
+
+void Test_int_codec::testStream()
+{
+    const auto a = random_values<uint32_t>(20000, 17, 1);
+    const auto b = time_stamps(300);
+
+    stream::byte_buffer_output_stream out;
+    QVERIFY(int_codec::write(&out, array_ref<const uint32_t>(a.data(), a.size()), int_codec::Transform::None));
+    QVERIFY(int_codec::write(&out, array_ref<const uint64_t>(b.data(), b.size()), int_codec::Transform::DeltaOfDelta));
+    QVERIFY(out.flush_buffer());
+    auto data = out.release_reset();
+
+    stream::byte_buffer_input_stream in(data.ref());
+    std::vector<uint32_t> ra = {1, 2, 3};
+    std::vector<uint64_t> rb;
+    QVERIFY(int_codec::read(&in, &ra));
+    QVERIFY(int_codec::read(&in, &rb));
+    QVERIFY(ra == a);
+    QVERIFY(rb == b);
+    QVERIFY( ! int_codec::read(&in, &ra));
+
+    // an unbuffered stream reads the block in parts
+    auto p = pipe::open();
+    QCOMPARE(p.status, int(pipe::StatusNoError));
+    QCOMPARE(io::write_all(*p.write_fd, data.ref()), int(io::WriteNoError));
+    p.write_fd.reset();
+    stream::fd_input_stream unbuffered({}, *p.read_fd);
+    QVERIFY(int_codec::read(&unbuffered, &ra));
+    QVERIFY(int_codec::read(&unbuffered, &rb));
+    QVERIFY(ra == a);
+    QVERIFY(rb == b);
+}
+
+void Test_int_codec::testTruncated()
+{
+    const auto values = random_values<uint32_t>(1000, 13, 2);
+    const auto data = encoded(values, int_codec::Transform::FrameOfReference);
+    const char* src = data.char_data();
+    std::vector<uint32_t> out(values.size());
+    const array_ref<uint32_t> dst(out.data(), out.size());
+
+    for( size_t size : {size_t(0), size_t(1), int_codec::HeaderSize - 1, int_codec::HeaderSize, data.size() - 1} ) {
+        QVERIFY(int_codec::decode(src, src + size, dst) == nullptr);
+
+        auto copy = data;
+        stream::byte_buffer_input_stream in(array_ref<char>(copy.char_data(), size));
+        std::vector<uint32_t> r;
+        QVERIFY( ! int_codec::read(&in, &r));
+    }
+    QVERIFY(int_codec::decode(src, src + data.size(), dst) == src + data.size());
+    QVERIFY(out == values);
+}
+
+void Test_int_codec::testCorrupt()
+{
+    const auto values = random_values<uint32_t>(200, 9, 3);
+    const auto data = encoded(values, int_codec::Transform::Delta);
+    int_codec::block_info info;
+    std::vector<uint32_t> out(values.size());
+    const array_ref<uint32_t> dst(out.data(), out.size());
+
+    auto corrupt = [&](size_t offset, char value) {
+        auto c = data;
+        c.char_data()[offset] = value;
+        return c;
+    };
+
+    // invalid transform, bit width, value size and padding
+    for( auto c : {corrupt(0, 4), corrupt(1, 33), corrupt(2, 2), corrupt(3, 1)} ) {
+        QVERIFY( ! int_codec::peek(c.char_data(), c.char_data() + c.size(), &info));
+        QVERIFY(int_codec::decode(c.char_data(), c.char_data() + c.size(), dst) == nullptr);
+    }
+    // 64 bit values where 32 bit ones are expected, a count that doesn't match
+    auto c = corrupt(2, 8);
+    QVERIFY(int_codec::peek(c.char_data(), c.char_data() + c.size(), &info));
+    QVERIFY(int_codec::decode(c.char_data(), c.char_data() + c.size(), dst) == nullptr);
+    QVERIFY(int_codec::decode(data.char_data(), data.char_data() + data.size(), dst.sub(1)) == nullptr);
+
+    // a huge count with little data does not allocate the values up front
+    c = data;
+    to_little_endian<uint32_t>(0xfffffff0, c.char_data() + 4);
+    {
+        stream::byte_buffer_input_stream in(c.ref());
+        std::vector<uint32_t> r;
+        QVERIFY( ! int_codec::read(&in, &r));
+        QVERIFY(r.capacity() < 100000);
+    }
+
+    // a 0 bit block has no data to check the count against
+    c = corrupt(1, 0);
+    to_little_endian<uint32_t>(0xfffffff0, c.char_data() + 4);
+    {
+        stream::byte_buffer_input_stream in(c.ref());
+        std::vector<uint32_t> r;
+        QVERIFY( ! int_codec::read(&in, &r, 1000000));
+    }
+    c = corrupt(1, 0);
+    {
+        stream::byte_buffer_input_stream in(c.ref());
+        std::vector<uint32_t> r;
+        QVERIFY( ! int_codec::read(&in, &r, values.size() - 1));
+        stream::byte_buffer_input_stream in2(c.ref());
+        QVERIFY(int_codec::read(&in2, &r, values.size()));
+        QCOMPARE(r.size(), values.size());
+    }
+}
+
+QTEST_APPLESS_MAIN(Test_int_codec)
+
+#include "test_int_codec.moc"
@@ -0,0 +1,178 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <QtTest>
+
+#include <lbu/io_vector_builder.h>
+#include <lbu/pipe.h>
+
+#include <random>
+#include <string>
+
+using namespace lbu;
+
+class Test_io_vector_builder : public QObject
+{
+    Q_OBJECT
+
+public:
+    Test_io_vector_builder() = default;
+
+private Q_SLOTS:
+    void testCoalesce();
+    void testAdvance();
+    void testBatchLimit();
+    void testWrite();
+};
+
+namespace {
+
+template< typename Builder >
+std::string pending_bytes(const Builder& b)
+{
+    std::string s;
+    for( const auto& v : b.pending() )
+        s.append(static_cast<const char*>(v.iov_base), v.iov_len);
+    return s;
+}
+
+}
+
+void Test_io_vector_builder::testCoalesce()
+{
+    io::io_vector_builder<16, 4> b(8);
+    const std::string big(100, 'x');
+    const std::string parts = "abcdefghijklmnopqrstuvwxyz";
+
+    // small pieces share one vector, even from separate places
+    b.append(parts.data(), 3);
+    b.append(parts.data() + 10, 5);
+    QCOMPARE(b.vector_count(), size_t(1));
+    b.append(big.data(), 50);
+    // directly following in memory
+    b.append(big.data() + 50, 50);
+    QCOMPARE(b.vector_count(), size_t(2));
+    QVERIFY(b.pending()[1].iov_base == big.data());
+    b.append(parts.data() + 20, 6);
+    b.append(parts.data(), 0);
+    QCOMPARE(b.vector_count(), size_t(3));
+    QCOMPARE(b.size(), size_t(3 + 5 + 100 + 6));
+    QCOMPARE(pending_bytes(b), "abc" + parts.substr(10, 5) + big + parts.substr(20, 6));
+
+    // two more bytes fill the scratch area, then small pieces are referenced
+    for( int i = 0; i < 10; ++i )
+        b.append(parts.data() + 2 * i, 1);
+    QCOMPARE(b.size(), size_t(114 + 10));
+    QCOMPARE(b.vector_count(), size_t(3 + 8));
+    QVERIFY(b.pending()[b.vector_count() - 1].iov_base == parts.data() + 18);
+    QCOMPARE(pending_bytes(b), "abc" + parts.substr(10, 5) + big + parts.substr(20, 6) + "acegikmoqs");
+
+    b.clear();
+    QVERIFY(b.is_empty());
+    QCOMPARE(b.vector_count(), size_t(0));
+    b.append(parts.data(), 4);
+    QCOMPARE(pending_bytes(b), parts.substr(0, 4));
+}
+
+void Test_io_vector_builder::testAdvance()
+{
+    std::mt19937 gen(1);
+    std::string data(20000, 0);
+    for( auto& c : data )
+        c = char('a' + gen() % 26);
+
+    for( int round = 0; round < 50; ++round ) {
+        io::io_vector_builder<> b;
+        std::string expected;
+        size_t pos = 0;
+        while( pos < data.size() ) {
+            // gaps keep most referenced pieces apart
+            const size_t n = std::min<size_t>(gen() % 3 ? gen() % 40 : gen() % 2000, data.size() - pos);
+            b.append(data.data() + pos, n);
+            expected.append(data, pos, n);
+            pos += n + gen() % 2;
+        }
+        QCOMPARE(b.size(), expected.size());
+        QCOMPARE(pending_bytes(b), expected);
+
+        while( ! b.is_empty() ) {
+            const size_t step = std::min<size_t>(gen() % 3000, b.size());
+            b.advance(step);
+            expected.erase(0, step);
+            QCOMPARE(b.size(), expected.size());
+            QCOMPARE(pending_bytes(b), expected);
+        }
+        QCOMPARE(b.vector_count(), size_t(0));
+
+        // starts over with the scratch area
+        b.append(data.data(), 10);
+        QCOMPARE(pending_bytes(b), data.substr(0, 10));
+    }
+}
+
+void Test_io_vector_builder::testBatchLimit()
+{
+    using builder = io::io_vector_builder<16, 4>;
+    const size_t count = builder::MaxBatch + 10;
+    std::string data(2 * count, 'z');
+    builder b(0);
+    for( size_t i = 0; i < count; ++i )
+        b.append(data.data() + 2 * i, 1);
+    QCOMPARE(b.vector_count(), count);
+    QCOMPARE(b.pending().size(), builder::MaxBatch);
+    b.advance(builder::MaxBatch - 1);
+    QCOMPARE(b.pending().size(), size_t(11));
+    b.advance(2);
+    QCOMPARE(b.pending().size(), size_t(9));
+    QCOMPARE(b.size(), size_t(9));
+}
+
+void Test_io_vector_builder::testWrite()
+{
+    auto p = pipe::open(pipe::FlagsNonBlock);
+    QCOMPARE(p.status, int(pipe::StatusNoError));
+
+    std::mt19937 gen(2);
+    std::string data(300000, 0);
+    for( auto& c : data )
+        c = char(gen());
+
+    io::io_vector_builder<> b;
+    for( size_t pos = 0; pos < data.size(); ) {
+        const size_t n = std::min<size_t>(gen() % 2 ? gen() % 30 : gen() % 5000, data.size() - pos);
+        b.append(data.data() + pos, n);
+        pos += n;
+    }
+
+    // the pipe holds less than the data, so writing blocks and continues partially
+    std::string received;
+    char buf[4096];
+    int blocked = 0;
+    while( true ) {
+        const int status = b.write_all(p.write_fd.get());
+        if( status == io::WriteNoError )
+            break;
+        QCOMPARE(status, int(io::WriteWouldBlock));
+        ++blocked;
+        while( true ) {
+            const auto r = io::read(p.read_fd.get(), array_ref<char>(buf, sizeof(buf)));
+            if( r.size <= 0 )
+                break;
+            received.append(buf, size_t(r.size));
+        }
+    }
+    while( true ) {
+        const auto r = io::read(p.read_fd.get(), array_ref<char>(buf, sizeof(buf)));
+        if( r.size <= 0 )
+            break;
+        received.append(buf, size_t(r.size));
+    }
+    QVERIFY(blocked > 0);
+    QVERIFY(b.is_empty());
+    QVERIFY(received == data);
+}
+
+QTEST_APPLESS_MAIN(Test_io_vector_builder)
+
+#include "test_io_vector_builder.moc"
@@ -0,0 +1,179 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <QtTest>
+
+#include <lbu/math_array.h>
+
+#include <random>
+#include <vector>
+
+using namespace lbu;
+
+class Test_math_array : public QObject
+{
+    Q_OBJECT
+
+public:
+    Test_math_array() = default;
+
+private Q_SLOTS:
+    void testInvariantDivisor();
+    void testLog2Pow2();
+    void testDivide();
+    void testAbsPow();
+};
+
+namespace {
+
+constexpr size_t MaxSize = 300;
+
+// every bit width, with the values around the powers of two
+template< typename T >
+std::vector<T> test_values(bool with_top_bit)
+{
+    std::mt19937_64 gen(sizeof(T));
+    std::vector<T> v;
+    const unsigned bits = 8 * sizeof(T) - (with_top_bit ? 0 : 1);
+    for( unsigned b = 0; b < bits; ++b ) {
+        const T p = T(1) << b;
+        v.push_back(p);
+        v.push_back(p + 1);
+        if( b > 1 )
+            v.push_back(p - 1);
+        v.push_back(p | (T(gen()) & (p - 1)));
+    }
+    while( v.size() < MaxSize )
+        v.push_back(T(T(gen()) >> (8 * sizeof(T) - bits)) | 1);
+    return v;
+}
+
+// each size up to MaxSize, so the vector loops and the scalar tails are covered
+template< typename T, typename U, typename ArrayOp, typename ScalarOp >
+void check(const std::vector<T>& values, ArrayOp array_op, ScalarOp scalar_op)
+{
+    for( size_t size = 0; size <= values.size(); size += (size < 70 ? 1 : 23) ) {
+        std::vector<U> dst(size + 1, U(0x5a));
+        array_op(array_ref<U>(dst.data(), size), array_ref<const T>(values.data(), size));
+        for( size_t i = 0; i < size; ++i )
+            QCOMPARE(dst[i], U(scalar_op(values[i])));
+        QCOMPARE(dst[size], U(0x5a));
+    }
+
+    // in place
+    if constexpr( std::is_same_v<T, U> ) {
+        std::vector<T> v = values;
+        array_op(array_ref<T>(v.data(), v.size()), array_ref<const T>(v.data(), v.size()));
+        for( size_t i = 0; i < v.size(); ++i )
+            QCOMPARE(v[i], T(scalar_op(values[i])));
+    }
+}
+
+template< typename T >
+void check_log2_pow2()
+{
+    const auto all = test_values<T>(true);
+    check<T, T>(all, [](auto d, auto s) { ilog2_floor(d, s); }, [](T v) { return ilog2_floor(v); });
+    check<T, T>(all, [](auto d, auto s) { ilog2_ceil(d, s); }, [](T v) { return ilog2_ceil(v); });
+    check<T, T>(test_values<T>(false), [](auto d, auto s) { next_greater_pow2(d, s); },
+                [](T v) { return next_greater_pow2(v); });
+    check<T, T>(std::vector<T>(40, 0), [](auto d, auto s) { next_greater_pow2(d, s); },
+                [](T) { return T(1); });
+}
+
+template< typename T >
+void check_divide()
+{
+    const auto values = test_values<T>(true);
+    std::vector<T> divisors = {1, 2, 3, 7, 10, 64, 1000, 641, T(~T(0)), T(~T(0) - 1), T(T(1) << (8 * sizeof(T) - 1))};
+    divisors.push_back(T(T(1) << (8 * sizeof(T) - 1)) + 1);
+    std::mt19937_64 gen(7);
+    for( int i = 0; i < 20; ++i )
+        divisors.push_back(T(T(gen()) >> (gen() % (8 * sizeof(T)))) | 1);
+
+    for( T den : divisors ) {
+        const invariant_divisor<T> inv(den);
+        check<T, T>(values, [&inv](auto d, auto s) { idiv_floor(d, s, inv); }, [den](T v) { return T(v / den); });
+        check<T, T>(values, [&inv](auto d, auto s) { idiv_ceil(d, s, inv); },
+                    [den](T v) { return T(v / den + (v % den ? 1 : 0)); });
+    }
+}
+
+template< typename T >
+void check_abs_pow()
+{
+    using S = std::make_signed_t<T>;
+    std::vector<S> s;
+    for( T v : test_values<T>(true) ) {
+        s.push_back(S(v));
+        s.push_back(S(T(0) - v));
+    }
+    s.push_back(0);
+    s.push_back(std::numeric_limits<S>::min());
+    s.push_back(std::numeric_limits<S>::max());
+    check<S, T>(s, [](auto d, auto src) { abs(d, src); }, [](S v) { return lbu::abs(v); });
+
+    const auto values = test_values<T>(true);
+    for( unsigned exp : {0u, 1u, 2u, 3u, 5u, 13u, 64u, 1000u} ) {
+        check<T, T>(values, [exp](auto d, auto src) { ipow(d, src, exp); },
+                    [exp](T v) {
+                        T r = 1;
+                        for( unsigned i = 0; i < exp; ++i )
+                            r = T(r * v);
+                        return r;
+                    });
+    }
+}
+
+}
+
+void Test_math_array::testInvariantDivisor()
+{
+    static_assert(invariant_divisor<uint32_t>(7).divide(100) == 14);
+    static_assert(idiv_ceil(100u, invariant_divisor<unsigned>(7)) == 15);
+    static_assert(idiv_floor(uint64_t(1) << 63, invariant_divisor<uint64_t>(3)) == (uint64_t(1) << 63) / 3);
+
+    std::mt19937_64 gen(1);
+    for( int i = 0; i < 10000; ++i ) {
+        const uint32_t d32 = uint32_t(gen() >> (gen() % 64)) | 1;
+        const uint64_t d64 = (gen() >> (gen() % 64)) | 1;
+        const invariant_divisor<uint32_t> inv32(d32);
+        const invariant_divisor<uint64_t> inv64(d64);
+        QCOMPARE(inv32.divisor(), d32);
+        for( int j = 0; j < 10; ++j ) {
+            const uint32_t n32 = uint32_t(gen() >> (gen() % 64));
+            const uint64_t n64 = gen() >> (gen() % 64);
+            QCOMPARE(inv32.divide(n32), n32 / d32);
+            QCOMPARE(inv32.modulo(n32), n32 % d32);
+            QCOMPARE(idiv_ceil(n32, inv32), idiv_ceil(n32, d32));
+            QCOMPARE(inv64.divide(n64), n64 / d64);
+            QCOMPARE(inv64.modulo(n64), n64 % d64);
+            QCOMPARE(idiv_ceil(n64, inv64), idiv_ceil(n64, d64));
+        }
+        QCOMPARE(inv32.divide(~uint32_t(0)), ~uint32_t(0) / d32);
+        QCOMPARE(inv64.divide(~uint64_t(0)), ~uint64_t(0) / d64);
+    }
+}
+
+void Test_math_array::testLog2Pow2()
+{
+    check_log2_pow2<uint32_t>();
+    check_log2_pow2<uint64_t>();
+}
+
+void Test_math_array::testDivide()
+{
+    check_divide<uint32_t>();
+    check_divide<uint64_t>();
+}
+
+void Test_math_array::testAbsPow()
+{
+    check_abs_pow<uint32_t>();
+    check_abs_pow<uint64_t>();
+}
+
+QTEST_APPLESS_MAIN(Test_math_array)
+
+#include "test_math_array.moc"
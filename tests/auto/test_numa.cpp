@@ -0,0 +1,164 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <QtTest>
+
+#include <lbu/fd_stream.h>
+#include <lbu/numa.h>
+#include <lbu/page_memory.h>
+#include <lbu/pipe.h>
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include <sched.h>
+
+using namespace lbu;
+
+class Test_numa : public QObject
+{
+    Q_OBJECT
+
+public:
+    Test_numa() = default;
+
+private Q_SLOTS:
+    void testTopology();
+    void testMemoryNode();
+    void testThreadPlacement();
+    void testPlacedStreamBuffers();
+};
+
+namespace {
+
+bool valid_node(int node)
+{
+    return node >= 0 && node < numa::node_count();
+}
+
+}
+
+void Test_numa::testTopology()
+{
+    QVERIFY(numa::node_count() >= 1);
+
+    const int cpu = numa::current_cpu();
+    QVERIFY(cpu >= 0);
+    QVERIFY(valid_node(numa::current_node()));
+    // a cpu without a node link in sysfs has no known node
+    const int node = numa::cpu_node(cpu);
+    QVERIFY(node == -1 || valid_node(node));
+
+    QCOMPARE(numa::cpu_node(-1), -1);
+    QCOMPARE(numa::cpu_node(1 << 20), -1);
+}
+
+void Test_numa::testMemoryNode()
+{
+    const size_t size = 4 * page_size();
+    int error = 0;
+    void* p = page_alloc(size, {}, &error);
+    QVERIFY(p != nullptr);
+
+    // nothing is populated yet
+    QCOMPARE(numa::memory_node(p), -1);
+
+    std::memset(p, 0x11, page_size());
+    numa::touch_memory(p, size);
+    // touching keeps the contents
+    QCOMPARE(static_cast<const char*>(p)[page_size() - 1], char(0x11));
+    QCOMPARE(static_cast<const char*>(p)[page_size()], char(0));
+    const int node = numa::memory_node(p);
+    QVERIFY(node == -1 || valid_node(node));
+    const int last = numa::memory_node(static_cast<const char*>(p) + size - 1);
+    QVERIFY(last == -1 || valid_node(last));
+
+    // without NUMA support in the kernel binding fails with ENOSYS
+    if( numa::bind_memory(p, size, 0, &error) ) {
+        if( node != -1 )
+            QCOMPARE(numa::memory_node(p), 0);
+    } else {
+        QCOMPARE(error, ENOSYS);
+    }
+    QVERIFY( ! numa::bind_memory(p, size, -1, &error));
+    QCOMPARE(error, EINVAL);
+    page_free(p, size, {});
+
+    // page_alloc binds before populating
+    page_options options;
+    options.numa_node = 0;
+    options.populate = true;
+    p = page_alloc(size, options, &error);
+    if( p != nullptr ) {
+        const int bound = numa::memory_node(p);
+        QVERIFY(bound == -1 || bound == 0);
+        page_free(p, size, options);
+    } else {
+        QCOMPARE(error, ENOSYS);
+    }
+}
+
+void Test_numa::testThreadPlacement()
+{
+    int error = 0;
+    QVERIFY( ! numa::set_thread_cpu(-1, &error));
+    QCOMPARE(error, EINVAL);
+    QVERIFY( ! numa::set_thread_node(-1, &error));
+    QCOMPARE(error, EINVAL);
+    QVERIFY( ! numa::set_thread_node(numa::node_count(), &error));
+    QCOMPARE(error, EINVAL);
+
+    // in a separate thread, so the affinity of the test thread stays
+    std::thread t([]() {
+        int error = 0;
+        const int cpu = numa::current_cpu();
+        QVERIFY(numa::set_thread_cpu(cpu, &error));
+        QCOMPARE(numa::current_cpu(), cpu);
+
+        const int node = numa::current_node();
+        QVERIFY(numa::set_thread_node(node, &error));
+        cpu_set_t set;
+        QCOMPARE(pthread_getaffinity_np(pthread_self(), sizeof(set), &set), 0);
+        QVERIFY(CPU_ISSET(size_t(numa::current_cpu()), &set));
+        QCOMPARE(numa::current_node(), node);
+    });
+    t.join();
+}
+
+void Test_numa::testPlacedStreamBuffers()
+{
+    auto p = pipe::open();
+    QCOMPARE(p.status, int(pipe::StatusNoError));
+
+    page_options options;
+    options.numa_node = 0;
+    int error = 0;
+    stream::managed_fd_output_stream out(4096, options, &error);
+    if( error != 0 ) {
+        // the stream is unbuffered then, but still works
+        QCOMPARE(error, ENOSYS);
+        options.numa_node = -1;
+    }
+    stream::managed_fd_input_stream in(100000, options, &error);
+    QCOMPARE(error, 0);
+    out.reset(std::move(p.write_fd));
+    in.reset(std::move(p.read_fd));
+
+    const std::string data = "placed stream buffers";
+    QCOMPARE(out.stream()->write(data.data(), data.size(), stream::Mode::Blocking), ssize_t(data.size()));
+    QVERIFY(out.stream()->flush_buffer());
+    char buf[64];
+    QCOMPARE(in.stream()->read(buf, data.size(), stream::Mode::Blocking), ssize_t(data.size()));
+    QCOMPARE(std::string(buf, data.size()), data);
+
+    // no buffer at all is no error
+    stream::managed_fd_input_stream unbuffered(0, options, &error);
+    QCOMPARE(error, 0);
+}
+
+QTEST_APPLESS_MAIN(Test_numa)
+
+#include "test_numa.moc"
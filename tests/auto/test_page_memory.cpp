@@ -0,0 +1,188 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <QtTest>
+
+#include <lbu/numa.h>
+#include <lbu/page_memory.h>
+#include <lbu/ring_spsc_stream.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <string>
+
+using namespace lbu;
+
+class Test_page_memory : public QObject
+{
+    Q_OBJECT
+
+public:
+    Test_page_memory() = default;
+
+private Q_SLOTS:
+    void testSizes();
+    void testAlloc();
+    void testHugePages();
+    void testPopulateLock();
+    void testRing();
+};
+
+namespace {
+
+page_options huge(huge_pages h)
+{
+    page_options options;
+    options.huge = h;
+    return options;
+}
+
+bool aligned(const void* p, size_t align)
+{
+    return reinterpret_cast<uintptr_t>(p) % align == 0;
+}
+
+bool zero_filled(const void* p, size_t size)
+{
+    const char* c = static_cast<const char*>(p);
+    return std::all_of(c, c + size, [](char x) { return x == 0; });
+}
+
+}
+
+void Test_page_memory::testSizes()
+{
+    const size_t page = page_size();
+    const size_t thp = transparent_huge_page_size();
+    const size_t explicit_size = explicit_huge_page_size();
+    QVERIFY(is_pow2(page));
+    QVERIFY(thp == 0 || (is_pow2(thp) && thp > page));
+    QVERIFY(explicit_size == 0 || (is_pow2(explicit_size) && explicit_size > page));
+
+    QCOMPARE(page_alloc_size(1, {}), page);
+    QCOMPARE(page_alloc_size(page, {}), page);
+    QCOMPARE(page_alloc_size(page + 1, {}), 2 * page);
+    QCOMPARE(page_alloc_size(std::numeric_limits<size_t>::max() - 1, {}), size_t(0));
+
+    const size_t huge_granule = std::max(thp, page);
+    QCOMPARE(page_alloc_size(1, huge(huge_pages::Transparent)), huge_granule);
+
+    // explicit pages are only used from their size on, smaller allocations fall back
+    QCOMPARE(page_alloc_size(1, huge(huge_pages::Explicit)), huge_granule);
+    if( explicit_size > 0 ) {
+        QCOMPARE(page_alloc_size(explicit_size, huge(huge_pages::Explicit)), explicit_size);
+        QCOMPARE(page_alloc_size(explicit_size + 1, huge(huge_pages::Explicit)), 2 * explicit_size);
+        if( explicit_size > huge_granule )
+            QCOMPARE(page_alloc_size(explicit_size - 1, huge(huge_pages::Explicit)), explicit_size);
+    }
+}
+
+void Test_page_memory::testAlloc()
+{
+    int error = 0;
+    QVERIFY(page_alloc(0, {}, &error) == nullptr);
+    QCOMPARE(error, EINVAL);
+    QVERIFY(page_alloc(std::numeric_limits<size_t>::max() - 1, {}, &error) == nullptr);
+    QCOMPARE(error, ENOMEM);
+
+    const size_t size = 3 * page_size() + 10;
+    void* p = page_alloc(size, {}, &error);
+    QVERIFY(p != nullptr);
+    QVERIFY(aligned(p, page_size()));
+    QVERIFY(zero_filled(p, page_alloc_size(size, {})));
+    std::memset(p, 0x7f, size);
+    page_free(p, size, {});
+    page_free(nullptr, size, {});
+
+    buffer_spec spec;
+    spec.size = 100;
+    spec.align = 64;
+    p = page_alloc(spec, {}, &error);
+    QVERIFY(p != nullptr);
+    page_free(p, spec.size, {});
+    spec.align = 2 * page_size();
+    QVERIFY(page_alloc(spec, {}, &error) == nullptr);
+    QCOMPARE(error, EINVAL);
+
+    p = xpage_alloc(size, {});
+    QVERIFY(p != nullptr);
+    page_free(p, size, {});
+}
+
+void Test_page_memory::testHugePages()
+{
+    // both kinds fall back to whatever the system has, down to small pages
+    for( auto h : {huge_pages::Transparent, huge_pages::Explicit} ) {
+        const auto options = huge(h);
+        for( size_t size : {size_t(1), size_t(3) << 20, explicit_huge_page_size()} ) {
+            if( size == 0 )
+                continue;
+            int error = 0;
+            void* p = page_alloc(size, options, &error);
+            QVERIFY(p != nullptr);
+            const size_t mapped = page_alloc_size(size, options);
+            QVERIFY(mapped >= size);
+            QVERIFY(aligned(p, std::max(transparent_huge_page_size(), page_size())));
+            QVERIFY(zero_filled(p, mapped));
+            std::memset(p, 0x33, mapped);
+            page_free(p, size, options);
+        }
+    }
+}
+
+void Test_page_memory::testPopulateLock()
+{
+    const size_t size = 8 * page_size();
+    int error = 0;
+
+    page_options options;
+    options.populate = true;
+    void* p = page_alloc(size, options, &error);
+    QVERIFY(p != nullptr);
+    // populated pages have a node (unless the kernel can't tell)
+    const int node = numa::memory_node(static_cast<char*>(p) + size - 1);
+    QVERIFY(node >= -1 && node < numa::node_count());
+    QVERIFY(zero_filled(p, size));
+    page_free(p, size, options);
+
+    // locking may not be permitted, but then page_alloc fails cleanly
+    options.lock = true;
+    options.huge = huge_pages::Explicit;
+    p = page_alloc(size, options, &error);
+    if( p != nullptr ) {
+        QVERIFY(zero_filled(p, size));
+        page_free(p, size, options);
+    } else {
+        QVERIFY(error == EPERM || error == ENOMEM || error == EAGAIN);
+    }
+}
+
+void Test_page_memory::testRing()
+{
+    for( auto h : {huge_pages::None, huge_pages::Transparent, huge_pages::Explicit} ) {
+        page_options options = huge(h);
+        options.populate = true;
+        int error = 0;
+        stream::ring_spsc_basic_controller controller(64 * 1024, options, &error);
+        QCOMPARE(error, 0);
+        const int node = controller.numa_node();
+        QVERIFY(node >= -1 && node < numa::node_count());
+
+        stream::ring_spsc::output_stream out;
+        stream::ring_spsc::input_stream in;
+        QVERIFY(controller.pair_streams(&out, &in));
+        const std::string data(1000, 'h');
+        QCOMPARE(out.write(data.data(), data.size(), stream::Mode::NonBlocking), ssize_t(data.size()));
+        QVERIFY(out.flush_buffer());
+        char buf[1000];
+        QCOMPARE(in.read(buf, sizeof(buf), stream::Mode::NonBlocking), ssize_t(sizeof(buf)));
+        QCOMPARE(std::string(buf, sizeof(buf)), data);
+    }
+}
+
+QTEST_APPLESS_MAIN(Test_page_memory)
+
+#include "test_page_memory.moc"
@@ -0,0 +1,168 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <QtTest>
+
+#include <lbu/byte_buffer_stream.h>
+#include <lbu/fd_stream.h>
+#include <lbu/io.h>
+#include <lbu/pipe.h>
+#include <lbu/rate_limit_stream.h>
+
+#include <string>
+
+using namespace lbu;
+using namespace lbu::stream;
+using namespace std::chrono_literals;
+
+class Test_rate_limit_stream : public QObject
+{
+    Q_OBJECT
+
+public:
+    Test_rate_limit_stream() = default;
+
+private Q_SLOTS:
+    void testTokenBucket();
+    void testOutputNonBlocking();
+    void testOutputBlocking();
+    void testInput();
+    void testInputPastEnd();
+};
+
+namespace {
+
+std::string pattern(size_t size)
+{
+    std::string s(size, '\0');
+    for( size_t i = 0; i < size; ++i )
+        s[i] = char(i * 7 + i / 251);
+    return s;
+}
+
+std::string to_string(const byte_buffer& b)
+{
+    return std::string(static_cast<const char*>(b.data()), b.size());
+}
+
+}
+
+void Test_rate_limit_stream::testTokenBucket()
+{
+    const auto t0 = token_bucket::clock::now();
+    token_bucket bucket(1000, 500, t0);
+    QCOMPARE(bucket.available(t0), uint64_t(500));
+    bucket.consume(500);
+    QCOMPARE(bucket.available(t0 + 100ms), uint64_t(100));
+    QCOMPARE(bucket.time_until(300), std::chrono::nanoseconds(200ms));
+    QCOMPARE(bucket.time_until(10000), std::chrono::nanoseconds(400ms));
+    QCOMPARE(bucket.available(t0 + 10s), uint64_t(500));
+    bucket.consume(1000);
+    QCOMPARE(bucket.available(t0 + 10s), uint64_t(0));
+
+    // fractions of a token are not lost between refills
+    token_bucket slow(3, 10, t0);
+    slow.consume(10);
+    QCOMPARE(slow.available(t0 + 500ms), uint64_t(1));
+    QCOMPARE(slow.available(t0 + 1000ms), uint64_t(3));
+    QCOMPARE(slow.time_until(4), std::chrono::nanoseconds(333333334));
+}
+
+void Test_rate_limit_stream::testOutputNonBlocking()
+{
+    byte_buffer_output_stream target;
+    token_bucket bucket(1000, 8192);
+    rate_limited_output_stream s(&target, &bucket);
+    QVERIFY(s.manages_buffer());
+
+    // the burst goes through, then the stream is throttled
+    const auto data = pattern(10000);
+    QCOMPARE(s.write(data.data(), data.size(), Mode::NonBlocking), ssize_t(8192));
+    QCOMPARE(s.write(data.data(), 1, Mode::NonBlocking), ssize_t(0));
+    QVERIFY(s.throttle_delay() > 4s);
+    QVERIFY(s.throttle_delay() <= 4096ms);
+    QVERIFY( ! s.get_buffer(Mode::NonBlocking).data());
+    QVERIFY( ! s.has_error());
+
+    QVERIFY(s.flush_buffer(Mode::NonBlocking));
+    QCOMPARE(to_string(target.release_reset()), data.substr(0, 8192));
+}
+
+void Test_rate_limit_stream::testOutputBlocking()
+{
+    byte_buffer_output_stream target;
+    token_bucket bucket(1000000, 4096);
+    rate_limited_output_stream s(&target, &bucket);
+
+    const auto data = pattern(64 * 1024);
+    const auto start = std::chrono::steady_clock::now();
+    for( size_t offset = 0; offset < data.size(); offset += 1000 ) {
+        const auto n = std::min<size_t>(1000, data.size() - offset);
+        QCOMPARE(s.write(data.data() + offset, n, Mode::Blocking), ssize_t(n));
+    }
+    QVERIFY(s.flush_buffer());
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    // everything past the burst is paced at 1 MB/s
+    QVERIFY(elapsed >= 60ms);
+    QCOMPARE(s.throttle_delay(), std::chrono::nanoseconds(0));
+    QCOMPARE(to_string(target.release_reset()), data);
+}
+
+void Test_rate_limit_stream::testInput()
+{
+    auto data = pattern(20000);
+    byte_buffer_input_stream source(array_ref<char>(&data[0], data.size()));
+    token_bucket bucket(1000, 4096);
+    rate_limited_input_stream s(&source, &bucket);
+    QVERIFY(s.manages_buffer());
+
+    // zero copy windows out of the source, limited to the burst
+    auto b = s.get_buffer(Mode::NonBlocking);
+    QCOMPARE(b.data(), static_cast<const void*>(data.data()));
+    QCOMPARE(b.byte_size(), size_t(4096));
+    s.advance_buffer(96);
+
+    std::string read(4000, '\0');
+    QCOMPARE(s.read(&read[0], read.size(), Mode::NonBlocking), ssize_t(4000));
+    QCOMPARE(read, data.substr(96, 4000));
+    QCOMPARE(s.read(&read[0], read.size(), Mode::NonBlocking), ssize_t(0));
+    QVERIFY(s.throttle_delay() > 4s);
+    QVERIFY( ! s.at_end());
+
+    bucket.set_rate(1000000, 4096);
+    read.resize(data.size());
+    QCOMPARE(s.read(&read[0], read.size(), Mode::Blocking), ssize_t(data.size() - 4096));
+    QCOMPARE(read.substr(0, data.size() - 4096), data.substr(4096));
+    QVERIFY(s.at_end());
+    QVERIFY( ! s.has_error());
+}
+
+void Test_rate_limit_stream::testInputPastEnd()
+{
+    auto p = pipe::open();
+    QCOMPARE(p.status, int(pipe::StatusNoError));
+    QCOMPARE(io::write_all(*p.write_fd, array_ref<const char>("0123456789", 10)), int(io::WriteNoError));
+    p.write_fd.reset();
+    fd_input_stream source({}, *p.read_fd);
+    token_bucket bucket(1000000, 4096);
+    rate_limited_input_stream s(&source, &bucket);
+    QVERIFY( ! s.manages_buffer());
+
+    char buf[16];
+    QCOMPARE(s.read(buf, 10, Mode::Blocking), ssize_t(10));
+    QCOMPARE(s.read(buf, sizeof(buf), Mode::NonBlocking), ssize_t(0));
+    QVERIFY(s.at_end());
+    QVERIFY( ! s.has_error());
+    QCOMPARE(s.read(buf, sizeof(buf), Mode::NonBlocking), ssize_t(0));
+    QVERIFY( ! s.has_error());
+
+    // unbuffered, a required read past the end is an error
+    QCOMPARE(s.read(buf, sizeof(buf), Mode::Blocking), ssize_t(-1));
+    QVERIFY(s.has_error());
+}
+
+QTEST_APPLESS_MAIN(Test_rate_limit_stream)
+
+#include "test_rate_limit_stream.moc"
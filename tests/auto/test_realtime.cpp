@@ -0,0 +1,151 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <QtTest>
+
+#include <lbu/page_memory.h>
+#include <lbu/realtime.h>
+
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#include <sys/mman.h>
+
+using namespace lbu;
+
+class Test_realtime : public QObject
+{
+    Q_OBJECT
+
+public:
+    Test_realtime() = default;
+
+private Q_SLOTS:
+    void testPrepareMemory();
+    void testPrefaultStack();
+    void testThreadStack();
+};
+
+namespace {
+
+// mincore reports whether the pages of a page aligned range are resident
+bool resident(const void* p, size_t size)
+{
+    const size_t pages = (size + page_size() - 1) / page_size();
+    std::vector<unsigned char> v(pages);
+    if( ::mincore(const_cast<void*>(p), size, v.data()) != 0 )
+        return false;
+    for( auto x : v ) {
+        if( (x & 1) == 0 )
+            return false;
+    }
+    return true;
+}
+
+bool lock_failure(int error)
+{
+    return error == EPERM || error == ENOMEM || error == EAGAIN;
+}
+
+struct thread_result {
+    uintptr_t local = 0;
+};
+
+void* stack_user(void* arg)
+{
+    char local[256];
+    std::memset(local, 1, sizeof(local));
+    static_cast<thread_result*>(arg)->local = reinterpret_cast<uintptr_t>(local);
+    return nullptr;
+}
+
+}
+
+void Test_realtime::testPrepareMemory()
+{
+    int error = 0;
+    QVERIFY(realtime::prepare_memory(nullptr, 0, realtime::PrepareDefault, &error));
+    realtime::release_memory(nullptr, 0);
+
+    const size_t size = 16 * page_size();
+    char* p = static_cast<char*>(page_alloc(size, {}, &error));
+    QVERIFY(p != nullptr);
+    QVERIFY( ! resident(p, size));
+
+    // nothing to do
+    QVERIFY(realtime::prepare_memory(p, size, realtime::PrepareNone, &error));
+    QVERIFY( ! resident(p, size));
+
+    // an unaligned range prepares all pages it touches, keeping the contents
+    p[page_size()] = 'a';
+    QVERIFY(realtime::prepare_memory(p + page_size() + 100, 2 * page_size(), realtime::PreparePrefault, &error));
+    QVERIFY(resident(p + page_size(), 3 * page_size()));
+    QCOMPARE(p[page_size()], 'a');
+
+    p[size - 1] = 'z';
+    if( realtime::prepare_memory(p, size, realtime::PrepareLock, &error) ) {
+        realtime::release_memory(p, size);
+    } else {
+        // a failed lock still prefaults
+        QVERIFY(lock_failure(error));
+    }
+    QVERIFY(resident(p, size));
+    QCOMPARE(p[page_size()], 'a');
+    QCOMPARE(p[size - 1], 'z');
+    page_free(p, size, {});
+}
+
+void Test_realtime::testPrefaultStack()
+{
+    realtime::prefault_stack(0);
+    realtime::prefault_stack(1);
+    realtime::prefault_stack(64 * 1024);
+}
+
+void Test_realtime::testThreadStack()
+{
+    realtime::thread_stack none;
+    QVERIFY( ! none.is_valid());
+
+    int error = 0;
+    realtime::thread_stack small(1, realtime::PreparePrefault, &error);
+    QCOMPARE(error, 0);
+    QVERIFY(small.is_valid());
+    QVERIFY(small.size() >= size_t(PTHREAD_STACK_MIN));
+    QCOMPARE(small.size() % page_size(), size_t(0));
+    QVERIFY(resident(small.data(), small.size()));
+    // the guard page below the stack is never populated
+    unsigned char guard = 0;
+    QVERIFY(::mincore(static_cast<char*>(small.data()) - page_size(), page_size(), &guard) == 0);
+    QCOMPARE(guard & 1, 0);
+
+    realtime::thread_stack stack(256 * 1024, realtime::PrepareDefault, &error);
+    QVERIFY(stack.is_valid());
+    QVERIFY(error == 0 || lock_failure(error));
+    QCOMPARE(stack.size(), size_t(256 * 1024));
+
+    realtime::thread_stack moved(std::move(stack));
+    QVERIFY( ! stack.is_valid());
+    QVERIFY(moved.is_valid());
+    stack = std::move(moved);
+    QVERIFY(stack.is_valid());
+    QVERIFY( ! moved.is_valid());
+
+    // a thread runs on it
+    pthread_attr_t attr;
+    QCOMPARE(::pthread_attr_init(&attr), 0);
+    QVERIFY(stack.apply(&attr, &error));
+    thread_result result;
+    pthread_t thread;
+    QCOMPARE(::pthread_create(&thread, &attr, stack_user, &result), 0);
+    QCOMPARE(::pthread_join(thread, nullptr), 0);
+    ::pthread_attr_destroy(&attr);
+    const auto begin = reinterpret_cast<uintptr_t>(stack.data());
+    QVERIFY(result.local >= begin && result.local < begin + stack.size());
+}
+
+QTEST_APPLESS_MAIN(Test_realtime)
+
+#include "test_realtime.moc"
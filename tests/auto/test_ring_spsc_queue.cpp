@@ -0,0 +1,261 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <QtTest>
+
+#include <lbu/ring_spsc_queue.h>
+
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+
+using namespace lbu;
+using namespace lbu::stream;
+
+class Test_ring_spsc_queue : public QObject
+{
+    Q_OBJECT
+
+public:
+    Test_ring_spsc_queue() = default;
+
+private Q_SLOTS:
+    void testPushPop();
+    void testBatch();
+    void testThreaded();
+    void testThreadedNonBlocking();
+    void testCorruptHeader();
+};
+
+namespace {
+
+constexpr uint32_t RingSize = 4096;
+
+std::string to_string(array_ref<const void> m)
+{
+    return std::string(static_cast<const char*>(m.data()), m.byte_size());
+}
+
+array_ref<const char> as_ref(const std::string& s)
+{
+    return array_ref<const char>(s.data(), s.size());
+}
+
+std::string message(uint32_t seq, std::mt19937& gen)
+{
+    const size_t size = (gen() % 8 == 0) ? gen() % 2000 : gen() % 50;
+    std::string s(size, 0);
+    for( size_t i = 0; i < size; ++i )
+        s[i] = char(seq * 7 + i);
+    return s;
+}
+
+}
+
+void Test_ring_spsc_queue::testPushPop()
+{
+    ring_spsc_basic_controller controller(RingSize);
+    ring_spsc_queue::producer p;
+    ring_spsc_queue::consumer c;
+    QVERIFY(ring_spsc_queue::pair(&p, &c, &controller));
+
+    QVERIFY( ! c.try_pop().data());
+    QVERIFY(p.push(array_ref<const char>("hello", 5)));
+    QVERIFY(p.push(array_ref<const char>("", size_t(0))));
+    auto buf = p.reserve(100);
+    QCOMPARE(buf.byte_size(), size_t(100));
+    QCOMPARE(reinterpret_cast<uintptr_t>(buf.data()) % ring_spsc_queue::RecordAlignment, uintptr_t(0));
+    std::memcpy(buf.data(), "world", 5);
+    p.commit(5);
+
+    // not flushed yet
+    QVERIFY( ! c.try_pop().data());
+    QVERIFY(p.flush());
+
+    auto m = c.try_pop();
+    QCOMPARE(to_string(m), std::string("hello"));
+    m = c.try_pop();
+    QVERIFY(m.data());
+    QCOMPARE(m.byte_size(), size_t(0));
+    m = c.try_pop();
+    QCOMPARE(to_string(m), std::string("world"));
+    QCOMPARE(reinterpret_cast<uintptr_t>(m.data()) % ring_spsc_queue::RecordAlignment, uintptr_t(0));
+    QVERIFY( ! c.try_pop().data());
+    c.release();
+    QVERIFY( ! c.try_pop().data());
+
+    // records that no longer fit before the end of the ring
+    const std::string big(RingSize / 2, 'x');
+    QVERIFY(p.push(as_ref(big)));
+    QVERIFY(p.flush());
+    QCOMPARE(to_string(c.try_pop()), big);
+    c.release();
+    QVERIFY(p.push(as_ref(big), Mode::NonBlocking));
+    QVERIFY(p.flush());
+    QCOMPARE(to_string(c.pop()), big);
+    c.release();
+
+    QVERIFY( ! p.push(as_ref(std::string(RingSize, 'y'))));
+    QVERIFY(p.has_error());
+}
+
+void Test_ring_spsc_queue::testBatch()
+{
+    ring_spsc_basic_controller controller(RingSize);
+    ring_spsc_queue::producer p;
+    ring_spsc_queue::consumer c;
+    QVERIFY(ring_spsc_queue::pair(&p, &c, &controller));
+
+    for( int i = 0; i < 10; ++i ) {
+        const char ch = char('0' + i);
+        QVERIFY(p.push(array_ref<const char>(&ch, 1)));
+    }
+    QVERIFY(p.flush());
+
+    array_ref<const void> batch[4];
+    QCOMPARE(c.pop_batch(array_ref<array_ref<const void>>(batch)), size_t(4));
+    QCOMPARE(to_string(batch[3]), std::string("3"));
+    const auto first = batch[0];
+    QCOMPARE(c.pop_batch(array_ref<array_ref<const void>>(batch)), size_t(4));
+    QCOMPARE(to_string(batch[0]), std::string("4"));
+    QCOMPARE(c.pop_batch(array_ref<array_ref<const void>>(batch)), size_t(2));
+    QCOMPARE(to_string(batch[1]), std::string("9"));
+    // the popped messages are all still valid
+    QCOMPARE(to_string(first), std::string("0"));
+    QCOMPARE(c.pop_batch(array_ref<array_ref<const void>>(batch)), size_t(0));
+    QVERIFY(c.must_release());
+    c.release();
+    QVERIFY( ! c.must_release());
+
+    QVERIFY(p.set_end_of_stream());
+    QCOMPARE(c.pop_batch(array_ref<array_ref<const void>>(batch), Mode::Blocking), size_t(0));
+    QVERIFY(c.at_end());
+    QVERIFY( ! c.has_error());
+}
+
+void Test_ring_spsc_queue::testThreaded()
+{
+    ring_spsc_basic_controller controller(RingSize);
+    ring_spsc_queue::producer p;
+    ring_spsc_queue::consumer c;
+    QVERIFY(ring_spsc_queue::pair(&p, &c, &controller, 512));
+
+    constexpr uint32_t Count = 50000;
+    bool producer_ok = true;
+    std::thread producer([&]() {
+        std::mt19937 gen(1);
+        for( uint32_t seq = 0; seq < Count && producer_ok; ++seq ) {
+            const auto m = message(seq, gen);
+            producer_ok = p.push(as_ref(m));
+            if( gen() % 16 == 0 )
+                producer_ok = producer_ok && p.flush();
+        }
+        producer_ok = producer_ok && p.flush() && p.set_end_of_stream();
+    });
+
+    std::mt19937 gen(1);
+    uint32_t seq = 0;
+    bool messages_ok = true;
+    array_ref<const void> batch[8];
+    while( messages_ok ) {
+        const auto count = c.pop_batch(array_ref<array_ref<const void>>(batch), Mode::Blocking);
+        if( count == 0 ) {
+            if( c.at_end() || c.has_error() )
+                break;
+            // batch ended with the buffer, everything popped
+            c.release();
+            continue;
+        }
+        for( size_t i = 0; i < count; ++i, ++seq ) {
+            if( to_string(batch[i]) != message(seq, gen) ) {
+                messages_ok = false;
+                break;
+            }
+            gen();
+        }
+        c.release();
+    }
+    producer.join();
+
+    QVERIFY(producer_ok);
+    QVERIFY(messages_ok);
+    QVERIFY(c.at_end());
+    QVERIFY( ! c.has_error());
+    QCOMPARE(seq, Count);
+}
+
+void Test_ring_spsc_queue::testThreadedNonBlocking()
+{
+    // a polling consumer must see every message before the end of the stream, also when
+    // the producer wraps through padding right before it finishes
+    ring_spsc_basic_controller controller(RingSize);
+    ring_spsc_queue::producer p;
+    ring_spsc_queue::consumer c;
+    QVERIFY(ring_spsc_queue::pair(&p, &c, &controller, 512));
+
+    constexpr uint32_t Count = 20000;
+    bool producer_ok = true;
+    std::thread producer([&]() {
+        std::mt19937 gen(2);
+        for( uint32_t seq = 0; seq < Count && producer_ok; ++seq ) {
+            const auto m = message(seq, gen);
+            producer_ok = p.push(as_ref(m));
+            if( gen() % 16 == 0 )
+                producer_ok = producer_ok && p.flush();
+        }
+        producer_ok = producer_ok && p.flush() && p.set_end_of_stream();
+    });
+
+    std::mt19937 gen(2);
+    uint32_t seq = 0;
+    bool messages_ok = true;
+    while( messages_ok ) {
+        auto m = c.try_pop();
+        if( ! m.data() ) {
+            if( c.must_release() ) {
+                c.release();
+                continue;
+            }
+            if( c.at_end() || c.has_error() )
+                break;
+            std::this_thread::yield();
+            continue;
+        }
+        messages_ok = (to_string(m) == message(seq, gen));
+        gen();
+        ++seq;
+    }
+    producer.join();
+
+    QVERIFY(producer_ok);
+    QVERIFY(messages_ok);
+    QVERIFY(c.at_end());
+    QVERIFY( ! c.has_error());
+    QCOMPARE(seq, Count);
+}
+
+void Test_ring_spsc_queue::testCorruptHeader()
+{
+    ring_spsc_basic_controller controller(RingSize);
+    ring_spsc_queue::producer p;
+    ring_spsc_queue::consumer c;
+    QVERIFY(ring_spsc_queue::pair(&p, &c, &controller));
+
+    QVERIFY(p.push(array_ref<const char>("ok", 2)));
+    const uint64_t header = uint64_t(1) << 40;
+    QCOMPARE(p.stream()->write(&header, sizeof(header), Mode::Blocking), ssize_t(sizeof(header)));
+    QVERIFY(p.flush());
+
+    QCOMPARE(to_string(c.try_pop()), std::string("ok"));
+    QVERIFY( ! c.has_error());
+    QVERIFY( ! c.try_pop().data());
+    QVERIFY(c.has_error());
+    QVERIFY( ! c.must_release());
+    QVERIFY( ! c.pop().data());
+}
+
+QTEST_APPLESS_MAIN(Test_ring_spsc_queue)
+
+#include "test_ring_spsc_queue.moc"
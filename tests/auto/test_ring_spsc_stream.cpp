@@ -0,0 +1,290 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <QtTest>
+
+#include <lbu/ring_spsc_stream.h>
+
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace lbu;
+using namespace lbu::stream;
+
+class Test_ring_spsc_stream : public QObject
+{
+    Q_OBJECT
+
+public:
+    Test_ring_spsc_stream() = default;
+
+private Q_SLOTS:
+    void testReserveNonBlocking();
+    void testReserveRecords();
+    void testReserveRecordsNonBlocking();
+    void testReserveMixed();
+};
+
+namespace {
+
+constexpr uint32_t RingSize = 4096;
+
+// a record is its size and sequence number followed by bytes derived from both
+struct record_header {
+    uint32_t size;
+    uint32_t seq;
+};
+
+unsigned char record_byte(uint32_t seq, uint32_t i)
+{
+    return static_cast<unsigned char>(seq * 31 + i);
+}
+
+void write_record(void* dst, uint32_t size, uint32_t seq)
+{
+    const record_header h = {size, seq};
+    auto p = static_cast<unsigned char*>(dst);
+    std::memcpy(p, &h, sizeof(h));
+    for( uint32_t i = sizeof(h); i < size; ++i )
+        p[i] = record_byte(seq, i);
+}
+
+bool check_record(const unsigned char* p, uint32_t size, uint32_t seq)
+{
+    for( uint32_t i = sizeof(record_header); i < size; ++i ) {
+        if( p[i] != record_byte(seq, i) )
+            return false;
+    }
+    return true;
+}
+
+// checks the whole records in buf, which must continue at record seq
+bool check_records(array_ref<const void> buf, uint32_t* seq)
+{
+    auto p = static_cast<const unsigned char*>(buf.data());
+    auto left = buf.byte_size();
+    while( left > 0 ) {
+        record_header h;
+        if( left < sizeof(h) )
+            return false;
+        std::memcpy(&h, p, sizeof(h));
+        if( h.seq != *seq || h.size > left || ! check_record(p, h.size, *seq) )
+            return false;
+        ++*seq;
+        p += h.size;
+        left -= h.size;
+    }
+    return true;
+}
+
+uint32_t record_size(std::mt19937& gen)
+{
+    const uint32_t limit = (gen() % 8 == 0) ? RingSize : 200;
+    return uint32_t(sizeof(record_header)) + gen() % (limit - sizeof(record_header) + 1);
+}
+
+}
+
+void Test_ring_spsc_stream::testReserveNonBlocking()
+{
+    ring_spsc_basic_controller controller(RingSize);
+    ring_spsc::output_stream out;
+    ring_spsc::input_stream in;
+    QVERIFY(controller.pair_streams(&out, &in, RingSize));
+
+    auto buf = out.reserve(3000, Mode::NonBlocking);
+    QVERIFY(buf.size() >= 3000);
+    std::memset(buf.data(), 'a', 3000);
+    out.commit(3000);
+
+    // does not fit before the end and the start is still in use
+    QCOMPARE(out.reserve(2000, Mode::NonBlocking).size(), size_t(0));
+    QVERIFY( ! out.has_error());
+
+    // the first record is published by then, followed by padding up to the end
+    auto r = in.get_buffer(Mode::NonBlocking);
+    QCOMPARE(r.size(), size_t(3000));
+    in.advance_whole_buffer();
+    QCOMPARE(in.get_buffer(Mode::NonBlocking).size(), size_t(0));
+    QVERIFY( ! in.at_end());
+
+    // the consumer released the record and skipped the padding
+    buf = out.reserve(2000, Mode::NonBlocking);
+    QVERIFY(buf.size() >= 2000);
+    std::memset(buf.data(), 'b', 2000);
+    out.commit(2000);
+    QVERIFY(out.flush_buffer());
+
+    r = in.get_buffer(Mode::NonBlocking);
+    QCOMPARE(r.size(), size_t(2000));
+    QCOMPARE(static_cast<const char*>(r.data())[0], 'b');
+    in.advance_whole_buffer();
+
+    QVERIFY(out.set_end_of_stream());
+    QCOMPARE(in.get_buffer(Mode::NonBlocking).size(), size_t(0));
+    QVERIFY(in.at_end());
+    QVERIFY( ! in.has_error());
+
+    // larger than the ring
+    ring_spsc_basic_controller c2(RingSize);
+    QVERIFY(c2.pair_streams(&out, &in, RingSize));
+    QCOMPARE(out.reserve(RingSize + 1).size(), size_t(0));
+    QVERIFY(out.has_error());
+}
+
+void Test_ring_spsc_stream::testReserveRecords()
+{
+    ring_spsc_basic_controller controller(RingSize);
+    ring_spsc::output_stream out;
+    ring_spsc::input_stream in;
+    QVERIFY(controller.pair_streams(&out, &in, RingSize));
+
+    constexpr uint32_t Count = 20000;
+    bool producer_ok = true;
+    std::thread producer([&]() {
+        std::mt19937 gen(1);
+        for( uint32_t seq = 0; seq < Count; ++seq ) {
+            const uint32_t size = record_size(gen);
+            auto buf = out.reserve(size);
+            if( buf.size() < size ) {
+                producer_ok = false;
+                return;
+            }
+            write_record(buf.data(), size, seq);
+            out.commit(size);
+        }
+        producer_ok = out.flush_buffer() && out.set_end_of_stream();
+    });
+
+    // with the segment limit at the ring size every buffer holds whole records
+    uint32_t seq = 0;
+    bool records_ok = true;
+    while( true ) {
+        auto buf = in.get_buffer(Mode::Blocking);
+        if( buf.size() == 0 )
+            break;
+        records_ok = check_records(buf, &seq);
+        if( ! records_ok )
+            break;
+        in.advance_whole_buffer();
+    }
+    producer.join();
+
+    QVERIFY(producer_ok);
+    QVERIFY(records_ok);
+    QVERIFY(in.at_end());
+    QVERIFY( ! in.has_error());
+    QCOMPARE(seq, Count);
+}
+
+void Test_ring_spsc_stream::testReserveRecordsNonBlocking()
+{
+    // A polling consumer must not see the end of stream before the last records, also when
+    // the producer publishes them while the consumer skips padding.
+    ring_spsc_basic_controller controller(RingSize);
+    ring_spsc::output_stream out;
+    ring_spsc::input_stream in;
+    QVERIFY(controller.pair_streams(&out, &in, RingSize));
+
+    constexpr uint32_t Count = 20000;
+    bool producer_ok = true;
+    std::thread producer([&]() {
+        std::mt19937 gen(3);
+        for( uint32_t seq = 0; seq < Count; ++seq ) {
+            const uint32_t size = record_size(gen);
+            auto buf = out.reserve(size);
+            if( buf.size() < size ) {
+                producer_ok = false;
+                return;
+            }
+            write_record(buf.data(), size, seq);
+            out.commit(size);
+        }
+        producer_ok = out.flush_buffer() && out.set_end_of_stream();
+    });
+
+    uint32_t seq = 0;
+    bool records_ok = true;
+    while( ! in.at_end() && ! in.has_error() ) {
+        auto buf = in.get_buffer(Mode::NonBlocking);
+        if( buf.size() == 0 ) {
+            std::this_thread::yield();
+            continue;
+        }
+        records_ok = check_records(buf, &seq);
+        if( ! records_ok )
+            break;
+        in.advance_whole_buffer();
+    }
+    producer.join();
+
+    QVERIFY(producer_ok);
+    QVERIFY(records_ok);
+    QVERIFY(in.at_end());
+    QVERIFY( ! in.has_error());
+    QCOMPARE(seq, Count);
+}
+
+void Test_ring_spsc_stream::testReserveMixed()
+{
+    // reserve mixed with plain writes, read back as a byte stream with a small segment limit
+    ring_spsc_basic_controller controller(RingSize);
+    ring_spsc::output_stream out;
+    ring_spsc::input_stream in;
+    QVERIFY(controller.pair_streams(&out, &in, 100));
+
+    constexpr uint32_t Count = 20000;
+    bool producer_ok = true;
+    std::thread producer([&]() {
+        std::mt19937 gen(2);
+        for( uint32_t seq = 0; seq < Count && producer_ok; ++seq ) {
+            const uint32_t size = record_size(gen);
+            if( gen() % 2 ) {
+                auto buf = out.reserve(size);
+                if( buf.size() < size ) {
+                    producer_ok = false;
+                    return;
+                }
+                write_record(buf.data(), size, seq);
+                out.commit(size);
+            } else {
+                std::vector<unsigned char> tmp(size);
+                write_record(tmp.data(), size, seq);
+                producer_ok = out.write(tmp.data(), size, Mode::Blocking) == ssize_t(size);
+            }
+        }
+        producer_ok = producer_ok && out.flush_buffer() && out.set_end_of_stream();
+    });
+
+    uint32_t seq = 0;
+    bool records_ok = true;
+    std::vector<unsigned char> tmp(RingSize);
+    while( true ) {
+        record_header h;
+        if( in.read(&h, sizeof(h), Mode::Blocking) != ssize_t(sizeof(h)) )
+            break;
+        std::memcpy(tmp.data(), &h, sizeof(h));
+        const auto rest = h.size - sizeof(h);
+        if( h.seq != seq || h.size > RingSize
+                || in.read(tmp.data() + sizeof(h), rest, Mode::Blocking) != ssize_t(rest)
+                || ! check_record(tmp.data(), h.size, seq) ) {
+            records_ok = false;
+            break;
+        }
+        ++seq;
+    }
+    producer.join();
+
+    QVERIFY(producer_ok);
+    QVERIFY(records_ok);
+    QVERIFY(in.at_end());
+    QVERIFY( ! in.has_error());
+    QCOMPARE(seq, Count);
+}
+
+QTEST_APPLESS_MAIN(Test_ring_spsc_stream)
+
+#include "test_ring_spsc_stream.moc"
@@ -0,0 +1,274 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <QtTest>
+
+#include <lbu/byte_buffer_stream.h>
+#include <lbu/fd_stream.h>
+#include <lbu/io.h>
+#include <lbu/pipe.h>
+#include <lbu/serialize.h>
+
+#include <string>
+
+using namespace lbu;
+
+class Test_serialize : public QObject
+{
+    Q_OBJECT
+
+public:
+    Test_serialize() = default;
+
+private Q_SLOTS:
+    void testFixed();
+    void testVarint();
+    void testRoundTrip();
+    void testTruncated();
+    void testStream();
+};
+
+// the described types need external linkage, they are used in the fields specializations
+
+enum class Color : uint8_t { Red = 1, Green = 2, Blue = 200 };
+enum class Offset : int32_t { Back = -100000, Forward = 100000 };
+
+struct point {
+    int16_t x;
+    int16_t y;
+};
+
+struct sample {
+    uint32_t id;
+    bool flag;
+    Color color;
+    int64_t delta;
+    bool vflag;
+    Offset offset;
+    std::array<float, 4> v;
+    std::array<int32_t, 3> small;
+    uint16_t be;
+    point p;
+    byte_buffer blob;
+    double d;
+};
+
+struct flags {
+    bool a;
+    bool b;
+    Color c;
+};
+
+namespace {
+
+sample make_sample()
+{
+    sample s;
+    s.id = 0x01020304;
+    s.flag = true;
+    s.color = Color::Blue;
+    s.delta = -123456789012;
+    s.vflag = true;
+    s.offset = Offset::Back;
+    s.v = {1.5f, -2.25f, 0.f, 1e10f};
+    s.small = {-1, 0, 300};
+    s.be = 0xabcd;
+    s.p = {-7, 9};
+    s.blob = byte_buffer(array_ref<const char>("payload", 7));
+    s.d = 3.141592653589793;
+    return s;
+}
+
+bool equal(const sample& a, const sample& b)
+{
+    return a.id == b.id && a.flag == b.flag && a.color == b.color && a.delta == b.delta
+        && a.vflag == b.vflag && a.offset == b.offset && a.v == b.v && a.small == b.small
+        && a.be == b.be && a.p.x == b.p.x && a.p.y == b.p.y
+        && a.blob.size() == b.blob.size() && std::memcmp(a.blob.data(), b.blob.data(), a.blob.size()) == 0
+        && a.d == b.d;
+}
+
+}
+
+template<> struct lbu::serialize::fields<point>
+    : lbu::serialize::field_list<lbu::serialize::fixed<&point::x>,
+                                 lbu::serialize::varint<&point::y>> {};
+
+template<> struct lbu::serialize::fields<sample>
+    : lbu::serialize::field_list<lbu::serialize::fixed<&sample::id>,
+                                 lbu::serialize::fixed<&sample::flag>,
+                                 lbu::serialize::fixed<&sample::color>,
+                                 lbu::serialize::varint<&sample::delta>,
+                                 lbu::serialize::varint<&sample::vflag>,
+                                 lbu::serialize::varint<&sample::offset>,
+                                 lbu::serialize::fixed<&sample::v>,
+                                 lbu::serialize::varint<&sample::small>,
+                                 lbu::serialize::fixed<&sample::be, lbu::serialize::ByteOrder::Big>,
+                                 lbu::serialize::fixed<&sample::p>,
+                                 lbu::serialize::bytes<&sample::blob>,
+                                 lbu::serialize::fixed<&sample::d>> {};
+
+template<> struct lbu::serialize::fields<flags>
+    : lbu::serialize::field_list<lbu::serialize::varint<&flags::a>,
+                                 lbu::serialize::varint<&flags::b>,
+                                 lbu::serialize::varint<&flags::c>> {};
+
+namespace {
+
+std::string encoded(const sample& s)
+{
+    std::string buf(serialize::encoded_size_bound(s), '\0');
+    const char* end = serialize::encode(s, &buf[0]);
+    buf.resize(size_t(end - buf.data()));
+    return buf;
+}
+
+}
+
+void Test_serialize::testFixed()
+{
+    const auto s = make_sample();
+    const auto buf = encoded(s);
+
+    // little endian id, bool and enum as single bytes
+    QCOMPARE(buf.substr(0, 6), std::string("\x04\x03\x02\x01\x01\xc8", 6));
+
+    // the big endian field sits after the varints of delta, vflag, offset, the floats
+    // and the small array
+    const size_t be_offset = 6 + varint::encoded_size(varint::zigzag_encode(s.delta)) + 1
+                             + varint::encoded_size(varint::zigzag_encode(int32_t(s.offset)))
+                             + sizeof(s.v) + 1 + 1 + 2;
+    QCOMPARE(buf.substr(be_offset, 2), std::string("\xab\xcd", 2));
+    // the nested struct uses its own layout
+    QCOMPARE(buf.substr(be_offset + 2, 3), std::string("\xf9\xff\x12", 3));
+}
+
+void Test_serialize::testVarint()
+{
+    flags f = {true, false, Color::Blue};
+    char buf[16];
+    char* end = serialize::encode(f, buf);
+    QCOMPARE(std::string(buf, end), std::string("\x01\x00\xc8\x01", 4));
+
+    flags r = {false, true, Color::Red};
+    QCOMPARE(serialize::decode(&r, buf, end), static_cast<const char*>(end));
+    QCOMPARE(r.a, true);
+    QCOMPARE(r.b, false);
+    QCOMPARE(r.c, Color::Blue);
+
+    // any non zero value is true
+    buf[0] = 5;
+    QCOMPARE(serialize::decode(&r, buf, end), static_cast<const char*>(end));
+    QCOMPARE(r.a, true);
+
+    // a varint that does not fit the member's type
+    const char overflow[] = {'\x01', '\x00', '\x80', '\x04'};
+    QVERIFY(serialize::decode(&r, overflow, overflow + sizeof(overflow)) == nullptr);
+}
+
+void Test_serialize::testRoundTrip()
+{
+    const auto s = make_sample();
+    const auto buf = encoded(s);
+    QVERIFY(buf.size() <= serialize::encoded_size_bound(s));
+
+    sample r = {};
+    QCOMPARE(serialize::decode(&r, buf.data(), buf.data() + buf.size()), buf.data() + buf.size());
+    QVERIFY(equal(r, s));
+
+    byte_buffer appended(array_ref<const char>("x", 1));
+    serialize::append(s, &appended);
+    serialize::append(s, &appended);
+    QCOMPARE(appended.size(), 1 + 2 * buf.size());
+    const char* p = static_cast<const char*>(appended.data()) + 1;
+    const char* end = p + 2 * buf.size();
+    p = serialize::decode(&r, p, end);
+    QVERIFY(p != nullptr && equal(r, s));
+    QCOMPARE(serialize::decode(&r, p, end), end);
+    QVERIFY(equal(r, s));
+}
+
+void Test_serialize::testTruncated()
+{
+    const auto s = make_sample();
+    const auto buf = encoded(s);
+    for( size_t size = 0; size < buf.size(); ++size ) {
+        sample r = {};
+        QVERIFY(serialize::decode(&r, buf.data(), buf.data() + size) == nullptr);
+
+        std::string copy = buf.substr(0, size);
+        stream::byte_buffer_input_stream in(array_ref<char>(&copy[0], size));
+        QVERIFY( ! serialize::read(&in, &r));
+    }
+
+    // a blob length past the end of the data
+    auto bad = buf;
+    const size_t blob_offset = buf.find("payload") - 1;
+    QCOMPARE(bad[blob_offset], char(7));
+    bad[blob_offset] = char(100);
+    sample r = {};
+    QVERIFY(serialize::decode(&r, bad.data(), bad.data() + bad.size()) == nullptr);
+
+    // a huge blob length followed by the end of the stream does not allocate it up front
+    char length[varint::max_bytes<uint32_t>()];
+    char* length_end = varint::encode(uint32_t(byte_buffer::max_size()), length);
+    auto huge = buf.substr(0, blob_offset) + std::string(length, length_end);
+    for( bool buffered : {true, false} ) {
+        r = {};
+        if( buffered ) {
+            stream::byte_buffer_input_stream in(array_ref<char>(&huge[0], huge.size()));
+            QVERIFY( ! serialize::read(&in, &r));
+        } else {
+            auto p = pipe::open();
+            QCOMPARE(p.status, int(pipe::StatusNoError));
+            QCOMPARE(io::write_all(*p.write_fd, array_ref<const char>(huge.data(), huge.size())), int(io::WriteNoError));
+            p.write_fd.reset();
+            stream::fd_input_stream in({}, *p.read_fd);
+            QVERIFY( ! serialize::read(&in, &r));
+        }
+        QVERIFY(r.blob.capacity() < 1024 * 1024);
+    }
+}
+
+void Test_serialize::testStream()
+{
+    const auto s = make_sample();
+
+    stream::byte_buffer_output_stream out;
+    for( int i = 0; i < 100; ++i )
+        QVERIFY(serialize::write(&out, s));
+    QVERIFY(out.flush_buffer());
+    auto data = out.release_reset();
+    QCOMPARE(data.size(), 100 * encoded(s).size());
+
+    stream::byte_buffer_input_stream in(data.ref());
+    for( int i = 0; i < 100; ++i ) {
+        sample r = {};
+        QVERIFY(serialize::read(&in, &r));
+        QVERIFY(equal(r, s));
+    }
+    sample r = {};
+    QVERIFY( ! serialize::read(&in, &r));
+
+    // unbuffered streams go field by field
+    auto p = pipe::open();
+    QCOMPARE(p.status, int(pipe::StatusNoError));
+    {
+        stream::fd_output_stream unbuffered_out({}, *p.write_fd);
+        QVERIFY(serialize::write(&unbuffered_out, s));
+        QVERIFY(serialize::write(&unbuffered_out, s));
+    }
+    p.write_fd.reset();
+    stream::fd_input_stream unbuffered_in({}, *p.read_fd);
+    for( int i = 0; i < 2; ++i ) {
+        r = {};
+        QVERIFY(serialize::read(&unbuffered_in, &r));
+        QVERIFY(equal(r, s));
+    }
+    QVERIFY( ! serialize::read(&unbuffered_in, &r));
+}
+
+QTEST_APPLESS_MAIN(Test_serialize)
+
+#include "test_serialize.moc"
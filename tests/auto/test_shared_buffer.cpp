@@ -0,0 +1,191 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <QtTest>
+
+#include <lbu/buffer_queue_stream.h>
+#include <lbu/shared_buffer.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace lbu;
+
+class Test_shared_buffer : public QObject
+{
+    Q_OBJECT
+
+public:
+    Test_shared_buffer() = default;
+
+private Q_SLOTS:
+    void testConstructor();
+    void testSlice();
+    void testToByteBuffer();
+    void testThreaded();
+    void testBufferQueue();
+};
+
+namespace {
+
+std::string to_string(array_ref<const void> m)
+{
+    return std::string(static_cast<const char*>(m.data()), m.byte_size());
+}
+
+byte_buffer buffer(const std::string& s)
+{
+    return byte_buffer(array_ref<const char>(s.data(), s.size()));
+}
+
+}
+
+void Test_shared_buffer::testConstructor()
+{
+    shared_buffer empty;
+    QVERIFY(empty.is_empty());
+    QVERIFY( ! empty.is_unique());
+    QVERIFY(shared_buffer(byte_buffer()).is_empty());
+
+    // a malloced byte_buffer is taken over without copying
+    const std::string text(1000, 'x');
+    auto b = buffer(text);
+    const void* data = b.data();
+    shared_buffer s(std::move(b));
+    QVERIFY(b.is_empty());
+    QCOMPARE(s.data(), data);
+    QCOMPARE(to_string(s.ref()), text);
+    QVERIFY(s.is_unique());
+
+    // small buffers are inline in the byte_buffer and get copied
+    auto small = buffer("small");
+    shared_buffer t(std::move(small));
+    QVERIFY(small.is_empty());
+    QCOMPARE(to_string(t.ref()), std::string("small"));
+
+    shared_buffer copy = s;
+    QCOMPARE(copy.data(), data);
+    QVERIFY( ! s.is_unique());
+    QVERIFY( ! copy.is_unique());
+    copy = t;
+    QVERIFY(s.is_unique());
+    QCOMPARE(to_string(copy.ref()), std::string("small"));
+
+    shared_buffer moved(std::move(s));
+    QVERIFY(s.is_empty());
+    QCOMPARE(moved.data(), data);
+    QVERIFY(moved.is_unique());
+    moved.clear();
+    QVERIFY(moved.is_empty());
+}
+
+void Test_shared_buffer::testSlice()
+{
+    std::string text;
+    for( int i = 0; i < 100; ++i )
+        text += std::to_string(i);
+    const shared_buffer s(array_ref<const char>(text.data(), text.size()));
+
+    auto a = s.slice(10, 20);
+    auto b = a.slice(5);
+    QCOMPARE(a.data(), static_cast<const void*>(static_cast<const char*>(s.data()) + 10));
+    QCOMPARE(to_string(a.ref()), text.substr(10, 20));
+    QCOMPARE(to_string(b.ref()), text.substr(15, 15));
+    QCOMPARE(s.slice(text.size()).size(), size_t(0));
+    QVERIFY( ! s.is_unique());
+
+    // the allocation lives as long as any slice
+    shared_buffer last;
+    {
+        shared_buffer tmp(array_ref<const char>(text.data(), text.size()));
+        last = tmp.slice(text.size() - 3);
+    }
+    QVERIFY(last.is_unique());
+    QCOMPARE(to_string(last.ref()), text.substr(text.size() - 3));
+}
+
+void Test_shared_buffer::testToByteBuffer()
+{
+    const std::string text(5000, 'y');
+    auto b = buffer(text + "tail");
+    const void* data = b.data();
+    shared_buffer s(std::move(b));
+
+    // shared: copies
+    auto other = s;
+    auto copy = std::move(s).to_byte_buffer();
+    QVERIFY(s.is_empty());
+    QVERIFY(copy.data() != data);
+    QCOMPARE(to_string(copy.ref()), text + "tail");
+
+    // unique: moves the allocation, also for a slice
+    auto tail = other.slice(4);
+    other.clear();
+    QVERIFY(tail.is_unique());
+    auto moved = std::move(tail).to_byte_buffer();
+    QVERIFY(tail.is_empty());
+    QCOMPARE(moved.data(), data);
+    QCOMPARE(to_string(moved.ref()), text.substr(4) + "tail");
+    moved.append(array_ref<const char>("!", 1));
+    QCOMPARE(moved.size(), text.size() + 1);
+
+    const shared_buffer c(array_ref<const char>(text.data(), 10));
+    QCOMPARE(to_string(c.to_byte_buffer().ref()), text.substr(0, 10));
+    QVERIFY(c.is_unique());
+}
+
+void Test_shared_buffer::testThreaded()
+{
+    const std::string text(100000, 'z');
+    shared_buffer s(buffer(text));
+    constexpr int Threads = 4;
+    constexpr int Rounds = 10000;
+
+    std::vector<std::thread> threads;
+    std::vector<char> ok(Threads, 0);
+    for( int t = 0; t < Threads; ++t ) {
+        threads.emplace_back([&, t, copy = s]() {
+            bool good = true;
+            for( int i = 0; i < Rounds; ++i ) {
+                auto a = copy.slice(size_t(i), 10);
+                shared_buffer b = a;
+                if( to_string(b.ref()) != text.substr(0, 10) )
+                    good = false;
+            }
+            ok[size_t(t)] = good;
+        });
+    }
+    for( auto& t : threads )
+        t.join();
+    for( char good : ok )
+        QVERIFY(good);
+    QVERIFY(s.is_unique());
+}
+
+void Test_shared_buffer::testBufferQueue()
+{
+    // fan out one payload to several queues without copying it
+    const std::string text(3000, 'q');
+    const shared_buffer s(buffer(text));
+    stream::buffer_queue_input_stream q1, q2;
+    QVERIFY(q1.append(s));
+    QVERIFY(q2.append(s.slice(1000)));
+    QVERIFY( ! s.is_unique());
+
+    auto b1 = q1.get_buffer(stream::Mode::NonBlocking);
+    auto b2 = q2.get_buffer(stream::Mode::NonBlocking);
+    QCOMPARE(b1.data(), s.data());
+    QCOMPARE(b1.byte_size(), size_t(3000));
+    QCOMPARE(b2.data(), static_cast<const void*>(static_cast<const char*>(s.data()) + 1000));
+    QCOMPARE(b2.byte_size(), size_t(2000));
+
+    q1.reset();
+    q2.reset();
+    QVERIFY(s.is_unique());
+}
+
+QTEST_APPLESS_MAIN(Test_shared_buffer)
+
+#include "test_shared_buffer.moc"
@@ -0,0 +1,203 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <QtTest>
+
+#include <lbu/small_vector.h>
+
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace lbu;
+
+class Test_small_vector : public QObject
+{
+    Q_OBJECT
+
+public:
+    Test_small_vector() = default;
+
+private Q_SLOTS:
+    void testInline();
+    void testModify();
+    void testAliasedElement();
+    void testCopyMove();
+    void testRawMalloc();
+};
+
+template< typename T, unsigned N >
+static bool equals(const small_vector<T, N>& v, const std::vector<T>& ref)
+{
+    return v.size() == ref.size() && std::equal(v.begin(), v.end(), ref.begin());
+}
+
+void Test_small_vector::testInline()
+{
+    small_vector<int, 4> v;
+    QVERIFY(v.is_empty());
+    QCOMPARE(v.capacity(), size_t(4));
+    const int* inline_data = v.data();
+
+    for( int i = 0; i < 4; ++i )
+        v.append(i);
+    QCOMPARE(v.data(), inline_data);
+    QCOMPARE(v.capacity(), size_t(4));
+    QCOMPARE(v.back(), 3);
+
+    v.append(4);
+    QVERIFY(v.data() != inline_data);
+    QVERIFY(v.capacity() >= 5);
+    QVERIFY(equals(v, {0, 1, 2, 3, 4}));
+
+    v.chop(2);
+    v.shrink_to_fit();
+    QCOMPARE(v.data(), inline_data);
+    QCOMPARE(v.capacity(), size_t(4));
+    QVERIFY(equals(v, {0, 1, 2}));
+
+    v.set_capacity(10);
+    QCOMPARE(v.capacity(), size_t(10));
+    v.set_capacity(0);
+    QCOMPARE(v.capacity(), size_t(4));
+    QVERIFY(equals(v, {0, 1, 2}));
+}
+
+void Test_small_vector::testModify()
+{
+    small_vector<uint32_t, 3> v;
+    std::vector<uint32_t> ref;
+    std::mt19937 gen(1);
+
+    for( int i = 0; i < 20000; ++i ) {
+        const uint32_t x = gen();
+        const size_t pos = ref.empty() ? 0 : x % (ref.size() + 1);
+        switch( x % 7 ) {
+        case 0:
+            v.append(x);
+            ref.push_back(x);
+            break;
+        case 1:
+            v.append_n(3, x);
+            ref.insert(ref.end(), 3, x);
+            break;
+        case 2:
+            v.insert(pos, x);
+            ref.insert(ref.begin() + long(pos), x);
+            break;
+        case 3:
+            v.erase(pos, 2);
+            ref.erase(ref.begin() + long(pos), ref.begin() + long(std::min(pos + 2, ref.size())));
+            break;
+        case 4: {
+            v.reserve(v.size() + 2);
+            auto a = v.append_begin();
+            QVERIFY(a.size() >= 2);
+            a[0] = x;
+            a[1] = x + 1;
+            v.append_commit(2);
+            ref.push_back(x);
+            ref.push_back(x + 1);
+            break;
+        }
+        case 5:
+            // self append
+            v.append(v.ref());
+            ref.insert(ref.end(), ref.begin(), ref.end());
+            break;
+        default:
+            v.resize(pos / 2);
+            ref.resize(pos / 2);
+        }
+        if( ref.size() > 300 ) {
+            v.clear();
+            ref.clear();
+        }
+        QVERIFY(equals(v, ref));
+    }
+
+    v.clear();
+    v.resize(5);
+    QVERIFY(equals(v, {0, 0, 0, 0, 0}));
+}
+
+void Test_small_vector::testAliasedElement()
+{
+    // the value is an element of the vector, growing moves it
+    small_vector<int, 2> v;
+    v.append(1);
+    v.append(2);
+    v.append(v[0]);
+    QVERIFY(equals(v, {1, 2, 1}));
+
+    v.shrink_to_fit();
+    v.append_n(3, v[1]);
+    QVERIFY(equals(v, {1, 2, 1, 2, 2, 2}));
+
+    v.shrink_to_fit();
+    v.insert(0, v.back());
+    QVERIFY(equals(v, {2, 1, 2, 1, 2, 2, 2}));
+
+    // append_n is not ambiguous with append for integer elements
+    small_vector<size_t, 2> s;
+    s.append(3);
+    s.append_n(2, 5);
+    QVERIFY(equals(s, {3, 5, 5}));
+}
+
+void Test_small_vector::testCopyMove()
+{
+    const int data[] = {1, 2, 3, 4, 5, 6};
+    for( size_t n : {size_t(2), size_t(6)} ) {
+        small_vector<int, 4> a(array_ref<const int>(data, n));
+        const std::vector<int> ref(data, data + n);
+
+        small_vector<int, 4> b = a;
+        QVERIFY(equals(b, ref));
+        QVERIFY(b.data() != a.data());
+
+        small_vector<int, 4> c = std::move(a);
+        QVERIFY(equals(c, ref));
+        QVERIFY(a.is_empty());
+        QCOMPARE(a.capacity(), size_t(4));
+
+        a = std::move(c);
+        QVERIFY(equals(a, ref));
+        c = a;
+        QVERIFY(equals(c, ref));
+    }
+}
+
+void Test_small_vector::testRawMalloc()
+{
+    small_vector<int, 2> v;
+    QVERIFY(v.release_raw_malloc() == nullptr);
+
+    v.append(7);
+    auto p = v.release_raw_malloc();
+    QVERIFY(p != nullptr);
+    QCOMPARE(*static_cast<int*>(p.get()), 7);
+    QVERIFY(v.is_empty());
+
+    auto* raw = static_cast<int*>(::malloc(10 * sizeof(int)));
+    for( int i = 0; i < 5; ++i )
+        raw[i] = i;
+    v.adopt_raw_malloc(unique_ptr_raw(raw), 5, 10);
+    QCOMPARE(v.data(), raw);
+    QCOMPARE(v.capacity(), size_t(10));
+    QVERIFY(equals(v, {0, 1, 2, 3, 4}));
+
+    p = v.release_raw_malloc();
+    QCOMPARE(p.get(), static_cast<void*>(raw));
+    QCOMPARE(v.capacity(), size_t(2));
+
+    // fits inline, gets copied
+    v.adopt_raw_malloc(std::move(p), 2);
+    QVERIFY(equals(v, {0, 1}));
+    QCOMPARE(v.capacity(), size_t(2));
+}
+
+QTEST_APPLESS_MAIN(Test_small_vector)
+
+#include "test_small_vector.moc"
@@ -0,0 +1,221 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <QtTest>
+
+#include <lbu/byte_buffer_stream.h>
+#include <lbu/fd_stream.h>
+#include <lbu/pipe.h>
+#include <lbu/ring_spsc_stream.h>
+#include <lbu/stream_statistics.h>
+
+#include <string>
+#include <thread>
+
+using namespace lbu;
+using namespace lbu::stream;
+
+class Test_stream_statistics : public QObject
+{
+    Q_OBJECT
+
+public:
+    Test_stream_statistics() = default;
+
+private Q_SLOTS:
+    void testHistogramBuckets();
+    void testHistogramPercentiles();
+    void testFdStream();
+    void testByteBufferStream();
+    void testRing();
+};
+
+namespace {
+
+// with the counters compiled out nothing is counted at all
+uint64_t expected(uint64_t count)
+{
+    return stream_statistics::enabled ? count : 0;
+}
+
+uint64_t load(const std::atomic<uint64_t>& c)
+{
+    return c.load(std::memory_order_relaxed);
+}
+
+}
+
+void Test_stream_statistics::testHistogramBuckets()
+{
+    using H = latency_histogram;
+
+    for( uint64_t v = 0; v < H::SubBucketCount; ++v ) {
+        QCOMPARE(H::bucket_index(v), unsigned(v));
+        QCOMPARE(H::bucket_upper_bound(unsigned(v)), v);
+    }
+
+    // every value lies in its bucket, with a relative error below 1 / SubBucketCount
+    unsigned prev = 0;
+    for( uint64_t v = 1; v < (uint64_t(1) << 20); v += 1 + v / 64 ) {
+        const unsigned i = H::bucket_index(v);
+        QVERIFY(i < H::BucketCount);
+        QVERIFY(i >= prev);
+        prev = i;
+        const uint64_t upper = H::bucket_upper_bound(i);
+        QVERIFY(upper >= v);
+        QVERIFY(upper - v <= v / H::SubBucketCount);
+        if( i > 0 )
+            QVERIFY(H::bucket_upper_bound(i - 1) < v);
+    }
+    QCOMPARE(H::bucket_index(~uint64_t(0)), H::BucketCount - 1);
+    QCOMPARE(H::bucket_upper_bound(H::BucketCount - 1), ~uint64_t(0));
+    QCOMPARE(H::bucket_index(uint64_t(1) << 63), H::BucketCount - H::SubBucketCount);
+}
+
+void Test_stream_statistics::testHistogramPercentiles()
+{
+    latency_histogram h;
+    QCOMPARE(h.count(), uint64_t(0));
+    QCOMPARE(h.value_at_percentile(50), uint64_t(0));
+
+    for( uint64_t v = 1; v <= 1000; ++v )
+        h.record(v * 1000);
+    QCOMPARE(h.count(), uint64_t(1000));
+
+    // percentiles are reported as the upper bound of their bucket
+    const auto p50 = h.value_at_percentile(50);
+    QVERIFY(p50 >= 500000 && p50 <= 500000 + 500000 / latency_histogram::SubBucketCount);
+    const auto p99 = h.value_at_percentile(99);
+    QVERIFY(p99 >= 990000 && p99 <= 990000 + 990000 / latency_histogram::SubBucketCount);
+    QCOMPARE(h.value_at_percentile(0), latency_histogram::bucket_upper_bound(latency_histogram::bucket_index(1000)));
+    QCOMPARE(h.value_at_percentile(100), latency_histogram::bucket_upper_bound(latency_histogram::bucket_index(1000000)));
+    QCOMPARE(h.value_at_percentile(200), h.value_at_percentile(100));
+
+    h.reset();
+    QCOMPARE(h.count(), uint64_t(0));
+    QCOMPARE(h.value_at_percentile(99), uint64_t(0));
+}
+
+void Test_stream_statistics::testFdStream()
+{
+    auto p = pipe::open();
+    QCOMPARE(p.status, int(pipe::StatusNoError));
+    managed_fd_output_stream out(std::move(p.write_fd));
+    managed_fd_input_stream in(std::move(p.read_fd));
+
+    stream_statistics write_stats, read_stats;
+    out.stream()->attach_statistics(&write_stats);
+    in.stream()->attach_statistics(&read_stats);
+    QCOMPARE(out.stream()->attached_statistics(), stream_statistics::enabled ? &write_stats : nullptr);
+
+    char buf[1000];
+    QCOMPARE(in.stream()->read(buf, sizeof(buf), Mode::NonBlocking), ssize_t(0));
+    QCOMPARE(load(read_stats.would_block), expected(1));
+    QCOMPARE(load(read_stats.bytes), uint64_t(0));
+
+    const std::string data(10000, 'x');
+    QCOMPARE(out.stream()->write(data.data(), data.size(), Mode::Blocking), ssize_t(data.size()));
+    QVERIFY(out.stream()->flush_buffer());
+    QCOMPARE(load(write_stats.bytes), expected(data.size()));
+    QVERIFY(load(write_stats.syscalls) >= expected(1));
+
+    size_t read = 0;
+    while( read < data.size() ) {
+        const auto r = in.stream()->read(buf, std::min(sizeof(buf), data.size() - read), Mode::Blocking);
+        QVERIFY(r > 0);
+        read += size_t(r);
+    }
+    QCOMPARE(load(read_stats.bytes), expected(data.size()));
+    QVERIFY(load(read_stats.syscalls) >= expected(2));
+    QVERIFY(load(read_stats.buffer_refills) >= expected(1));
+    QCOMPARE(read_stats.blocked_latency.count() > 0, stream_statistics::enabled);
+
+    read_stats.reset();
+    QCOMPARE(load(read_stats.bytes), uint64_t(0));
+    QCOMPARE(load(read_stats.syscalls), uint64_t(0));
+    QCOMPARE(read_stats.blocked_latency.count(), uint64_t(0));
+
+    // detached streams count nothing
+    in.stream()->attach_statistics(nullptr);
+    QCOMPARE(in.stream()->read(buf, sizeof(buf), Mode::NonBlocking), ssize_t(0));
+    QCOMPARE(load(read_stats.would_block), uint64_t(0));
+}
+
+void Test_stream_statistics::testByteBufferStream()
+{
+    // the whole window is counted once, however it is read
+    std::string data(5000, 'b');
+    stream_statistics read_stats;
+    byte_buffer_input_stream in;
+    in.attach_statistics(&read_stats);
+    in.reset(array_ref<char>(&data[0], data.size()));
+    QCOMPARE(load(read_stats.bytes), expected(data.size()));
+    char buf[100];
+    QCOMPARE(in.read(buf, sizeof(buf), Mode::Blocking), ssize_t(sizeof(buf)));
+    std::string rest(data.size(), '\0');
+    QCOMPARE(in.read(&rest[0], rest.size(), Mode::Blocking), ssize_t(data.size() - sizeof(buf)));
+    QVERIFY(in.at_end());
+    QCOMPARE(load(read_stats.bytes), expected(data.size()));
+
+    // small writes go through the buffer and are counted as they are committed
+    stream_statistics write_stats;
+    byte_buffer_output_stream out;
+    out.attach_statistics(&write_stats);
+    for( size_t i = 0; i < data.size(); i += 10 )
+        QCOMPARE(out.write(data.data() + i, 10, Mode::Blocking), ssize_t(10));
+    QVERIFY(out.flush_buffer());
+    QCOMPARE(load(write_stats.bytes), expected(data.size()));
+
+    // an oversized write goes past the buffer
+    const std::string large(100000, 'l');
+    QCOMPARE(out.write(large.data(), large.size(), Mode::Blocking), ssize_t(large.size()));
+    QVERIFY(out.flush_buffer());
+    QCOMPARE(load(write_stats.bytes), expected(data.size() + large.size()));
+    QCOMPARE(out.release_reset().size(), data.size() + large.size());
+}
+
+void Test_stream_statistics::testRing()
+{
+    ring_spsc_basic_controller controller(4096);
+    ring_spsc::output_stream out;
+    ring_spsc::input_stream in;
+    QVERIFY(controller.pair_streams(&out, &in));
+
+    // one object shared by both ends
+    stream_statistics stats;
+    out.attach_statistics(&stats);
+    in.attach_statistics(&stats);
+
+    char buf[256];
+    QCOMPARE(in.read(buf, sizeof(buf), Mode::NonBlocking), ssize_t(0));
+    QCOMPARE(load(stats.would_block), expected(1));
+
+    constexpr size_t Total = 100000;
+    std::thread producer([&]() {
+        const std::string data(1000, 'r');
+        for( size_t i = 0; i < Total / data.size(); ++i )
+            out.write(data.data(), data.size(), Mode::Blocking);
+        out.flush_buffer();
+        out.set_end_of_stream();
+    });
+    size_t read = 0;
+    while( true ) {
+        const auto r = in.read(buf, sizeof(buf), Mode::Blocking);
+        if( r <= 0 )
+            break;
+        read += size_t(r);
+    }
+    producer.join();
+
+    QCOMPARE(read, Total);
+    QVERIFY(in.at_end());
+    // bytes are counted on both ends
+    QCOMPARE(load(stats.bytes), expected(2 * Total));
+    QVERIFY(load(stats.buffer_refills) >= expected(1));
+    QCOMPARE(load(stats.wakeups_sent) > 0, stream_statistics::enabled);
+}
+
+QTEST_APPLESS_MAIN(Test_stream_statistics)
+
+#include "test_stream_statistics.moc"
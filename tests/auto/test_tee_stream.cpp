@@ -0,0 +1,273 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <QtTest>
+
+#include <lbu/byte_buffer_stream.h>
+#include <lbu/fd_stream.h>
+#include <lbu/pipe.h>
+#include <lbu/ring_spsc_stream.h>
+#include <lbu/tee_stream.h>
+
+#include <cerrno>
+#include <csignal>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace lbu;
+using namespace lbu::stream;
+
+class Test_tee_stream : public QObject
+{
+    Q_OBJECT
+
+public:
+    Test_tee_stream() = default;
+
+private Q_SLOTS:
+    void testSinks();
+    void testLag();
+    void testFailure();
+    void testFdBlockingState();
+    void testThreaded();
+};
+
+namespace {
+
+std::string pattern(size_t size, size_t offset = 0)
+{
+    std::string s(size, '\0');
+    for( size_t i = 0; i < size; ++i )
+        s[i] = char((i + offset) * 7 + (i + offset) / 251);
+    return s;
+}
+
+std::string read_available(fd f)
+{
+    std::string s;
+    char buf[4096];
+    while( true ) {
+        const auto r = io::read(f, array_ref<char>(buf, sizeof(buf)));
+        if( r.size <= 0 )
+            return s;
+        s.append(buf, size_t(r.size));
+    }
+}
+
+std::string to_string(const byte_buffer& b)
+{
+    return std::string(static_cast<const char*>(b.data()), b.size());
+}
+
+bool nonblocking(fd f)
+{
+    int error = 0;
+    return f.is_nonblock(&error);
+}
+
+}
+
+void Test_tee_stream::testSinks()
+{
+    auto p = pipe::open();
+    QCOMPARE(p.status, int(pipe::StatusNoError));
+    byte_buffer_output_stream buffered;
+    ring_spsc_basic_controller controller(4096);
+    ring_spsc::output_stream ring_out;
+    ring_spsc::input_stream ring_in;
+    QVERIFY(controller.pair_streams(&ring_out, &ring_in, 4096));
+
+    std::vector<char> window(1024);
+    tee_output_stream tee(array_ref<char>(window.data(), window.size()));
+    int error = 0;
+    QVERIFY(tee.add_sink(p.write_fd.get(), &error));
+    tee.add_sink(&buffered);
+    tee.add_sink(&ring_out);
+    QCOMPARE(tee.sink_count(), size_t(3));
+
+    // larger than the window, in odd pieces and through the zero copy buffer
+    const auto data = pattern(3000);
+    size_t offset = 0;
+    for( size_t chunk = 1; offset + chunk <= 2000; chunk += 37 ) {
+        QCOMPARE(tee.write(data.data() + offset, chunk, Mode::Blocking), ssize_t(chunk));
+        offset += chunk;
+    }
+    while( offset < data.size() ) {
+        auto b = tee.get_buffer(Mode::Blocking);
+        QVERIFY(b.byte_size() > 0);
+        const auto n = std::min(b.byte_size(), data.size() - offset);
+        std::memcpy(b.data(), data.data() + offset, n);
+        tee.advance_buffer(n);
+        offset += n;
+    }
+    QVERIFY(tee.flush_buffer());
+    QCOMPARE(tee.max_lag(), size_t(0));
+
+    QVERIFY(p.read_fd.get().set_nonblock(true, &error));
+    QCOMPARE(read_available(p.read_fd.get()), data);
+    QCOMPARE(to_string(buffered.release_reset()), data);
+    std::string from_ring(data.size(), '\0');
+    QCOMPARE(ring_in.read(&from_ring[0], from_ring.size(), Mode::Blocking), ssize_t(data.size()));
+    QCOMPARE(from_ring, data);
+    QVERIFY( ! tee.has_error());
+    QCOMPARE(tee.failed_sink(), -1);
+}
+
+void Test_tee_stream::testLag()
+{
+    // a stalled pipe holds up the other sink only once it lags behind by the whole window
+    auto p = pipe::open();
+    QCOMPARE(p.status, int(pipe::StatusNoError));
+    byte_buffer_output_stream buffered;
+
+    constexpr size_t Window = 4096;
+    std::vector<char> window(Window);
+    tee_output_stream tee(array_ref<char>(window.data(), window.size()));
+    int error = 0;
+    QVERIFY(tee.add_sink(p.write_fd.get(), &error));
+    tee.add_sink(&buffered);
+
+    const auto chunk = pattern(1000);
+    size_t written = 0;
+    while( true ) {
+        const auto r = tee.write(chunk.data(), chunk.size(), Mode::NonBlocking);
+        QVERIFY(r >= 0);
+        written += size_t(r);
+        if( size_t(r) < chunk.size() )
+            break;
+    }
+    QVERIFY(written > Window);
+    QCOMPARE(tee.max_lag(), Window);
+    QVERIFY( ! tee.flush_buffer(Mode::NonBlocking));
+    QVERIFY( ! tee.has_error());
+
+    // the other sink is not held up by the stalled one
+    QVERIFY(buffered.flush_buffer());
+    QCOMPARE(buffered.release_reset().size(), written);
+
+    QVERIFY(p.read_fd.get().set_nonblock(true, &error));
+    size_t received = 0;
+    while( ! tee.flush_buffer(Mode::NonBlocking) )
+        received += read_available(p.read_fd.get()).size();
+    received += read_available(p.read_fd.get()).size();
+    QCOMPARE(received, written);
+    QCOMPARE(tee.max_lag(), size_t(0));
+    QVERIFY(buffered.release_reset().is_empty());
+}
+
+void Test_tee_stream::testFailure()
+{
+    std::signal(SIGPIPE, SIG_IGN);
+
+    byte_buffer_output_stream buffered;
+    auto p = pipe::open();
+    QCOMPARE(p.status, int(pipe::StatusNoError));
+    p.read_fd.reset();
+
+    char window[64];
+    tee_output_stream tee(array_ref<char>(window, sizeof(window)));
+    int error = 0;
+    tee.add_sink(&buffered);
+    QVERIFY(tee.add_sink(p.write_fd.get(), &error));
+
+    QCOMPARE(tee.write("data", 4, Mode::Blocking), ssize_t(4));
+    QVERIFY( ! tee.flush_buffer());
+    QVERIFY(tee.has_error());
+    QCOMPARE(tee.failed_sink(), 1);
+    QCOMPARE(tee.status(), int(io::WriteClosedPipe));
+    QVERIFY(tee.write("more", 4, Mode::Blocking) < 0);
+}
+
+void Test_tee_stream::testFdBlockingState()
+{
+    auto a = pipe::open();
+    auto b = pipe::open();
+    QCOMPARE(a.status, int(pipe::StatusNoError));
+    QCOMPARE(b.status, int(pipe::StatusNoError));
+    int error = 0;
+    QVERIFY(b.write_fd.get().set_nonblock(true, &error));
+    QVERIFY( ! nonblocking(a.write_fd.get()));
+
+    {
+        char window[64];
+        tee_output_stream tee(array_ref<char>(window, sizeof(window)));
+        QVERIFY(tee.add_sink(a.write_fd.get(), &error));
+        QVERIFY(tee.add_sink(b.write_fd.get(), &error));
+        // only while the tee uses them
+        QVERIFY(nonblocking(a.write_fd.get()));
+        QVERIFY(nonblocking(b.write_fd.get()));
+        QCOMPARE(tee.write("data", 4, Mode::Blocking), ssize_t(4));
+        QVERIFY(tee.flush_buffer());
+
+        QVERIFY( ! tee.add_sink(fd(), &error));
+        QCOMPARE(error, EBADF);
+        QCOMPARE(tee.sink_count(), size_t(2));
+    }
+    // the fds are handed back the way they were added
+    QVERIFY( ! nonblocking(a.write_fd.get()));
+    QVERIFY(nonblocking(b.write_fd.get()));
+}
+
+void Test_tee_stream::testThreaded()
+{
+    auto p = pipe::open();
+    QCOMPARE(p.status, int(pipe::StatusNoError));
+    ring_spsc_basic_controller controller(4096);
+    ring_spsc::output_stream ring_out;
+    ring_spsc::input_stream ring_in;
+    QVERIFY(controller.pair_streams(&ring_out, &ring_in, 4096));
+
+    std::vector<char> window(8192);
+    tee_output_stream tee(array_ref<char>(window.data(), window.size()));
+    int error = 0;
+    QVERIFY(tee.add_sink(p.write_fd.get(), &error));
+    tee.add_sink(&ring_out);
+
+    constexpr size_t Total = 1 << 20;
+    const auto data = pattern(Total);
+
+    std::string from_pipe;
+    std::thread pipe_reader([&]() {
+        char inbuf[2048];
+        fd_input_stream in(array_ref<char>(inbuf, sizeof(inbuf)), p.read_fd.get(), FdBlockingState::AlwaysBlocking);
+        char buf[3000];
+        ssize_t r;
+        while( (r = in.read(buf, sizeof(buf), Mode::Blocking)) > 0 ) {
+            from_pipe.append(buf, size_t(r));
+        }
+    });
+    std::string from_ring;
+    std::thread ring_reader([&]() {
+        char buf[5000];
+        ssize_t r;
+        while( (r = ring_in.read(buf, sizeof(buf), Mode::NonBlocking)) >= 0 ) {
+            from_ring.append(buf, size_t(r));
+            if( from_ring.size() == Total || ring_in.at_end() )
+                break;
+            if( r == 0 )
+                std::this_thread::yield();
+        }
+    });
+
+    bool write_ok = true;
+    for( size_t offset = 0; offset < Total; ) {
+        const auto n = std::min<size_t>(777, Total - offset);
+        if( tee.write(data.data() + offset, n, Mode::Blocking) != ssize_t(n) )
+            write_ok = false;
+        offset += n;
+    }
+    write_ok = tee.flush_buffer() && write_ok;
+    p.write_fd.reset();
+    pipe_reader.join();
+    ring_reader.join();
+
+    QVERIFY(write_ok);
+    QVERIFY(from_pipe == data);
+    QVERIFY(from_ring == data);
+}
+
+QTEST_APPLESS_MAIN(Test_tee_stream)
+
+#include "test_tee_stream.moc"
@@ -0,0 +1,265 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <QtTest>
+
+#include <lbu/endian.h>
+#include <lbu/io.h>
+#include <lbu/trace.h>
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace lbu;
+
+class Test_trace : public QObject
+{
+    Q_OBJECT
+
+public:
+    Test_trace() = default;
+
+private Q_SLOTS:
+    void testRecord();
+    void testDropped();
+    void testChromeJson();
+    void testConvertErrors();
+};
+
+namespace {
+
+constexpr uint16_t EventTest = trace::EventUserFirst;
+constexpr uint16_t EventWork = trace::EventUserFirst + 1;
+
+// an anonymous temporary file
+struct temp_file {
+    temp_file() : file(std::tmpfile()) {}
+    ~temp_file() { std::fclose(file); }
+
+    fd descriptor() const { return fd(::fileno(file)); }
+
+    std::string content() const
+    {
+        std::string s;
+        char buf[4096];
+        ssize_t r;
+        off_t offset = 0;
+        while( (r = ::pread(::fileno(file), buf, sizeof(buf), offset)) > 0 ) {
+            s.append(buf, size_t(r));
+            offset += r;
+        }
+        return s;
+    }
+
+    void set_content(const std::string& s)
+    {
+        QVERIFY(::ftruncate(::fileno(file), 0) == 0);
+        rewind();
+        QCOMPARE(io::write_all(descriptor(), array_ref<const char>(s.data(), s.size())), int(io::WriteNoError));
+        rewind();
+    }
+
+    void rewind() { QVERIFY(::lseek(::fileno(file), 0, SEEK_SET) == 0); }
+
+    std::FILE* file;
+};
+
+std::vector<trace::event> events(const std::string& data)
+{
+    std::vector<trace::event> r;
+    for( size_t offset = sizeof(trace::file_header); offset + sizeof(trace::event) <= data.size();
+         offset += sizeof(trace::event) ) {
+        const char* p = data.data() + offset;
+        trace::event e;
+        e.ticks = from_little_endian<uint64_t>(p);
+        e.id = from_little_endian<uint16_t>(p + 8);
+        e.phase = trace::Phase(p[10]);
+        e.thread = from_little_endian<uint32_t>(p + 12);
+        e.arg0 = from_little_endian<uint64_t>(p + 16);
+        e.arg1 = from_little_endian<uint64_t>(p + 24);
+        r.push_back(e);
+    }
+    return r;
+}
+
+size_t count(const std::vector<trace::event>& list, uint16_t id)
+{
+    size_t n = 0;
+    for( const auto& e : list )
+        n += (e.id == id);
+    return n;
+}
+
+size_t count(const std::string& s, const std::string& pattern)
+{
+    size_t n = 0;
+    for( size_t pos = s.find(pattern); pos != std::string::npos; pos = s.find(pattern, pos + 1) )
+        ++n;
+    return n;
+}
+
+std::string header(uint64_t start_ticks, uint64_t start_ns)
+{
+    std::string h(sizeof(trace::file_header), '\0');
+    std::memcpy(&h[0], trace::file_header::Magic, sizeof(trace::file_header::Magic));
+    to_little_endian<uint32_t>(trace::file_header::Version, &h[8]);
+    to_little_endian<uint32_t>(uint32_t(sizeof(trace::event)), &h[12]);
+    to_little_endian<uint64_t>(start_ticks, &h[16]);
+    to_little_endian<uint64_t>(start_ns, &h[24]);
+    to_little_endian<uint32_t>(42, &h[32]);
+    return h;
+}
+
+std::string encoded(uint64_t ticks, uint16_t id, trace::Phase phase, uint64_t arg0 = 0)
+{
+    std::string e(sizeof(trace::event), '\0');
+    to_little_endian<uint64_t>(ticks, &e[0]);
+    to_little_endian<uint16_t>(id, &e[8]);
+    e[10] = char(phase);
+    to_little_endian<uint32_t>(7, &e[12]);
+    to_little_endian<uint64_t>(arg0, &e[16]);
+    return e;
+}
+
+}
+
+void Test_trace::testRecord()
+{
+    // without a session recording does nothing
+    trace::instant(EventTest);
+
+    temp_file file;
+    {
+        trace::session s(file.descriptor());
+        QVERIFY(s.is_active());
+        trace::session second(file.descriptor());
+        QVERIFY( ! second.is_active());
+
+        trace::instant(EventTest, 1, 2);
+        std::thread t([]() {
+            for( int i = 0; i < 100; ++i ) {
+                trace::scope work(EventWork, uint64_t(i));
+            }
+        });
+        t.join();
+        trace::counter(EventTest, 99);
+    }
+    trace::instant(EventTest);
+
+    const auto data = file.content();
+    QCOMPARE((data.size() - sizeof(trace::file_header)) % sizeof(trace::event), size_t(0));
+    QCOMPARE(std::memcmp(data.data(), trace::file_header::Magic, sizeof(trace::file_header::Magic)), 0);
+    QCOMPARE(from_little_endian<uint32_t>(data.data() + 32), uint32_t(::getpid()));
+
+    const auto list = events(data);
+    QCOMPARE(count(list, EventTest), size_t(2));
+    QCOMPARE(count(list, EventWork), size_t(200));
+    QCOMPARE(count(list, trace::EventDropped), size_t(0));
+    // the file ends with a calibration record
+    QVERIFY(count(list, trace::EventCalibration) >= 1);
+    QCOMPARE(list.back().id, uint16_t(trace::EventCalibration));
+
+    // the events of one thread are in order
+    uint64_t prev_ticks = 0;
+    for( const auto& e : list ) {
+        if( e.id != EventWork )
+            continue;
+        QVERIFY(e.ticks >= prev_ticks);
+        prev_ticks = e.ticks;
+    }
+}
+
+void Test_trace::testDropped()
+{
+    temp_file file;
+    {
+        // the collector won't drain before the session ends
+        trace::session s(file.descriptor(), 16, std::chrono::milliseconds(100000));
+        for( int i = 0; i < 100; ++i )
+            trace::instant(EventTest, uint64_t(i));
+    }
+
+    const auto list = events(file.content());
+    const size_t recorded = count(list, EventTest);
+    QVERIFY(recorded > 0 && recorded < 100);
+    uint64_t dropped = 0;
+    for( const auto& e : list ) {
+        if( e.id == trace::EventDropped )
+            dropped += e.arg0;
+    }
+    QCOMPARE(recorded + dropped, uint64_t(100));
+}
+
+void Test_trace::testChromeJson()
+{
+    temp_file file;
+    {
+        trace::session s(file.descriptor());
+        trace::begin(EventWork);
+        trace::instant(EventTest, 5, 6);
+        trace::counter(EventTest + 2, 1234);
+        trace::end(EventWork);
+    }
+
+    temp_file json;
+    file.rewind();
+    const trace::event_name names[] = {{EventWork, "work \"quoted\""}};
+    QCOMPARE(trace::write_chrome_json(file.descriptor(), json.descriptor(), array_ref<const trace::event_name>(names)), int(trace::ConvertNoError));
+    const auto text = json.content();
+
+    QVERIFY(text.compare(0, 16, "{\"traceEvents\":[") == 0);
+    QCOMPARE(count(text, "\"name\":\"work \\\"quoted\\\"\""), size_t(2));
+    QCOMPARE(count(text, "\"ph\":\"B\""), size_t(1));
+    QCOMPARE(count(text, "\"ph\":\"E\""), size_t(1));
+    QCOMPARE(count(text, "\"name\":\"event_1024\",\"ph\":\"i\""), size_t(1));
+    QCOMPARE(count(text, "\"args\":{\"arg0\":5,\"arg1\":6}"), size_t(1));
+    QCOMPARE(count(text, "\"name\":\"event_1026\",\"ph\":\"C\""), size_t(1));
+    QCOMPARE(count(text, "\"args\":{\"value\":1234}"), size_t(1));
+    // calibration records are not exported
+    QCOMPARE(count(text, "\"name\":"), size_t(4));
+
+    // ticks are converted to microseconds with the calibration record
+    file.set_content(header(1000, 1000000) + encoded(3000, EventTest, trace::Phase::Instant)
+                     + encoded(11000, trace::EventCalibration, trace::Phase::Instant, 1000000 + 5000));
+    json.set_content({});
+    QCOMPARE(trace::write_chrome_json(file.descriptor(), json.descriptor()), int(trace::ConvertNoError));
+    QCOMPARE(count(json.content(), "\"ts\":1.000,"), size_t(1));
+}
+
+void Test_trace::testConvertErrors()
+{
+    temp_file file, json;
+
+    // no calibration record: the ticks can't be converted
+    file.set_content(header(1000, 1000000) + encoded(3000, EventTest, trace::Phase::Instant));
+    QCOMPARE(trace::write_chrome_json(file.descriptor(), json.descriptor()), int(trace::ConvertMissingCalibration));
+    QVERIFY(json.content().empty());
+
+    // but a trace without events is fine
+    file.set_content(header(1000, 1000000));
+    QCOMPARE(trace::write_chrome_json(file.descriptor(), json.descriptor()), int(trace::ConvertNoError));
+    QCOMPARE(json.content(), std::string("{\"traceEvents\":[\n\n]}\n"));
+
+    auto bad = header(1000, 1000000);
+    bad[0] = 'X';
+    file.set_content(bad);
+    QCOMPARE(trace::write_chrome_json(file.descriptor(), json.descriptor()), int(trace::ConvertInvalidFormat));
+
+    file.set_content(header(1000, 1000000).substr(0, 20));
+    QCOMPARE(trace::write_chrome_json(file.descriptor(), json.descriptor()), int(trace::ConvertInvalidFormat));
+
+    // a truncated event
+    const auto e = encoded(3000, EventTest, trace::Phase::Instant);
+    file.set_content(header(1000, 1000000) + e + e.substr(0, 10));
+    QCOMPARE(trace::write_chrome_json(file.descriptor(), json.descriptor()), int(trace::ConvertInvalidFormat));
+}
+
+QTEST_APPLESS_MAIN(Test_trace)
+
+#include "test_trace.moc"
@@ -0,0 +1,148 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <QtTest>
+
+#include <lbu/byte_buffer_stream.h>
+#include <lbu/ring_spsc_stream.h>
+#include <lbu/varint.h>
+
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace lbu;
+
+class Test_varint : public QObject
+{
+    Q_OBJECT
+
+public:
+    Test_varint() = default;
+
+private Q_SLOTS:
+    void testScalar();
+    void testStream();
+    void testGroup();
+    void testStreamVbyte();
+};
+
+static std::vector<uint32_t> random_values(size_t count, unsigned seed)
+{
+    std::mt19937 rng(seed);
+    std::vector<uint32_t> v(count);
+    for( auto& x : v )
+        x = rng() >> (8 * (rng() % 4));
+    return v;
+}
+
+void Test_varint::testScalar()
+{
+    char buf[16];
+
+    for( uint64_t v : {uint64_t(0), uint64_t(1), uint64_t(127), uint64_t(128), uint64_t(300),
+                       uint64_t(1) << 35, ~uint64_t(0)} ) {
+        char* e = varint::encode(v, buf);
+        QCOMPARE(size_t(e - buf), size_t(varint::encoded_size(v)));
+        uint64_t r = 0;
+        QCOMPARE(varint::decode<uint64_t>(buf, e, &r), static_cast<const char*>(e));
+        QCOMPARE(r, v);
+        QVERIFY(varint::decode<uint64_t>(buf, e - 1, &r) == nullptr);
+    }
+    QCOMPARE(varint::encoded_size(~uint64_t(0)), varint::max_bytes<uint64_t>());
+
+    const char overflow64[10] = {'\xff', '\xff', '\xff', '\xff', '\xff', '\xff', '\xff', '\xff', '\xff', '\x02'};
+    uint64_t r64;
+    QVERIFY(varint::decode(overflow64, overflow64 + 10, &r64) == nullptr);
+
+    const char overflow16[3] = {'\xff', '\xff', '\x04'};
+    uint16_t r16;
+    QVERIFY(varint::decode(overflow16, overflow16 + 3, &r16) == nullptr);
+
+    for( int64_t v : {int64_t(0), int64_t(-1), int64_t(1), int64_t(-64), std::numeric_limits<int64_t>::min(),
+                      std::numeric_limits<int64_t>::max()} ) {
+        QCOMPARE(varint::zigzag_decode(varint::zigzag_encode(v)), v);
+    }
+    QCOMPARE(varint::zigzag_encode(int32_t(-1)), uint32_t(1));
+    QCOMPARE(varint::zigzag_encode(int32_t(1)), uint32_t(2));
+}
+
+void Test_varint::testStream()
+{
+    const auto values = random_values(1000, 1);
+
+    stream::byte_buffer_output_stream out;
+    for( auto v : values )
+        QVERIFY(varint::write(&out, v));
+    QVERIFY(out.flush_buffer());
+    auto data = out.release_reset();
+
+    stream::byte_buffer_input_stream in(data.ref());
+    for( auto v : values ) {
+        uint32_t r;
+        QVERIFY(varint::read(&in, &r));
+        QCOMPARE(r, v);
+    }
+    uint32_t r;
+    QVERIFY( ! varint::read(&in, &r));
+
+    // tiny ring segments split most values across buffers
+    stream::ring_spsc_basic_controller c(64);
+    stream::ring_spsc::output_stream rout;
+    stream::ring_spsc::input_stream rin;
+    c.pair_streams(&rout, &rin, 3);
+    std::thread t([&] {
+        for( auto v : values )
+            varint::write(&rout, uint64_t(v) << 20);
+        rout.flush_buffer();
+        rout.set_end_of_stream();
+    });
+    bool ok = true;
+    for( auto v : values ) {
+        uint64_t r64;
+        ok = ok && varint::read(&rin, &r64) && r64 == uint64_t(v) << 20;
+    }
+    t.join();
+    QVERIFY(ok);
+}
+
+void Test_varint::testGroup()
+{
+    for( size_t count : {size_t(0), size_t(1), size_t(3), size_t(4), size_t(5), size_t(17), size_t(1000)} ) {
+        const auto values = random_values(count, unsigned(count));
+        std::vector<char> buf(varint::group::encoded_size_bound(count));
+        const size_t size = varint::group::encode({values.data(), values.size()}, buf.data());
+        QVERIFY(size <= buf.size());
+
+        std::vector<uint32_t> result(count);
+        QCOMPARE(varint::group::decode(buf.data(), buf.data() + size, {result.data(), result.size()}),
+                 static_cast<const char*>(buf.data() + size));
+        QVERIFY(result == values);
+
+        if( size > 0 )
+            QVERIFY(varint::group::decode(buf.data(), buf.data() + size - 1, {result.data(), result.size()}) == nullptr);
+    }
+}
+
+void Test_varint::testStreamVbyte()
+{
+    for( size_t count : {size_t(0), size_t(1), size_t(3), size_t(4), size_t(5), size_t(17), size_t(1000)} ) {
+        const auto values = random_values(count, unsigned(count) + 100);
+        std::vector<char> buf(varint::stream_vbyte::encoded_size_bound(count));
+        const size_t size = varint::stream_vbyte::encode({values.data(), values.size()}, buf.data());
+        QVERIFY(size <= buf.size());
+
+        std::vector<uint32_t> result(count);
+        QCOMPARE(varint::stream_vbyte::decode(buf.data(), buf.data() + size, {result.data(), result.size()}),
+                 static_cast<const char*>(buf.data() + size));
+        QVERIFY(result == values);
+
+        if( size > 0 )
+            QVERIFY(varint::stream_vbyte::decode(buf.data(), buf.data() + size - 1, {result.data(), result.size()}) == nullptr);
+    }
+}
+
+QTEST_APPLESS_MAIN(Test_varint)
+
+#include "test_varint.moc"
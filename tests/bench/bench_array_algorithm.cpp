@@ -0,0 +1,214 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// lbu/array_algorithm.h kernels against the equivalent std algorithm, one pair per kernel.
+// The kernel set in use is reported as "lbu_kernels" in the benchmark context.
+//
+//   --lbu_size  element counts (comma separated)
+//
+// All other options are handled by google benchmark (--benchmark_filter, --benchmark_format=json, ...).
+
+#include "bench_util.h"
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+
+#include "lbu/array_algorithm.h"
+#include "lbu/endian.h"
+
+namespace {
+
+std::vector<long> s_sizes;
+
+template< typename T >
+std::vector<T> random_values(size_t count, uint64_t max)
+{
+    std::mt19937_64 gen(1);
+    std::vector<T> v(count);
+    for( auto& e : v )
+        e = T(gen() % max);
+    return v;
+}
+
+void report(benchmark::State& state, size_t count, size_t element_size)
+{
+    state.SetItemsProcessed(int64_t(state.iterations()) * int64_t(count));
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(count * element_size));
+}
+
+// the searched value is not contained, so every element is looked at
+template< typename T, bool Lbu >
+void Find(benchmark::State& state)
+{
+    const auto v = random_values<T>(size_t(state.range(0)), 100);
+    const lbu::array_ref<const T> a(v.data(), v.size());
+    for( auto _ : state ) {
+        if constexpr( Lbu )
+            benchmark::DoNotOptimize(lbu::array_algorithm::find(a, T(100)));
+        else
+            benchmark::DoNotOptimize(std::find(a.begin(), a.end(), T(100)));
+    }
+    report(state, v.size(), sizeof(T));
+}
+
+template< typename T, bool Lbu >
+void Count(benchmark::State& state)
+{
+    const auto v = random_values<T>(size_t(state.range(0)), 4);
+    const lbu::array_ref<const T> a(v.data(), v.size());
+    for( auto _ : state ) {
+        if constexpr( Lbu )
+            benchmark::DoNotOptimize(lbu::array_algorithm::count(a, T(1)));
+        else
+            benchmark::DoNotOptimize(std::count(a.begin(), a.end(), T(1)));
+    }
+    report(state, v.size(), sizeof(T));
+}
+
+template< typename T, bool Lbu >
+void MinMax(benchmark::State& state)
+{
+    const auto v = random_values<T>(size_t(state.range(0)), 1u << 30);
+    const lbu::array_ref<const T> a(v.data(), v.size());
+    for( auto _ : state ) {
+        if constexpr( Lbu ) {
+            benchmark::DoNotOptimize(lbu::array_algorithm::min_max(a));
+        } else {
+            auto r = std::minmax_element(a.begin(), a.end());
+            benchmark::DoNotOptimize(r);
+        }
+    }
+    report(state, v.size(), sizeof(T));
+}
+
+template< typename T, typename Total, bool Lbu >
+void Sum(benchmark::State& state)
+{
+    const auto v = random_values<T>(size_t(state.range(0)), 1u << 30);
+    const lbu::array_ref<const T> a(v.data(), v.size());
+    for( auto _ : state ) {
+        if constexpr( Lbu )
+            benchmark::DoNotOptimize(lbu::array_algorithm::sum(a));
+        else
+            benchmark::DoNotOptimize(std::accumulate(a.begin(), a.end(), Total(0)));
+    }
+    report(state, v.size(), sizeof(T));
+}
+
+template< bool Lbu >
+void Mismatch(benchmark::State& state)
+{
+    const auto v = random_values<uint8_t>(size_t(state.range(0)), 256);
+    const auto w = v;
+    const lbu::array_ref<const uint8_t> a(v.data(), v.size());
+    const lbu::array_ref<const uint8_t> b(w.data(), w.size());
+    for( auto _ : state ) {
+        if constexpr( Lbu ) {
+            benchmark::DoNotOptimize(lbu::array_algorithm::mismatch(a, b));
+        } else {
+            auto r = std::mismatch(a.begin(), a.end(), b.begin());
+            benchmark::DoNotOptimize(r);
+        }
+    }
+    report(state, v.size(), 1);
+}
+
+template< typename T, bool Lbu >
+void ByteSwap(benchmark::State& state)
+{
+    auto v = random_values<T>(size_t(state.range(0)), ~uint64_t(0));
+    lbu::array_ref<T> a(v.data(), v.size());
+    for( auto _ : state ) {
+        if constexpr( Lbu ) {
+            lbu::array_algorithm::byte_swap(a);
+        } else {
+            for( auto& e : a )
+                e = lbu::from_big_endian<T>(&e);
+        }
+        benchmark::ClobberMemory();
+    }
+    report(state, v.size(), sizeof(T));
+}
+
+template< typename T, bool Lbu >
+void Fill(benchmark::State& state)
+{
+    std::vector<T> v(size_t(state.range(0)));
+    lbu::array_ref<T> a(v.data(), v.size());
+    T x = 0;
+    for( auto _ : state ) {
+        if constexpr( Lbu )
+            lbu::array_algorithm::fill(a, ++x);
+        else
+            std::fill(a.begin(), a.end(), ++x);
+        benchmark::ClobberMemory();
+    }
+    report(state, v.size(), sizeof(T));
+}
+
+template< typename T, bool Lbu >
+void PrefixSum(benchmark::State& state)
+{
+    auto v = random_values<T>(size_t(state.range(0)), 1000);
+    lbu::array_ref<T> a(v.data(), v.size());
+    for( auto _ : state ) {
+        if constexpr( Lbu )
+            lbu::array_algorithm::prefix_sum(a);
+        else
+            std::partial_sum(a.begin(), a.end(), a.begin());
+        benchmark::ClobberMemory();
+    }
+    report(state, v.size(), sizeof(T));
+}
+
+void apply_sizes(benchmark::internal::Benchmark* b)
+{
+    for( long s : s_sizes )
+        b->Arg(s);
+}
+
+template< void (*Lbu)(benchmark::State&), void (*Std)(benchmark::State&) >
+void register_pair(const std::string& name)
+{
+    benchmark::RegisterBenchmark((name + "/lbu").c_str(), Lbu)->Apply(apply_sizes);
+    benchmark::RegisterBenchmark((name + "/std").c_str(), Std)->Apply(apply_sizes);
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    bench::options opt(&argc, argv);
+    s_sizes = opt.list("size", {64, 4096, 262144});
+
+    register_pair<&Find<uint8_t, true>, &Find<uint8_t, false>>("Find<uint8_t>");
+    register_pair<&Find<uint16_t, true>, &Find<uint16_t, false>>("Find<uint16_t>");
+    register_pair<&Find<uint32_t, true>, &Find<uint32_t, false>>("Find<uint32_t>");
+    register_pair<&Find<uint64_t, true>, &Find<uint64_t, false>>("Find<uint64_t>");
+    register_pair<&Count<uint8_t, true>, &Count<uint8_t, false>>("Count<uint8_t>");
+    register_pair<&Count<uint32_t, true>, &Count<uint32_t, false>>("Count<uint32_t>");
+    register_pair<&MinMax<uint8_t, true>, &MinMax<uint8_t, false>>("MinMax<uint8_t>");
+    register_pair<&MinMax<int16_t, true>, &MinMax<int16_t, false>>("MinMax<int16_t>");
+    register_pair<&MinMax<int32_t, true>, &MinMax<int32_t, false>>("MinMax<int32_t>");
+    register_pair<&MinMax<float, true>, &MinMax<float, false>>("MinMax<float>");
+    register_pair<&Sum<uint8_t, uint64_t, true>, &Sum<uint8_t, uint64_t, false>>("Sum<uint8_t>");
+    register_pair<&Sum<int16_t, int64_t, true>, &Sum<int16_t, int64_t, false>>("Sum<int16_t>");
+    register_pair<&Sum<int32_t, int64_t, true>, &Sum<int32_t, int64_t, false>>("Sum<int32_t>");
+    register_pair<&Mismatch<true>, &Mismatch<false>>("Mismatch");
+    register_pair<&ByteSwap<uint16_t, true>, &ByteSwap<uint16_t, false>>("ByteSwap<uint16_t>");
+    register_pair<&ByteSwap<uint32_t, true>, &ByteSwap<uint32_t, false>>("ByteSwap<uint32_t>");
+    register_pair<&ByteSwap<uint64_t, true>, &ByteSwap<uint64_t, false>>("ByteSwap<uint64_t>");
+    register_pair<&Fill<uint32_t, true>, &Fill<uint32_t, false>>("Fill<uint32_t>");
+    register_pair<&PrefixSum<uint32_t, true>, &PrefixSum<uint32_t, false>>("PrefixSum<uint32_t>");
+    register_pair<&PrefixSum<uint64_t, true>, &PrefixSum<uint64_t, false>>("PrefixSum<uint64_t>");
+
+    benchmark::Initialize(&argc, argv);
+    if( benchmark::ReportUnrecognizedArguments(argc, argv) )
+        return 1;
+    benchmark::AddCustomContext("lbu_kernels", lbu::array_algorithm::kernel_set_name());
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
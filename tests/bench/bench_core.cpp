@@ -0,0 +1,435 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// Microbenchmarks of the basic (non-io) building blocks.
+//
+//   --lbu_size  element counts resp. byte sizes of the bulk benchmarks (comma separated)
+//
+// All other options are handled by google benchmark (--benchmark_filter, --benchmark_format=json, ...).
+
+#include "bench_util.h"
+
+#include <random>
+
+#include "lbu/ascii.h"
+#include "lbu/byte_buffer_stream.h"
+#include "lbu/byte_buffer.h"
+#include "lbu/endian.h"
+#include "lbu/int_codec.h"
+#include "lbu/serialize.h"
+#include "lbu/varint.h"
+
+namespace {
+
+std::vector<long> s_sizes;
+
+template< typename T >
+std::vector<T> random_values(size_t count, T max = std::numeric_limits<T>::max())
+{
+    std::mt19937_64 gen(42);
+    std::uniform_int_distribution<uint64_t> dist(0, uint64_t(max));
+    std::vector<T> v(count);
+    for( auto& e : v )
+        e = T(dist(gen));
+    return v;
+}
+
+
+// byte_buffer
+
+void ByteBufferAppendSmall(benchmark::State& state)
+{
+    const auto count = size_t(state.range(0));
+    const char data[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    bench::perf_cache_misses misses;
+
+    for( auto _ : state ) {
+        lbu::byte_buffer b;
+        for( size_t i = 0; i < count; ++i )
+            b.append(lbu::array_ref<const char>(data, sizeof(data)));
+        benchmark::DoNotOptimize(b.data());
+    }
+
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(count * sizeof(data)));
+    bench::report_ops(state, double(count));
+    misses.report(state, double(count) * double(state.iterations()));
+}
+
+void ByteBufferAppendCommit(benchmark::State& state)
+{
+    const auto count = size_t(state.range(0));
+    bench::perf_cache_misses misses;
+
+    for( auto _ : state ) {
+        lbu::byte_buffer b;
+        for( size_t i = 0; i < count; ++i ) {
+            if( b.capacity() - b.size() < sizeof(uint64_t) )
+                b.auto_grow_reserve();
+            auto a = b.append_begin();
+            lbu::to_little_endian<uint64_t>(i, a.data());
+            b.append_commit(sizeof(uint64_t));
+        }
+        benchmark::DoNotOptimize(b.data());
+    }
+
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(count * sizeof(uint64_t)));
+    bench::report_ops(state, double(count));
+    misses.report(state, double(count) * double(state.iterations()));
+}
+
+void ByteBufferCopy(benchmark::State& state)
+{
+    const auto size = size_t(state.range(0));
+    lbu::byte_buffer src;
+    src.append(size, 'x');
+
+    for( auto _ : state ) {
+        lbu::byte_buffer b(src);
+        benchmark::DoNotOptimize(b.data());
+    }
+
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(size));
+}
+
+
+// ascii
+
+void AsciiToDecimal(benchmark::State& state)
+{
+    const auto values = random_values<uint64_t>(size_t(state.range(0)));
+    bench::perf_cache_misses misses;
+
+    for( auto _ : state ) {
+        size_t sum = 0;
+        for( auto v : values )
+            sum += lbu::ascii::integer::decimal<uint64_t>(v).ref().size();
+        benchmark::DoNotOptimize(sum);
+    }
+
+    bench::report_ops(state, double(values.size()));
+    misses.report(state, double(values.size()) * double(state.iterations()));
+}
+
+void AsciiFromDecimal(benchmark::State& state)
+{
+    const auto values = random_values<int64_t>(size_t(state.range(0)));
+    std::vector<lbu::ascii::integer::decimal<int64_t>> strings(values.begin(), values.end());
+    bench::perf_cache_misses misses;
+
+    for( auto _ : state ) {
+        int64_t sum = 0;
+        for( const auto& s : strings ) {
+            int64_t v = 0;
+            lbu::ascii::integer::from_decimal(s.data(), &v);
+            sum += v;
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+
+    bench::report_ops(state, double(strings.size()));
+    misses.report(state, double(strings.size()) * double(state.iterations()));
+}
+
+
+// endian
+
+template< typename T >
+void EndianToBig(benchmark::State& state)
+{
+    const auto values = random_values<T>(size_t(state.range(0)));
+    std::vector<char> out(values.size() * sizeof(T));
+    bench::perf_cache_misses misses;
+
+    for( auto _ : state ) {
+        char* p = out.data();
+        for( auto v : values ) {
+            lbu::to_big_endian<T>(v, p);
+            p += sizeof(T);
+        }
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(out.size()));
+    bench::report_ops(state, double(values.size()));
+    misses.report(state, double(values.size()) * double(state.iterations()));
+}
+
+template< typename T >
+void EndianFromBig(benchmark::State& state)
+{
+    const auto values = random_values<T>(size_t(state.range(0)));
+    std::vector<char> in(values.size() * sizeof(T));
+    std::memcpy(in.data(), values.data(), in.size());
+    bench::perf_cache_misses misses;
+
+    for( auto _ : state ) {
+        T sum = 0;
+        for( const char* p = in.data(); p != in.data() + in.size(); p += sizeof(T) )
+            sum += lbu::from_big_endian<T>(p);
+        benchmark::DoNotOptimize(sum);
+    }
+
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(in.size()));
+    bench::report_ops(state, double(values.size()));
+    misses.report(state, double(values.size()) * double(state.iterations()));
+}
+
+void EndianFromLittleU24(benchmark::State& state)
+{
+    const auto count = size_t(state.range(0));
+    const auto values = random_values<uint32_t>(count, (1u << 24) - 1);
+    std::vector<char> in(count * 3 + 1);
+    for( size_t i = 0; i < count; ++i )
+        lbu::to_little_endian_u24_packed(values[i], in.data() + 3 * i);
+
+    for( auto _ : state ) {
+        uint32_t sum = 0;
+        for( size_t i = 0; i < count; ++i )
+            sum += lbu::from_little_endian_u24_packed(in.data() + 3 * i);
+        benchmark::DoNotOptimize(sum);
+    }
+
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(count * 3));
+    bench::report_ops(state, double(count));
+}
+
+// serialize
+
+struct wire_record {
+    uint64_t timestamp;
+    uint32_t id;
+    uint16_t flags;
+    uint16_t channel;
+    std::array<float, 4> values;
+};
+
+}
+
+template<> struct lbu::serialize::fields<wire_record>
+    : lbu::serialize::field_list<lbu::serialize::fixed<&wire_record::timestamp>,
+                                 lbu::serialize::fixed<&wire_record::id>,
+                                 lbu::serialize::fixed<&wire_record::flags>,
+                                 lbu::serialize::fixed<&wire_record::channel>,
+                                 lbu::serialize::fixed<&wire_record::values>> {};
+
+namespace {
+
+std::vector<wire_record> random_records(size_t count)
+{
+    const auto v = random_values<uint64_t>(count);
+    std::vector<wire_record> records(count);
+    for( size_t i = 0; i < count; ++i )
+        records[i] = {v[i], uint32_t(v[i]), uint16_t(i), uint16_t(v[i] >> 16), {1.f, 2.f, float(i), -1.f}};
+    return records;
+}
+
+// baseline for the serializer, the in-memory layout is the wire layout here
+void RecordMemcpy(benchmark::State& state)
+{
+    const auto records = random_records(size_t(state.range(0)));
+    std::vector<char> out(records.size() * sizeof(wire_record));
+
+    for( auto _ : state ) {
+        std::memcpy(out.data(), records.data(), out.size());
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(out.size()));
+    bench::report_ops(state, double(records.size()));
+}
+
+void SerializeEncode(benchmark::State& state)
+{
+    const auto records = random_records(size_t(state.range(0)));
+    std::vector<char> out(records.size() * lbu::serialize::encoded_size_bound(records.front()));
+
+    for( auto _ : state ) {
+        char* p = out.data();
+        for( const auto& r : records )
+            p = lbu::serialize::encode(r, p);
+        benchmark::DoNotOptimize(p);
+        benchmark::ClobberMemory();
+    }
+
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(out.size()));
+    bench::report_ops(state, double(records.size()));
+}
+
+void SerializeDecode(benchmark::State& state)
+{
+    auto records = random_records(size_t(state.range(0)));
+    std::vector<char> in(records.size() * lbu::serialize::encoded_size_bound(records.front()));
+    char* end = in.data();
+    for( const auto& r : records )
+        end = lbu::serialize::encode(r, end);
+
+    for( auto _ : state ) {
+        const char* p = in.data();
+        for( auto& r : records )
+            p = lbu::serialize::decode(&r, p, end);
+        benchmark::DoNotOptimize(p);
+        benchmark::ClobberMemory();
+    }
+
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(in.size()));
+    bench::report_ops(state, double(records.size()));
+}
+
+void SerializeStreamWrite(benchmark::State& state)
+{
+    const auto records = random_records(size_t(state.range(0)));
+    lbu::stream::byte_buffer_output_stream out;
+
+    for( auto _ : state ) {
+        out.reset({});
+        for( const auto& r : records )
+            lbu::serialize::write(&out, r);
+        out.flush_buffer();
+        benchmark::DoNotOptimize(&out);
+    }
+
+    bench::report_ops(state, double(records.size()));
+}
+
+
+// varint
+
+// values of mixed encoded length, like the deltas of posting lists or timestamps
+std::vector<uint32_t> mixed_length_values(size_t count)
+{
+    auto v = random_values<uint32_t>(count);
+    for( auto& e : v )
+        e >>= 8 * (e % 4);
+    return v;
+}
+
+void VarintDecode(benchmark::State& state)
+{
+    const auto values = mixed_length_values(size_t(state.range(0)));
+    std::vector<char> in(values.size() * lbu::varint::max_bytes<uint32_t>());
+    char* end = in.data();
+    for( auto v : values )
+        end = lbu::varint::encode(v, end);
+    std::vector<uint32_t> out(values.size());
+
+    for( auto _ : state ) {
+        const char* p = in.data();
+        for( auto& v : out )
+            p = lbu::varint::decode(p, end, &v);
+        benchmark::DoNotOptimize(p);
+        benchmark::ClobberMemory();
+    }
+
+    bench::report_ops(state, double(values.size()));
+}
+
+template< size_t (*Encode)(lbu::array_ref<const uint32_t>, char*),
+          const char* (*Decode)(const char*, const char*, lbu::array_ref<uint32_t>) >
+void BulkVarintDecode(benchmark::State& state)
+{
+    const auto values = mixed_length_values(size_t(state.range(0)));
+    std::vector<char> in(lbu::varint::group::encoded_size_bound(values.size()));
+    const size_t size = Encode({values.data(), values.size()}, in.data());
+    std::vector<uint32_t> out(values.size());
+
+    for( auto _ : state ) {
+        const char* p = Decode(in.data(), in.data() + size, {out.data(), out.size()});
+        benchmark::DoNotOptimize(p);
+        benchmark::ClobberMemory();
+    }
+
+    bench::report_ops(state, double(values.size()));
+}
+
+
+// int_codec
+
+template< unsigned Bits >
+void BitUnpack(benchmark::State& state)
+{
+    const auto values = random_values<uint32_t>(size_t(state.range(0)), uint32_t((uint64_t(1) << Bits) - 1));
+    std::vector<char> in(lbu::int_codec::packed_size(values.size(), Bits));
+    lbu::int_codec::pack({values.data(), values.size()}, Bits, in.data());
+    std::vector<uint32_t> out(values.size());
+
+    for( auto _ : state ) {
+        lbu::int_codec::unpack(in.data(), Bits, {out.data(), out.size()});
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+
+    bench::report_ops(state, double(values.size()));
+}
+
+void TimestampDecode(benchmark::State& state)
+{
+    const auto jitter = random_values<uint64_t>(size_t(state.range(0)), 1000);
+    std::vector<uint64_t> values(jitter.size());
+    for( size_t i = 0; i < values.size(); ++i )
+        values[i] = 1700000000000000000 + i * 1000000 + jitter[i];
+    std::vector<char> in(lbu::int_codec::encoded_size_bound<uint64_t>(values.size()));
+    const size_t size = lbu::int_codec::encode({values.data(), values.size()},
+                                               lbu::int_codec::Transform::DeltaOfDelta, in.data());
+    std::vector<uint64_t> out(values.size());
+
+    for( auto _ : state ) {
+        const char* p = lbu::int_codec::decode(in.data(), in.data() + size, {out.data(), out.size()});
+        benchmark::DoNotOptimize(p);
+        benchmark::ClobberMemory();
+    }
+
+    state.counters["bytes/value"] = double(size) / double(values.size());
+    bench::report_ops(state, double(values.size()));
+}
+
+void apply_sizes(benchmark::internal::Benchmark* b)
+{
+    for( long s : s_sizes )
+        b->Arg(s);
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    bench::options opt(&argc, argv);
+    s_sizes = opt.list("size", {16, 1024, 65536});
+
+    benchmark::RegisterBenchmark("ByteBufferAppendSmall", &ByteBufferAppendSmall)->Apply(apply_sizes);
+    benchmark::RegisterBenchmark("ByteBufferAppendCommit", &ByteBufferAppendCommit)->Apply(apply_sizes);
+    benchmark::RegisterBenchmark("ByteBufferCopy", &ByteBufferCopy)->Apply(apply_sizes);
+    benchmark::RegisterBenchmark("AsciiToDecimal", &AsciiToDecimal)->Apply(apply_sizes);
+    benchmark::RegisterBenchmark("AsciiFromDecimal", &AsciiFromDecimal)->Apply(apply_sizes);
+    benchmark::RegisterBenchmark("EndianToBig<uint16_t>", &EndianToBig<uint16_t>)->Apply(apply_sizes);
+    benchmark::RegisterBenchmark("EndianToBig<uint32_t>", &EndianToBig<uint32_t>)->Apply(apply_sizes);
+    benchmark::RegisterBenchmark("EndianToBig<uint64_t>", &EndianToBig<uint64_t>)->Apply(apply_sizes);
+    benchmark::RegisterBenchmark("EndianFromBig<uint16_t>", &EndianFromBig<uint16_t>)->Apply(apply_sizes);
+    benchmark::RegisterBenchmark("EndianFromBig<uint32_t>", &EndianFromBig<uint32_t>)->Apply(apply_sizes);
+    benchmark::RegisterBenchmark("EndianFromBig<uint64_t>", &EndianFromBig<uint64_t>)->Apply(apply_sizes);
+    benchmark::RegisterBenchmark("EndianFromLittleU24", &EndianFromLittleU24)->Apply(apply_sizes);
+    benchmark::RegisterBenchmark("RecordMemcpy", &RecordMemcpy)->Apply(apply_sizes);
+    benchmark::RegisterBenchmark("SerializeEncode", &SerializeEncode)->Apply(apply_sizes);
+    benchmark::RegisterBenchmark("SerializeDecode", &SerializeDecode)->Apply(apply_sizes);
+    benchmark::RegisterBenchmark("SerializeStreamWrite", &SerializeStreamWrite)->Apply(apply_sizes);
+    benchmark::RegisterBenchmark("VarintDecode", &VarintDecode)->Apply(apply_sizes);
+    benchmark::RegisterBenchmark("GroupVarintDecode",
+                                 &BulkVarintDecode<lbu::varint::group::encode, lbu::varint::group::decode>)
+            ->Apply(apply_sizes);
+    benchmark::RegisterBenchmark("StreamVbyteDecode",
+                                 &BulkVarintDecode<lbu::varint::stream_vbyte::encode, lbu::varint::stream_vbyte::decode>)
+            ->Apply(apply_sizes);
+    benchmark::RegisterBenchmark("BitUnpack<5>", &BitUnpack<5>)->Apply(apply_sizes);
+    benchmark::RegisterBenchmark("BitUnpack<13>", &BitUnpack<13>)->Apply(apply_sizes);
+    benchmark::RegisterBenchmark("BitUnpack<32>", &BitUnpack<32>)->Apply(apply_sizes);
+    benchmark::RegisterBenchmark("TimestampDecode", &TimestampDecode)->Apply(apply_sizes);
+
+    benchmark::Initialize(&argc, argv);
+    if( benchmark::ReportUnrecognizedArguments(argc, argv) )
+        return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,190 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// flat_hash_map against std::unordered_map, plus the raw hash throughput.
+//
+//   --lbu_size  element counts of the map benchmarks resp. byte sizes of the hash benchmark (comma separated)
+//
+// All other options are handled by google benchmark (--benchmark_filter, --benchmark_format=json, ...).
+
+#include "bench_util.h"
+
+#include <random>
+#include <string>
+#include <unordered_map>
+
+#include "lbu/flat_hash_map.h"
+#include "lbu/hash.h"
+
+namespace {
+
+std::vector<long> s_sizes;
+
+template< typename Key >
+std::vector<Key> random_keys(size_t count, uint64_t seed);
+
+template<>
+std::vector<uint64_t> random_keys<uint64_t>(size_t count, uint64_t seed)
+{
+    std::mt19937_64 gen(seed);
+    std::vector<uint64_t> v(count);
+    for( auto& e : v )
+        e = gen();
+    return v;
+}
+
+// connection table like keys, e.g. "10.12.7.201:41234"
+template<>
+std::vector<std::string> random_keys<std::string>(size_t count, uint64_t seed)
+{
+    std::mt19937_64 gen(seed);
+    std::vector<std::string> v(count);
+    for( auto& e : v ) {
+        const auto r = gen();
+        e = "10." + std::to_string(r & 0xff) + '.' + std::to_string((r >> 8) & 0xff) + '.'
+            + std::to_string((r >> 16) & 0xff) + ':' + std::to_string((r >> 24) & 0xffff);
+    }
+    return v;
+}
+
+template< typename Key >
+using lbu_map = lbu::flat_hash_map<Key, uint64_t>;
+
+template< typename Key >
+using std_map = std::unordered_map<Key, uint64_t>;
+
+
+template< typename Map >
+void Insert(benchmark::State& state)
+{
+    const auto keys = random_keys<typename Map::key_type>(size_t(state.range(0)), 1);
+    bench::perf_cache_misses misses;
+
+    for( auto _ : state ) {
+        Map m;
+        for( const auto& k : keys )
+            m[k] = 1;
+        benchmark::DoNotOptimize(&m);
+    }
+
+    bench::report_ops(state, double(keys.size()));
+    misses.report(state, double(keys.size()) * double(state.iterations()));
+}
+
+template< typename Map >
+void FindHit(benchmark::State& state)
+{
+    const auto keys = random_keys<typename Map::key_type>(size_t(state.range(0)), 1);
+    Map m;
+    for( const auto& k : keys )
+        m[k] = 1;
+    bench::perf_cache_misses misses;
+
+    for( auto _ : state ) {
+        uint64_t sum = 0;
+        for( const auto& k : keys )
+            sum += m.find(k)->second;
+        benchmark::DoNotOptimize(sum);
+    }
+
+    bench::report_ops(state, double(keys.size()));
+    misses.report(state, double(keys.size()) * double(state.iterations()));
+}
+
+template< typename Map >
+void FindMiss(benchmark::State& state)
+{
+    const auto keys = random_keys<typename Map::key_type>(size_t(state.range(0)), 1);
+    const auto other = random_keys<typename Map::key_type>(keys.size(), 2);
+    Map m;
+    for( const auto& k : keys )
+        m[k] = 1;
+
+    for( auto _ : state ) {
+        size_t found = 0;
+        for( const auto& k : other )
+            found += m.find(k) != m.end() ? 1 : 0;
+        benchmark::DoNotOptimize(found);
+    }
+
+    bench::report_ops(state, double(keys.size()));
+}
+
+// steady state of a connection table: every new entry replaces an old one
+template< typename Map >
+void Churn(benchmark::State& state)
+{
+    const auto keys = random_keys<typename Map::key_type>(size_t(state.range(0)) * 2, 1);
+    const size_t half = keys.size() / 2;
+    Map m;
+    for( size_t i = 0; i < half; ++i )
+        m[keys[i]] = 1;
+
+    size_t i = 0;
+    for( auto _ : state ) {
+        for( size_t n = 0; n < half; ++n ) {
+            m.erase(keys[i]);
+            m[keys[(i + half) % keys.size()]] = 1;
+            i = (i + 1) % keys.size();
+        }
+    }
+
+    bench::report_ops(state, double(half));
+}
+
+void HashBytes(benchmark::State& state)
+{
+    const std::string data(size_t(state.range(0)), 'x');
+    for( auto _ : state )
+        benchmark::DoNotOptimize(lbu::hash::hash_bytes(data.data(), data.size()));
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(data.size()));
+}
+
+void StdHashBytes(benchmark::State& state)
+{
+    const std::string data(size_t(state.range(0)), 'x');
+    for( auto _ : state )
+        benchmark::DoNotOptimize(std::hash<std::string_view>()(data));
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(data.size()));
+}
+
+void apply_sizes(benchmark::internal::Benchmark* b)
+{
+    for( long s : s_sizes )
+        b->Arg(s);
+}
+
+template< typename Key >
+void register_maps(const char* key_name)
+{
+    const std::string k = key_name;
+    benchmark::RegisterBenchmark(("Insert<flat_hash_map," + k + ">").c_str(), &Insert<lbu_map<Key>>)->Apply(apply_sizes);
+    benchmark::RegisterBenchmark(("Insert<unordered_map," + k + ">").c_str(), &Insert<std_map<Key>>)->Apply(apply_sizes);
+    benchmark::RegisterBenchmark(("FindHit<flat_hash_map," + k + ">").c_str(), &FindHit<lbu_map<Key>>)->Apply(apply_sizes);
+    benchmark::RegisterBenchmark(("FindHit<unordered_map," + k + ">").c_str(), &FindHit<std_map<Key>>)->Apply(apply_sizes);
+    benchmark::RegisterBenchmark(("FindMiss<flat_hash_map," + k + ">").c_str(), &FindMiss<lbu_map<Key>>)->Apply(apply_sizes);
+    benchmark::RegisterBenchmark(("FindMiss<unordered_map," + k + ">").c_str(), &FindMiss<std_map<Key>>)->Apply(apply_sizes);
+    benchmark::RegisterBenchmark(("Churn<flat_hash_map," + k + ">").c_str(), &Churn<lbu_map<Key>>)->Apply(apply_sizes);
+    benchmark::RegisterBenchmark(("Churn<unordered_map," + k + ">").c_str(), &Churn<std_map<Key>>)->Apply(apply_sizes);
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    bench::options opt(&argc, argv);
+    s_sizes = opt.list("size", {16, 1024, 65536, 1048576});
+
+    register_maps<uint64_t>("uint64_t");
+    register_maps<std::string>("string");
+    benchmark::RegisterBenchmark("HashBytes", &HashBytes)->Apply(apply_sizes);
+    benchmark::RegisterBenchmark("StdHashBytes", &StdHashBytes)->Apply(apply_sizes);
+
+    benchmark::Initialize(&argc, argv);
+    if( benchmark::ReportUnrecognizedArguments(argc, argv) )
+        return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,322 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// Request/response (ping-pong) latency of different thread to thread signalling mechanisms.
+//
+// Every benchmark iteration is one round trip of an 8 byte message. Reported are the round
+// trip time and the one-way (client -> server) latency distributions as p50/p99/p99.9/max
+// counters, for each of the cpu placements (same cpu, SMT siblings, different cores and
+// different sockets). Placements the machine does not provide are skipped.
+//
+//   --lbu_ring  ring buffer sizes in bytes for the ring based links (default 4096)
+//
+// All other options are handled by google benchmark (--benchmark_filter, --benchmark_format=json, ...).
+
+#include "bench_util.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#include <pthread.h>
+#include <sys/socket.h>
+#include <time.h>
+
+#include "lbu/eventfd.h"
+#include "lbu/io.h"
+#include "lbu/pipe.h"
+#include "lbu/ring_spsc.h"
+#include "lbu/ring_spsc_stream.h"
+
+namespace {
+
+constexpr uint64_t StopMessage = 1; // never a valid timestamp
+
+uint32_t s_ring_byte_size = 4096;
+
+inline uint64_t now_ns()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000u + uint64_t(ts.tv_nsec);
+}
+
+inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+// Spin for a while, then start yielding so a shared cpu still makes progress
+class spin_wait {
+public:
+    void operator()()
+    {
+        if( ++count < 1024 )
+            cpu_relax();
+        else
+            std::this_thread::yield();
+    }
+
+private:
+    unsigned count = 0;
+};
+
+
+// One-directional links transporting uint64_t messages. All of them block in recv.
+
+struct fd_link {
+    lbu::unique_fd r;
+    lbu::unique_fd w;
+
+    bool send(uint64_t v)
+    {
+        return lbu::io::write_all(w.get(), lbu::array_ref_one_element(&v)) == lbu::io::WriteNoError;
+    }
+    bool recv(uint64_t* v)
+    {
+        return lbu::io::read_all(r.get(), lbu::array_ref_one_element(v)) == lbu::io::ReadNoError;
+    }
+};
+
+struct pipe_link : fd_link {
+    pipe_link()
+    {
+        auto p = lbu::pipe::open(lbu::pipe::FlagsCloExec);
+        r = std::move(p.read_fd);
+        w = std::move(p.write_fd);
+    }
+};
+
+struct socketpair_link : fd_link {
+    socketpair_link()
+    {
+        int fds[2];
+        if( ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == 0 ) {
+            w.reset(lbu::fd(fds[0]));
+            r.reset(lbu::fd(fds[1]));
+        }
+    }
+};
+
+// The message is the eventfd counter value itself
+struct eventfd_link {
+    lbu::unique_fd f = lbu::event_fd::create(0, lbu::event_fd::FlagsCloExec);
+
+    bool send(uint64_t v) { return lbu::event_fd::write(f.get(), v) == lbu::event_fd::WriteNoError; }
+    bool recv(uint64_t* v) { return lbu::event_fd::read(f.get(), v) == lbu::event_fd::ReadNoError; }
+};
+
+// ring_spsc streams, i.e. the library's eventfd based wake up protocol
+struct ring_stream_link {
+    lbu::stream::ring_spsc_basic_controller controller{s_ring_byte_size};
+    lbu::stream::ring_spsc::output_stream out;
+    lbu::stream::ring_spsc::input_stream in;
+
+    ring_stream_link()
+    {
+        controller.pair_streams(&out, &in, std::min(s_ring_byte_size / 2,
+                                                    lbu::stream::ring_spsc::DefaultRingSegmentLimit));
+    }
+
+    bool send(uint64_t v)
+    {
+        return out.write(&v, sizeof(v), lbu::stream::Mode::Blocking) == sizeof(v) && out.flush_buffer();
+    }
+    bool recv(uint64_t* v)
+    {
+        return in.read(v, sizeof(*v), lbu::stream::Mode::Blocking) == sizeof(*v);
+    }
+};
+
+using u64_ring = lbu::ring_spsc::handle<uint64_t>;
+
+struct raw_ring_base {
+    std::vector<uint64_t> buffer = std::vector<uint64_t>(std::max<size_t>(2, s_ring_byte_size / sizeof(uint64_t)));
+    std::atomic<size_t> producer_index{0};
+    std::atomic<size_t> consumer_index{0};
+    u64_ring::producer producer;
+    u64_ring::consumer consumer;
+
+    raw_ring_base()
+    {
+        u64_ring::pair_producer_consumer({buffer.data(), buffer.size()},
+                                         &producer, &producer_index,
+                                         &consumer, &consumer_index);
+    }
+
+    // the rings never fill up in a ping-pong, so the producer does not need to wait
+    void push(uint64_t v)
+    {
+        while( producer.update_available() == 0 )
+            std::this_thread::yield();
+        producer.continuous_range()[0] = v;
+        producer.publish(1);
+    }
+
+    uint64_t pop()
+    {
+        const auto v = consumer.continuous_range()[0];
+        consumer.release(1);
+        return v;
+    }
+};
+
+struct ring_spin_link : raw_ring_base {
+    bool send(uint64_t v)
+    {
+        push(v);
+        return true;
+    }
+    bool recv(uint64_t* v)
+    {
+        spin_wait w;
+        while( consumer.update_available() == 0 )
+            w();
+        *v = pop();
+        return true;
+    }
+};
+
+struct ring_eventfd_link : raw_ring_base {
+    lbu::unique_fd f = lbu::event_fd::create(0, lbu::event_fd::FlagsCloExec);
+
+    bool send(uint64_t v)
+    {
+        push(v);
+        return lbu::event_fd::write(f.get(), 1) == lbu::event_fd::WriteNoError;
+    }
+    bool recv(uint64_t* v)
+    {
+        while( consumer.update_available() == 0 ) {
+            eventfd_t tmp;
+            if( lbu::event_fd::read(f.get(), &tmp) != lbu::event_fd::ReadNoError )
+                return false;
+        }
+        *v = pop();
+        return true;
+    }
+};
+
+struct ring_condvar_link : raw_ring_base {
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+
+    ~ring_condvar_link()
+    {
+        pthread_cond_destroy(&cond);
+        pthread_mutex_destroy(&mutex);
+    }
+
+    bool send(uint64_t v)
+    {
+        push(v);
+        pthread_mutex_lock(&mutex);
+        pthread_cond_signal(&cond);
+        pthread_mutex_unlock(&mutex);
+        return true;
+    }
+    bool recv(uint64_t* v)
+    {
+        if( consumer.update_available() == 0 ) {
+            pthread_mutex_lock(&mutex);
+            while( consumer.update_available() == 0 )
+                pthread_cond_wait(&cond, &mutex);
+            pthread_mutex_unlock(&mutex);
+        }
+        *v = pop();
+        return true;
+    }
+};
+
+
+template< typename Link >
+void PingPong(benchmark::State& state, bench::Placement placement)
+{
+    const auto cpus = bench::find_cpu_pair(placement);
+    if( cpus.first < 0 ) {
+        state.SkipWithError("placement not available on this machine");
+        return;
+    }
+
+    auto request = std::make_unique<Link>();
+    auto response = std::make_unique<Link>();
+    bench::latency_samples one_way;
+    bench::latency_samples round_trip;
+    bool server_ok = true;
+
+    std::thread server([&]() {
+        bench::pin_current_thread(cpus.second);
+        uint64_t v = 0;
+        while( true ) {
+            if( ! request->recv(&v) ) {
+                server_ok = false;
+                return;
+            }
+            if( v == StopMessage )
+                return;
+            one_way.add(now_ns() - v);
+            if( ! response->send(v) ) {
+                server_ok = false;
+                return;
+            }
+        }
+    });
+    bench::pin_current_thread(cpus.first);
+
+    bool ok = true;
+    for( auto _ : state ) {
+        const uint64_t t0 = now_ns();
+        uint64_t v = 0;
+        if( ! request->send(t0) || ! response->recv(&v) || v != t0 ) {
+            ok = false;
+            break;
+        }
+        round_trip.add(now_ns() - t0);
+    }
+
+    request->send(StopMessage);
+    server.join();
+
+    if( ! ok || ! server_ok ) {
+        state.SkipWithError("message transfer failed");
+        return;
+    }
+    round_trip.report(state, "rtt");
+    one_way.report(state, "one_way");
+}
+
+template< typename Link >
+void register_link(const char* name)
+{
+    for( auto p : { bench::Placement::SameCpu, bench::Placement::SmtSibling,
+                    bench::Placement::CrossCore, bench::Placement::CrossSocket } ) {
+        const std::string n = std::string(name) + "/" + bench::placement_name(p);
+        benchmark::RegisterBenchmark(n.c_str(), &PingPong<Link>, p)->UseRealTime();
+    }
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    bench::options opt(&argc, argv);
+    s_ring_byte_size = uint32_t(opt.value("ring", 4096));
+
+    register_link<ring_stream_link>("RingStream");
+    register_link<ring_spin_link>("RingSpin");
+    register_link<ring_eventfd_link>("RingEventFd");
+    register_link<ring_condvar_link>("RingCondVar");
+    register_link<pipe_link>("Pipe");
+    register_link<socketpair_link>("SocketPair");
+    register_link<eventfd_link>("EventFd");
+
+    benchmark::Initialize(&argc, argv);
+    if( benchmark::ReportUnrecognizedArguments(argc, argv) )
+        return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,167 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// lbu/math_array.h kernels against a loop over the scalar lbu/math.h function
+// (or the plain operator). The kernel set in use is reported as "lbu_kernels" in
+// the benchmark context.
+//
+//   --lbu_size  element counts (comma separated)
+//
+// All other options are handled by google benchmark (--benchmark_filter, --benchmark_format=json, ...).
+
+#include "bench_util.h"
+
+#include <random>
+
+#include "lbu/math_array.h"
+
+namespace {
+
+std::vector<long> s_sizes;
+
+// odd values of all magnitudes, with the top bit clear
+template< typename T >
+std::vector<T> random_values(size_t count)
+{
+    using U = std::make_unsigned_t<T>;
+    std::mt19937_64 gen(1);
+    std::vector<T> v(count);
+    for( auto& e : v )
+        e = T(U(U(gen()) >> (1 + gen() % (8 * sizeof(T) - 1))) | 1u);
+    return v;
+}
+
+void report(benchmark::State& state, size_t count, size_t element_size)
+{
+    state.SetItemsProcessed(int64_t(state.iterations()) * int64_t(count));
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(count * element_size));
+}
+
+// runs dst = f(src) either as one array call or element by element
+template< typename T, typename U, typename ArrayOp, typename ScalarOp >
+void run(benchmark::State& state, bool array, ArrayOp array_op, ScalarOp scalar_op)
+{
+    const auto src = random_values<T>(size_t(state.range(0)));
+    std::vector<U> dst(src.size());
+    const lbu::array_ref<const T> s(src.data(), src.size());
+    lbu::array_ref<U> d(dst.data(), dst.size());
+    for( auto _ : state ) {
+        if( array ) {
+            array_op(d, s);
+        } else {
+            for( size_t i = 0; i < s.size(); ++i )
+                d[i] = scalar_op(s[i]);
+        }
+        benchmark::ClobberMemory();
+    }
+    report(state, src.size(), sizeof(T));
+}
+
+template< typename T, bool Array >
+void ILog2Floor(benchmark::State& state)
+{
+    run<T, T>(state, Array,
+              [](auto d, auto s) { lbu::ilog2_floor(d, s); },
+              [](T v) { return lbu::ilog2_floor(v); });
+}
+
+template< typename T, bool Array >
+void ILog2Ceil(benchmark::State& state)
+{
+    run<T, T>(state, Array,
+              [](auto d, auto s) { lbu::ilog2_ceil(d, s); },
+              [](T v) { return lbu::ilog2_ceil(v); });
+}
+
+template< typename T, bool Array >
+void NextGreaterPow2(benchmark::State& state)
+{
+    run<T, T>(state, Array,
+              [](auto d, auto s) { lbu::next_greater_pow2(d, s); },
+              [](T v) { return lbu::next_greater_pow2(v); });
+}
+
+// divisors and exponents are runtime values, as the compiler cannot know them
+template< typename T, bool Array >
+void IDivFloor(benchmark::State& state)
+{
+    T den = 1000;
+    benchmark::DoNotOptimize(den);
+    const lbu::invariant_divisor<T> inv(den);
+    run<T, T>(state, Array,
+              [&inv](auto d, auto s) { lbu::idiv_floor(d, s, inv); },
+              [den](T v) { return v / den; });
+}
+
+template< typename T, bool Array >
+void IDivCeil(benchmark::State& state)
+{
+    T den = 1000;
+    benchmark::DoNotOptimize(den);
+    const lbu::invariant_divisor<T> inv(den);
+    run<T, T>(state, Array,
+              [&inv](auto d, auto s) { lbu::idiv_ceil(d, s, inv); },
+              [den](T v) { return lbu::idiv_ceil(v, den); });
+}
+
+template< typename T, bool Array >
+void Abs(benchmark::State& state)
+{
+    using S = std::make_signed_t<T>;
+    run<S, T>(state, Array,
+              [](auto d, auto s) { lbu::abs(d, s); },
+              [](S v) { return lbu::abs(v); });
+}
+
+template< typename T, bool Array >
+void IPow(benchmark::State& state)
+{
+    unsigned exp = 5;
+    benchmark::DoNotOptimize(exp);
+    run<T, T>(state, Array,
+              [exp](auto d, auto s) { lbu::ipow(d, s, exp); },
+              [exp](T v) { return lbu::ipow(v, exp); });
+}
+
+void apply_sizes(benchmark::internal::Benchmark* b)
+{
+    for( long s : s_sizes )
+        b->Arg(s);
+}
+
+template< void (*Array)(benchmark::State&), void (*Scalar)(benchmark::State&) >
+void register_pair(const std::string& name)
+{
+    benchmark::RegisterBenchmark((name + "/lbu").c_str(), Array)->Apply(apply_sizes);
+    benchmark::RegisterBenchmark((name + "/scalar").c_str(), Scalar)->Apply(apply_sizes);
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    bench::options opt(&argc, argv);
+    s_sizes = opt.list("size", {64, 4096, 262144});
+
+    register_pair<&ILog2Floor<uint32_t, true>, &ILog2Floor<uint32_t, false>>("ILog2Floor<uint32_t>");
+    register_pair<&ILog2Floor<uint64_t, true>, &ILog2Floor<uint64_t, false>>("ILog2Floor<uint64_t>");
+    register_pair<&ILog2Ceil<uint32_t, true>, &ILog2Ceil<uint32_t, false>>("ILog2Ceil<uint32_t>");
+    register_pair<&NextGreaterPow2<uint32_t, true>, &NextGreaterPow2<uint32_t, false>>("NextGreaterPow2<uint32_t>");
+    register_pair<&NextGreaterPow2<uint64_t, true>, &NextGreaterPow2<uint64_t, false>>("NextGreaterPow2<uint64_t>");
+    register_pair<&IDivFloor<uint32_t, true>, &IDivFloor<uint32_t, false>>("IDivFloor<uint32_t>");
+    register_pair<&IDivFloor<uint64_t, true>, &IDivFloor<uint64_t, false>>("IDivFloor<uint64_t>");
+    register_pair<&IDivCeil<uint32_t, true>, &IDivCeil<uint32_t, false>>("IDivCeil<uint32_t>");
+    register_pair<&Abs<uint32_t, true>, &Abs<uint32_t, false>>("Abs<int32_t>");
+    register_pair<&Abs<uint64_t, true>, &Abs<uint64_t, false>>("Abs<int64_t>");
+    register_pair<&IPow<uint32_t, true>, &IPow<uint32_t, false>>("IPow<uint32_t>");
+    register_pair<&IPow<uint64_t, true>, &IPow<uint64_t, false>>("IPow<uint64_t>");
+
+    benchmark::Initialize(&argc, argv);
+    if( benchmark::ReportUnrecognizedArguments(argc, argv) )
+        return 1;
+    benchmark::AddCustomContext("lbu_kernels", lbu::math_array_kernel_set_name());
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -1,711 +1,642 @@
-#include <QDebug>
-#include <QString>
-#include <QObject>
-#include <QVector>
-#include <QIODevice>
-#include <QThread>
-#include <QtTest>
-
-#include <stdio.h>
-#include <unistd.h>
-#include <pthread.h>
-
-#include <array>
+/* Copyright 2015-2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// Bulk transfer throughput of different producer -> consumer thread mechanisms.
+//
+// Parameters are given on the command line (all lists are comma separated), e.g.
+//   bench_stream --lbu_chunk=16,4096 --lbu_ring=65536 --lbu_segment=16384 --lbu_pin=0,1
+//                --lbu_transfer_mib=256 --benchmark_format=json
+//
+//   --lbu_chunk         bytes per write/read call (multiple of sizeof(int))
+//   --lbu_ring          ring buffer sizes in bytes (ring benchmarks only)
+//   --lbu_segment       ring stream segment limits in bytes (RingStream* only)
+//   --lbu_pin           producer and consumer cpu (-1 = not pinned)
+//   --lbu_big_ring      ring sizes for RingStreamBig (default 32 MiB), which runs with malloc,
+//                       transparent and explicit huge pages
+//   --lbu_numa          producer and consumer NUMA node (RingStreamNuma only, default 0,1); the
+//                       ring is placed on the consumer node, and a same node run is added
+//   --lbu_transfer_mib  transferred data per benchmark iteration
+//
+// All other options are handled by google benchmark (--benchmark_filter, --benchmark_out, ...).
+
+#include "bench_util.h"
+
+#include <cstdio>
+#include <cstring>
 #include <memory>
+#include <thread>
+
+#include <pthread.h>
 
+#include "lbu/buffer_queue_stream.h"
 #include "lbu/eventfd.h"
 #include "lbu/fd_stream.h"
 #include "lbu/io.h"
+#include "lbu/numa.h"
 #include "lbu/pipe.h"
 #include "lbu/poll.h"
 #include "lbu/ring_spsc.h"
 #include "lbu/ring_spsc_stream.h"
 
+namespace {
 
-static const unsigned s_chunk_size = 16; // modify to test different chunk sizes
-
-static const unsigned s_transfer_size = ((1024*1024*1024) / sizeof(int) / s_chunk_size) * s_chunk_size;
-static inline int valueForIndex(unsigned i)
-{
-    return ((i % 2) == 0) ? 1 : -1;
-}
-static const int s_expected = 0;
-
-
-static const unsigned s_chunk_byte_size = s_chunk_size * sizeof(int);
-static const unsigned s_transfer_byte_size = s_transfer_size * sizeof(int);
-
-static int s_result = 0;
-
-static std::array<int, s_chunk_size> s_read_buffer;
-static std::array<int, 1024*16> s_ring_buffer;
-static const unsigned s_ring_chunk_size = s_chunk_size;//s_ring_buffer.size() / 4;
-static std::array<int, s_chunk_size> s_write_buffer;
-static std::atomic<size_t> s_producerIdx;
-static std::atomic<size_t> s_consumerIdx;
-static bool s_wake_request = false;
-
-
-// ---------- QIODevice test class
-
-class QtFdDev : public QIODevice {
-    Q_OBJECT
-
-public:
-    QtFdDev(lbu::fd f) : m_fd(f) {}
+struct config {
+    uint32_t chunk_byte_size = 64;
+    uint32_t ring_byte_size = lbu::stream::ring_spsc_basic_controller::DefaultRingBufferSize;
+    uint32_t segment_limit = lbu::stream::ring_spsc::DefaultRingSegmentLimit;
+    int producer_cpu = -1;
+    int consumer_cpu = -1;
+    int producer_node = -1;     // overrides the cpu if set
+    int consumer_node = -1;
+    int huge_pages = -1;        // lbu::huge_pages of the ring, -1 for malloc
+    int fd_blocking = -1;       // lbu::stream::FdBlockingState (FdStreamMixed only)
 
-    bool isSequential() const { return true; }
-
-protected:
-    qint64 readData(char *data, qint64 maxlen)
-    {
-        auto a = lbu::array_ref<char>(data, maxlen < 0 ? 0 : size_t(maxlen));
-//        ssize_t res;
-//        if(lbu::io::read(m_fd, a, &res) != lbu::io::ReadNoError)
-//            return -1;
-//        return res;
-        return (lbu::io::read_all(m_fd, a) == lbu::io::ReadNoError) ? qint64(a.size()) : -1;
-    }
+    size_t chunk_size() const { return chunk_byte_size / sizeof(int); }
+};
 
-    qint64 writeData(const char *data, qint64 len)
-    {
-        auto a = lbu::array_ref<const char>(data, len < 0 ? 0 : size_t(len));
-        return (lbu::io::write_all(m_fd, a) == lbu::io::WriteNoError) ? len : -1;
-    }
+size_t s_transfer_byte_size = size_t(64) * 1024 * 1024;
 
-private:
-    lbu::fd m_fd;
-};
+size_t transfer_size(const config& c)
+{
+    return (s_transfer_byte_size / c.chunk_byte_size) * c.chunk_size();
+}
 
+inline int value_for_index(size_t i)
+{
+    return ((i % 2) == 0) ? 1 : -1;
+}
 
-// ---------- Signal & Slot test classes
+void fill_chunk(int* dst, size_t count, size_t base_index)
+{
+    for( size_t i = 0; i < count; ++i )
+        dst[i] = value_for_index(base_index + i);
+}
 
-class QtSigSlotTransferSender : public QObject {
-    Q_OBJECT
+int sum_chunk(const int* src, size_t count)
+{
+    int sum = 0;
+    for( size_t i = 0; i < count; ++i )
+        sum += src[i];
+    return sum;
+}
 
-public:
-    QtSigSlotTransferSender()
-    {
-        d.resize(s_chunk_size);
+// Runs the producer (benchmark thread) and the consumer (new thread each iteration) and
+// checks that the consumer saw the expected data.
+template< typename Producer, typename Consumer >
+void run_transfer(benchmark::State& state, const config& c, Producer&& produce, Consumer&& consume)
+{
+    int error = 0;
+    if( c.producer_node >= 0 ? ! lbu::numa::set_thread_node(c.producer_node, &error)
+                             : ! bench::pin_current_thread(c.producer_cpu) ) {
+        state.SkipWithError("pinning the producer failed");
+        return;
     }
-
-    void run()
-    {
-        for( unsigned i = 0; i < (s_transfer_size / s_chunk_size); ++i ) {
-            for( unsigned j = 0; j < s_chunk_size; ++j ) {
-                d[int(j)] = valueForIndex(j + (i * s_chunk_size));
-            }
-            emit dataAvailable(d);
+    bench::perf_cache_misses misses;
+    const size_t total = transfer_size(c);
+
+    for( auto _ : state ) {
+        int result = 0;
+        std::thread t([&]() {
+            if( c.consumer_node >= 0 )
+                lbu::numa::set_thread_node(c.consumer_node, &error);
+            else
+                bench::pin_current_thread(c.consumer_cpu);
+            result = consume(total);
+        });
+        const bool ok = produce(total);
+        t.join();
+
+        if( ! ok || result != 0 ) {
+            state.SkipWithError("transfer failed");
+            return;
         }
-        emit done();
     }
 
-signals:
-    void dataAvailable(const QVector<int> &data);
-    void done();
-
-private:
-    QVector<int> d;
-};
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(total * sizeof(int)));
+    const double chunks = double(total / c.chunk_size());
+    bench::report_ops(state, chunks);
+    misses.report(state, chunks * double(state.iterations()));
+}
 
-class QtSigSlotTransferReceiver : public QObject {
-    Q_OBJECT
 
-public slots:
-    void process(const QVector<int> &data)
-    {
-        for( auto f : data )
-            s_result += f;
+void RawIO(benchmark::State& state, config c)
+{
+    auto pipe = lbu::pipe::open(lbu::pipe::FlagsCloExec);
+    if( pipe.status != lbu::pipe::StatusNoError ) {
+        state.SkipWithError("pipe failed");
+        return;
     }
 
-    void done() { QThread::currentThread()->quit(); }
-};
-
-Q_DECLARE_METATYPE(QVector<int>)
-
-
-// ---------- Bench reader threads
-
-class Thread_RawIO : public QThread {
-    Q_OBJECT
-    void run() override
-    {
-        unsigned processed = 0;
-        char *rawBuffer = reinterpret_cast<char*>(s_read_buffer.data());
-
+    run_transfer(state, c, [&](size_t total) {
+        std::vector<int> buf(c.chunk_size());
+        const auto a = lbu::array_ref<int>(buf.data(), buf.size());
+        for( size_t i = 0; i < total; i += buf.size() ) {
+            fill_chunk(buf.data(), buf.size(), i);
+            if( lbu::io::write_all(pipe.write_fd.get(), a) != lbu::io::WriteNoError )
+                return false;
+        }
+        return true;
+    }, [&](size_t total) {
+        std::vector<int> buf(c.chunk_size());
+        char* raw = reinterpret_cast<char*>(buf.data());
+        int result = 0;
+        size_t processed = 0;
         size_t offset = 0;
-        while( processed < s_transfer_size ) {
-            const ssize_t bytes = read(m_fd, rawBuffer + offset, s_chunk_byte_size - offset);
-            Q_ASSERT(bytes > 0);
-
-            const unsigned count = unsigned(bytes) / sizeof(int);
-            for( unsigned i = 0; i < count; ++i )
-                s_result += s_read_buffer[i];
-
+        while( processed < total ) {
+            const ssize_t bytes = ::read(pipe.read_fd.get().value, raw + offset, c.chunk_byte_size - offset);
+            if( bytes <= 0 )
+                return -1;
+            const size_t count = (size_t(bytes) + offset) / sizeof(int);
+            result += sum_chunk(buf.data(), count);
             processed += count;
-
-            offset = unsigned(bytes) % sizeof(int);
-            if( offset != 0 ) {
-                qDebug() << "OFFSET" << offset;
-                memmove(rawBuffer, rawBuffer + (count * sizeof(int)), offset);
-            }
+            offset = (size_t(bytes) + offset) % sizeof(int);
+            if( offset != 0 )
+                std::memmove(raw, raw + (count * sizeof(int)), offset);
         }
-    }
-    int m_fd = 0;
-public:
-    Thread_RawIO(int fd)
-    {
-        m_fd = fd;
-        Q_ASSERT(m_fd);
-    }
-};
-
-class Thread_FILE : public QThread {
-    Q_OBJECT
-    void run() override
-    {
-        unsigned processed = 0;
-        while( processed < s_transfer_size ) {
-            const int c = fread_unlocked(s_read_buffer.data(), sizeof(int), s_chunk_size, m_file);
-            Q_ASSERT(c > 0);
-
-            const unsigned count = unsigned(c);
-            for( size_t i = 0; i < count; ++i )
-                s_result += s_read_buffer[i];
+        return result;
+    });
+}
 
+void FILE_io(benchmark::State& state, config c)
+{
+    auto pipe = lbu::pipe::open(lbu::pipe::FlagsCloExec);
+    if( pipe.status != lbu::pipe::StatusNoError ) {
+        state.SkipWithError("pipe failed");
+        return;
+    }
+    std::unique_ptr<FILE, int(*)(FILE*)> out(fdopen(pipe.write_fd.release().value, "w"), &fclose);
+    std::unique_ptr<FILE, int(*)(FILE*)> in(fdopen(pipe.read_fd.release().value, "r"), &fclose);
+
+    run_transfer(state, c, [&](size_t total) {
+        std::vector<int> buf(c.chunk_size());
+        for( size_t i = 0; i < total; i += buf.size() ) {
+            fill_chunk(buf.data(), buf.size(), i);
+            if( fwrite_unlocked(buf.data(), sizeof(int), buf.size(), out.get()) != buf.size() )
+                return false;
+        }
+        return fflush(out.get()) == 0;
+    }, [&](size_t total) {
+        std::vector<int> buf(c.chunk_size());
+        int result = 0;
+        size_t processed = 0;
+        while( processed < total ) {
+            const size_t count = fread_unlocked(buf.data(), sizeof(int), buf.size(), in.get());
+            if( count == 0 )
+                return -1;
+            result += sum_chunk(buf.data(), count);
             processed += count;
         }
-    }
-    FILE* m_file = nullptr;
-public:
-    Thread_FILE(int fd)
-    {
-        m_file = fdopen(fd, "r");
-        Q_ASSERT(m_file);
-    }
-    ~Thread_FILE()
-    {
-        fclose(m_file);
-    }
-};
-
-class Thread_QIODev : public QThread {
-    Q_OBJECT
-    void run() override
-    {
-        char *rawBuffer = reinterpret_cast<char*>(s_read_buffer.data());
-        unsigned processed = 0;
-        while( processed < s_transfer_size ) {
-            const int c = m_dev.read(rawBuffer, s_chunk_byte_size);
-            Q_ASSERT(c == s_chunk_byte_size);
-
-            for( unsigned i = 0; i < s_chunk_size; ++i )
-                s_result += s_read_buffer[i];
+        return result;
+    });
+}
 
-            processed += s_chunk_size;
-        }
-    }
-    QtFdDev m_dev;
-public:
-    Thread_QIODev(lbu::fd f)
-        : m_dev(f)
-    {
-        //auto b = m_dev.open(QIODevice::ReadOnly);
-        auto b = m_dev.open(QIODevice::ReadOnly|QIODevice::Unbuffered);
-        Q_ASSERT(b);
+void FdStream(benchmark::State& state, config c)
+{
+    auto pipe = lbu::pipe::open(lbu::pipe::FlagsCloExec);
+    if( pipe.status != lbu::pipe::StatusNoError ) {
+        state.SkipWithError("pipe failed");
+        return;
     }
-};
-
-class Thread_FdStream : public QThread {
-    Q_OBJECT
-    void run() override
-    {
-        unsigned processed = 0;
-        auto *s = m_stream.stream();
-
-        while( processed < s_transfer_size ) {
-            const int c = s->read(s_read_buffer.data(), s_chunk_byte_size, lbu::stream::Mode::Blocking);
-            Q_ASSERT(c == s_chunk_byte_size);
-
-            for( unsigned i = 0; i < s_chunk_size; ++i )
-                s_result += s_read_buffer[i];
-
-            processed += s_chunk_size;
+    lbu::stream::managed_fd_output_stream out(std::move(pipe.write_fd), lbu::stream::FdBlockingState::AlwaysBlocking);
+    lbu::stream::managed_fd_input_stream in(std::move(pipe.read_fd), lbu::stream::FdBlockingState::AlwaysBlocking);
+
+    run_transfer(state, c, [&](size_t total) {
+        std::vector<int> buf(c.chunk_size());
+        auto* s = out.stream();
+        for( size_t i = 0; i < total; i += buf.size() ) {
+            fill_chunk(buf.data(), buf.size(), i);
+            if( s->write(buf.data(), c.chunk_byte_size, lbu::stream::Mode::Blocking) != ssize_t(c.chunk_byte_size) )
+                return false;
         }
-    }
-    lbu::stream::managed_fd_input_stream m_stream;
-public:
-    Thread_FdStream(lbu::unique_fd f)
-    {
-        m_stream.reset(std::move(f), lbu::stream::FdBlockingState::AlwaysBlocking);
-    }
-};
-
-class Thread_RingStream : public QThread {
-    Q_OBJECT
-    void run() override
-    {
-        unsigned processed = 0;
-
-        while( processed < s_transfer_size ) {
-            const int c = in.read(s_read_buffer.data(), s_chunk_byte_size, lbu::stream::Mode::Blocking);
-            Q_ASSERT(c == s_chunk_byte_size);
-
-            for( unsigned i = 0; i < s_chunk_size; ++i )
-                s_result += s_read_buffer[i];
-
-            processed += s_chunk_size;
+        return s->flush_buffer();
+    }, [&](size_t total) {
+        std::vector<int> buf(c.chunk_size());
+        auto* s = in.stream();
+        int result = 0;
+        for( size_t processed = 0; processed < total; processed += buf.size() ) {
+            if( s->read(buf.data(), c.chunk_byte_size, lbu::stream::Mode::Blocking) != ssize_t(c.chunk_byte_size) )
+                return -1;
+            result += sum_chunk(buf.data(), buf.size());
         }
-    }
-public:
-    lbu::stream::ring_spsc::input_stream in;
-};
-
-#ifdef BENCH_RING_ADDITIONAL
-class Thread_RingSpin : public QThread {
-    Q_OBJECT
-    void run() override
-    {
-        unsigned processed = 0;
+        return result;
+    });
+}
 
-        while( processed < s_transfer_size ) {
-            auto r = consumer.continuous_range();
-            if( r.size() == 0 ) {
-                while( consumer.update_available() == 0 )
-                    yieldCurrentThread();
-                r = consumer.continuous_range();
-            }
-            r = r.sub_first(s_ring_chunk_size);
+// Both sides try a non-blocking request first and block for the rest, which makes
+// FdBlockingState::Automatic toggle O_NONBLOCK all the time. With stream statistics
+// enabled (LBU_STREAM_STATS) the syscalls per chunk and side are reported as well.
+void FdStreamMixed(benchmark::State& state, config c)
+{
+    auto pipe = lbu::pipe::open(lbu::pipe::FlagsCloExec);
+    if( pipe.status != lbu::pipe::StatusNoError ) {
+        state.SkipWithError("pipe failed");
+        return;
+    }
+    const auto blocking = lbu::stream::FdBlockingState(c.fd_blocking);
+    lbu::stream::managed_fd_output_stream out(std::move(pipe.write_fd), blocking);
+    lbu::stream::managed_fd_input_stream in(std::move(pipe.read_fd), blocking);
+    lbu::stream::stream_statistics stats;
+    out.stream()->attach_statistics(&stats);
+    in.stream()->attach_statistics(&stats);
+
+    run_transfer(state, c, [&](size_t total) {
+        std::vector<int> buf(c.chunk_size());
+        auto* s = out.stream();
+        const char* raw = reinterpret_cast<const char*>(buf.data());
+        for( size_t i = 0; i < total; i += buf.size() ) {
+            fill_chunk(buf.data(), buf.size(), i);
+            const ssize_t w = s->write(raw, c.chunk_byte_size, lbu::stream::Mode::NonBlocking);
+            if( w < 0 )
+                return false;
+            const auto rest = c.chunk_byte_size - size_t(w);
+            if( rest > 0 && s->write(raw + w, rest, lbu::stream::Mode::Blocking) != ssize_t(rest) )
+                return false;
+        }
+        return s->flush_buffer();
+    }, [&](size_t total) {
+        std::vector<int> buf(c.chunk_size());
+        auto* s = in.stream();
+        char* raw = reinterpret_cast<char*>(buf.data());
+        int result = 0;
+        for( size_t processed = 0; processed < total; processed += buf.size() ) {
+            const ssize_t r = s->read(raw, c.chunk_byte_size, lbu::stream::Mode::NonBlocking);
+            if( r < 0 )
+                return -1;
+            const auto rest = c.chunk_byte_size - size_t(r);
+            if( rest > 0 && s->read(raw + r, rest, lbu::stream::Mode::Blocking) != ssize_t(rest) )
+                return -1;
+            result += sum_chunk(buf.data(), buf.size());
+        }
+        return result;
+    });
 
-            for( auto v : r )
-                s_result += v;
+    if( stats.enabled ) {
+        const double chunks = double(transfer_size(c) / c.chunk_size()) * double(state.iterations());
+        state.counters["syscalls/chunk"] = double(stats.syscalls.load()) / (2 * chunks);
+    }
+}
 
-            processed += r.size();
-            consumer.release(r.size());
+// in-process transport with one byte_buffer segment per chunk
+void BufferQueueStream(benchmark::State& state, config c)
+{
+    lbu::stream::buffer_queue_input_stream in;
+
+    run_transfer(state, c, [&](size_t total) {
+        std::vector<int> buf(c.chunk_size());
+        for( size_t i = 0; i < total; i += buf.size() ) {
+            fill_chunk(buf.data(), buf.size(), i);
+            if( ! in.append(lbu::byte_buffer(lbu::array_ref<const int>(buf.data(), buf.size()))) )
+                return false;
         }
-    }
-public:
-    lbu::ring_spsc::handle<int>::consumer consumer;
-};
+        return true;
+    }, [&](size_t total) {
+        std::vector<int> buf(c.chunk_size());
+        int result = 0;
+        for( size_t processed = 0; processed < total; processed += buf.size() ) {
+            if( in.read(buf.data(), c.chunk_byte_size, lbu::stream::Mode::Blocking) != ssize_t(c.chunk_byte_size) )
+                return -1;
+            result += sum_chunk(buf.data(), buf.size());
+        }
+        return result;
+    });
+}
 
-class Thread_RingBlockFd : public QThread {
-    Q_OBJECT
-    void run() override
-    {
-        unsigned processed = 0;
-        eventfd_t unused;
+void ring_stream_transfer(benchmark::State& state, const config& c,
+                          lbu::stream::ring_spsc_basic_controller* controller)
+{
+    lbu::stream::ring_spsc::output_stream out;
+    lbu::stream::ring_spsc::input_stream in;
+    if( ! controller->pair_streams(&out, &in, c.segment_limit) ) {
+        state.SkipWithError("pair_streams failed");
+        return;
+    }
 
-        while( processed < s_transfer_size ) {
-            auto r = consumer.continuous_range();
-            if( r.size() == 0 ) {
-                if( consumer.update_available() == 0 ) {
-                    lbu::poll::wait_for_event(m_fd, lbu::poll::FlagsReadReady);
-                    consumer.update_available();
-                }
-                r = consumer.continuous_range();
-            }
-            r = r.sub_first(s_ring_chunk_size);
+    run_transfer(state, c, [&](size_t total) {
+        std::vector<int> buf(c.chunk_size());
+        for( size_t i = 0; i < total; i += buf.size() ) {
+            fill_chunk(buf.data(), buf.size(), i);
+            if( out.write(buf.data(), c.chunk_byte_size, lbu::stream::Mode::Blocking) != ssize_t(c.chunk_byte_size) )
+                return false;
+        }
+        return out.flush_buffer();
+    }, [&](size_t total) {
+        std::vector<int> buf(c.chunk_size());
+        int result = 0;
+        for( size_t processed = 0; processed < total; processed += buf.size() ) {
+            if( in.read(buf.data(), c.chunk_byte_size, lbu::stream::Mode::Blocking) != ssize_t(c.chunk_byte_size) )
+                return -1;
+            result += sum_chunk(buf.data(), buf.size());
+        }
+        return result;
+    });
+}
 
-            for( auto v : r )
-                s_result += v;
+void RingStream(benchmark::State& state, config c)
+{
+    lbu::stream::ring_spsc_basic_controller controller(c.ring_byte_size);
+    ring_stream_transfer(state, c, &controller);
+}
 
-            processed += r.size();
-            consumer.release(r.size());
-            lbu::event_fd::read(m_fd, &unused);
-        }
+// like RingStream, with the threads on the given NUMA nodes and the ring on the consumer node
+void RingStreamNuma(benchmark::State& state, config c)
+{
+    const int nodes = lbu::numa::node_count();
+    if( c.producer_node >= nodes || c.consumer_node >= nodes ) {
+        state.SkipWithError("NUMA node not available");
+        return;
     }
-    lbu::fd m_fd;
-public:
-    Thread_RingBlockFd(lbu::fd f)
-        : m_fd(f)
-    {
+    lbu::page_options options;
+    options.numa_node = c.consumer_node;
+    int error = 0;
+    lbu::stream::ring_spsc_basic_controller controller(c.ring_byte_size, options, &error);
+    if( error != 0 ) {
+        state.SkipWithError(("binding the ring failed: " + std::string(std::strerror(error))).c_str());
+        return;
     }
-    lbu::ring_spsc::handle<int>::consumer consumer;
-};
-
-class Thread_RingBlockCond : public QThread {
-    Q_OBJECT
-    void run() override
-    {
-        unsigned processed = 0;
-
-        while( processed < s_transfer_size ) {
-            auto r = consumer.continuous_range();
-            if( r.size() == 0 ) {
-                if( consumer.update_available() == 0 ) {
-                    pthread_mutex_lock(m_mutex);
-                    while( consumer.update_available() == 0 ) {
-                        s_wake_request = true;
-                        pthread_cond_wait(m_cond, m_mutex);
-                    }
-                    pthread_mutex_unlock(m_mutex);
-                }
-                r = consumer.continuous_range();
-            }
-            r = r.sub_first(s_ring_chunk_size);
-
-            for( auto v : r )
-                s_result += v;
+    ring_stream_transfer(state, c, &controller);
+}
 
-            processed += r.size();
-            consumer.release(r.size());
-
-            bool sendSignal = false;
-            pthread_mutex_lock(m_mutex);
-            sendSignal = s_wake_request;
-            s_wake_request = false;
-            pthread_mutex_unlock(m_mutex);
-            if( sendSignal )
-                pthread_cond_signal(m_cond);
-        }
+// like RingStream, for big rings that are mapped with page_alloc if huge pages are requested
+void RingStreamBig(benchmark::State& state, config c)
+{
+    if( c.huge_pages < 0 ) {
+        lbu::stream::ring_spsc_basic_controller controller(c.ring_byte_size);
+        ring_stream_transfer(state, c, &controller);
+        return;
     }
-    pthread_mutex_t* m_mutex;
-    pthread_cond_t* m_cond;
-public:
-    Thread_RingBlockCond(pthread_mutex_t* mutex, pthread_cond_t* cond)
-        : m_mutex(mutex)
-        , m_cond(cond)
-    {
+    lbu::page_options options;
+    options.huge = lbu::huge_pages(c.huge_pages);
+    int error = 0;
+    lbu::stream::ring_spsc_basic_controller controller(c.ring_byte_size, options, &error);
+    if( error != 0 ) {
+        state.SkipWithError(("mapping the ring failed: " + std::string(std::strerror(error))).c_str());
+        return;
     }
-    lbu::ring_spsc::handle<int>::consumer consumer;
-};
-#endif
-
-
-// ---------- Main
+    ring_stream_transfer(state, c, &controller);
+}
 
-class BenchStream : public QObject
+// like RingStream, but the producer fills the ring in place through reserve/commit
+void RingStreamReserve(benchmark::State& state, config c)
 {
-    Q_OBJECT
-
-private Q_SLOTS:
-    void RawIO()
-    {
-        auto pipe = lbu::pipe::open();
-        QVERIFY(pipe.status == lbu::pipe::StatusNoError);
-        const auto buf = lbu::array_ref<int>(s_write_buffer);
-
-        Thread_RawIO t(pipe.read_fd.get().value);
-        QBENCHMARK {
-            s_result = 0;
-            t.start();
-
-            const unsigned iter = s_transfer_size / s_chunk_size;
-            for( unsigned i = 0; i < iter; ++i ) {
-                for( unsigned j = 0; j < s_chunk_size; ++j ) {
-                    s_write_buffer[j] = valueForIndex(i*s_chunk_size + j);
-                }
-                if( lbu::io::write_all(pipe.write_fd.get(), buf) != lbu::io::WriteNoError )
-                    Q_ASSERT(false);
-            }
-
-            t.wait();
-        }
-
-        QCOMPARE(s_result, s_expected);
+    lbu::stream::ring_spsc_basic_controller controller(c.ring_byte_size);
+    lbu::stream::ring_spsc::output_stream out;
+    lbu::stream::ring_spsc::input_stream in;
+    if( c.chunk_byte_size > c.ring_byte_size || ! controller.pair_streams(&out, &in, c.segment_limit) ) {
+        state.SkipWithError("pair_streams failed");
+        return;
     }
 
-    void FILE_io()
-    {
-        auto pipe = lbu::pipe::open();
-        QVERIFY(pipe.status == lbu::pipe::StatusNoError);
-        FILE* pipe_out = fdopen(pipe.write_fd.release().value, "w");
-        QVERIFY(pipe_out);
-
-        Thread_FILE t(pipe.read_fd.release().value);
-        QBENCHMARK {
-            s_result = 0;
-            t.start();
-
-            const unsigned iter = s_transfer_size / s_chunk_size;
-            for( unsigned i = 0; i < iter; ++i ) {
-                for( unsigned j = 0; j < s_chunk_size; ++j ) {
-                    s_write_buffer[j] = valueForIndex(i*s_chunk_size + j);
-                }
-                if( fwrite_unlocked(s_write_buffer.data(), sizeof(int), s_chunk_size, pipe_out) != s_chunk_size )
-                    Q_ASSERT(false);
-            }
-
-            fflush(pipe_out);
-            t.wait();
+    run_transfer(state, c, [&](size_t total) {
+        for( size_t i = 0; i < total; i += c.chunk_size() ) {
+            auto buf = out.reserve(c.chunk_byte_size);
+            if( buf.size() == 0 )
+                return false;
+            fill_chunk(static_cast<int*>(buf.data()), c.chunk_size(), i);
+            out.commit(c.chunk_byte_size);
         }
+        return out.flush_buffer();
+    }, [&](size_t total) {
+        std::vector<int> buf(c.chunk_size());
+        int result = 0;
+        for( size_t processed = 0; processed < total; processed += buf.size() ) {
+            if( in.read(buf.data(), c.chunk_byte_size, lbu::stream::Mode::Blocking) != ssize_t(c.chunk_byte_size) )
+                return -1;
+            result += sum_chunk(buf.data(), buf.size());
+        }
+        return result;
+    });
+}
 
-        fclose(pipe_out);
-        QCOMPARE(s_result, s_expected);
-    }
-
-    void QIODev()
-    {
-        auto pipe = lbu::pipe::open();
-        QVERIFY(pipe.status == lbu::pipe::StatusNoError);
-
-        QtFdDev writeDev(pipe.write_fd.get());
-        QVERIFY(writeDev.open((QIODevice::WriteOnly)));
-        Thread_QIODev t(pipe.read_fd.get());
 
-        QBENCHMARK {
-            s_result = 0;
-            t.start();
+// Raw ring_spsc::handle benchmarks with different wait strategies
 
-            const unsigned iter = s_transfer_size / s_chunk_size;
-            for( unsigned i = 0; i < iter; ++i ) {
-                for( unsigned j = 0; j < s_chunk_size; ++j ) {
-                    s_write_buffer[j] = valueForIndex(i*s_chunk_size + j);
-                }
-                if( writeDev.write(reinterpret_cast<char*>(s_write_buffer.data()), s_chunk_byte_size) != s_chunk_byte_size )
-                    Q_ASSERT(false);
-            }
+using int_ring = lbu::ring_spsc::handle<int>;
 
-            if( writeDev.bytesToWrite() != 0 )
-                Q_ASSERT(false);
-            t.wait();
-        }
+struct raw_ring {
+    std::vector<int> buffer;
+    std::atomic<size_t> producer_index{0};
+    std::atomic<size_t> consumer_index{0};
+    int_ring::producer producer;
+    int_ring::consumer consumer;
 
-        QCOMPARE(s_result, s_expected);
-    }
+    explicit raw_ring(const config& c) : buffer(c.ring_byte_size / sizeof(int)) {}
 
-    void QSigSlot()
+    void reset()
     {
-        qRegisterMetaType<QVector<int>>();
-        QThread t;
-        QtSigSlotTransferSender sender;
-        QtSigSlotTransferReceiver receiver;
-        sender.connect(&sender, &QtSigSlotTransferSender::dataAvailable, &receiver, &QtSigSlotTransferReceiver::process);
-        sender.connect(&sender, &QtSigSlotTransferSender::done, &receiver, &QtSigSlotTransferReceiver::done);
-        receiver.moveToThread(&t);
-
-        QBENCHMARK {
-            s_result = 0;
-            t.start();
-            sender.run();
-            t.wait();
-        }
-
-        QCOMPARE(s_result, s_expected);
+        producer_index = consumer_index = 0;
+        int_ring::pair_producer_consumer({buffer.data(), buffer.size()},
+                                         &producer, &producer_index,
+                                         &consumer, &consumer_index);
     }
+};
 
-    void FdStream()
-    {
-        auto pipe = lbu::pipe::open();
-        QVERIFY(pipe.status == lbu::pipe::StatusNoError);
-
-        lbu::stream::managed_fd_output_stream writeDev;
-        writeDev.reset(std::move(pipe.write_fd), lbu::stream::FdBlockingState::AlwaysBlocking);
-        auto *s = writeDev.stream();
-        std::unique_ptr<Thread_FdStream> t(new Thread_FdStream(std::move(pipe.read_fd)));
-
-        QBENCHMARK {
-            s_result = 0;
-            t->start();
-
-            const unsigned iter = s_transfer_size / s_chunk_size;
-            for( unsigned i = 0; i < iter; ++i ) {
-                for( unsigned j = 0; j < s_chunk_size; ++j ) {
-                    s_write_buffer[j] = valueForIndex(i*s_chunk_size + j);
-                }
-                auto r = s->write(s_write_buffer.data(), s_chunk_byte_size, lbu::stream::Mode::Blocking);
-                if( r != ssize_t(s_chunk_byte_size) )
-                    Q_ASSERT(false);
+template< typename ProducerWait, typename ProducerNotify, typename ConsumerWait, typename ConsumerNotify >
+void run_raw_ring(benchmark::State& state, const config& c,
+                  ProducerWait&& producer_wait, ProducerNotify&& producer_notify,
+                  ConsumerWait&& consumer_wait, ConsumerNotify&& consumer_notify)
+{
+    // Every iteration transfers everything, so the indices are consistent between iterations
+    raw_ring ring(c);
+    ring.reset();
+
+    run_transfer(state, c, [&](size_t total) {
+        size_t processed = 0;
+        while( processed < total ) {
+            auto r = ring.producer.continuous_range();
+            if( r.size() == 0 ) {
+                producer_wait(ring.producer);
+                r = ring.producer.continuous_range();
             }
-
-            if( ! s->flush_buffer() )
-                Q_ASSERT(false);
-            t->wait();
+            r = r.sub_first(std::min(c.chunk_size(), total - processed));
+            fill_chunk(r.data(), r.size(), processed);
+            processed += r.size();
+            ring.producer.publish(r.size());
+            producer_notify();
         }
-
-        QCOMPARE(s->has_error(), false);
-        QCOMPARE(s_result, s_expected);
-    }
-
-    void RingStream()
-    {
-        //lbu::stream::ring_spsc_basic_controller controller(s_ring_buffer.size() * sizeof(int));
-        lbu::stream::ring_spsc_basic_controller controller;
-        lbu::stream::ring_spsc::output_stream out;
-        std::unique_ptr<Thread_RingStream> t(new Thread_RingStream);
-        QVERIFY(controller.pair_streams(&out, &t->in));
-
-        QBENCHMARK {
-            s_result = 0;
-            t->start();
-
-            const unsigned iter = s_transfer_size / s_chunk_size;
-            for( unsigned i = 0; i < iter; ++i ) {
-                for( unsigned j = 0; j < s_chunk_size; ++j ) {
-                    s_write_buffer[j] = valueForIndex(i*s_chunk_size + j);
-                }
-                auto r = out.write(s_write_buffer.data(), s_chunk_byte_size, lbu::stream::Mode::Blocking);
-                if( r != ssize_t(s_chunk_byte_size) )
-                    Q_ASSERT(false);
+        return true;
+    }, [&](size_t total) {
+        int result = 0;
+        size_t processed = 0;
+        while( processed < total ) {
+            auto r = ring.consumer.continuous_range();
+            if( r.size() == 0 ) {
+                consumer_wait(ring.consumer);
+                r = ring.consumer.continuous_range();
             }
-
-            if( ! out.flush_buffer() )
-                Q_ASSERT(false);
-            t->wait();
+            r = r.sub_first(c.chunk_size());
+            result += sum_chunk(r.data(), r.size());
+            processed += r.size();
+            ring.consumer.release(r.size());
+            consumer_notify();
         }
+        return result;
+    });
+}
 
-        QCOMPARE(out.has_error(), false);
-        QCOMPARE(s_result, s_expected);
-    }
-
-#ifdef BENCH_RING_ADDITIONAL
-    void RingSpin()
-    {
-        s_producerIdx = s_consumerIdx = 0;
-        std::unique_ptr<Thread_RingSpin> t(new Thread_RingSpin);
-        lbu::ring_spsc::handle<int>::producer producer;
-
-        lbu::ring_spsc::handle<int>::pair_producer_consumer({s_ring_buffer.begin(), s_ring_buffer.end()},
-                                                            &producer, &s_producerIdx,
-                                                            &t->consumer, &s_consumerIdx);
-
-        QBENCHMARK {
-            s_result = 0;
-            t->start();
-
-            unsigned processed = 0;
-
-            while( true ) {
-                auto c = s_transfer_size - processed;
-                if( c == 0 )
-                    break;
-
-                auto r = producer.continuous_range();
-                if( r.size() == 0 ) {
-                    while( producer.update_available() == 0 )
-                        QThread::yieldCurrentThread();
-                    r = producer.continuous_range();
-                }
-                r = r.sub_first(std::min(s_ring_chunk_size, c));
-
-                for( unsigned i = 0; i < r.size(); ++i )
-                    r[i] = 1;
+void RingSpin(benchmark::State& state, config c)
+{
+    auto wait = [](auto& h) {
+        while( h.update_available() == 0 )
+            std::this_thread::yield();
+    };
+    auto notify = []() {};
+    run_raw_ring(state, c, wait, notify, wait, notify);
+}
 
-                processed += r.size();
-                producer.publish(r.size());
-            }
+void RingBlockFd(benchmark::State& state, config c)
+{
+    auto efd = lbu::event_fd::create(0, lbu::event_fd::FlagsNonBlock | lbu::event_fd::FlagsCloExec);
+    const lbu::fd f = efd.get();
 
-            t->wait();
+    run_raw_ring(state, c, [f](auto& h) {
+        if( h.update_available() == 0 ) {
+            lbu::poll::wait_for_event(f, lbu::poll::FlagsWriteReady);
+            h.update_available();
         }
+    }, [f]() {
+        lbu::event_fd::write(f, lbu::event_fd::MaximumValue);
+    }, [f](auto& h) {
+        if( h.update_available() == 0 ) {
+            lbu::poll::wait_for_event(f, lbu::poll::FlagsReadReady);
+            h.update_available();
+        }
+    }, [f]() {
+        eventfd_t unused;
+        lbu::event_fd::read(f, &unused);
+    });
+}
 
-        QCOMPARE(s_result, int(s_transfer_size));
-    }
-
-    void RingBlockFd()
-    {
-        s_producerIdx = s_consumerIdx = 0;
-        auto fd = lbu::event_fd::create(0, lbu::event_fd::FlagsNonBlock);
-
-        std::unique_ptr<Thread_RingBlockFd> t(new Thread_RingBlockFd(fd.get()));
-        lbu::ring_spsc::handle<int>::producer producer;
-
-        lbu::ring_spsc::handle<int>::pair_producer_consumer({s_ring_buffer.begin(), s_ring_buffer.end()},
-                                                            &producer, &s_producerIdx,
-                                                            &t->consumer, &s_consumerIdx);
-
-        QBENCHMARK {
-            s_result = 0;
-            t->start();
-
-            unsigned processed = 0;
-
-            while( true ) {
-                auto c = s_transfer_size - processed;
-                if( c == 0 )
-                    break;
-
-                auto r = producer.continuous_range();
-                if( r.size() == 0 ) {
-                    if( producer.update_available() == 0 ) {
-                        lbu::poll::wait_for_event(fd.get(), lbu::poll::FlagsWriteReady);
-                        producer.update_available();
-                    }
-                    r = producer.continuous_range();
-                }
-                r = r.sub_first(std::min(s_ring_chunk_size, c));
-
-                for( unsigned i = 0; i < r.size(); ++i )
-                    r[i] = 1;
-
-                processed += r.size();
-                producer.publish(r.size());
-                lbu::event_fd::write(fd.get(), lbu::event_fd::MaximumValue);
+void RingBlockCond(benchmark::State& state, config c)
+{
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+    bool wake_request = false;
+
+    auto wait = [&](auto& h) {
+        if( h.update_available() == 0 ) {
+            pthread_mutex_lock(&mutex);
+            while( h.update_available() == 0 ) {
+                wake_request = true;
+                pthread_cond_wait(&cond, &mutex);
             }
-
-            t->wait();
+            pthread_mutex_unlock(&mutex);
         }
+    };
+    auto notify = [&]() {
+        pthread_mutex_lock(&mutex);
+        const bool send_signal = wake_request;
+        wake_request = false;
+        pthread_mutex_unlock(&mutex);
+        if( send_signal )
+            pthread_cond_signal(&cond);
+    };
+    run_raw_ring(state, c, wait, notify, wait, notify);
+
+    pthread_cond_destroy(&cond);
+    pthread_mutex_destroy(&mutex);
+}
 
-        QCOMPARE(s_result, int(s_transfer_size));
-    }
-
-
-    void RingBlockCond()
-    {
-        s_producerIdx = s_consumerIdx = 0;
-
-        pthread_mutex_t mutex;
-        pthread_cond_t cond;
-
-        pthread_mutex_init(&mutex, nullptr);
-        pthread_cond_init(&cond, nullptr);
-
-        std::unique_ptr<Thread_RingBlockCond> t(new Thread_RingBlockCond(&mutex, &cond));
-        lbu::ring_spsc::handle<int>::producer producer;
-
-        lbu::ring_spsc::handle<int>::pair_producer_consumer({s_ring_buffer.begin(), s_ring_buffer.end()},
-                                                            &producer, &s_producerIdx,
-                                                            &t->consumer, &s_consumerIdx);
-
-        QBENCHMARK {
-            s_result = 0;
-            t->start();
 
-            unsigned processed = 0;
+std::string config_name(const char* base, const config& c, bool ring, bool segment)
+{
+    std::string n = std::string(base) + "/chunk:" + std::to_string(c.chunk_byte_size);
+    if( ring )
+        n += "/ring:" + std::to_string(c.ring_byte_size);
+    if( segment )
+        n += "/segment:" + std::to_string(c.segment_limit);
+    if( c.producer_cpu >= 0 || c.consumer_cpu >= 0 )
+        n += "/pin:" + std::to_string(c.producer_cpu) + "," + std::to_string(c.consumer_cpu);
+    if( c.huge_pages >= 0 )
+        n += c.huge_pages == int(lbu::huge_pages::Explicit) ? "/pages:hugetlb" : "/pages:thp";
+    if( c.fd_blocking == int(lbu::stream::FdBlockingState::Automatic) )
+        n += "/fd:automatic";
+    else if( c.fd_blocking == int(lbu::stream::FdBlockingState::NonBlockingPoll) )
+        n += "/fd:poll";
+    if( c.producer_node >= 0 || c.consumer_node >= 0 )
+        n += "/numa:" + std::to_string(c.producer_node) + "," + std::to_string(c.consumer_node);
+    return n;
+}
 
-            while( true ) {
-                auto c = s_transfer_size - processed;
-                if( c == 0 )
-                    break;
+}
 
-                auto r = producer.continuous_range();
-                if( r.size() == 0 ) {
-                    if( producer.update_available() == 0 ) {
-                        pthread_mutex_lock(&mutex);
-                        while( producer.update_available() == 0 ) {
-                            s_wake_request = true;
-                            pthread_cond_wait(&cond, &mutex);
+int main(int argc, char** argv)
+{
+    bench::options opt(&argc, argv);
+
+    s_transfer_byte_size = size_t(opt.value("transfer_mib", 64)) * 1024 * 1024;
+    const auto chunks = opt.list("chunk", {16, 64, 1024, 16384});
+    const auto rings = opt.list("ring", {lbu::stream::ring_spsc_basic_controller::DefaultRingBufferSize});
+    const auto segments = opt.list("segment", {lbu::stream::ring_spsc::DefaultRingSegmentLimit});
+    const auto pin = opt.list("pin", {-1, -1});
+    const auto big_rings = opt.list("big_ring", {32 * 1024 * 1024});
+    const auto numa = opt.list("numa", {0, 1});
+
+    using bench_fn = void(*)(benchmark::State&, config);
+    struct entry { const char* name; bench_fn fn; bool ring; bool segment; bool numa = false; bool big = false; bool fd_modes = false; };
+    const entry entries[] = {
+        {"RawIO", &RawIO, false, false},
+        {"FILE_io", &FILE_io, false, false},
+        {"FdStream", &FdStream, false, false},
+        {"FdStreamMixed", &FdStreamMixed, false, false, false, false, true},
+        {"BufferQueueStream", &BufferQueueStream, false, false},
+        {"RingStream", &RingStream, true, true},
+        {"RingStreamNuma", &RingStreamNuma, true, true, true},
+        {"RingStreamBig", &RingStreamBig, true, true, false, true},
+        {"RingStreamReserve", &RingStreamReserve, true, true},
+        {"RingSpin", &RingSpin, true, false},
+        {"RingBlockFd", &RingBlockFd, true, false},
+        {"RingBlockCond", &RingBlockCond, true, false},
+    };
+
+    for( const auto& e : entries ) {
+        for( long chunk : chunks ) {
+            for( long ring : (e.big ? big_rings : e.ring ? rings : std::vector<long>{rings.front()}) ) {
+                for( long segment : (e.segment ? segments : std::vector<long>{segments.front()}) ) {
+                    config c;
+                    c.chunk_byte_size = uint32_t(std::max(long(sizeof(int)), chunk - chunk % long(sizeof(int))));
+                    c.ring_byte_size = uint32_t(ring);
+                    c.segment_limit = uint32_t(segment);
+                    c.producer_cpu = pin.size() > 0 ? int(pin[0]) : -1;
+                    c.consumer_cpu = pin.size() > 1 ? int(pin[1]) : -1;
+                    std::vector<config> configs{c};
+                    if( e.numa ) {
+                        // same node and cross node placement
+                        configs[0].producer_node = numa.size() > 0 ? int(numa[0]) : 0;
+                        configs[0].consumer_node = configs[0].producer_node;
+                        const int consumer_node = numa.size() > 1 ? int(numa[1]) : configs[0].producer_node;
+                        if( consumer_node != configs[0].producer_node ) {
+                            configs.push_back(configs[0]);
+                            configs[1].consumer_node = consumer_node;
                         }
-                        pthread_mutex_unlock(&mutex);
                     }
-                    r = producer.continuous_range();
+                    if( e.fd_modes ) {
+                        configs.clear();
+                        for( auto b : {lbu::stream::FdBlockingState::Automatic, lbu::stream::FdBlockingState::NonBlockingPoll} ) {
+                            configs.push_back(c);
+                            configs.back().fd_blocking = int(b);
+                        }
+                    }
+                    if( e.big ) {
+                        for( auto huge : {lbu::huge_pages::Transparent, lbu::huge_pages::Explicit} ) {
+                            configs.push_back(c);
+                            configs.back().huge_pages = int(huge);
+                        }
+                    }
+                    for( const auto& nc : configs ) {
+                        benchmark::RegisterBenchmark(config_name(e.name, nc, e.ring, e.segment).c_str(), e.fn, nc)
+                            ->Unit(benchmark::kMillisecond)
+                            ->UseRealTime();
+                    }
                 }
-                r = r.sub_first(std::min(s_ring_chunk_size, c));
-
-                for( unsigned i = 0; i < r.size(); ++i )
-                    r[i] = 1;
-
-                processed += r.size();
-                producer.publish(r.size());
-
-                bool sendSignal = false;
-                pthread_mutex_lock(&mutex);
-                sendSignal = s_wake_request;
-                s_wake_request = false;
-                pthread_mutex_unlock(&mutex);
-                if( sendSignal )
-                    pthread_cond_signal(&cond);
             }
-
-            t->wait();
         }
-
-        QCOMPARE(s_result, int(s_transfer_size));
     }
-#endif
-
-};
 
-
-QTEST_MAIN(BenchStream)
-
-#include "bench_stream.moc"
+    benchmark::Initialize(&argc, argv);
+    if( benchmark::ReportUnrecognizedArguments(argc, argv) )
+        return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,280 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef LIBLBU_BENCH_UTIL_H
+#define LIBLBU_BENCH_UTIL_H
+
+#include <benchmark/benchmark.h>
+
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "lbu/fd.h"
+
+namespace bench {
+
+    // Hardware cache miss counter of the calling process (including threads created after
+    // construction). If perf_event_open is not permitted (see perf_event_paranoid) the counter
+    // is simply not reported.
+    class perf_cache_misses {
+    public:
+        perf_cache_misses()
+        {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CACHE_MISSES;
+            attr.disabled = 1;
+            attr.inherit = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            f = lbu::fd(int(::syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC)));
+            if( f ) {
+                ::ioctl(f.value, PERF_EVENT_IOC_RESET, 0);
+                ::ioctl(f.value, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+
+        ~perf_cache_misses()
+        {
+            if( f )
+                f.close();
+        }
+
+        bool is_valid() const { return bool(f); }
+
+        uint64_t value() const
+        {
+            uint64_t v = 0;
+            if( f && ::read(f.value, &v, sizeof(v)) != sizeof(v) )
+                v = 0;
+            return v;
+        }
+
+        // Report the misses since construction divided by \p ops as "cache_misses/op"
+        void report(benchmark::State& state, double ops) const
+        {
+            if( ! f || ops <= 0 )
+                return;
+            state.counters["cache_misses/op"] = benchmark::Counter(double(value()) / ops);
+        }
+
+        perf_cache_misses(const perf_cache_misses&) = delete;
+        perf_cache_misses& operator=(const perf_cache_misses&) = delete;
+
+    private:
+        lbu::fd f;
+    };
+
+    inline void report_ops(benchmark::State& state, double ops_per_iteration)
+    {
+        state.counters["time/op"] = benchmark::Counter(ops_per_iteration,
+                                                       benchmark::Counter::kIsIterationInvariantRate
+                                                       | benchmark::Counter::kInvert);
+    }
+
+    // Pin the calling thread to \p cpu; a negative value leaves the affinity unchanged.
+    inline bool pin_current_thread(int cpu)
+    {
+        if( cpu < 0 )
+            return true;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+    }
+
+    // CPU topology as reported by sysfs
+
+    inline std::vector<int> parse_cpu_list(const std::string& list)
+    {
+        std::vector<int> result;
+        const char* p = list.c_str();
+        while( *p ) {
+            char* end = nullptr;
+            const long first = std::strtol(p, &end, 10);
+            if( end == p )
+                break;
+            long last = first;
+            if( *end == '-' )
+                last = std::strtol(end + 1, &end, 10);
+            for( long c = first; c <= last; ++c )
+                result.push_back(int(c));
+            p = (*end == ',') ? end + 1 : end;
+        }
+        return result;
+    }
+
+    inline std::string read_sysfs_line(const std::string& path)
+    {
+        std::ifstream f(path);
+        std::string line;
+        std::getline(f, line);
+        return line;
+    }
+
+    inline std::vector<int> online_cpus()
+    {
+        return parse_cpu_list(read_sysfs_line("/sys/devices/system/cpu/online"));
+    }
+
+    struct cpu_location {
+        int cpu = -1;
+        int core = -1;
+        int package = -1;
+    };
+
+    inline cpu_location locate_cpu(int cpu)
+    {
+        const std::string base = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/";
+        cpu_location l;
+        l.cpu = cpu;
+        l.core = std::atoi(read_sysfs_line(base + "core_id").c_str());
+        l.package = std::atoi(read_sysfs_line(base + "physical_package_id").c_str());
+        return l;
+    }
+
+    enum class Placement {
+        SameCpu,        // both threads share one logical cpu
+        SmtSibling,     // hyperthreads of one physical core
+        CrossCore,      // different cores of one package
+        CrossSocket     // different packages
+    };
+
+    inline const char* placement_name(Placement p)
+    {
+        switch( p ) {
+        case Placement::SameCpu: return "same_cpu";
+        case Placement::SmtSibling: return "smt_sibling";
+        case Placement::CrossCore: return "cross_core";
+        case Placement::CrossSocket: return "cross_socket";
+        }
+        return "";
+    }
+
+    // Returns a pair of cpus with the requested relation, or {-1, -1} if the machine has none.
+    inline std::pair<int, int> find_cpu_pair(Placement p)
+    {
+        std::vector<cpu_location> cpus;
+        for( int c : online_cpus() )
+            cpus.push_back(locate_cpu(c));
+        if( cpus.empty() )
+            return {-1, -1};
+        if( p == Placement::SameCpu )
+            return {cpus.front().cpu, cpus.front().cpu};
+
+        for( const auto& a : cpus ) {
+            for( const auto& b : cpus ) {
+                if( a.cpu == b.cpu )
+                    continue;
+                const bool same_package = (a.package == b.package);
+                const bool same_core = same_package && (a.core == b.core);
+                if( (p == Placement::SmtSibling && same_core)
+                    || (p == Placement::CrossCore && same_package && ! same_core)
+                    || (p == Placement::CrossSocket && ! same_package) )
+                    return {a.cpu, b.cpu};
+            }
+        }
+        return {-1, -1};
+    }
+
+
+    // Latency samples in ns, reported as percentile counters
+
+    class latency_samples {
+    public:
+        void reserve(size_t n) { samples.reserve(n); }
+        void add(uint64_t ns) { samples.push_back(ns); }
+        size_t size() const { return samples.size(); }
+
+        void report(benchmark::State& state, const std::string& prefix)
+        {
+            if( samples.empty() )
+                return;
+            std::sort(samples.begin(), samples.end());
+            state.counters[prefix + "_p50_ns"] = double(percentile(50.0));
+            state.counters[prefix + "_p99_ns"] = double(percentile(99.0));
+            state.counters[prefix + "_p99.9_ns"] = double(percentile(99.9));
+            state.counters[prefix + "_max_ns"] = double(samples.back());
+        }
+
+    private:
+        uint64_t percentile(double p) const
+        {
+            const auto idx = size_t(p / 100.0 * double(samples.size() - 1) + 0.5);
+            return samples[std::min(idx, samples.size() - 1)];
+        }
+
+        std::vector<uint64_t> samples;
+    };
+
+
+    // Parse "--name=v1,v2,..." style options of the benchmark executables. Recognized options
+    // are removed from argv, so the rest can be passed to benchmark::Initialize. A value that
+    // is not a number ends the program with an error, rather than silently benchmarking 0.
+    class options {
+    public:
+        options(int* argc, char** argv)
+        {
+            int out = 1;
+            for( int i = 1; i < *argc; ++i ) {
+                const char* a = argv[i];
+                if( std::strncmp(a, "--lbu_", 6) == 0 && std::strchr(a, '=') != nullptr )
+                    args.emplace_back(a + 6);
+                else
+                    argv[out++] = argv[i];
+            }
+            *argc = out;
+            argv[out] = nullptr;
+        }
+
+        std::vector<long> list(const char* name, std::vector<long> fallback) const
+        {
+            const std::string prefix = std::string(name) + "=";
+            for( const auto& a : args ) {
+                if( a.compare(0, prefix.size(), prefix) != 0 )
+                    continue;
+                std::vector<long> result;
+                const char* p = a.c_str() + prefix.size();
+                while( *p ) {
+                    char* end = nullptr;
+                    const long v = std::strtol(p, &end, 0);
+                    if( end == p || (*end != ',' && *end != '\0') ) {
+                        std::fprintf(stderr, "invalid value in --lbu_%s\n", a.c_str());
+                        std::exit(EXIT_FAILURE);
+                    }
+                    result.push_back(v);
+                    p = (*end == ',') ? end + 1 : end;
+                }
+                return result;
+            }
+            return fallback;
+        }
+
+        long value(const char* name, long fallback) const
+        {
+            const auto l = list(name, {fallback});
+            return l.empty() ? fallback : l.front();
+        }
+
+    private:
+        std::vector<std::string> args;
+    };
+
+}
+
+#endif
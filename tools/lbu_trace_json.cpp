@@ -0,0 +1,54 @@
+/* Copyright 2024 Zeno Sebastian Endemann <zeno.endemann@mailbox.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// Converts a trace recorded with lbu::trace::session into Chrome trace event JSON
+// (loadable by chrome://tracing and https://ui.perfetto.dev).
+//
+//   lbu-trace-json <trace file> [<json file>]
+//
+// Without a json file argument the output is written to stdout.
+
+#include "lbu/file.h"
+#include "lbu/trace.h"
+
+#include <cstdio>
+#include <cstring>
+
+int main(int argc, char** argv)
+{
+    if( argc < 2 || argc > 3 ) {
+        std::fprintf(stderr, "usage: %s <trace file> [<json file>]\n", argv[0]);
+        return 2;
+    }
+
+    auto in = lbu::file::open(argv[1], lbu::file::AccessRead | lbu::file::FlagsCloExec);
+    if( in.status != lbu::file::OpenNoError ) {
+        std::fprintf(stderr, "cannot open %s: %s\n", argv[1], std::strerror(in.status));
+        return 1;
+    }
+
+    lbu::unique_fd out_file;
+    lbu::fd out(STDOUT_FILENO);
+    if( argc == 3 ) {
+        auto o = lbu::file::open(argv[2], lbu::file::AccessWrite | lbu::file::FlagsCreate
+                                          | lbu::file::FlagsTruncate | lbu::file::FlagsCloExec);
+        if( o.status != lbu::file::OpenNoError ) {
+            std::fprintf(stderr, "cannot open %s: %s\n", argv[2], std::strerror(o.status));
+            return 1;
+        }
+        out_file = std::move(o.f);
+        out = out_file.get();
+    }
+
+    const int r = lbu::trace::write_chrome_json(in.f.get(), out);
+    if( r == lbu::trace::ConvertInvalidFormat ) {
+        std::fprintf(stderr, "%s is not a valid lbu trace file\n", argv[1]);
+        return 1;
+    }
+    if( r != lbu::trace::ConvertNoError ) {
+        std::fprintf(stderr, "conversion failed: %s\n", std::strerror(r));
+        return 1;
+    }
+    return 0;
+}